@@ -29,7 +29,8 @@ make bench
 
 cd ..
 
-for BASENAME in compare list map maybe "set" show string tuple value vector
+for BASENAME in compare hash hashmap hashset intmap intset list map maybe \
+    region "set" show stats string tuple value vector
 do
     examples/libf2html f${BASENAME}.h > doc/${BASENAME}.html
 done
@@ -53,6 +53,8 @@
 #define SUM_F_FOLDL_MAP     11
 #define SUM_STD_VECTOR      12
 #define SUM_STD_MAP         13
+#define MERGE_F_MAP_SHARED  14
+#define MERGE_F_MAP_COPY    15
 
 /*
  * Get the time in milliseconds.
@@ -273,6 +275,36 @@ void do_bench(FILE *stream, int bench, size_t start, size_t end, size_t tick)
                 assert(sum == sum0);
                 break;
             }
+            case MERGE_F_MAP_SHARED:
+            case MERGE_F_MAP_COPY:
+            {
+                // Merge a map with a version of itself that differs in a
+                // few entries.  The shared version has most nodes in common
+                // with the original; the copy is rebuilt from scratch.
+                for (int i = 0; i < n; i++)
+                    q = F::insert(q, F::tuple(i, i));
+                F::Map<int, int> r = F::map<int, int>();
+                if (bench == MERGE_F_MAP_SHARED)
+                    r = q;
+                else
+                {
+                    for (int i = 0; i < n; i++)
+                        r = F::insert(r, F::tuple(i, i));
+                }
+                for (int i = 0; i < 8; i++)
+                    r = F::insert(r, F::tuple((int)(i * n / 8), -1));
+                size_t len = 0;
+                GC_disable();
+                size_t t0 = get_time();
+                for (int i = 0; i < 100; i++)
+                    len += size(F::merge(q, r));
+                size_t t1 = get_time();
+                GC_enable();
+                GC_gcollect();
+                fprintf(stream, "%zu\n", t1 - t0);
+                assert(len == 100 * n);
+                break;
+            }
             default:
                 fprintf(stderr, "error: unknown bench (%d)\n", bench);
                 exit(EXIT_FAILURE);
@@ -314,6 +346,10 @@ int main(int argc, char **argv)
         bench = SUM_STD_VECTOR;
     else if (strcmp(argv[1], "sum_std_map") == 0)
         bench = SUM_STD_MAP;
+    else if (strcmp(argv[1], "merge_f_map_shared") == 0)
+        bench = MERGE_F_MAP_SHARED;
+    else if (strcmp(argv[1], "merge_f_map_copy") == 0)
+        bench = MERGE_F_MAP_COPY;
     else
     {
         fprintf(stderr, "error: bad benchmark \"%s\"\n", argv[1]);
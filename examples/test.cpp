@@ -31,10 +31,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../fhashmap.h"
+#include "../fhashset.h"
+#include "../fintmap.h"
+#include "../fintset.h"
 #include "../flist.h"
 #include "../fmap.h"
 #include "../fmaybe.h"
+#include "../fregion.h"
 #include "../fset.h"
+#include "../fstats.h"
 #include "../fstring.h"
 #include "../fvector.h"
 
@@ -136,6 +142,39 @@ PURE String show(LIST<T> xs)
     return str;
 }
 
+/****************************************************************************/
+// Custom monoids:
+struct SUM
+{
+    static int empty(void) { return 0; }
+    static int measure(int k, int v) { return v; }
+    static int combine(int a, int b) { return a + b; }
+};
+
+struct MAX
+{
+    static int empty(void) { return -1; }
+    static int measure(int k, int v) { return k; }
+    static int combine(int a, int b) { return (a > b? a: b); }
+};
+
+/****************************************************************************/
+// Custom hashed keys (with colliding hashes):
+struct KEY
+{
+    int k;
+};
+
+static uint64_t hash(KEY x)
+{
+    return (uint64_t)(x.k % 4);
+}
+
+static int compare(KEY x, KEY y)
+{
+    return (x.k < y.k? -1: x.k > y.k? 1: 0);
+}
+
 /****************************************************************************/
 
 int main(void)
@@ -187,6 +226,7 @@ int main(void)
     TEST(first(last(zip(xs, xs))) == last(xs));
     TEST(second(head(zip(ys, xs))) == head(xs));
     TEST(first(last(zip(ys, xs))) == last(ys));
+    TEST(size(zip(xs, ys)) == (size(xs) < size(ys)? size(xs): size(ys)));
     TEST(compare(sort(xs), xs) == 0);
     TEST(head(sort(ys)) == -55.0);
     TEST(last(sort(ys)) == 10.0);
@@ -303,6 +343,20 @@ int main(void)
             string("234567891")) == 0);
     TEST(compare(({String tmp; for (char32_t c: filter_map(string("A man, a plan, a canal, Panama"), [] (size_t _, char32_t c) -> Optional<char32_t> { if (!isalpha(c)) return Optional<char32_t>(); return Optional<char32_t>(tolower(c));})) tmp = append(tmp, c); tmp;}), string("amanaplanacanalpanama")) == 0);
 
+    {
+        auto t = transient(str);
+        for (int i = 0; i < 40; i++)
+            append(t, (char32_t)('a' + i % 26));
+        append(t, " \u00e9t\u00e9");
+        TEST(size(t) == size(str) + 44);
+        auto str1 = persistent(t);
+        TEST(verify(str1));
+        TEST(size(str1) == size(str) + 44);
+        TEST(lookup(str1, size(str) + 27) == 'b');
+        TEST(compare(right(str1, size(str) + 40), string(" \u00e9t\u00e9")) == 0);
+        TEST(compare(left(str1, size(str)), str) == 0);
+    };
+
     Set<char32_t> seen;
     for (auto c: str)
     {
@@ -378,6 +432,8 @@ int main(void)
     TEST(foldl(xs, 0, [] (int x, size_t _, int y) { return x+y; }) == 150*299);
     TEST(foldl(ws, 0, [] (int x, size_t _, int y) { return x+y; }) == 19);
     TEST(foldr(xs, 0, [] (int x, size_t _, int y) { return x+y; }) == 150*299);
+    TEST(({int sum = 0; size_t n = 0; for_each(xs, [&] (size_t i, int x)
+        { sum += x; n += (i == n); }); sum == 150*299 && n == size(xs);}));
     TEST(({int sum = 0; for (auto x: xs) sum += x; sum;}) == 150*299);
     TEST(({int sum = 0; for (auto x: ws) sum += x; sum;}) == 19);
     TEST(at(map<float>(xs, [] (size_t _, int x) { return (float)x; }), 123) ==
@@ -391,6 +447,31 @@ int main(void)
         split(xs, 3).fst) == 0);
     TEST(verify(show(xs)));
 
+    {
+        auto ys1 = retain(push_back(xs, 300));
+        auto ys2 = retain(pop_front(ys1));
+        release(ys1);
+        TEST(verify(ys2));
+        TEST(size(ys2) == 300);
+        TEST(back(ys2) == 300);
+        TEST(verify(xs));
+        release(ys2);
+    };
+
+    {
+        auto t = transient(xs);
+        for (int i = 300; i < 1000; i++)
+            push_back(t, i);
+        TEST(size(t) == 1000);
+        auto ys = persistent(t);
+        TEST(verify(ys));
+        TEST(size(ys) == 1000);
+        TEST(at(ys, 299) == 299);
+        TEST(at(ys, 777) == 777);
+        TEST(back(ys) == 999);
+        TEST(size(xs) == 300);
+    };
+
     {
         VectorItr<int> i = begin(xs);
         VectorItr<int> j = i;
@@ -425,6 +506,58 @@ int main(void)
     TEST(compare(t, tuple(7, 10.0f, 'x', false, tuple(1, 2))) < 0);
     TEST(compare(t, tuple(7, 3.125f, 'c', true, tuple(1, 2))) == 0);
     TEST(compare(t, tuple(7, 3.125f, 'c', true, tuple(1, 0))) > 0);
+
+    auto u = tuple<char, double, short, String, Tuple<int, int>, float>('x',
+        -2.5, 1234, string("abc"), tuple(3, 4), 0.5f);
+    TEST(first(u) == 'x');
+    TEST(second(u) == -2.5);
+    TEST(third(u) == 1234);
+    TEST(compare(fourth(u), string("abc")) == 0);
+    TEST(second(fifth(u)) == 4);
+    TEST(sixth(u) == 0.5f);
+    TEST(sizeof(_TupleData<char, double, short, String, Tuple<int, int>,
+        float>) == 6 * sizeof(Word));
+    TEST(sizeof(_TupleData<char, short, int>) == sizeof(Word));
+    TEST(compare(u, tuple<char, double, short, String, Tuple<int, int>,
+        float>('x', -2.5, 1235, string("abc"), tuple(3, 4), 0.5f)) < 0);
+}
+
+    // Maybes:
+{
+    Maybe<int64_t> m = maybe<int64_t>(-(1ll << 62));
+    Maybe<double> d = maybe<double>(0.1);
+    Maybe<const char *> p = maybe<const char *>("abc");
+    TEST(sizeof(m) == 2 * sizeof(Word));
+    TEST(sizeof(maybe<int>(1)) == sizeof(Word));
+    TEST(!empty(m));
+    TEST(empty(maybe<int64_t>()));
+    TEST((const int64_t &)m == -(1ll << 62));
+    TEST((const double &)d == 0.1);
+    TEST(strcmp((const char * const &)p, "abc") == 0);
+    TEST(m == maybe<int64_t>(-(1ll << 62)));
+    TEST(!(m == maybe<int64_t>()));
+    TEST(sizeof(p) == 2 * sizeof(Word));
+    TEST(empty(maybe<const char *>()));
+    TEST(sizeof(Union<long, Nothing, char>) == sizeof(Word));
+    TEST(({Union<long, char> u = (long)(1ll << 40); Value<long> x = u;
+        (const long &)x == (1ll << 40) && (const long &)u == (1ll << 40);}));
+
+    auto v = vector<Maybe<int64_t>>();
+    for (int64_t i = 0; i < 100; i++)
+        v = push_back(v, (i % 3 == 0? maybe<int64_t>():
+            maybe<int64_t>(i << 40)));
+    TEST(verify(v) && size(v) == 100);
+    TEST(empty(at(v, 33)) && (const int64_t &)at(v, 34) == (34ll << 40));
+    TEST((const int64_t &)back(pop_back(v)) == (98ll << 40));
+    TEST((const int64_t &)data(v)[97] == (97ll << 40));
+    TEST(foldl(v, 0, [] (int a, size_t _, Maybe<int64_t> x)
+        { return a + !empty(x); }) == 66);
+    TEST(({Maybe<int64_t> a[3] = {maybe<int64_t>(1ll << 50),
+        maybe<int64_t>(), maybe<int64_t>(-1)};
+        auto u = vector(a, 3); size(u) == 3 && empty(at(u, 1)) &&
+        (const int64_t &)at(u, 2) == -1;}));
+    TEST(({auto w = vector<Maybe<double>>(); w = push_front(w,
+        maybe<double>(0.5)); (const double &)front(w) == 0.5;}));
 }
 
     // Maps:
@@ -476,13 +609,160 @@ int main(void)
         == 0);
     TEST(compare(merge(split(m, 123).snd, split(m, 123).fst), erase(m, 123))
         == 0);
+    TEST(first(get(nth(m, 0))) == 0);
+    TEST(second(get(nth(m, 137))) == 274);
+    TEST(empty(nth(m, 200)));
+    TEST(rank(m, 137) == 137 && rank(m, -5) == 0 && rank(m, 500) == 200);
+    TEST(verify(split_at(m, 77).fst) && verify(split_at(m, 77).snd));
+    TEST(compare(split_at(m, 77).fst, split(m, 77).fst) == 0);
+    TEST(first(get(nth(split_at(m, 77).snd, 0))) == 77);
+    TEST(size(take(m, 50)) == 50 && size(drop(m, 50)) == 150);
+    TEST(compare(take(m, 500), m) == 0 && empty(drop(m, 200)));
+    {
+        auto i = lower_bound(m, 50), j = upper_bound(m, 50);
+        TEST(first(*i) == 50 && first(*j) == 51);
+    };
+    TEST(lower_bound(m, 200) == end(m) && upper_bound(m, -1) == begin(m));
+    TEST(count_range(m, 10, 20) == 10 && count_range(m, 20, 10) == 0);
+    TEST(count_range(m, -100, 1000) == 200);
+    TEST(foldl_range(m, 10, 20, 0, [] (int a, Tuple<int, int> t)
+        { return a + second(t); }) == 2*(10+19)*5);
+    TEST(aggregate<SUM>(m, 10, 20) == 2*(10+19)*5);
+    TEST(aggregate<SUM>(m) == 2*199*100 && aggregate<MAX>(m) == 199);
+    TEST(aggregate<MAX>(m, 10, 20) == 19 && aggregate<MAX>(m, 20, 10) == -1);
+    TEST(aggregate<SUM>(insert(m, tuple(50, 0)), -100, 1000) == 2*199*100 - 100);
     TEST(compare(sort(list(m)), list(m)) == 0);
     TEST(foldl(m, 0, [] (int a, Tuple<int, int> t) { return a + first(t); }) == 199*100);
     TEST(foldr(m, 0, [] (int a, Tuple<int, int> t) { return a + second(t); }) == 2*199*100);
+    TEST(({int sum = 0; for_each(m, [&] (Tuple<int, int> t)
+        { sum += second(t); }); sum;}) == 2*199*100);
     TEST(({int sum = 0; for (auto t: m) sum += second(t); sum;}) == 2*199*100);
     TEST(second(get(find(map<int>(m, [] (Tuple<int, int> t) { return first(t); }), 43))) == 43);
     TEST(verify(show(m)));
 
+    {
+        auto add = [] (int a, int b) { return a + b; };
+        auto m1 = insert_with(m, 25, 1, add);
+        TEST(verify(m1) && size(m1) == 200);
+        TEST(second(get(find(m1, 25))) == 51);
+        auto m2 = insert_with(m1, 1000, 7, add);
+        TEST(verify(m2) && size(m2) == 201);
+        TEST(second(get(find(m2, 1000))) == 7);
+        TEST(second(get(find(adjust(m, 77, [] (int x) { return -x; }), 77)))
+            == -154);
+        TEST(compare(adjust(m, 777, [] (int x) { return -x; }), m) == 0);
+        auto m3 = adjust(m, 30, [] (int x) { return x; });
+        TEST(memcmp(&m3, &m, sizeof(m)) == 0);
+        auto m4 = alter(m, 40, [] (Optional<int> x) { return Optional<int>(); });
+        TEST(verify(m4) && size(m4) == 199 && empty(find(m4, 40)));
+        auto m5 = alter(m, -3, [] (Optional<int> x)
+            { return (empty(x)? Optional<int>(9): x); });
+        TEST(verify(m5) && size(m5) == 201);
+        TEST(second(get(find(m5, -3))) == 9);
+        bool ok = true;
+        auto m6 = map<int, int>();
+        for (int i = 0; i < 300; i++)
+        {
+            m6 = insert_with(m6, (i * 7) % 50, 1, add);
+            m6 = alter(m6, (i * 11) % 60, [] (Optional<int> x)
+                { return (empty(x) || get(x) > 2? Optional<int>(): x); });
+            ok = ok && verify(m6);
+        }
+        TEST(ok);
+    };
+
+    {
+        auto m1 = map<int, int>();
+        for (int i = 150; i < 260; i += 2)
+            m1 = insert(m1, tuple(i, 1));
+        auto add = [] (int k, int a, int b) { return a + b; };
+        auto mu = merge_with(m, m1, add);
+        TEST(verify(mu) && size(mu) == 230);
+        TEST(second(get(find(mu, 152))) == 305 && second(get(find(mu, 258))) == 1);
+        TEST(second(get(find(mu, 151))) == 302);
+        auto mi = intersect_with(m, m1, add);
+        TEST(verify(mi) && size(mi) == 25);
+        TEST(second(get(find(mi, 198))) == 397 && empty(find(mi, 200)));
+        auto md = difference_with(m, m1, [] (int k, int a, int b)
+            { return (k % 4 == 0? Optional<int>(-a): Optional<int>()); });
+        TEST(verify(md) && size(md) == 187);
+        TEST(second(get(find(md, 152))) == -304 && empty(find(md, 154)));
+        TEST(second(get(find(md, 151))) == 302);
+        TEST(compare(merge_with(m, m, [] (int k, int a, int b) { return a; }),
+            m) == 0);
+        TEST(size(intersect_with(m, map<int, int>(), add)) == 0);
+    };
+
+    {
+        auto m1 = erase(insert(insert(m, tuple(7, 0)), tuple(300, 1)), 150);
+        int added = 0, removed = 0, changed = 0;
+        diff_entries(m, m1,
+            [&] (Tuple<int, int> e) { added += first(e); },
+            [&] (Tuple<int, int> e) { removed += first(e); },
+            [&] (Tuple<int, int> e1, Tuple<int, int> e2)
+                { changed += second(e1) - second(e2); });
+        TEST(added == 300 && removed == 150 && changed == 14);
+        auto d = diff_entries(m, m1);
+        TEST(verify(d) && size(d) == 3);
+        TEST(empty(second(get(find(d, 150)))));
+        TEST(get(second(get(find(d, 300)))) == 1);
+        TEST(size(diff_entries(m1, m1)) == 0);
+        TEST(size(diff_entries(map<int, int>(), m)) == 200);
+        bool ok = true;
+        auto m2 = m;
+        for (int i = 0; i < 100; i++)
+        {
+            auto m3 = insert(erase(m2, (i * 37) % 211), tuple(i * 3, i));
+            auto d1 = diff_entries(m2, m3);
+            auto d2 = diff_entries(m3, m2);
+            ok = ok && size(d1) <= 2 && size(d1) == size(d2);
+            m2 = m3;
+        }
+        TEST(ok);
+    };
+
+    {
+        auto m1 = retain(insert(m, tuple(500, 1000)));
+        auto m2 = retain(erase(m1, 100));
+        release(m1);
+        TEST(verify(m2));
+        TEST(size(m2) == 200);
+        TEST(empty(find(m2, 100)));
+        TEST(second(get(find(m2, 500))) == 1000);
+        TEST(verify(m));
+        release(m2);
+    };
+
+    {
+        auto t = transient(m);
+        for (int i = 150; i < 400; i++)
+            insert(t, tuple(i, -i));
+        erase(t, 10);
+        TEST(size(t) == 399);
+        TEST(second(get(find(t, 300))) == -300);
+        auto m1 = persistent(t);
+        TEST(verify(m1));
+        TEST(size(m1) == 399);
+        TEST(second(get(find(m1, 151))) == -151);
+        TEST(second(get(find(m1, 149))) == 298);
+        TEST(verify(m));
+        TEST(size(m) == 200);
+        TEST(second(get(find(m, 151))) == 302);
+        TEST(!empty(find(m, 10)));
+    };
+
+    {
+        // Entries found in a transient are not updated in place:
+        auto t = transient(m);
+        insert(t, tuple(5, 50));
+        Optional<Tuple<int, int>> e = find(t, 5);
+        insert(t, tuple(5, 999));
+        TEST(second(get(e)) == 50);
+        TEST(second(get(find(t, 5))) == 999);
+        auto m1 = persistent(t);
+        TEST(verify(m1));
+    };
+
     {
         MapItr<int, int> i = begin(m);
         printf("%s\n", c_str(show(*i)));
@@ -503,6 +783,47 @@ int main(void)
         TEST(verify(erase(m, first(t))));
     }
 
+    {
+        // Entries retained beyond the map operations:
+        auto es = foldl(m, list<Tuple<int, int>>(),
+            [] (List<Tuple<int, int>> xs, Tuple<int, int> e)
+            { return list(e, xs); });
+        TEST(size(es) == 200);
+        TEST(head(es) == tuple(199, 398));
+        TEST(last(es) == tuple(0, 0));
+        auto ys = list(m);
+        TEST(size(ys) == 200);
+        TEST(head(ys) == tuple(0, 0));
+        auto m2 = map<int>(m, [] (Tuple<int, int> e) { return second(e) + 1; });
+        TEST(verify(m2));
+        TEST(second(get(find(m2, 50))) == 101);
+        TEST(foldl(values(m2), 0, [] (int a, int v) { return a + v; }) ==
+            200 * 199 + 200);
+        Map<int, char> m3 = map<int, char>();
+        for (int i = 0; i < 100; i++)
+            m3 = insert(m3, tuple(i, (char)('a' + i % 26)));
+        TEST(verify(m3));
+        TEST(second(get(find(m3, 27))) == 'b');
+        TEST(size(keys(m3)) == 100);
+    }
+
+    {
+        // Bulk construction from sorted entries:
+        Tuple<int, String> es[300];
+        for (int i = 0; i < 300; i++)
+            es[i] = tuple(i, show(i));
+        auto m4 = map_from_sorted(es, 300);
+        TEST(verify(m4));
+        TEST(size(m4) == 300);
+        TEST(compare(second(get(find(m4, 123))), string("123")) == 0);
+        auto m5 = map_from_sorted(list(m));
+        TEST(verify(m5));
+        TEST(compare(m5, m) == 0);
+        auto m6 = map_from_sorted(vector(es, 7));
+        TEST(verify(m6));
+        TEST(size(m6) == 7 && empty(find(m6, 7)));
+    }
+
 }
     // Sets:
 {
@@ -530,9 +851,103 @@ int main(void)
     TEST(size(s) == 100);
     TEST(foldl(s, 0, [] (int a, int x) { return a + x; }) == 99*50*2);
     TEST(foldr(s, 0, [] (int a, int x) { return a + x; }) == 99*50*2);
+    TEST(({int prev = -1; bool ok = true; for_each(s, [&] (int x)
+        { ok = ok && prev < x; prev = x; }); ok && prev == 198;}));
     TEST(({int sum = 0; for (auto a: s) sum += a; sum;}) == 99*50*2);
+    TEST(({int sum = 0; for (auto i = end(s); i != begin(s); )
+        sum += *--i; sum;}) == 99*50*2);
+    {
+        auto i = begin(s);
+        i += 40;
+        auto j = i;
+        ++j;
+        TEST(*i == 80 && *j == 82 && *++i == 82 && *--j == 80);
+        TEST(*(j += 30) == 140 && *--j == 138 && *i == 82);
+    }
     TEST(verify(show(s)));
 
+    {
+        auto t = transient(s);
+        for (int i = 0; i < 300; i++)
+            insert(t, 3*i);
+        TEST(find(t, 297));
+        TEST(!find(t, 301));
+        auto s1 = persistent(t);
+        TEST(verify(s1));
+        TEST(size(s1) == 366);
+        TEST(!find(s, 3));
+        TEST(size(s) == 100);
+    };
+
+    {
+        // Small sets (leaf roots and leaves that grow and shrink):
+        bool ok = true;
+        auto s1 = set<int>();
+        for (int i = 0; i < 10; i++)
+        {
+            s1 = insert(s1, 9-i);
+            auto s2 = erase(s1, 9-i/2);
+            int sum = 0;
+            for (auto x: s1)
+                sum += x;
+            ok = ok && verify(s1) && verify(s2) && size(s2) == (size_t)i &&
+                sum == foldr(s1, 0, [] (int a, int x) { return a + x; });
+        }
+        TEST(ok);
+    };
+
+    {
+        // Positional access:
+        bool ok = true;
+        for (int i = 0; i <= 100; i += 3)
+        {
+            auto [s1, s2] = split_at(s, i);
+            ok = ok && verify(s1) && verify(s2) && size(s1) == (size_t)i &&
+                compare(merge(s1, s2), s) == 0 && rank(s, 2*i) == (size_t)i &&
+                rank(s, 2*i+1) == (size_t)(i < 100? i+1: 100) &&
+                (i < 100? get(nth(s, i)) == 2*i: empty(nth(s, i))) &&
+                compare(take(s, i), s1) == 0 && compare(drop(s, i), s2) == 0;
+        }
+        TEST(ok);
+        auto i = lower_bound(s, 33), j = upper_bound(s, 34);
+        TEST(*i == 34 && *j == 36);
+        TEST(upper_bound(s, 198) == end(s));
+        TEST(count_range(s, 33, 67) == 17);
+        TEST(foldl_range(s, 10, 21, 0, [] (int a, int x) { return a + x; })
+            == 10+12+14+16+18+20);
+        int added = 0, removed = 0;
+        diff_entries(s, insert(erase(s, 50), 51),
+            [&] (int x) { added += x; }, [&] (int x) { removed += x; });
+        TEST(added == 51 && removed == 50);
+    };
+
+    {
+        // Bulk construction from sorted input:
+        bool ok = true;
+        List<int> zs = list<int>();
+        for (int n = 100; n >= 0; n--)
+        {
+            Set<int> s1 = set(zs);
+            Set<int> s2 = set_from_sorted(zs);
+            ok = ok && verify(s1) && verify(s2) && size(s2) == size(zs) &&
+                compare(s1, s2) == 0;
+            zs = list(n, zs);
+        }
+        TEST(ok);
+        int a[1000];
+        for (int i = 0; i < 1000; i++)
+            a[i] = 2*i;
+        auto s3 = set_from_sorted(a, 1000);
+        TEST(verify(s3));
+        TEST(size(s3) == 1000);
+        TEST(find(s3, 998) && !find(s3, 999));
+        auto s4 = set_from_sorted(vector(a, 1000));
+        TEST(verify(s4));
+        TEST(compare(s3, s4) == 0);
+        TEST(verify(insert(erase(s4, 500), 501)));
+        TEST(compare(set(reverse(list(s))), s) == 0);
+    };
+
     for (auto x: s)
     {
         printf("(x = %d) ", x);
@@ -543,6 +958,251 @@ int main(void)
         TEST(verify(erase(s, x)));
     }
 
+}
+
+    // Hash maps:
+{
+    auto m = hash_map<int, int>();
+    for (int i = 0; i < 1000; i++)
+        m = insert(m, tuple(i, 2*i));
+    auto m0 = hash_map<int, int>();
+    for (int i = 0; i < 10; i++)
+        m0 = insert(m0, tuple(i, 2*i));
+    printf("\n\33[33mm = %s\33[0m\n", c_str(show(m0)));
+
+    TEST(empty(hash_map<int, double>()));
+    TEST(verify(m));
+    TEST(size(m) == 1000);
+    TEST(({Tuple<int, int> e = find(m, 500); second(e) == 1000;}));
+    TEST(empty(find(m, 1000)));
+    TEST(!empty(find(insert(m, tuple(1000, 0)), 1000)));
+    TEST(size(insert(m, tuple(7, 0))) == 1000);
+    TEST(({Tuple<int, int> e = find(insert(m, tuple(7, 0)), 7);
+        second(e) == 0;}));
+    TEST(empty(find(erase(m, 44), 44)));
+    TEST(size(erase(m, 44)) == 999 && size(erase(m, -1)) == 1000);
+    TEST(verify(erase(m, 44)));
+    TEST(foldl(m, 0, [] (int a, Tuple<int, int> e) { return a + second(e); })
+        == 999*1000);
+    TEST(({int sum = 0; for_each(m, [&] (Tuple<int, int> e)
+        { sum += first(e); }); sum == 999*500;}));
+    TEST(compare(sort(keys(m)), sort(values(map<int>(m,
+        [] (Tuple<int, int> e) { return first(e); })))) == 0);
+    TEST(verify(map<bool>(m, [] (Tuple<int, int> e) { return true; })));
+    TEST(size(hash_map(list(map<int, int>()))) == 0);
+    TEST(({auto m1 = m; bool ok = true; for (int i = 0; i < 1000; i++)
+        { m1 = erase(m1, i); ok = ok && size(m1) == 999 - (size_t)i &&
+        (i % 100 != 0 || verify(m1)); } ok && empty(m1);}));
+
+    auto n = hash_map<String, int>();
+    for (int i = 0; i < 200; i++)
+        n = insert(n, tuple(show(i), i));
+    TEST(verify(n));
+    TEST(({Tuple<String, int> e = find(n, string("42")); second(e) == 42;}));
+    TEST(empty(find(n, string("420"))));
+    TEST(size(erase(n, string("199"))) == 199);
+}
+
+    // Hash sets:
+{
+    auto s = hash_set<int>();
+    for (int i = 0; i < 100; i++)
+        s = insert(s, 2*i);
+    printf("\n\33[33ms = %s\33[0m\n", c_str(show(s)));
+
+    TEST(empty(hash_set<double>()));
+    TEST(verify(s));
+    TEST(find(s, 64));
+    TEST(!find(s, 63));
+    TEST(find(insert(s, 999), 999));
+    TEST(!find(erase(s, 44), 44));
+    TEST(size(s) == 100);
+    TEST(foldl(s, 0, [] (int a, int x) { return a + x; }) == 99*50*2);
+    TEST(({int n = 0; for_each(s, [&] (int x) { n += find(s, x); });
+        n == 100;}));
+    TEST(size(hash_set(list(s))) == 100);
+
+    auto c = hash_set<KEY>();
+    for (int i = 0; i < 100; i++)
+        c = insert(c, (KEY){i});
+    TEST(verify(c));
+    TEST(size(c) == 100 && size(insert(c, (KEY){5})) == 100);
+    TEST(find(c, (KEY){99}) && !find(c, (KEY){100}));
+    TEST(!find(erase(c, (KEY){42}), (KEY){42}) &&
+        find(erase(c, (KEY){42}), (KEY){46}));
+    TEST(({auto c1 = c; bool ok = true; for (int i = 0; i < 100; i++)
+        { c1 = erase(c1, (KEY){i}); ok = ok && verify(c1) &&
+        size(c1) == 99 - (size_t)i; } ok && empty(c1);}));
+
+    auto t = hash_set<Tuple<int, String>>();
+    for (int i = 0; i < 100; i++)
+        t = insert(t, tuple(i, show(i)));
+    TEST(verify(t));
+    TEST(find(t, tuple(7, string("7"))) && !find(t, tuple(7, string("8"))));
+
+    String str1 = string("the quick brown fox jumps over the lazy dog");
+    String str2 = string("");
+    for (char32_t x: str1)
+        str2 = append(str2, x);
+    TEST(compare(str1, str2) == 0 && hash(str1) == hash(str2));
+}
+
+    // Integer maps:
+{
+    auto m = int_map<int>();
+    for (int i = 0; i < 1000; i++)
+        m = insert(m, tuple((uint64_t)(7*i), i));
+    auto m0 = int_map<int>();
+    for (int i = 0; i < 10; i++)
+        m0 = insert(m0, tuple((uint64_t)i, 2*i));
+    printf("\n\33[33mm = %s\33[0m\n", c_str(show(m0)));
+
+    TEST(empty(int_map<double>()));
+    TEST(verify(m));
+    TEST(size(m) == 1000);
+    TEST(({Tuple<uint64_t, int> e = find(m, 700); second(e) == 100;}));
+    TEST(empty(find(m, 701)));
+    TEST(size(insert(m, tuple((uint64_t)7, 0))) == 1000);
+    TEST(({Tuple<uint64_t, int> e = find(insert(m, tuple((uint64_t)7, -1)),
+        7); second(e) == -1;}));
+    TEST(empty(find(erase(m, 14), 14)));
+    TEST(size(erase(m, 14)) == 999 && size(erase(m, 15)) == 1000);
+    TEST(verify(erase(m, 14)));
+    TEST(foldl(m, 0, [] (int a, Tuple<uint64_t, int> e)
+        { return a + second(e); }) == 999*500);
+    TEST(({uint64_t prev = 0; bool ok = true; for_each(m,
+        [&] (Tuple<uint64_t, int> e) { ok = ok && (first(e) > prev ||
+        second(e) == 0); prev = first(e); }); ok;}));
+    TEST(compare(values(map<int>(m, [] (Tuple<uint64_t, int> e)
+        { return (int)first(e); })), map<int>(keys(m),
+        [] (uint64_t k) { return (int)k; })) == 0);
+
+    auto n = int_map<int>();
+    for (int i = 0; i < 1000; i++)
+        n = insert(n, tuple((uint64_t)(5*i), -i));
+    TEST(verify(merge(m, n)));
+    TEST(size(merge(m, n)) == 2000 - 143);
+    TEST(({Tuple<uint64_t, int> e = find(merge(m, n), 35); second(e) == -7;}));
+    TEST(size(intersect(m, n)) == 143);
+    TEST(({Tuple<uint64_t, int> e = find(intersect(m, n), 35);
+        second(e) == 5;}));
+    TEST(size(diff(m, n)) == 1000 - 143 && verify(diff(m, n)));
+    TEST(empty(diff(m, m)) && size(intersect(m, m)) == 1000);
+    TEST(({auto m1 = m; bool ok = true; for (int i = 0; i < 1000; i++)
+        { m1 = erase(m1, 7*i); ok = ok && size(m1) == 999 - (size_t)i &&
+        (i % 100 != 0 || verify(m1)); } ok && empty(m1);}));
+}
+
+    // Integer sets:
+{
+    auto s = int_set();
+    for (int i = 0; i < 100; i++)
+        s = insert(s, 2*i);
+    auto t = int_set();
+    for (int i = 0; i < 100; i++)
+        t = insert(t, ((uint64_t)1 << 63) + i);
+    printf("\n\33[33ms = %s\33[0m\n", c_str(show(s)));
+
+    TEST(empty(int_set()));
+    TEST(verify(s) && verify(t));
+    TEST(find(s, 64));
+    TEST(!find(s, 63));
+    TEST(find(insert(s, 999), 999));
+    TEST(!find(erase(s, 44), 44));
+    TEST(size(s) == 100 && size(insert(s, 2)) == 100);
+    TEST(foldl(s, 0, [] (int a, uint64_t x) { return a + (int)x; })
+        == 99*50*2);
+    TEST(foldr(s, 0, [] (int a, uint64_t x) { return 2*a + (int)(x & 1); })
+        == 0);
+    TEST(head(list(s)) == 0 && head(list(t)) == (uint64_t)1 << 63);
+    TEST(size(int_set(list(s))) == 100);
+    TEST(verify(merge(s, t)) && size(merge(s, t)) == 200);
+    TEST(find(merge(s, t), ((uint64_t)1 << 63) + 99) && find(merge(t, s), 0));
+    TEST(empty(intersect(s, t)) && size(diff(s, t)) == 100);
+    TEST(({auto u = int_set(); for (int i = 0; i < 100; i++)
+        u = insert(u, 3*i); size(intersect(s, u)) == 34 &&
+        size(diff(s, u)) == 66 && size(merge(s, u)) == 166 &&
+        verify(diff(u, s));}));
+    TEST(compare(list(merge(s, t)), append(list(s), list(t))) == 0);
+    TEST(({auto s1 = merge(s, t); bool ok = true; for (int i = 0; i < 100; i++)
+        { s1 = erase(s1, 2*i); ok = ok && verify(s1) &&
+        size(s1) == 199 - (size_t)i; } ok && size(s1) == 100;}));
+}
+
+    // Regions:
+{
+    Map<int, String> m;
+    Vector<int> xs;
+    List<String> ys;
+    {
+        Region r;
+        auto m0 = map<int, String>();
+        auto xs0 = vector<int>();
+        auto ys0 = list<String>();
+        for (int i = 0; i < 100; i++)
+        {
+            m0 = insert(m0, tuple(i, show(i)));
+            xs0 = push_back(xs0, i);
+            ys0 = list(show(i), ys0);
+        }
+        TEST(verify(m0));
+        TEST(verify(xs0));
+        m = promote(m0);
+        xs = promote(xs0);
+        ys = promote(ys0);
+    }
+    TEST(verify(m));
+    TEST(size(m) == 100);
+    TEST(compare(second(get(find(m, 42))), string("42")) == 0);
+    TEST(verify(xs));
+    TEST(at(xs, 99) == 99);
+    TEST(size(ys) == 100);
+    TEST(compare(head(ys), string("99")) == 0);
+}
+
+    // Allocation statistics:
+{
+    AllocStats before = alloc_stats();
+    auto s = set<int>();
+    for (int i = 0; i < 100; i++)
+        s = insert(s, i);
+    auto t = tuple(1, 2.0, 'c');
+    AllocStats after = alloc_stats();
+#ifdef LIBF_ALLOC_STATS
+    TEST(after.tree.allocs > before.tree.allocs);
+    TEST(after.tree.bytes > before.tree.bytes);
+    TEST(after.tuple.allocs == before.tuple.allocs + 1);
+#else
+    TEST(after.tree.allocs == 0 && after.tuple.allocs == 0);
+#endif
+    TEST(after.tree.live <= after.tree.bytes);
+    TEST(size(s) == 100 && first(t) == 1);
+}
+{
+    // Transient erase updates owned nodes in place:
+    auto t = transient(map<int, int>());
+    for (int i = 0; i < 1000; i++)
+        insert(t, tuple(i, i));
+    auto m = persistent(t);
+    AllocStats before = alloc_stats();
+    auto m1 = m;
+    for (int i = 0; i < 1000; i += 2)
+        m1 = erase(m1, i);
+    AllocStats middle = alloc_stats();
+    t = transient(m);
+    for (int i = 0; i < 1000; i += 2)
+        erase(t, i);
+    AllocStats after = alloc_stats();
+#ifdef LIBF_ALLOC_STATS
+    TEST(2 * (after.tree.allocs - middle.tree.allocs) <
+        middle.tree.allocs - before.tree.allocs);
+#endif
+    TEST(size(t) == 500);
+    TEST(empty(find(t, 10)) && second(get(find(t, 11))) == 11);
+    auto m2 = persistent(t);
+    TEST(verify(m2));
+    TEST(compare(m1, m2) == 0);
+    TEST(size(m) == 1000);
 }
 
     // Custom lists.
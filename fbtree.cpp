@@ -0,0 +1,2046 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fbase.h"
+#include "fgc.h"
+#include "flist.h"
+#include "fstring.h"
+#include "ftree.h"
+#include "ftree_inline.h"
+
+#ifdef LIBF_TREE_BTREE          /* else see ftree.cpp */
+
+namespace F
+{
+
+/*
+ * B-Trees.  An alternative backend for the tree interface of ftree.h, with
+ * wide nodes (see ftree_inline.h) to reduce the number of levels, and hence
+ * cache misses, per search.  Nodes are size-augmented exactly like the 234
+ * trees, and split/union/etc. are implemented with an O(log(n)) join.
+ */
+
+#define error_bad_tree()    error("data-structure invariant violated")
+
+/*
+ * Interface renaming.
+ */
+typedef _Tree Tree;
+typedef _TreeNil TreeNil;
+typedef _BTreeLeaf BTreeLeaf;
+typedef _BTreeNode BTreeNode;
+typedef _Compare Compare;
+typedef Value<Word> K;
+typedef Value<Word> A;
+typedef Value<Word> C;
+#define TREE_EMPTY _tree_empty()
+
+/*
+ * Tree node definitions (see ftree_inline.h).
+ */
+#define TREE_OWNER_SHIFT    _TREE_OWNER_SHIFT
+#define TREE_SIZE_MASK      _TREE_SIZE_MASK
+#define TREE_OWNER_MAX      ((1ull << (64 - TREE_OWNER_SHIFT)) - 1)
+
+#define BTREE_DEGREE        LIBF_BTREE_DEGREE
+#define BTREE_MIN_KEYS      _BTREE_MIN_KEYS
+#define BTREE_MAX_KEYS      _BTREE_MAX_KEYS
+
+enum
+{
+    TREE_NIL  = _TREE_NIL,
+    TREE_LEAF = _TREE_LEAF,
+    TREE_NODE = _TREE_NODE
+};
+
+/*
+ * Reference counting (only enabled for the LIBF_GC_RC backend).  Each node
+ * holds a reference to its children.
+ */
+static inline const void *tree_ptr(Tree t)
+{
+    return _tree_ptr(t);
+}
+static inline void tree_retain(Tree t)
+{
+    _tree_ref(t);
+}
+static inline void tree_unref(Tree t)
+{
+#ifdef LIBF_GC_RC
+    if (index(t) != TREE_NIL && gc_release(tree_ptr(t)))
+        _tree_free(t);
+#else
+    (void)t;
+#endif
+}
+
+/*
+ * Free a temporary node that was consumed without being linked in.
+ */
+static inline void tree_drop(Tree t)
+{
+    _tree_drop(t);
+}
+
+/*
+ * Release a reference without freeing, i.e., make a node fresh again.
+ */
+static inline void tree_disown(Tree t)
+{
+#ifdef LIBF_GC_RC
+    if (index(t) != TREE_NIL)
+        gc_release(tree_ptr(t));
+#else
+    (void)t;
+#endif
+}
+
+/*
+ * Replace a child of an owned node.
+ */
+static inline void tree_replace(Tree *slot, Tree t)
+{
+    if (tree_ptr(*slot) == tree_ptr(t))
+        return;
+    tree_retain(t);
+    tree_unref(*slot);
+    *slot = t;
+}
+
+/*
+ * Node access.  The key array of a node is mutable only if it is owned by a
+ * transient (see below).
+ */
+static inline size_t *tree_size_ptr(Tree t)
+{
+    return (size_t *)tree_ptr(t);
+}
+
+static inline size_t tree_count(Tree t)
+{
+    switch (index(t))
+    {
+        case TREE_NIL:
+            return 0;
+        case TREE_LEAF:
+        {
+            const BTreeLeaf &l = t;
+            return l.size & TREE_SIZE_MASK;
+        }
+        case TREE_NODE:
+        {
+            const BTreeNode &b = t;
+            return b.n;
+        }
+        default:
+            error_bad_tree();
+    }
+}
+
+static inline K *tree_keys(Tree t)
+{
+    if (index(t) == TREE_LEAF)
+    {
+        const BTreeLeaf &l = t;
+        return (K *)l.k;
+    }
+    const BTreeNode &b = t;
+    return (K *)b.k;
+}
+
+static inline Tree *tree_children(Tree t)
+{
+    const BTreeNode &b = t;
+    return (Tree *)b.t;
+}
+
+static size_t tree_height(Tree t)
+{
+    size_t h = 0;
+    while (index(t) == TREE_NODE)
+    {
+        h++;
+        t = tree_children(t)[0];
+    }
+    return (index(t) == TREE_LEAF? h+1: h);
+}
+
+/*
+ * Copy the keys and children of a node into arrays.  The children of a leaf
+ * are empty trees.
+ */
+static size_t tree_unpack(Tree t, K *ks, Tree *ts)
+{
+    size_t n = tree_count(t);
+    const K *tks = (n == 0? nullptr: tree_keys(t));
+    for (size_t i = 0; i < n; i++)
+        ks[i] = tks[i];
+    if (index(t) == TREE_NODE)
+    {
+        const Tree *tts = tree_children(t);
+        for (size_t i = 0; i <= n; i++)
+            ts[i] = tts[i];
+    }
+    else
+    {
+        for (size_t i = 0; i <= n; i++)
+            ts[i] = TREE_EMPTY;
+    }
+    return n;
+}
+
+/*
+ * Node constructor.  Builds a leaf if leaf is set (ts is ignored), else an
+ * internal node with n keys and n+1 children.
+ */
+static Tree tree_pack(size_t owner, size_t n, const K *ks, const Tree *ts,
+    bool leaf)
+{
+    if (n > BTREE_MAX_KEYS)
+        error_bad_tree();
+    Word w;
+    if (leaf)
+    {
+        BTreeLeaf *l = (BTreeLeaf *)gc_malloc_node<BTreeLeaf>();
+        l->size = n | (owner << TREE_OWNER_SHIFT);
+        for (size_t i = 0; i < n; i++)
+            l->k[i] = ks[i];
+        w = (Word)l | TREE_LEAF;
+    }
+    else
+    {
+        BTreeNode *b = (BTreeNode *)gc_malloc_node<BTreeNode>();
+        size_t size = n;
+        for (size_t i = 0; i <= n; i++)
+        {
+            tree_retain(ts[i]);
+            size += _tree_node_size(ts[i]);
+            b->t[i] = ts[i];
+        }
+        for (size_t i = 0; i < n; i++)
+            b->k[i] = ks[i];
+        b->n = n;
+        b->size = size | (owner << TREE_OWNER_SHIFT);
+#ifdef LIBF_TREE_MEASURE
+        b->c.tag = nullptr;
+#endif
+        w = (Word)b | TREE_NODE;
+    }
+    return _bit_cast<Tree>(w);
+}
+
+/*
+ * Build from arrays of up to 2*BTREE_MAX_KEYS+1 keys.  If the keys do not fit
+ * into one node, they are split evenly around a median key (*mk) into two
+ * nodes (the result and *rt), each with at least BTREE_MIN_KEYS keys.
+ */
+static Tree tree_build(size_t owner, size_t n, const K *ks, const Tree *ts,
+    bool leaf, bool *split, K *mk, Tree *rt)
+{
+    if (n <= BTREE_MAX_KEYS)
+    {
+        *split = false;
+        return tree_pack(owner, n, ks, ts, leaf);
+    }
+    size_t m = (n - 1) / 2;
+    *split = true;
+    *mk = ks[m];
+    *rt = tree_pack(owner, n - m - 1, ks + m + 1, ts + m + 1, leaf);
+    return tree_pack(owner, m, ks, ts, leaf);
+}
+
+/*
+ * Combine two adjacent siblings a and b (of the same height) separated by k,
+ * either by merging them into one node, or by redistributing the keys.
+ */
+static Tree tree_combine(Tree a, K k, Tree b, bool leaf, bool *split, K *mk,
+    Tree *rt)
+{
+    K ks[2 * BTREE_MAX_KEYS + 1];
+    Tree ts[2 * BTREE_MAX_KEYS + 2];
+    size_t n = tree_unpack(a, ks, ts);
+    ks[n] = k;
+    n += 1 + tree_unpack(b, ks + n + 1, ts + n + 1);
+    return tree_build(0, n, ks, ts, leaf, split, mk, rt);
+}
+
+/*
+ * Fix the underfull child c of a node (given as arrays of n keys and n+1
+ * children) using an adjacent sibling.  Returns the new number of keys.
+ */
+static size_t tree_fix(K *ks, Tree *ts, size_t n, size_t c)
+{
+    size_t j = (c < n? c: c-1);
+    Tree a = ts[j], b = ts[j+1];
+    bool split;
+    K mk;
+    Tree rt;
+    Tree nt = tree_combine(a, ks[j], b, (index(a) == TREE_LEAF), &split, &mk,
+        &rt);
+    tree_drop(a);
+    tree_drop(b);
+    ts[j] = nt;
+    if (split)
+    {
+        ks[j] = mk;
+        ts[j+1] = rt;
+        return n;
+    }
+    for (size_t i = j+1; i < n; i++)
+    {
+        ks[i-1] = ks[i];
+        ts[i] = ts[i+1];
+    }
+    return n-1;
+}
+
+/*
+ * Collapse a root without keys.
+ */
+static Tree tree_shrink(Tree t)
+{
+    if (index(t) == TREE_NIL || tree_count(t) > 0)
+        return t;
+    if (index(t) == TREE_LEAF)
+    {
+        tree_drop(t);
+        return TREE_EMPTY;
+    }
+    Tree c = tree_children(t)[0];
+    tree_retain(c);
+    tree_drop(t);
+    tree_disown(c);
+    return c;
+}
+
+/*
+ * Delete modes (see tree_delete_2()).
+ */
+enum
+{
+    TREE_DELETE_KEY,
+    TREE_DELETE_MIN,
+    TREE_DELETE_MAX
+};
+
+/*
+ * Prototypes.
+ */
+static Tree tree_insert(Tree t, K k, Compare compare, size_t owner);
+static Tree tree_delete_2(Tree t, K k, Compare compare, int mode, K *dk);
+static Tree tree_join(Tree l, K k, Tree r, size_t l_height, size_t r_height,
+    size_t *height);
+static Tree tree_concat(Tree l, Tree r, size_t l_height, size_t r_height,
+    size_t *height);
+static bool tree_split_2(Tree t, K k, size_t height, Tree *lt, Tree *rt,
+    size_t *l_height, size_t *r_height, Compare compare);
+static List<C> tree_to_list_2(Tree t, C (*f)(void *, K), void *data,
+    List<C> xs);
+static bool tree_verify_2(Tree t, size_t height, bool root);
+static String tree_show_2(Tree t, String r, bool *first, String (*f)(A));
+
+/*
+ * Constructor.
+ */
+extern PURE Tree _tree_singleton(K k)
+{
+    return tree_pack(0, 1, &k, nullptr, true);
+}
+
+/*
+ * Retain/release.
+ */
+extern Tree _tree_retain(Tree t)
+{
+    tree_retain(t);
+    return t;
+}
+
+extern void _tree_release(Tree t)
+{
+#ifdef LIBF_GC_RC
+    if (index(t) == TREE_NIL)
+        return;
+    if (gc_refs(tree_ptr(t)) == 0)
+        error("release of a value that was not retained");
+    tree_unref(t);
+#else
+    (void)t;
+#endif
+}
+
+extern void _tree_free(Tree t)
+{
+    switch (index(t))
+    {
+        case TREE_LEAF:
+        {
+            const BTreeLeaf &l = t;
+            gc_free_node<BTreeLeaf>((void *)&l);
+            break;
+        }
+        case TREE_NODE:
+        {
+            const BTreeNode &b = t;
+            for (size_t i = 0; i <= b.n; i++)
+                tree_unref(b.t[i]);
+            gc_free_node<BTreeNode>((void *)&b);
+            break;
+        }
+        default:
+            error_bad_tree();
+    }
+}
+
+/*
+ * Search.
+ */
+extern const K *_tree_search(Tree t, K k, Compare compare)
+{
+    return _tree_search_k(t, k, compare);
+}
+
+/*
+ * Insert.
+ */
+extern PURE Tree _tree_insert(Tree t, K k, Compare compare)
+{
+    return tree_insert(t, k, compare, 0);
+}
+
+/*
+ * Transients.  A transient tree tags the nodes it creates with an owner
+ * token, and updates owned nodes in place rather than path copying them.
+ * Nodes without the token are shared and are copied (as owned nodes) when
+ * updated.  Freezing clears the tokens, making the tree immutable again.
+ * The persistent insert is the same operation with owner 0, which owns
+ * nothing.
+ * As in ftree.cpp, tokens wrap after 2^24 transients, so a transient that
+ * is abandoned without being frozen must not share nodes with later ones.
+ */
+static size_t tree_owner_next = 0;
+
+extern size_t _tree_owner_new(void)
+{
+    size_t owner;
+    do
+    {
+        owner = __atomic_add_fetch(&tree_owner_next, 1, __ATOMIC_RELAXED) &
+            TREE_OWNER_MAX;
+    }
+    while (owner == 0);
+    return owner;
+}
+
+static inline bool tree_is_owned(Tree t, size_t owner)
+{
+    return (owner != 0 && index(t) != TREE_NIL &&
+        (*tree_size_ptr(t) >> TREE_OWNER_SHIFT) == owner);
+}
+
+/*
+ * Insert into a non-empty subtree.  If the node overflows it is split into
+ * the result and *rt around the key *mk.
+ */
+static Tree tree_insert_2(Tree t, K k, Compare compare, size_t owner,
+    bool *added, bool *split, K *mk, Tree *rt)
+{
+    bool leaf = (index(t) == TREE_LEAF);
+    bool owned = tree_is_owned(t, owner);
+    size_t n = tree_count(t);
+    K *tks = tree_keys(t);
+    K ks[BTREE_MAX_KEYS + 1];
+    Tree ts[BTREE_MAX_KEYS + 2];
+    bool found;
+    size_t i = _btree_find(tks, n, k, compare, &found);
+    *split = false;
+    if (found)
+    {
+        *added = false;
+        if (owned)
+        {
+            tks[i] = k;
+            return t;
+        }
+        tree_unpack(t, ks, ts);
+        ks[i] = k;
+        return tree_pack(owner, n, ks, ts, leaf);
+    }
+
+    K nk = k;
+    Tree lt = TREE_EMPTY, nrt = TREE_EMPTY;
+    if (leaf)
+        *added = true;
+    else
+    {
+        Tree *tts = tree_children(t);
+        bool nsplit;
+        lt = tree_insert_2(tts[i], k, compare, owner, added, &nsplit, &nk,
+            &nrt);
+        if (!nsplit)
+        {
+            if (owned)
+            {
+                tree_replace(&tts[i], lt);
+                if (*added)
+                    (*tree_size_ptr(t))++;
+                return t;
+            }
+            tree_unpack(t, ks, ts);
+            ts[i] = lt;
+            return tree_pack(owner, n, ks, ts, leaf);
+        }
+    }
+
+    // Insert nk at position i, with children lt and nrt replacing child i:
+    if (owned && n < BTREE_MAX_KEYS)
+    {
+        for (size_t j = n; j > i; j--)
+            tks[j] = tks[j-1];
+        tks[i] = nk;
+        (*tree_size_ptr(t))++;
+        if (leaf)
+            return t;
+        BTreeNode *b = (BTreeNode *)tree_ptr(t);
+        for (size_t j = n+1; j > i+1; j--)
+            b->t[j] = b->t[j-1];
+        tree_retain(nrt);
+        b->t[i+1] = nrt;
+        tree_replace(&b->t[i], lt);
+        b->n++;
+        return t;
+    }
+    tree_unpack(t, ks, ts);
+    for (size_t j = n; j > i; j--)
+    {
+        ks[j] = ks[j-1];
+        ts[j+1] = ts[j];
+    }
+    ks[i] = nk;
+    ts[i] = lt;
+    ts[i+1] = nrt;
+    return tree_build(owner, n+1, ks, ts, leaf, split, mk, rt);
+}
+
+static Tree tree_insert(Tree t, K k, Compare compare, size_t owner)
+{
+    if (index(t) == TREE_NIL)
+        return tree_pack(owner, 1, &k, nullptr, true);
+    bool added, split;
+    K mk;
+    Tree rt;
+    Tree nt = tree_insert_2(t, k, compare, owner, &added, &split, &mk, &rt);
+    if (split)
+    {
+        Tree ts[2];
+        ts[0] = nt;
+        ts[1] = rt;
+        nt = tree_pack(owner, 1, &mk, ts, false);
+    }
+    if (tree_ptr(nt) != tree_ptr(t) && tree_is_owned(t, owner))
+        tree_drop(t);
+    return nt;
+}
+
+/*
+ * Transient insert.
+ */
+extern Tree _tree_insert_owned(Tree t, K k, Compare compare, size_t owner)
+{
+    return tree_insert(t, k, compare, owner);
+}
+
+/*
+ * Transient delete.  Owned nodes are updated in place unless the child that
+ * was deleted from becomes underfull, in which case the node is fixed and
+ * repacked (as an owned node).  Shared subtrees are path copied by the
+ * persistent delete, and the fresh copy is claimed.
+ */
+static Tree tree_delete_owned_2(Tree t, K k, Compare compare, size_t owner)
+{
+    if (!tree_is_owned(t, owner))
+    {
+        K dk;
+        Tree nt = tree_delete_2(t, k, compare, TREE_DELETE_KEY, &dk);
+        if (tree_ptr(nt) != tree_ptr(t))
+            *tree_size_ptr(nt) |= (owner << TREE_OWNER_SHIFT);
+        return nt;
+    }
+    size_t n = tree_count(t);
+    K *tks = tree_keys(t);
+    bool found;
+    size_t i = _btree_find(tks, n, k, compare, &found);
+    if (index(t) == TREE_LEAF)
+    {
+        if (!found)
+            return t;
+        for (size_t j = i+1; j < n; j++)
+            tks[j-1] = tks[j];
+        (*tree_size_ptr(t))--;
+        return t;
+    }
+
+    Tree *tts = tree_children(t);
+    Tree nt;
+    K pk = tks[i];
+    if (found)
+    {
+        // Replace the key with its predecessor:
+        nt = tree_delete_2(tts[i], k, compare, TREE_DELETE_MAX, &pk);
+        *tree_size_ptr(nt) |= (owner << TREE_OWNER_SHIFT);
+    }
+    else
+    {
+        size_t size = _tree_size(tts[i]);
+        nt = tree_delete_owned_2(tts[i], k, compare, owner);
+        if (_tree_size(nt) == size)
+            return t;
+    }
+    if (tree_count(nt) < BTREE_MIN_KEYS)
+    {
+        K ks[BTREE_MAX_KEYS];
+        Tree ts[BTREE_MAX_KEYS + 1];
+        tree_unpack(t, ks, ts);
+        if (found)
+            ks[i] = pk;
+        ts[i] = nt;
+        n = tree_fix(ks, ts, n, i);
+        return tree_pack(owner, n, ks, ts, false);
+    }
+    if (found)
+        tks[i] = pk;
+    tree_replace(&tts[i], nt);
+    (*tree_size_ptr(t))--;
+    return t;
+}
+
+extern Tree _tree_delete_owned(Tree t, K k, Compare compare, size_t owner)
+{
+    if (index(t) == TREE_NIL)
+        return t;
+    Tree nt = tree_delete_owned_2(t, k, compare, owner);
+    if (tree_ptr(nt) != tree_ptr(t) && tree_is_owned(t, owner))
+        tree_drop(t);
+    return tree_shrink(nt);
+}
+
+/*
+ * Freeze a transient tree.  Only owned nodes are visited, since owned nodes
+ * are only ever reachable through other owned nodes.
+ */
+extern Tree _tree_freeze(Tree t, size_t owner)
+{
+    if (!tree_is_owned(t, owner))
+        return t;
+    *tree_size_ptr(t) &= TREE_SIZE_MASK;
+    if (index(t) == TREE_NODE)
+    {
+        const BTreeNode &b = t;
+        for (size_t i = 0; i <= b.n; i++)
+            _tree_freeze(b.t[i], owner);
+    }
+    return t;
+}
+
+/*
+ * Delete.  The result of deleting from a subtree may be underfull, and is
+ * fixed by the parent.  A key that is not found leaves the tree unchanged.
+ */
+extern Tree _tree_delete(Tree t, K k, Compare compare)
+{
+    if (index(t) == TREE_NIL)
+        return t;
+    K dk;
+    Tree nt = tree_delete_2(t, k, compare, TREE_DELETE_KEY, &dk);
+    if (tree_ptr(nt) == tree_ptr(t))
+        return t;
+    return tree_shrink(nt);
+}
+
+static Tree tree_delete_2(Tree t, K k, Compare compare, int mode, K *dk)
+{
+    K ks[BTREE_MAX_KEYS];
+    Tree ts[BTREE_MAX_KEYS + 1];
+    size_t n = tree_unpack(t, ks, ts);
+    bool found = false;
+    size_t i;
+    switch (mode)
+    {
+        case TREE_DELETE_KEY:
+            i = _btree_find(ks, n, k, compare, &found);
+            break;
+        case TREE_DELETE_MIN:
+            i = 0;
+            break;
+        default:
+            i = n;
+            break;
+    }
+
+    if (index(t) == TREE_LEAF)
+    {
+        if (mode == TREE_DELETE_MAX)
+            i--;
+        else if (mode == TREE_DELETE_KEY && !found)
+            return t;
+        *dk = ks[i];
+        for (size_t j = i+1; j < n; j++)
+            ks[j-1] = ks[j];
+        return tree_pack(0, n-1, ks, nullptr, true);
+    }
+
+    Tree nt;
+    if (found)
+    {
+        // Replace the key with its predecessor:
+        *dk = ks[i];
+        nt = tree_delete_2(ts[i], k, compare, TREE_DELETE_MAX, ks + i);
+    }
+    else
+    {
+        nt = tree_delete_2(ts[i], k, compare, mode, dk);
+        if (tree_ptr(nt) == tree_ptr(ts[i]))
+            return t;
+    }
+    ts[i] = nt;
+    if (tree_count(nt) < BTREE_MIN_KEYS)
+        n = tree_fix(ks, ts, n, i);
+    return tree_pack(0, n, ks, ts, false);
+}
+
+/*
+ * Alter.  A single pass that calls f on the entry matching k (nullptr if
+ * there is none), and then keeps, sets or erases the entry as directed.
+ * Overfull nodes are split and underfull nodes fixed on the way back up, as
+ * for insert and delete.  If the entry is kept, the original tree is
+ * returned.
+ */
+typedef int (*TreeAlter)(void *, const K *, K *);
+
+static Tree tree_alter_2(Tree t, K k, Compare compare, TreeAlter f,
+    void *data, bool *split, K *mk, Tree *rt)
+{
+    bool leaf = (index(t) == TREE_LEAF);
+    K ks[BTREE_MAX_KEYS + 1];
+    Tree ts[BTREE_MAX_KEYS + 2];
+    size_t n = tree_unpack(t, ks, ts);
+    bool found;
+    size_t i = _btree_find(ks, n, k, compare, &found);
+    *split = false;
+    K nk;
+    if (found)
+    {
+        switch (f(data, ks + i, &nk))
+        {
+            case _TREE_ALTER_SET:
+                ks[i] = nk;
+                return tree_pack(0, n, ks, ts, leaf);
+            case _TREE_ALTER_ERASE:
+                if (leaf)
+                {
+                    for (size_t j = i+1; j < n; j++)
+                        ks[j-1] = ks[j];
+                    return tree_pack(0, n-1, ks, nullptr, true);
+                }
+                // Replace the key with its predecessor:
+                ts[i] = tree_delete_2(ts[i], k, compare, TREE_DELETE_MAX,
+                    ks + i);
+                if (tree_count(ts[i]) < BTREE_MIN_KEYS)
+                    n = tree_fix(ks, ts, n, i);
+                return tree_pack(0, n, ks, ts, false);
+            default:
+                return t;
+        }
+    }
+
+    Tree lt = TREE_EMPTY, nrt = TREE_EMPTY;
+    if (leaf)
+    {
+        if (f(data, nullptr, &nk) != _TREE_ALTER_SET)
+            return t;
+    }
+    else
+    {
+        bool nsplit;
+        lt = tree_alter_2(ts[i], k, compare, f, data, &nsplit, &nk, &nrt);
+        if (tree_ptr(lt) == tree_ptr(ts[i]))
+            return t;
+        if (!nsplit)
+        {
+            ts[i] = lt;
+            if (tree_count(lt) < BTREE_MIN_KEYS)
+                n = tree_fix(ks, ts, n, i);
+            return tree_pack(0, n, ks, ts, false);
+        }
+    }
+
+    // Insert nk at position i, with children lt and nrt replacing child i:
+    for (size_t j = n; j > i; j--)
+    {
+        ks[j] = ks[j-1];
+        ts[j+1] = ts[j];
+    }
+    ks[i] = nk;
+    ts[i] = lt;
+    ts[i+1] = nrt;
+    return tree_build(0, n+1, ks, ts, leaf, split, mk, rt);
+}
+
+extern PURE Tree _tree_alter(Tree t, K k, Compare compare, TreeAlter f,
+    void *data)
+{
+    K nk;
+    if (index(t) == TREE_NIL)
+    {
+        if (f(data, nullptr, &nk) != _TREE_ALTER_SET)
+            return t;
+        return tree_pack(0, 1, &nk, nullptr, true);
+    }
+    bool split;
+    Tree rt;
+    Tree nt = tree_alter_2(t, k, compare, f, data, &split, &nk, &rt);
+    if (tree_ptr(nt) == tree_ptr(t))
+        return t;
+    if (split)
+    {
+        Tree ts[2];
+        ts[0] = nt;
+        ts[1] = rt;
+        return tree_pack(0, 1, &nk, ts, false);
+    }
+    return tree_shrink(nt);
+}
+
+/*
+ * Size.
+ */
+extern size_t _tree_size(Tree t)
+{
+    return _tree_node_size(t);
+}
+
+/*
+ * Join.  Joins l < k < r (of the given heights) by descending the spine of
+ * the taller tree down to the height of the shorter tree.  O(|l_height -
+ * r_height| + 1).
+ */
+static Tree tree_join_2(Tree l, K k, Tree r, size_t l_height,
+    size_t r_height, bool *split, K *mk, Tree *rt)
+{
+    if (l_height == r_height || l_height + r_height == 1)
+        return tree_combine(l, k, r, (l_height <= 1 && r_height <= 1),
+            split, mk, rt);
+
+    K ks[BTREE_MAX_KEYS + 1];
+    Tree ts[BTREE_MAX_KEYS + 2];
+    bool nsplit;
+    K nk;
+    Tree nrt;
+    if (l_height > r_height)
+    {
+        size_t n = tree_unpack(l, ks, ts);
+        Tree nt = tree_join_2(ts[n], k, r, l_height-1, r_height, &nsplit,
+            &nk, &nrt);
+        ts[n] = nt;
+        if (nsplit)
+        {
+            ks[n] = nk;
+            ts[n+1] = nrt;
+            n++;
+        }
+        else if (tree_count(nt) < BTREE_MIN_KEYS)
+            n = tree_fix(ks, ts, n, n);
+        return tree_build(0, n, ks, ts, false, split, mk, rt);
+    }
+    else
+    {
+        size_t n = tree_unpack(r, ks + 1, ts + 1);
+        Tree nt = tree_join_2(l, k, ts[1], l_height, r_height-1, &nsplit,
+            &nk, &nrt);
+        size_t o = 1;
+        if (nsplit)
+        {
+            ts[0] = nt;
+            ks[0] = nk;
+            ts[1] = nrt;
+            o = 0;
+            n++;
+        }
+        else
+        {
+            ts[1] = nt;
+            if (tree_count(nt) < BTREE_MIN_KEYS)
+                n = tree_fix(ks + 1, ts + 1, n, 0);
+        }
+        return tree_build(0, n, ks + o, ts + o, false, split, mk, rt);
+    }
+}
+
+static Tree tree_join(Tree l, K k, Tree r, size_t l_height, size_t r_height,
+    size_t *height)
+{
+    if (l_height == 0 && r_height == 0)
+    {
+        *height = 1;
+        return tree_pack(0, 1, &k, nullptr, true);
+    }
+    *height = (l_height > r_height? l_height: r_height);
+    bool split;
+    K mk;
+    Tree rt;
+    Tree t = tree_join_2(l, k, r, l_height, r_height, &split, &mk, &rt);
+    if (split)
+    {
+        Tree ts[2];
+        ts[0] = t;
+        ts[1] = rt;
+        t = tree_pack(0, 1, &mk, ts, false);
+        (*height)++;
+    }
+    else if (tree_count(t) == 0)
+    {
+        t = tree_shrink(t);
+        (*height)--;
+    }
+    return t;
+}
+
+/*
+ * Concat (join without a middle key).
+ */
+static Tree tree_concat(Tree l, Tree r, size_t l_height, size_t r_height,
+    size_t *height)
+{
+    if (l_height == 0)
+    {
+        *height = r_height;
+        return r;
+    }
+    if (r_height == 0)
+    {
+        *height = l_height;
+        return l;
+    }
+    K k;
+    Tree nr = tree_delete_2(r, k, nullptr, TREE_DELETE_MIN, &k);
+    if (tree_count(nr) == 0)
+    {
+        nr = tree_shrink(nr);
+        r_height--;
+    }
+    Tree t = tree_join(l, k, nr, l_height, r_height, height);
+    tree_drop(nr);
+    return t;
+}
+
+/*
+ * Split.
+ */
+extern PURE Result<Tree, Tree> _tree_split(Tree t, K k, Compare compare)
+{
+    size_t height = tree_height(t), l_height, r_height;
+    Tree lt = TREE_EMPTY, rt = TREE_EMPTY;
+    tree_split_2(t, k, height, &lt, &rt, &l_height, &r_height, compare);
+    return {lt, rt};
+}
+
+/*
+ * Positional access.  The subtree sizes give the position of every key
+ * without visiting the keys before it.
+ */
+extern PURE const K *_tree_nth(Tree t, size_t i)
+{
+    while (index(t) != TREE_NIL)
+    {
+        size_t n = tree_count(t);
+        const K *ks = tree_keys(t);
+        if (index(t) == TREE_LEAF)
+            return (i < n? ks + i: nullptr);
+        const Tree *ts = tree_children(t);
+        size_t j;
+        for (j = 0; j < n; j++)
+        {
+            size_t size = _tree_size(ts[j]);
+            if (i < size)
+                break;
+            if (i == size)
+                return ks + j;
+            i -= size + 1;
+        }
+        t = ts[j];
+    }
+    return nullptr;
+}
+
+extern PURE size_t _tree_rank(Tree t, K k, Compare compare, bool upper)
+{
+    size_t r = 0;
+    while (index(t) != TREE_NIL)
+    {
+        size_t n = tree_count(t);
+        bool found;
+        size_t i = _btree_find(tree_keys(t), n, k, compare, &found);
+        if (index(t) == TREE_LEAF)
+            return r + i + (found && upper);
+        const Tree *ts = tree_children(t);
+        for (size_t j = 0; j < i; j++)
+            r += _tree_size(ts[j]) + 1;
+        if (found)
+            return r + _tree_size(ts[i]) + upper;
+        t = ts[i];
+    }
+    return r;
+}
+
+/*
+ * Split at a position.  Splits on the key at position i, which then heads
+ * the right tree.
+ */
+extern PURE Result<Tree, Tree> _tree_split_at(Tree t, size_t i,
+    Compare compare)
+{
+    const K *kp = _tree_nth(t, i);
+    if (kp == nullptr)
+        return {t, TREE_EMPTY};
+    K k = *kp;
+    size_t height = tree_height(t), l_height, r_height;
+    Tree lt = TREE_EMPTY, rt = TREE_EMPTY;
+    tree_split_2(t, k, height, &lt, &rt, &l_height, &r_height, compare);
+    Tree nrt = tree_join(TREE_EMPTY, k, rt, 0, r_height, &r_height);
+    tree_drop(rt);
+    return {lt, nrt};
+}
+
+/*
+ * The keys [i, j) of a node and the children between them, as a tree that
+ * may have an underfull root.
+ */
+static Tree tree_slice(const K *ks, const Tree *ts, size_t i, size_t j,
+    size_t height, size_t *s_height)
+{
+    bool leaf = (height == 1);
+    if (i == j)
+    {
+        *s_height = height - 1;
+        return ts[i];
+    }
+    *s_height = height;
+    return tree_pack(0, j - i, ks + i, ts + i, leaf);
+}
+
+static bool tree_split_2(Tree t, K k, size_t height, Tree *lt, Tree *rt,
+    size_t *l_height, size_t *r_height, Compare compare)
+{
+    if (height == 0)
+    {
+        *lt = TREE_EMPTY;
+        *rt = TREE_EMPTY;
+        *l_height = 0;
+        *r_height = 0;
+        return false;
+    }
+
+    K ks[BTREE_MAX_KEYS];
+    Tree ts[BTREE_MAX_KEYS + 1];
+    size_t n = tree_unpack(t, ks, ts);
+    bool found;
+    size_t i = _btree_find(ks, n, k, compare, &found);
+    if (found)
+    {
+        *lt = tree_slice(ks, ts, 0, i, height, l_height);
+        *rt = tree_slice(ks, ts, i+1, n, height, r_height);
+        return true;
+    }
+
+    Tree nlt, nrt;
+    size_t nl_height, nr_height;
+    found = tree_split_2(ts[i], k, height-1, &nlt, &nrt, &nl_height,
+        &nr_height, compare);
+    if (i == 0)
+    {
+        *lt = nlt;
+        *l_height = nl_height;
+    }
+    else
+    {
+        size_t s_height;
+        Tree st = tree_slice(ks, ts, 0, i-1, height, &s_height);
+        *lt = tree_join(st, ks[i-1], nlt, s_height, nl_height, l_height);
+        tree_drop(st);
+        tree_drop(nlt);
+    }
+    if (i == n)
+    {
+        *rt = nrt;
+        *r_height = nr_height;
+    }
+    else
+    {
+        size_t s_height;
+        Tree st = tree_slice(ks, ts, i+1, n, height, &s_height);
+        *rt = tree_join(nrt, ks[i], st, nr_height, s_height, r_height);
+        tree_drop(st);
+        tree_drop(nrt);
+    }
+    return found;
+}
+
+/*
+ * Union/intersection/difference.  The tree t is split by each key of the
+ * root of u, the pieces are combined with the corresponding children of u,
+ * and the results are joined back together.  Subtrees shared by both trees
+ * are resolved without being visited.
+ */
+enum
+{
+    TREE_UNION     = _TREE_UNION,
+    TREE_INTERSECT = _TREE_INTERSECT,
+    TREE_DIFF      = _TREE_DIFF
+};
+
+static Tree tree_merge_2(Tree t, Tree u, size_t t_height, size_t u_height,
+    size_t *height, Compare compare, int op)
+{
+    if (t == u)
+    {
+        *height = (op == TREE_DIFF? 0: t_height);
+        return (op == TREE_DIFF? TREE_EMPTY: t);
+    }
+    if (u_height == 0)
+    {
+        *height = (op == TREE_INTERSECT? 0: t_height);
+        return (op == TREE_INTERSECT? TREE_EMPTY: t);
+    }
+    if (t_height == 0)
+    {
+        *height = (op == TREE_UNION? u_height: 0);
+        return (op == TREE_UNION? u: TREE_EMPTY);
+    }
+
+    K ks[BTREE_MAX_KEYS];
+    Tree us[BTREE_MAX_KEYS + 1];
+    size_t n = tree_unpack(u, ks, us);
+    Tree ps[BTREE_MAX_KEYS + 1];
+    size_t hs[BTREE_MAX_KEYS + 1];
+    bool in[BTREE_MAX_KEYS];
+    for (size_t i = 0; i < n; i++)
+    {
+        in[i] = tree_split_2(t, ks[i], t_height, ps + i, &t, hs + i,
+            &t_height, compare);
+    }
+    ps[n] = t;
+    hs[n] = t_height;
+    for (size_t i = 0; i <= n; i++)
+        ps[i] = tree_merge_2(ps[i], us[i], hs[i], u_height-1, hs + i,
+            compare, op);
+
+    t = ps[0];
+    t_height = hs[0];
+    for (size_t i = 0; i < n; i++)
+    {
+        if (op == TREE_UNION || (op == TREE_INTERSECT && in[i]))
+            t = tree_join(t, ks[i], ps[i+1], t_height, hs[i+1], &t_height);
+        else
+            t = tree_concat(t, ps[i+1], t_height, hs[i+1], &t_height);
+    }
+    *height = t_height;
+    return t;
+}
+
+/*
+ * Union.
+ */
+extern PURE Tree _tree_union(Tree t, Tree u, Compare compare)
+{
+    size_t height;
+    return tree_merge_2(t, u, tree_height(t), tree_height(u), &height,
+        compare, TREE_UNION);
+}
+
+/*
+ * Intersection.
+ */
+extern PURE Tree _tree_intersect(Tree t, Tree u, Compare compare)
+{
+    size_t height;
+    return tree_merge_2(t, u, tree_height(t), tree_height(u), &height,
+        compare, TREE_INTERSECT);
+}
+
+/*
+ * Difference.
+ */
+extern PURE Tree _tree_diff(Tree t, Tree u, Compare compare)
+{
+    size_t height;
+    return tree_merge_2(t, u, tree_height(t), tree_height(u), &height,
+        compare, TREE_DIFF);
+}
+
+/*
+ * Union/intersection/difference with a combining function.  As above, but
+ * for each key of u that is also in t, f is passed both entries and writes
+ * the combined entry, or returns false to drop the key.
+ * O(m * log(n/m + 1)).
+ */
+typedef bool (*TreeCombine)(void *, const K *, const K *, K *);
+
+static Tree tree_merge_with_2(Tree t, Tree u, size_t t_height, size_t u_height,
+    size_t *height, Compare compare, int op, TreeCombine f, void *data)
+{
+    if (u_height == 0)
+    {
+        *height = (op == TREE_INTERSECT? 0: t_height);
+        return (op == TREE_INTERSECT? TREE_EMPTY: t);
+    }
+    if (t_height == 0)
+    {
+        *height = (op == TREE_UNION? u_height: 0);
+        return (op == TREE_UNION? u: TREE_EMPTY);
+    }
+
+    K ks[BTREE_MAX_KEYS];
+    Tree us[BTREE_MAX_KEYS + 1];
+    size_t n = tree_unpack(u, ks, us);
+    Tree ps[BTREE_MAX_KEYS + 1];
+    size_t hs[BTREE_MAX_KEYS + 1];
+    bool in[BTREE_MAX_KEYS];
+    for (size_t i = 0; i < n; i++)
+    {
+        const K *k = _tree_search(t, ks[i], compare);
+        K nk;
+        in[i] = (k == nullptr? op == TREE_UNION: f(data, k, ks + i, &nk));
+        if (k != nullptr && in[i])
+            ks[i] = nk;
+        tree_split_2(t, ks[i], t_height, ps + i, &t, hs + i, &t_height,
+            compare);
+    }
+    ps[n] = t;
+    hs[n] = t_height;
+    for (size_t i = 0; i <= n; i++)
+        ps[i] = tree_merge_with_2(ps[i], us[i], hs[i], u_height-1, hs + i,
+            compare, op, f, data);
+
+    t = ps[0];
+    t_height = hs[0];
+    for (size_t i = 0; i < n; i++)
+    {
+        if (in[i])
+            t = tree_join(t, ks[i], ps[i+1], t_height, hs[i+1], &t_height);
+        else
+            t = tree_concat(t, ps[i+1], t_height, hs[i+1], &t_height);
+    }
+    *height = t_height;
+    return t;
+}
+
+extern PURE Tree _tree_merge_with(Tree t, Tree u, Compare compare, int op,
+    TreeCombine f, void *data)
+{
+    size_t height;
+    return tree_merge_with_2(t, u, tree_height(t), tree_height(u), &height,
+        compare, op, f, data);
+}
+
+/*
+ * Fold left.
+ */
+extern PURE C _tree_foldl(Tree t, C arg, C (*f)(void *, C, const K &),
+    void *data)
+{
+    switch (index(t))
+    {
+        case TREE_NIL:
+            return arg;
+        case TREE_LEAF:
+        {
+            const BTreeLeaf &l = t;
+            size_t n = l.size & TREE_SIZE_MASK;
+            for (size_t i = 0; i < n; i++)
+                arg = f(data, arg, l.k[i]);
+            return arg;
+        }
+        case TREE_NODE:
+        {
+            const BTreeNode &b = t;
+            for (size_t i = 0; i < b.n; i++)
+            {
+                arg = _tree_foldl(b.t[i], arg, f, data);
+                arg = f(data, arg, b.k[i]);
+            }
+            return _tree_foldl(b.t[b.n], arg, f, data);
+        }
+        default:
+            error_bad_tree();
+    }
+}
+
+/*
+ * Fold left over the keys in [*lo, *hi) (a null bound is open).  Only the
+ * children that overlap the range are visited.
+ */
+extern PURE C _tree_foldl_range(Tree t, const K *lo, const K *hi, C arg,
+    C (*f)(void *, C, const K &), void *data, Compare compare)
+{
+    if (index(t) == TREE_NIL)
+        return arg;
+    if (lo == nullptr && hi == nullptr)
+        return _tree_foldl(t, arg, f, data);
+    size_t n = tree_count(t);
+    const K *ks = tree_keys(t);
+    bool found;
+    size_t i = (lo == nullptr? 0: _btree_find(ks, n, *lo, compare, &found));
+    size_t j = (hi == nullptr? n:
+        i + _btree_find(ks + i, n - i, *hi, compare, &found));
+    if (index(t) == TREE_LEAF)
+    {
+        for (; i < j; i++)
+            arg = f(data, arg, ks[i]);
+        return arg;
+    }
+    const Tree *ts = tree_children(t);
+    for (size_t m = i; m <= j; m++)
+    {
+        arg = _tree_foldl_range(ts[m], (m == i? lo: nullptr),
+            (m == j? hi: nullptr), arg, f, data, compare);
+        if (m < j)
+            arg = f(data, arg, ks[m]);
+    }
+    return arg;
+}
+
+/*
+ * Measure of a whole (sub)tree.  Internal nodes memoise the result in their
+ * cache slot, tagged with the measure, unless owned by a transient (whose
+ * nodes may still be updated in place).
+ */
+static A tree_measure(Tree t, const _TreeMeasure *m)
+{
+    if (index(t) == TREE_NIL)
+        return m->_empty();
+    size_t n = tree_count(t);
+    const K *ks = tree_keys(t);
+    if (index(t) == TREE_LEAF)
+    {
+        A r = m->_empty();
+        for (size_t i = 0; i < n; i++)
+            r = m->_combine(r, m->_measure(ks[i]));
+        return r;
+    }
+#ifdef LIBF_TREE_MEASURE
+    _TreeCache *c = &((BTreeNode *)tree_ptr(t))->c;
+    A cached;
+    if (_tree_cache_lookup(c, (const void *)m, &cached))
+        return cached;
+#endif
+    const Tree *ts = tree_children(t);
+    A r = tree_measure(ts[0], m);
+    for (size_t i = 0; i < n; i++)
+    {
+        r = m->_combine(r, m->_measure(ks[i]));
+        r = m->_combine(r, tree_measure(ts[i+1], m));
+    }
+#ifdef LIBF_TREE_MEASURE
+    if ((*tree_size_ptr(t) >> TREE_OWNER_SHIFT) == 0)
+        _tree_cache_publish(c, (const void *)m, r);
+#endif
+    return r;
+}
+
+/*
+ * Aggregate of the keys in [*lo, *hi) (a null bound is open).  Children that
+ * lie wholly inside the range contribute their (cached) measure, so only the
+ * two boundary paths are visited.
+ */
+extern PURE A _tree_aggregate(Tree t, const K *lo, const K *hi,
+    const _TreeMeasure *m, Compare compare)
+{
+    if (index(t) == TREE_NIL)
+        return m->_empty();
+    if (lo == nullptr && hi == nullptr)
+        return tree_measure(t, m);
+    size_t n = tree_count(t);
+    const K *ks = tree_keys(t);
+    bool found;
+    size_t i = (lo == nullptr? 0: _btree_find(ks, n, *lo, compare, &found));
+    size_t j = (hi == nullptr? n:
+        i + _btree_find(ks + i, n - i, *hi, compare, &found));
+    A r = m->_empty();
+    if (index(t) == TREE_LEAF)
+    {
+        for (; i < j; i++)
+            r = m->_combine(r, m->_measure(ks[i]));
+        return r;
+    }
+    const Tree *ts = tree_children(t);
+    for (size_t k = i; k <= j; k++)
+    {
+        r = m->_combine(r, _tree_aggregate(ts[k], (k == i? lo: nullptr),
+            (k == j? hi: nullptr), m, compare));
+        if (k < j)
+            r = m->_combine(r, m->_measure(ks[k]));
+    }
+    return r;
+}
+
+/*
+ * Fold right.
+ */
+extern PURE C _tree_foldr(Tree t, C arg, C (*f)(void *, C, const K &),
+    void *data)
+{
+    switch (index(t))
+    {
+        case TREE_NIL:
+            return arg;
+        case TREE_LEAF:
+        {
+            const BTreeLeaf &l = t;
+            size_t n = l.size & TREE_SIZE_MASK;
+            for (size_t i = n; i > 0; i--)
+                arg = f(data, arg, l.k[i-1]);
+            return arg;
+        }
+        case TREE_NODE:
+        {
+            const BTreeNode &b = t;
+            arg = _tree_foldr(b.t[b.n], arg, f, data);
+            for (size_t i = b.n; i > 0; i--)
+            {
+                arg = f(data, arg, b.k[i-1]);
+                arg = _tree_foldr(b.t[i-1], arg, f, data);
+            }
+            return arg;
+        }
+        default:
+            error_bad_tree();
+    }
+}
+
+/*
+ * Map.
+ */
+extern PURE Tree _tree_map(Tree t, K (*f)(void *, K), void *data)
+{
+    if (index(t) == TREE_NIL)
+        return TREE_EMPTY;
+    K ks[BTREE_MAX_KEYS];
+    Tree ts[BTREE_MAX_KEYS + 1];
+    size_t n = tree_unpack(t, ks, ts);
+    bool leaf = (index(t) == TREE_LEAF);
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!leaf)
+            ts[i] = _tree_map(ts[i], f, data);
+        ks[i] = f(data, ks[i]);
+    }
+    if (!leaf)
+        ts[n] = _tree_map(ts[n], f, data);
+    return tree_pack(0, n, ks, ts, leaf);
+}
+
+/*
+ * From list.
+ */
+static K tree_list_next(void *data)
+{
+    List<K> *ys = (List<K> *)data;
+    K k = head(*ys);
+    *ys = tail(*ys);
+    return k;
+}
+
+extern PURE Tree _tree_from_list(const List<K> xs, Compare compare)
+{
+    // Sorted input (e.g. a reloaded dump) is built bottom-up in O(n):
+    size_t n = 0;
+    bool sorted = true;
+    List<K> ys = xs;
+    K prev;
+    while (!empty(ys))
+    {
+        K k = head(ys);
+        if (n > 0 && compare(prev, k) >= 0)
+        {
+            sorted = false;
+            break;
+        }
+        prev = k;
+        n++;
+        ys = tail(ys);
+    }
+    if (sorted)
+    {
+        ys = xs;
+        return _tree_from_sorted(n, tree_list_next, (void *)&ys, compare);
+    }
+
+    size_t owner = _tree_owner_new();
+    Tree t = TREE_EMPTY;
+    ys = xs;
+    while (!empty(ys))
+    {
+        t = _tree_insert_owned(t, head(ys), compare, owner);
+        ys = tail(ys);
+    }
+    return _tree_freeze(t, owner);
+}
+
+/*
+ * From sorted.  The n keys are produced in order by next(), and are placed
+ * into a tree of minimal height where every non-root subtree of height h
+ * holds between D^h-1 and (2D)^h-1 keys (D = BTREE_DEGREE).  Each node is
+ * allocated exactly once.
+ */
+struct TreeSource
+{
+    K (*next)(void *);
+    void *data;
+    Compare compare;
+    size_t count;
+    K prev;
+};
+
+static size_t tree_pow_keys(size_t b, size_t h)
+{
+    size_t x = 1;
+    for (size_t i = 0; i < h; i++)
+    {
+        if (x > SIZE_MAX / b)
+            return SIZE_MAX;
+        x *= b;
+    }
+    return x - 1;
+}
+
+static inline size_t tree_min_keys(size_t h)
+{
+    return tree_pow_keys(BTREE_DEGREE, h);
+}
+
+static inline size_t tree_max_keys(size_t h)
+{
+    return tree_pow_keys(2 * BTREE_DEGREE, h);
+}
+
+static K tree_source_next(TreeSource *src)
+{
+    K k = src->next(src->data);
+    if (src->count > 0 && src->compare(src->prev, k) >= 0)
+        error("sorted input is not strictly increasing");
+    src->prev = k;
+    src->count++;
+    return k;
+}
+
+static Tree tree_from_sorted_2(TreeSource *src, size_t n, size_t h,
+    bool root)
+{
+    K ks[BTREE_MAX_KEYS];
+    Tree ts[BTREE_MAX_KEYS + 1];
+    if (h == 1)
+    {
+        for (size_t i = 0; i < n; i++)
+            ks[i] = tree_source_next(src);
+        return tree_pack(0, n, ks, nullptr, true);
+    }
+
+    // The fewest children (i.e. the fullest nodes) that fit:
+    size_t lo = tree_min_keys(h-1), hi = tree_max_keys(h-1);
+    size_t c = (hi >= n? 0: n / (hi + 1) + 1);
+    size_t c_min = (root? 2: BTREE_DEGREE);
+    c = (c < c_min? c_min: c);
+    if (c > BTREE_MAX_KEYS + 1 || n + 1 < c * (lo + 1))
+        error_bad_tree();
+
+    size_t m = n - (c-1);
+    size_t q = m / c, r = m % c;
+    for (size_t i = 0; i < c; i++)
+    {
+        ts[i] = tree_from_sorted_2(src, q + (i < r), h-1, false);
+        if (i < c-1)
+            ks[i] = tree_source_next(src);
+    }
+    return tree_pack(0, c-1, ks, ts, false);
+}
+
+extern Tree _tree_from_sorted(size_t n, K (*next)(void *), void *data,
+    Compare compare)
+{
+    if (n == 0)
+        return TREE_EMPTY;
+    size_t h = 1;
+    while (tree_max_keys(h) < n)
+        h++;
+    TreeSource src = {next, data, compare, 0, K()};
+    return tree_from_sorted_2(&src, n, h, true);
+}
+
+/*
+ * To list.
+ */
+extern PURE List<C> _tree_to_list(Tree t, C (*f)(void *, K), void *data)
+{
+    return tree_to_list_2(t, f, data, list<C>());
+}
+
+static List<C> tree_to_list_2(Tree t, C (*f)(void *, K), void *data,
+    List<C> xs)
+{
+    switch (index(t))
+    {
+        case TREE_NIL:
+            return xs;
+        case TREE_LEAF:
+        {
+            const BTreeLeaf &l = t;
+            size_t n = l.size & TREE_SIZE_MASK;
+            for (size_t i = n; i > 0; i--)
+                xs = list<C>(f(data, l.k[i-1]), xs);
+            return xs;
+        }
+        case TREE_NODE:
+        {
+            const BTreeNode &b = t;
+            xs = tree_to_list_2(b.t[b.n], f, data, xs);
+            for (size_t i = b.n; i > 0; i--)
+            {
+                xs = list<C>(f(data, b.k[i-1]), xs);
+                xs = tree_to_list_2(b.t[i-1], f, data, xs);
+            }
+            return xs;
+        }
+        default:
+            error_bad_tree();
+    }
+}
+
+/*
+ * Verify.
+ */
+extern PURE bool _tree_verify(Tree t)
+{
+    size_t height = tree_height(t);
+    return tree_verify_2(t, height, true);
+}
+
+static bool tree_verify_2(Tree t, size_t height, bool root)
+{
+    if (height == 0)
+        return (index(t) == TREE_NIL);
+    if (index(t) != (height == 1? TREE_LEAF: TREE_NODE))
+        return false;
+    size_t n = tree_count(t);
+    if (n < (root? 1: BTREE_MIN_KEYS) || n > BTREE_MAX_KEYS)
+        return false;
+    if (height == 1)
+        return true;
+    const BTreeNode &b = t;
+    size_t size = n;
+    for (size_t i = 0; i <= n; i++)
+    {
+        if (!tree_verify_2(b.t[i], height-1, false))
+            return false;
+        size += _tree_size(b.t[i]);
+    }
+    return ((b.size & TREE_SIZE_MASK) == size);
+}
+
+/*
+ * Paired walks.  Each tree is walked in order as a stack of pending subtrees
+ * and keys (a key entry has an empty subtree).  The larger of the two
+ * pending subtrees is expanded first, so subtrees shared by both trees meet
+ * at the top of both stacks and can be skipped unvisited.
+ */
+struct TreeWalk
+{
+    Tree t;
+    K k;
+};
+
+static TreeWalk *tree_walk_init(Tree t, size_t *ptr)
+{
+    TreeWalk *stack = (TreeWalk *)gc_malloc(
+        (tree_height(t) + 1) * (2*BTREE_MAX_KEYS + 1) * sizeof(TreeWalk));
+    *ptr = 0;
+    if (index(t) != TREE_NIL)
+    {
+        stack[0].t = t;
+        *ptr = 1;
+    }
+    return stack;
+}
+
+static void tree_walk_expand(TreeWalk *stack, size_t *ptr)
+{
+    (*ptr)--;
+    K ks[BTREE_MAX_KEYS];
+    Tree ts[BTREE_MAX_KEYS + 1];
+    size_t n = tree_unpack(stack[*ptr].t, ks, ts);
+    for (size_t i = n+1; i-- > 0; )
+    {
+        if (index(ts[i]) != TREE_NIL)
+        {
+            stack[*ptr].t = ts[i];
+            (*ptr)++;
+        }
+        if (i > 0)
+        {
+            stack[*ptr].t = TREE_EMPTY;
+            stack[*ptr].k = ks[i-1];
+            (*ptr)++;
+        }
+    }
+}
+
+/*
+ * Advance both walks until neither top is a subtree, skipping the subtrees
+ * that are on top of both.
+ */
+static void tree_walk_align(TreeWalk *ts, size_t *t_ptr, TreeWalk *us,
+    size_t *u_ptr)
+{
+    while (true)
+    {
+        Tree a = (*t_ptr > 0? ts[*t_ptr - 1].t: TREE_EMPTY);
+        Tree b = (*u_ptr > 0? us[*u_ptr - 1].t: TREE_EMPTY);
+        bool a_node = (index(a) != TREE_NIL), b_node = (index(b) != TREE_NIL);
+        if (a_node && b_node && a == b)
+        {
+            (*t_ptr)--;
+            (*u_ptr)--;
+        }
+        else if (a_node && (!b_node || _tree_size(a) >= _tree_size(b)))
+            tree_walk_expand(ts, t_ptr);
+        else if (b_node)
+            tree_walk_expand(us, u_ptr);
+        else
+            return;
+    }
+}
+
+/*
+ * Compare.  Shared subtrees compare equal without being visited.
+ */
+extern PURE int _tree_compare(Tree t, Tree u, void *data,
+    int (*val_compare)(void *, Value<Word>, Value<Word>))
+{
+    if (t == u)
+        return 0;
+
+    size_t t_ptr, u_ptr;
+    TreeWalk *ts = tree_walk_init(t, &t_ptr);
+    TreeWalk *us = tree_walk_init(u, &u_ptr);
+    int cmp = 0;
+    while (true)
+    {
+        tree_walk_align(ts, &t_ptr, us, &u_ptr);
+        if (t_ptr == 0 || u_ptr == 0)
+        {
+            cmp = (t_ptr == 0? (u_ptr == 0? 0: -1): 1);
+            break;
+        }
+        cmp = val_compare(data, ts[t_ptr - 1].k, us[u_ptr - 1].k);
+        if (cmp != 0)
+            break;
+        t_ptr--;
+        u_ptr--;
+    }
+    gc_free(ts);
+    gc_free(us);
+    return cmp;
+}
+
+/*
+ * Structural diff.  f is called with (k, nullptr) for removed keys,
+ * (nullptr, k) for added keys, and (k, k') for keys in both trees with
+ * different entries.
+ */
+extern void _tree_diff_entries(Tree t, Tree u, Compare compare,
+    void (*f)(void *, const K *, const K *), void *data)
+{
+    if (t == u)
+        return;
+
+    size_t t_ptr, u_ptr;
+    TreeWalk *ts = tree_walk_init(t, &t_ptr);
+    TreeWalk *us = tree_walk_init(u, &u_ptr);
+    while (true)
+    {
+        tree_walk_align(ts, &t_ptr, us, &u_ptr);
+        if (t_ptr == 0 && u_ptr == 0)
+            break;
+        const K *a = (t_ptr > 0? &ts[t_ptr - 1].k: nullptr);
+        const K *b = (u_ptr > 0? &us[u_ptr - 1].k: nullptr);
+        int cmp = (a == nullptr? 1: b == nullptr? -1: compare(*a, *b));
+        if (cmp < 0)
+        {
+            f(data, a, nullptr);
+            t_ptr--;
+        }
+        else if (cmp > 0)
+        {
+            f(data, nullptr, b);
+            u_ptr--;
+        }
+        else
+        {
+            if (memcmp(a, b, sizeof(K)) != 0)
+                f(data, a, b);
+            t_ptr--;
+            u_ptr--;
+        }
+    }
+    gc_free(ts);
+    gc_free(us);
+}
+
+/*
+ * Show.
+ */
+extern PURE String _tree_show(Tree t, String (*f)(A))
+{
+    String r = string('{');
+    bool first = true;
+    r = tree_show_2(t, r, &first, f);
+    r = append(r, '}');
+    return r;
+}
+
+static String tree_show_2(Tree t, String r, bool *first, String (*f)(A))
+{
+    if (index(t) == TREE_NIL)
+        return r;
+    K ks[BTREE_MAX_KEYS];
+    Tree ts[BTREE_MAX_KEYS + 1];
+    size_t n = tree_unpack(t, ks, ts);
+    for (size_t i = 0; i < n; i++)
+    {
+        r = tree_show_2(ts[i], r, first, f);
+        if (!*first)
+            r = append(r, ',');
+        r = append(r, f(ks[i]));
+        *first = false;
+    }
+    return tree_show_2(ts[n], r, first, f);
+}
+
+/*
+ * Iterators (see ftree.cpp).  Below the top of the stack, _slot[] is the
+ * child that was descended into; at the top it is the index of the current
+ * key.
+ */
+static inline void tree_itr_push(_TreeItr *itr, Tree t, size_t slot)
+{
+    if (itr->_ptr >= _TREE_ITR_DEPTH)
+        error_bad_tree();
+    itr->_stack[itr->_ptr] = _bit_cast<Word>(t);
+    itr->_slot[itr->_ptr] = (uint8_t)slot;
+    itr->_ptr++;
+}
+
+static inline Tree tree_itr_node(const _TreeItr *itr, size_t i)
+{
+    return _bit_cast<Tree>(itr->_stack[i]);
+}
+
+static inline Tree tree_itr_child(Tree t, size_t i)
+{
+    if (index(t) == TREE_LEAF)
+        return TREE_EMPTY;
+    return tree_children(t)[i];
+}
+
+/*
+ * Rebuild the path to the key at index _idx from the root.
+ */
+static void tree_itr_seek(_TreeItr *itr)
+{
+    size_t idx = itr->_idx;
+    Tree t = itr->_root;
+    itr->_ptr = 0;
+    while (true)
+    {
+        if (index(t) == TREE_NIL)
+            error_bad_tree();
+        size_t n = tree_count(t);
+        if (index(t) == TREE_LEAF)
+        {
+            if (idx >= n)
+                error_bad_tree();
+            tree_itr_push(itr, t, idx);
+            break;
+        }
+        const Tree *ts = tree_children(t);
+        size_t i = 0;
+        while (i < n && idx > _tree_node_size(ts[i]))
+        {
+            idx -= _tree_node_size(ts[i]) + 1;
+            i++;
+        }
+        tree_itr_push(itr, t, i);
+        size_t m = _tree_node_size(ts[i]);
+        if (idx == m && i < n)
+            break;
+        if (idx >= m)
+            error_bad_tree();
+        t = ts[i];
+    }
+    itr->_pos = itr->_idx;
+}
+
+/*
+ * Step the path to the next key.  Returns false if there is none.
+ */
+static bool tree_itr_next(_TreeItr *itr)
+{
+    size_t top = itr->_ptr - 1;
+    Tree t = tree_itr_node(itr, top);
+    size_t j = itr->_slot[top];
+    Tree u = tree_itr_child(t, j + 1);
+    if (index(u) != TREE_NIL)
+    {
+        itr->_slot[top] = (uint8_t)(j + 1);
+        while (index(u) != TREE_NIL)
+        {
+            tree_itr_push(itr, u, 0);
+            u = tree_itr_child(u, 0);
+        }
+        return true;
+    }
+    if (j + 1 < tree_count(t))
+    {
+        itr->_slot[top] = (uint8_t)(j + 1);
+        return true;
+    }
+    while (--itr->_ptr > 0)
+    {
+        top = itr->_ptr - 1;
+        if (itr->_slot[top] < tree_count(tree_itr_node(itr, top)))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Step the path to the previous key.  Returns false if there is none.
+ */
+static bool tree_itr_prev(_TreeItr *itr)
+{
+    size_t top = itr->_ptr - 1;
+    Tree t = tree_itr_node(itr, top);
+    size_t j = itr->_slot[top];
+    Tree u = tree_itr_child(t, j);
+    if (index(u) != TREE_NIL)
+    {
+        while (true)
+        {
+            size_t n = tree_count(u);
+            Tree v = tree_itr_child(u, n);
+            if (index(v) == TREE_NIL)
+            {
+                tree_itr_push(itr, u, n - 1);
+                return true;
+            }
+            tree_itr_push(itr, u, n);
+            u = v;
+        }
+    }
+    if (j > 0)
+    {
+        itr->_slot[top] = (uint8_t)(j - 1);
+        return true;
+    }
+    while (--itr->_ptr > 0)
+    {
+        top = itr->_ptr - 1;
+        if (itr->_slot[top] > 0)
+        {
+            itr->_slot[top]--;
+            return true;
+        }
+    }
+    return false;
+}
+
+extern void _tree_itr_begin(_TreeItr *itr, _Tree t)
+{
+    itr->_idx = 0;
+    itr->_pos = 0;
+    itr->_ptr = 0;
+    itr->_root = t;
+    itr->_cur = nullptr;
+    itr->_lim = nullptr;
+}
+
+extern void _tree_itr_end(_TreeItr *itr, _Tree t)
+{
+    itr->_idx = _tree_size(t);
+    itr->_pos = 0;
+    itr->_ptr = 0;
+    itr->_root = t;
+    itr->_cur = nullptr;
+    itr->_lim = nullptr;
+}
+
+extern const Value<Word> &_tree_itr_get(_TreeItr *itr)
+{
+    if (itr->_ptr != 0 && itr->_idx != itr->_pos)
+    {
+        bool ok = false;
+        if (itr->_idx == itr->_pos + 1)
+            ok = tree_itr_next(itr);
+        else if (itr->_idx + 1 == itr->_pos)
+            ok = tree_itr_prev(itr);
+        if (ok)
+            itr->_pos = itr->_idx;
+        else
+            itr->_ptr = 0;
+    }
+    if (itr->_ptr == 0)
+        tree_itr_seek(itr);
+    size_t top = itr->_ptr - 1;
+    Tree t = tree_itr_node(itr, top);
+    bool leaf = (index(t) == TREE_LEAF);
+    const K *ks = tree_keys(t);
+    itr->_cur = ks + itr->_slot[top];
+    itr->_lim = (leaf? ks + tree_count(t): itr->_cur + 1);
+    return *itr->_cur;
+}
+
+}
+
+#endif      /* LIBF_TREE_BTREE */
+
@@ -32,6 +32,10 @@
 
 #include <cstdint>
 #include <gc.h>
+#include <pthread.h>
+#ifdef LIBF_GC_TYPED
+#include <gc_typed.h>
+#endif      /* LIBF_GC_TYPED */
 
 #ifndef GC_INLINE
 #define GC_INLINE static inline __attribute__ ((__always_inline__))
@@ -42,20 +46,510 @@
 namespace F
 {
 
+/*
+ * Thread-local size-class free lists for small fixed-size objects (e.g. tree
+ * and finger-tree nodes).  Lists are refilled in batches by GC_malloc_many(),
+ * so the allocator lock is taken once per batch rather than once per node.
+ * The list heads live in an uncollectable (but scanned) block so that free
+ * objects are not reclaimed by the collector.  When a thread exits, its
+ * lists are flushed back to the collector by a thread-specific destructor.
+ */
+#define GC_SLAB_CLASSES     8
+#define GC_SLAB_MAX         (GC_SLAB_CLASSES * GC_ALIGNMENT)
+
+struct _GCSlab
+{
+    void *_free[GC_SLAB_CLASSES];
+};
+
+inline thread_local _GCSlab *_gc_slab = nullptr;
+inline pthread_key_t _gc_slab_key;
+inline pthread_once_t _gc_slab_once = PTHREAD_ONCE_INIT;
+
+static inline void _gc_slab_flush(void *_data)
+{
+    _GCSlab *_slab = (_GCSlab *)_data;
+    if (_gc_slab == _slab)
+        _gc_slab = nullptr;
+    for (size_t _cls = 0; _cls < GC_SLAB_CLASSES; _cls++)
+    {
+        void *_ptr = _slab->_free[_cls];
+        while (_ptr != nullptr)
+        {
+            void *_next = GC_NEXT(_ptr);
+            GC_free(_ptr);
+            _ptr = _next;
+        }
+    }
+    GC_free(_slab);
+}
+
+static inline void _gc_slab_key_init(void)
+{
+    pthread_key_create(&_gc_slab_key, _gc_slab_flush);
+}
+
+static inline __attribute__ ((__noinline__)) void *_gc_slab_refill(
+    size_t _cls)
+{
+    if (_gc_slab == nullptr)
+    {
+        _gc_slab = (_GCSlab *)GC_malloc_uncollectable(sizeof(_GCSlab));
+        pthread_once(&_gc_slab_once, _gc_slab_key_init);
+        pthread_setspecific(_gc_slab_key, _gc_slab);
+    }
+    void *_ptr = GC_malloc_many((_cls + 1) * GC_ALIGNMENT);
+    if (_ptr != nullptr)
+        _gc_slab->_free[_cls] = GC_NEXT(_ptr);
+    return _ptr;
+}
+
+GC_INLINE void *_gc_slab_malloc(size_t _size)
+{
+    size_t _cls = (_size - 1) / GC_ALIGNMENT;
+    _GCSlab *_slab = _gc_slab;
+    void *_ptr;
+    if (_slab == nullptr || (_ptr = _slab->_free[_cls]) == nullptr)
+        _ptr = _gc_slab_refill(_cls);
+    else
+        _slab->_free[_cls] = GC_NEXT(_ptr);
+    GC_NEXT(_ptr) = nullptr;
+    return _ptr;
+}
+
+GC_INLINE void _gc_slab_free(void *_ptr, size_t _size)
+{
+    size_t _cls = (_size - 1) / GC_ALIGNMENT;
+    _GCSlab *_slab = _gc_slab;
+    if (_slab == nullptr)
+    {
+        GC_free(_ptr);
+        return;
+    }
+    __builtin_memset(_ptr, 0, (_cls + 1) * GC_ALIGNMENT);
+    GC_NEXT(_ptr) = _slab->_free[_cls];
+    _slab->_free[_cls] = _ptr;
+}
+
+/*
+ * Allocation regions (see fregion.h).  While a region is active on the
+ * current thread, all allocations are bump-allocated from the region's
+ * chunks, and are released together when the region ends.  Chunks are
+ * uncollectable (but scanned) so region objects keep GC objects alive.
+ * Explicit frees are ignored while a region is active.
+ */
+#define GC_REGION_CHUNK_SIZE    (64 * 1024)
+
+struct _GCRegion
+{
+    uint8_t *_ptr;
+    uint8_t *_end;
+    void *_chunks;
+    _GCRegion *_prev;
+};
+
+inline thread_local _GCRegion *_gc_region = nullptr;
+
+static inline __attribute__ ((__noinline__)) void *_gc_region_refill(
+    _GCRegion *_r, size_t _size)
+{
+    size_t _chunk_size = GC_ALIGNMENT + _size;
+    _chunk_size = (_chunk_size < GC_REGION_CHUNK_SIZE? GC_REGION_CHUNK_SIZE:
+        _chunk_size);
+    uint8_t *_chunk = (uint8_t *)GC_malloc_uncollectable(_chunk_size);
+    *(void **)_chunk = _r->_chunks;
+    _r->_chunks = (void *)_chunk;
+    _r->_ptr = _chunk + GC_ALIGNMENT + _size;
+    _r->_end = _chunk + _chunk_size;
+    return (void *)(_chunk + GC_ALIGNMENT);
+}
+
+GC_INLINE void *_gc_region_malloc(_GCRegion *_r, size_t _size)
+{
+    _size = (_size + GC_ALIGNMENT - 1) & ~(size_t)(GC_ALIGNMENT - 1);
+    uint8_t *_ptr = _r->_ptr;
+    if ((size_t)(_r->_end - _ptr) < _size)
+        return _gc_region_refill(_r, _size);
+    _r->_ptr = _ptr + _size;
+    return (void *)_ptr;
+}
+
+GC_INLINE void _gc_region_begin(_GCRegion *_r)
+{
+    _r->_ptr = _r->_end = nullptr;
+    _r->_chunks = nullptr;
+    _r->_prev = _gc_region;
+    _gc_region = _r;
+}
+
+GC_INLINE void _gc_region_end(_GCRegion *_r)
+{
+    void *_chunk = _r->_chunks;
+    while (_chunk != nullptr)
+    {
+        void *_next = *(void **)_chunk;
+        GC_free(_chunk);
+        _chunk = _next;
+    }
+    _gc_region = _r->_prev;
+}
+
+/*
+ * Raw (de)allocation, consulting the current region.
+ */
+GC_INLINE void *_gc_malloc(size_t _size)
+{
+    _GCRegion *_r = _gc_region;
+    if (__builtin_expect(_r != nullptr, false))
+        return _gc_region_malloc(_r, _size);
+    return GC_malloc(_size);
+}
+GC_INLINE void *_gc_malloc_atomic(size_t _size)
+{
+    _GCRegion *_r = _gc_region;
+    if (__builtin_expect(_r != nullptr, false))
+        return _gc_region_malloc(_r, _size);
+    return GC_malloc_atomic(_size);
+}
+GC_INLINE void *_gc_malloc_small(size_t _size)
+{
+    _GCRegion *_r = _gc_region;
+    if (__builtin_expect(_r != nullptr, false))
+        return _gc_region_malloc(_r, _size);
+    if (_size <= GC_SLAB_MAX)
+        return _gc_slab_malloc(_size);
+    return GC_malloc(_size);
+}
+GC_INLINE void _gc_free(void *_ptr)
+{
+    if (__builtin_expect(_gc_region != nullptr, false))
+        return;
+    GC_free(_ptr);
+}
+GC_INLINE void _gc_free_small(void *_ptr, size_t _size)
+{
+    if (__builtin_expect(_gc_region != nullptr, false))
+        return;
+    if (_size <= GC_SLAB_MAX)
+        _gc_slab_free(_ptr, _size);
+    else
+        GC_free(_ptr);
+}
+
+#ifndef LIBF_GC_RC
+
+#define GC_HEADER_SIZE      0
+
 /*
  * GC memory (de)allocation.
  */
 GC_INLINE void *gc_malloc(size_t _size)
 {
-    return GC_malloc(_size);
+    return _gc_malloc(_size);
 }
 GC_INLINE void *gc_malloc_atomic(size_t _size)
 {
-    return GC_malloc_atomic(_size);
+    return _gc_malloc_atomic(_size);
 }
 GC_INLINE void gc_free(void *_ptr)
 {
-    GC_free(_ptr);
+    _gc_free(_ptr);
+}
+
+/*
+ * Fixed-size node (de)allocation.  _size should be a compile-time constant.
+ */
+GC_INLINE void *gc_malloc_node(size_t _size)
+{
+    return _gc_malloc_small(_size);
+}
+GC_INLINE void gc_free_node(void *_ptr, size_t _size)
+{
+    _gc_free_small(_ptr, _size);
+}
+
+/*
+ * Reference counting (no-ops for the tracing backend).
+ */
+GC_INLINE void gc_retain(const void *)
+{
+    // NOP
+}
+GC_INLINE bool gc_release(const void *)
+{
+    return false;
+}
+GC_INLINE size_t gc_refs(const void *)
+{
+    return 1;
+}
+
+#else       /* LIBF_GC_RC */
+
+/*
+ * Reference counting backend (-DLIBF_GC_RC).
+ *
+ * Each object is prefixed by a header holding its reference count.  Nodes
+ * retain their children when constructed, and a structure is freed
+ * node-by-node as soon as the last reference is released.  Objects are
+ * still carved from the GC heap, so the collector remains a backstop for
+ * any object that is never released (e.g. temporaries and boxed elements).
+ */
+struct _GCHeader
+{
+    size_t _refs;
+    size_t _pad;                // Preserve GC_ALIGNMENT.
+};
+
+#define GC_HEADER_SIZE      sizeof(_GCHeader)
+
+GC_INLINE _GCHeader *_gc_header(const void *_ptr)
+{
+    return (_GCHeader *)((const uint8_t *)_ptr - sizeof(_GCHeader));
+}
+
+/*
+ * GC memory (de)allocation.
+ */
+GC_INLINE void *gc_malloc(size_t _size)
+{
+    _GCHeader *_hdr = (_GCHeader *)_gc_malloc(sizeof(_GCHeader) + _size);
+    _hdr->_refs = 0;
+    return (void *)(_hdr + 1);
+}
+GC_INLINE void *gc_malloc_atomic(size_t _size)
+{
+    _GCHeader *_hdr =
+        (_GCHeader *)_gc_malloc_atomic(sizeof(_GCHeader) + _size);
+    _hdr->_refs = 0;
+    return (void *)(_hdr + 1);
+}
+GC_INLINE void gc_free(void *_ptr)
+{
+    _gc_free(_gc_header(_ptr));
+}
+
+/*
+ * Fixed-size node (de)allocation.  _size should be a compile-time constant.
+ */
+GC_INLINE void *gc_malloc_node(size_t _size)
+{
+    _GCHeader *_hdr =
+        (_GCHeader *)_gc_malloc_small(sizeof(_GCHeader) + _size);
+    _hdr->_refs = 0;
+    return (void *)(_hdr + 1);
+}
+GC_INLINE void gc_free_node(void *_ptr, size_t _size)
+{
+    _gc_free_small(_gc_header(_ptr), sizeof(_GCHeader) + _size);
+}
+
+/*
+ * Reference counting.  gc_release() returns true if the last reference was
+ * dropped, in which case the caller is responsible for freeing the object.
+ */
+GC_INLINE void gc_retain(const void *_ptr)
+{
+    __atomic_add_fetch(&_gc_header(_ptr)->_refs, 1, __ATOMIC_RELAXED);
+}
+GC_INLINE bool gc_release(const void *_ptr)
+{
+    return (__atomic_sub_fetch(&_gc_header(_ptr)->_refs, 1,
+        __ATOMIC_ACQ_REL) == 0);
+}
+GC_INLINE size_t gc_refs(const void *_ptr)
+{
+    return __atomic_load_n(&_gc_header(_ptr)->_refs, __ATOMIC_ACQUIRE);
+}
+
+#endif      /* LIBF_GC_RC */
+
+/*
+ * Precise object layouts (-DLIBF_GC_TYPED).
+ *
+ * By default all objects are scanned conservatively.  A type may specialize
+ * _GCLayout<T> with a mask of the words that may hold pointers (bit i for
+ * word i).  With LIBF_GC_TYPED such types are allocated with an explicit GC
+ * descriptor, so the collector never scans their other words.
+ */
+#define GC_LAYOUT_CONSERVATIVE  (~(uint64_t)0)
+#define GC_LAYOUT_WORDS(T)      \
+    ((sizeof(T) + sizeof(GC_word) - 1) / sizeof(GC_word))
+
+template <typename _T>
+struct _GCLayout
+{
+    static const uint64_t _mask = GC_LAYOUT_CONSERVATIVE;
+};
+
+/*
+ * Layout for nodes whose first word is a non-pointer size/length field.
+ */
+template <typename _T>
+struct _GCLayoutSized
+{
+    static const uint64_t _mask =
+        (((uint64_t)1 << GC_LAYOUT_WORDS(_T)) - 1) & ~(uint64_t)1;
+};
+
+/*
+ * Types whose Value<T> representation never holds a pointer.  Note that
+ * `unsigned long' (i.e. Word) is deliberately omitted since it is also used
+ * for type-erased values.
+ */
+template <typename _T>
+struct _GCAtomic
+{
+    static const bool _value = false;
+};
+#define _GC_ATOMIC(T)                                                   \
+    template <>                                                         \
+    struct _GCAtomic<T>                                                 \
+    {                                                                   \
+        static const bool _value = true;                                \
+    }
+_GC_ATOMIC(bool);
+_GC_ATOMIC(char);
+_GC_ATOMIC(signed char);
+_GC_ATOMIC(unsigned char);
+_GC_ATOMIC(short);
+_GC_ATOMIC(unsigned short);
+_GC_ATOMIC(int);
+_GC_ATOMIC(unsigned);
+_GC_ATOMIC(long);
+_GC_ATOMIC(long long);
+_GC_ATOMIC(unsigned long long);
+_GC_ATOMIC(char16_t);
+_GC_ATOMIC(char32_t);
+_GC_ATOMIC(wchar_t);
+_GC_ATOMIC(float);
+_GC_ATOMIC(double);
+#undef _GC_ATOMIC
+
+#ifdef LIBF_GC_TYPED
+template <typename _T>
+struct _GCDescr
+{
+    static inline GC_descr _descr = 0;
+    static inline bool _init = false;
+};
+
+template <typename _T>
+static inline __attribute__ ((__noinline__)) GC_descr _gc_descr_init(void)
+{
+    const size_t _hdr_words = GC_HEADER_SIZE / sizeof(GC_word);
+    GC_word _bitmap[1] =
+        {(GC_word)(_GCLayout<_T>::_mask << _hdr_words)};
+    GC_descr _descr = GC_make_descriptor(_bitmap,
+        _hdr_words + GC_LAYOUT_WORDS(_T));
+    _GCDescr<_T>::_descr = _descr;
+    __atomic_store_n(&_GCDescr<_T>::_init, true, __ATOMIC_RELEASE);
+    return _descr;
+}
+
+template <typename _T>
+GC_INLINE void *_gc_malloc_typed(void)
+{
+    static_assert(GC_HEADER_SIZE / sizeof(GC_word) + GC_LAYOUT_WORDS(_T) <=
+        8 * sizeof(GC_word), "_GCLayout<T> too large");
+    GC_descr _descr = (__atomic_load_n(&_GCDescr<_T>::_init,
+        __ATOMIC_ACQUIRE)? _GCDescr<_T>::_descr: _gc_descr_init<_T>());
+    uint8_t *_ptr = (uint8_t *)GC_malloc_explicitly_typed(
+        GC_HEADER_SIZE + sizeof(_T), _descr);
+#ifdef LIBF_GC_RC
+    ((_GCHeader *)_ptr)->_refs = 0;
+#endif
+    return (void *)(_ptr + GC_HEADER_SIZE);
+}
+#endif      /* LIBF_GC_TYPED */
+
+/*
+ * Allocation statistics (-DLIBF_ALLOC_STATS).
+ *
+ * Allocations are counted per subsystem.  Node types are attributed by
+ * specializing _GCStatKind<T>; fragment allocations are counted at their
+ * allocation sites.  Without LIBF_ALLOC_STATS the counters compile away.
+ */
+enum
+{
+    GC_STAT_OTHER,
+    GC_STAT_TREE,
+    GC_STAT_SEQ,
+    GC_STAT_VECTOR,
+    GC_STAT_STRING,
+    GC_STAT_TUPLE,
+    GC_STAT_LIST,
+    GC_STAT_MAX
+};
+
+struct _GCStat
+{
+    size_t _allocs;
+    size_t _bytes;
+    size_t _frees;
+    size_t _freed_bytes;
+};
+
+#ifdef LIBF_ALLOC_STATS
+inline _GCStat _gc_stats[GC_STAT_MAX];
+#endif      /* LIBF_ALLOC_STATS */
+
+template <typename _T>
+struct _GCStatKind
+{
+    static const unsigned _kind = GC_STAT_OTHER;
+};
+
+GC_INLINE void gc_stat_alloc(unsigned _kind, size_t _size)
+{
+#ifdef LIBF_ALLOC_STATS
+    __atomic_add_fetch(&_gc_stats[_kind]._allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&_gc_stats[_kind]._bytes, _size, __ATOMIC_RELAXED);
+#else
+    (void)_kind;
+    (void)_size;
+#endif
+}
+GC_INLINE void gc_stat_free(unsigned _kind, size_t _size)
+{
+#ifdef LIBF_ALLOC_STATS
+    __atomic_add_fetch(&_gc_stats[_kind]._frees, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&_gc_stats[_kind]._freed_bytes, _size,
+        __ATOMIC_RELAXED);
+#else
+    (void)_kind;
+    (void)_size;
+#endif
+}
+
+/*
+ * Allocate/free a node of type T.
+ */
+template <typename _T>
+GC_INLINE void *gc_malloc_node(void)
+{
+    gc_stat_alloc(_GCStatKind<_T>::_kind, sizeof(_T));
+#ifdef LIBF_GC_TYPED
+    if (_GCLayout<_T>::_mask == 0)
+        return gc_malloc_atomic(sizeof(_T));
+    if (_GCLayout<_T>::_mask != GC_LAYOUT_CONSERVATIVE &&
+            _gc_region == nullptr)
+        return _gc_malloc_typed<_T>();
+#endif
+    return gc_malloc_node(sizeof(_T));
+}
+template <typename _T>
+GC_INLINE void gc_free_node(void *_ptr)
+{
+    gc_stat_free(_GCStatKind<_T>::_kind, sizeof(_T));
+#ifdef LIBF_GC_TYPED
+    if (_GCLayout<_T>::_mask != GC_LAYOUT_CONSERVATIVE)
+    {
+        gc_free(_ptr);
+        return;
+    }
+#endif
+    gc_free_node(_ptr, sizeof(_T));
 }
 
 }           /* namesLpace F */
@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "fbase.h"
+#include "fgc.h"
+#include "fhamt.h"
+#include "fstring.h"
+
+namespace F
+{
+
+/*
+ * Hash array mapped tries.
+ */
+
+#define error_bad_hamt()    error("data-structure invariant violated")
+
+/*
+ * Interface renaming.
+ */
+typedef _Hamt Hamt;
+typedef _HamtNode HamtNode;
+typedef _HamtCollision HamtCollision;
+typedef _Hash Hash;
+typedef Value<Word> K;
+#define HAMT_EMPTY _hamt_empty()
+
+#define HAMT_BITS           _HAMT_BITS
+#define HAMT_MAX_SHIFT      _HAMT_MAX_SHIFT
+
+enum
+{
+    HAMT_NIL       = _HAMT_NIL,
+    HAMT_NODE      = _HAMT_NODE,
+    HAMT_COLLISION = _HAMT_COLLISION
+};
+
+/*
+ * Node accessors.
+ */
+static inline const void *hamt_ptr(Hamt t)
+{
+    return _hamt_ptr(t);
+}
+static inline size_t hamt_popcount(uint32_t map)
+{
+    return __builtin_popcount(map);
+}
+static inline K *hamt_keys(HamtNode *n)
+{
+    return (K *)_hamt_keys(*n);
+}
+static inline Hamt *hamt_children(HamtNode *n)
+{
+    return (Hamt *)_hamt_children(*n);
+}
+static inline K *hamt_collision_keys(HamtCollision *c)
+{
+    return (K *)_hamt_collision_keys(*c);
+}
+static inline size_t hamt_node_bytes(uint32_t datamap, uint32_t nodemap)
+{
+    return sizeof(HamtNode) +
+        (hamt_popcount(datamap) + hamt_popcount(nodemap)) * sizeof(Word);
+}
+static inline size_t hamt_collision_bytes(size_t size)
+{
+    return sizeof(HamtCollision) + size * sizeof(K);
+}
+
+/*
+ * Reference counting (only enabled for the LIBF_GC_RC backend).  Each node
+ * holds a reference to its sub-tries.
+ */
+static inline void hamt_retain(Hamt t)
+{
+#ifdef LIBF_GC_RC
+    if (index(t) != HAMT_NIL)
+        gc_retain(hamt_ptr(t));
+#else
+    (void)t;
+#endif
+}
+static inline void hamt_unref(Hamt t)
+{
+#ifdef LIBF_GC_RC
+    if (index(t) != HAMT_NIL && gc_release(hamt_ptr(t)))
+        _hamt_free(t);
+#else
+    (void)t;
+#endif
+}
+
+/*
+ * Node allocation.  Nodes are variable-sized, so they are allocated (and
+ * attributed) by size rather than by type.
+ */
+static HamtNode *hamt_node_alloc(size_t size, uint32_t datamap,
+    uint32_t nodemap)
+{
+    size_t bytes = hamt_node_bytes(datamap, nodemap);
+    gc_stat_alloc(GC_STAT_TREE, bytes);
+    HamtNode *n = (HamtNode *)gc_malloc_node(bytes);
+    n->size = size;
+    n->datamap = datamap;
+    n->nodemap = nodemap;
+    return n;
+}
+static HamtCollision *hamt_collision_alloc(size_t size)
+{
+    size_t bytes = hamt_collision_bytes(size);
+    gc_stat_alloc(GC_STAT_TREE, bytes);
+    HamtCollision *c = (HamtCollision *)gc_malloc_node(bytes);
+    c->size = size;
+    return c;
+}
+
+/*
+ * Finish a node whose sub-tries have been filled in.
+ */
+static Hamt hamt_node(HamtNode *n)
+{
+    const Hamt *ts = hamt_children(n);
+    size_t nt = hamt_popcount(n->nodemap);
+    for (size_t i = 0; i < nt; i++)
+        hamt_retain(ts[i]);
+    return _bit_cast<Hamt>((Word)n | HAMT_NODE);
+}
+static Hamt hamt_collision(HamtCollision *c)
+{
+    return _bit_cast<Hamt>((Word)c | HAMT_COLLISION);
+}
+
+/*
+ * Retain/release.
+ */
+extern Hamt _hamt_retain(Hamt t)
+{
+    hamt_retain(t);
+    return t;
+}
+
+extern void _hamt_release(Hamt t)
+{
+#ifdef LIBF_GC_RC
+    if (index(t) == HAMT_NIL)
+        return;
+    if (gc_refs(hamt_ptr(t)) == 0)
+        error("release of a value that was not retained");
+    hamt_unref(t);
+#else
+    (void)t;
+#endif
+}
+
+extern void _hamt_free(Hamt t)
+{
+    switch (index(t))
+    {
+        case HAMT_NODE:
+        {
+            const HamtNode &n = t;
+            const Hamt *ts = _hamt_children(n);
+            size_t nt = hamt_popcount(n.nodemap);
+            for (size_t i = 0; i < nt; i++)
+                hamt_unref(ts[i]);
+            size_t bytes = hamt_node_bytes(n.datamap, n.nodemap);
+            gc_stat_free(GC_STAT_TREE, bytes);
+            gc_free_node((void *)&n, bytes);
+            break;
+        }
+        case HAMT_COLLISION:
+        {
+            const HamtCollision &c = t;
+            size_t bytes = hamt_collision_bytes(c.size);
+            gc_stat_free(GC_STAT_TREE, bytes);
+            gc_free_node((void *)&c, bytes);
+            break;
+        }
+        default:
+            error_bad_hamt();
+    }
+}
+
+/*
+ * Constructors.
+ */
+extern Hamt _hamt_singleton(K k, uint64_t h)
+{
+    HamtNode *n = hamt_node_alloc(1, _hamt_bit(h, 0), 0);
+    hamt_keys(n)[0] = k;
+    return hamt_node(n);
+}
+
+/*
+ * Build the sub-trie (at the given shift) for two keys with distinct slots
+ * at the previous level.
+ */
+extern Hamt _hamt_pair(K k0, uint64_t h0, K k1, uint64_t h1, size_t shift)
+{
+    if (shift >= HAMT_MAX_SHIFT)
+    {
+        HamtCollision *c = hamt_collision_alloc(2);
+        K *ks = hamt_collision_keys(c);
+        ks[0] = k0;
+        ks[1] = k1;
+        return hamt_collision(c);
+    }
+    uint32_t bit0 = _hamt_bit(h0, shift), bit1 = _hamt_bit(h1, shift);
+    if (bit0 == bit1)
+    {
+        Hamt t = _hamt_pair(k0, h0, k1, h1, shift + HAMT_BITS);
+        HamtNode *n = hamt_node_alloc(2, 0, bit0);
+        hamt_children(n)[0] = t;
+        return hamt_node(n);
+    }
+    HamtNode *n = hamt_node_alloc(2, bit0 | bit1, 0);
+    K *ks = hamt_keys(n);
+    ks[bit0 < bit1? 0: 1] = k0;
+    ks[bit0 < bit1? 1: 0] = k1;
+    return hamt_node(n);
+}
+
+/*
+ * Path copying.  Copy a node with new bitmaps, where slot bit (if present
+ * in the new bitmaps) holds *k or *t (if non-NULL), and every other slot is
+ * as in the original node.
+ */
+extern Hamt _hamt_node_update(const HamtNode &n, size_t size, uint32_t bit,
+    uint32_t datamap, uint32_t nodemap, const K *k, const Hamt *t)
+{
+    HamtNode *m = hamt_node_alloc(size, datamap, nodemap);
+    const K *ks0 = _hamt_keys(n);
+    const Hamt *ts0 = _hamt_children(n);
+    K *ks = hamt_keys(m);
+    Hamt *ts = hamt_children(m);
+    for (uint32_t map = datamap; map != 0; map &= map - 1)
+    {
+        uint32_t b = map & -map;
+        *ks++ = (b == bit && k != nullptr? *k:
+            ks0[_hamt_index(n.datamap, b)]);
+    }
+    for (uint32_t map = nodemap; map != 0; map &= map - 1)
+    {
+        uint32_t b = map & -map;
+        *ts++ = (b == bit && t != nullptr? *t:
+            ts0[_hamt_index(n.nodemap, b)]);
+    }
+    return hamt_node(m);
+}
+
+/*
+ * Copy a collision node with entry i replaced by *k, or appended if i is
+ * the size, or erased if k is NULL.
+ */
+extern Hamt _hamt_collision_update(const HamtCollision &c, size_t i,
+    const K *k)
+{
+    size_t size = (k == nullptr? c.size - 1: i == c.size? c.size + 1: c.size);
+    HamtCollision *d = hamt_collision_alloc(size);
+    const K *ks0 = _hamt_collision_keys(c);
+    K *ks = hamt_collision_keys(d);
+    for (size_t j = 0; j < c.size; j++)
+    {
+        if (j != i)
+            *ks++ = ks0[j];
+        else if (k != nullptr)
+            *ks++ = *k;
+    }
+    if (i == c.size)
+        *ks = *k;
+    return hamt_collision(d);
+}
+
+/*
+ * Map.  The function must preserve the key (and hence the hash) of each
+ * entry, so the trie keeps its shape.
+ */
+extern PURE Hamt _hamt_map(Hamt t, K (*f)(void *, K), void *data)
+{
+    switch (index(t))
+    {
+        case HAMT_NIL:
+            return t;
+        case HAMT_NODE:
+        {
+            const HamtNode &n = t;
+            HamtNode *m = hamt_node_alloc(n.size, n.datamap, n.nodemap);
+            const K *ks0 = _hamt_keys(n);
+            const Hamt *ts0 = _hamt_children(n);
+            K *ks = hamt_keys(m);
+            Hamt *ts = hamt_children(m);
+            size_t nk = hamt_popcount(n.datamap);
+            for (size_t i = 0; i < nk; i++)
+                ks[i] = f(data, ks0[i]);
+            size_t nt = hamt_popcount(n.nodemap);
+            for (size_t i = 0; i < nt; i++)
+                ts[i] = _hamt_map(ts0[i], f, data);
+            return hamt_node(m);
+        }
+        case HAMT_COLLISION:
+        {
+            const HamtCollision &c = t;
+            HamtCollision *d = hamt_collision_alloc(c.size);
+            const K *ks0 = _hamt_collision_keys(c);
+            K *ks = hamt_collision_keys(d);
+            for (size_t i = 0; i < c.size; i++)
+                ks[i] = f(data, ks0[i]);
+            return hamt_collision(d);
+        }
+        default:
+            error_bad_hamt();
+    }
+}
+
+/*
+ * Verify.  Each entry must be in the slots selected by its hash, sizes must
+ * be correct, and sub-tries must hold at least two entries.
+ */
+static bool hamt_verify_2(Hamt t, size_t shift, uint64_t prefix, Hash hash)
+{
+    uint64_t mask = (shift >= HAMT_MAX_SHIFT? ~(uint64_t)0:
+        ((uint64_t)1 << shift) - 1);
+    switch (index(t))
+    {
+        case HAMT_NODE:
+        {
+            const HamtNode &n = t;
+            if (shift >= HAMT_MAX_SHIFT || (n.datamap & n.nodemap) != 0)
+                return false;
+            const K *ks = _hamt_keys(n);
+            const Hamt *ts = _hamt_children(n);
+            size_t size = 0;
+            for (uint32_t map = n.datamap; map != 0; map &= map - 1)
+            {
+                uint32_t b = map & -map;
+                uint64_t h = hash(*ks++);
+                if ((h & mask) != prefix || _hamt_bit(h, shift) != b)
+                    return false;
+                size++;
+            }
+            for (uint32_t map = n.nodemap; map != 0; map &= map - 1)
+            {
+                uint32_t b = map & -map;
+                Hamt u = *ts++;
+                uint64_t prefix1 = prefix |
+                    ((uint64_t)__builtin_ctz(b) << shift);
+                if (_hamt_size(u) < 2 ||
+                        !hamt_verify_2(u, shift + HAMT_BITS, prefix1, hash))
+                    return false;
+                size += _hamt_size(u);
+            }
+            return (size == n.size);
+        }
+        case HAMT_COLLISION:
+        {
+            const HamtCollision &c = t;
+            if (shift < HAMT_MAX_SHIFT || c.size < 2)
+                return false;
+            const K *ks = _hamt_collision_keys(c);
+            for (size_t i = 0; i < c.size; i++)
+            {
+                if (hash(ks[i]) != prefix)
+                    return false;
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+extern PURE bool _hamt_verify(Hamt t, Hash hash)
+{
+    if (index(t) == HAMT_NIL)
+        return true;
+    return (index(t) == HAMT_NODE && hamt_verify_2(t, 0, 0, hash));
+}
+
+/*
+ * Show.
+ */
+static String hamt_show_2(Hamt t, String r, bool *first, String (*f)(K))
+{
+    const K *ks;
+    size_t nk;
+    switch (index(t))
+    {
+        case HAMT_NIL:
+            return r;
+        case HAMT_NODE:
+        {
+            const HamtNode &n = t;
+            ks = _hamt_keys(n);
+            nk = hamt_popcount(n.datamap);
+            break;
+        }
+        case HAMT_COLLISION:
+        {
+            const HamtCollision &c = t;
+            ks = _hamt_collision_keys(c);
+            nk = c.size;
+            break;
+        }
+        default:
+            error_bad_hamt();
+    }
+    for (size_t i = 0; i < nk; i++)
+    {
+        if (!*first)
+            r = append(r, ',');
+        *first = false;
+        r = append(r, f(ks[i]));
+    }
+    if (index(t) == HAMT_NODE)
+    {
+        const HamtNode &n = t;
+        const Hamt *ts = _hamt_children(n);
+        size_t nt = hamt_popcount(n.nodemap);
+        for (size_t i = 0; i < nt; i++)
+            r = hamt_show_2(ts[i], r, first, f);
+    }
+    return r;
+}
+
+extern PURE String _hamt_show(Hamt t, String (*f)(K))
+{
+    bool first = true;
+    String r = string('{');
+    r = hamt_show_2(t, r, &first, f);
+    r = append(r, '}');
+    return r;
+}
+
+}
+
@@ -0,0 +1,472 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FHAMT_H
+#define _FHAMT_H
+
+/*
+ * Hash array mapped tries (HAMTs) for HashMap and HashSet.  Entries are
+ * type-erased as for trees (see ftree.h).  The search/insert/delete kernels
+ * are templates over the hash and equality functions, so that they are
+ * inlined into client code.  Node construction is out-of-line (see
+ * fhamt.cpp).
+ */
+
+#include <cstdint>
+
+#include "fbase.h"
+#include "fgc.h"
+#include "fvalue.h"
+
+#include "fstring_defs.h"
+
+namespace F
+{
+
+/*
+ * HAMT object.
+ */
+struct _HamtNil
+{
+    // Empty
+};
+struct _HamtNode;
+struct _HamtCollision;
+typedef Union<_HamtNil, _HamtNode, _HamtCollision> _Hamt;
+
+typedef uint64_t (*_Hash)(Value<Word> _k);
+typedef bool (*_Equal)(Value<Word> _a, Value<Word> _b);
+
+/*
+ * Each level of the trie consumes _HAMT_BITS bits of the 64-bit key hash,
+ * starting from the least significant bits.  Keys with equal hashes share a
+ * collision node below the last level.
+ */
+#define _HAMT_BITS          5
+#define _HAMT_MASK          ((1u << _HAMT_BITS) - 1)
+#define _HAMT_MAX_SHIFT     64
+
+/*
+ * Bitmap node.  Bit i of datamap (resp. nodemap) is set if slot i holds an
+ * entry (resp. a sub-trie).  The node is followed by its entries and then
+ * its sub-tries, each in slot order.  The size field is the number of
+ * entries in the trie.  Sub-tries always hold at least two entries, so the
+ * shape of a trie depends only on its keys.
+ */
+struct _HamtNode
+{
+    size_t size;
+    uint32_t datamap;
+    uint32_t nodemap;
+};
+
+/*
+ * Collision node, followed by its size (at least two) entries, all with the
+ * same hash.
+ */
+struct _HamtCollision
+{
+    size_t size;
+};
+
+/*
+ * HAMT node types.
+ */
+enum
+{
+    _HAMT_NIL       = _Hamt::index<_HamtNil>(),
+    _HAMT_NODE      = _Hamt::index<_HamtNode>(),
+    _HAMT_COLLISION = _Hamt::index<_HamtCollision>()
+};
+
+inline PURE _Hamt _hamt_empty(void)
+{
+    return (_HamtNil){};
+}
+inline PURE bool _hamt_is_empty(_Hamt _t)
+{
+    return (index(_t) == _HAMT_NIL);
+}
+
+inline const void *_hamt_ptr(_Hamt _t)
+{
+    return (const void *)(_bit_cast<Word>(_t) & ~(Word)_UNION_TAG_MASK);
+}
+
+inline const Value<Word> *_hamt_keys(const _HamtNode &_n)
+{
+    return (const Value<Word> *)(&_n + 1);
+}
+inline const _Hamt *_hamt_children(const _HamtNode &_n)
+{
+    return (const _Hamt *)(_hamt_keys(_n) + __builtin_popcount(_n.datamap));
+}
+inline const Value<Word> *_hamt_collision_keys(const _HamtCollision &_c)
+{
+    return (const Value<Word> *)(&_c + 1);
+}
+
+inline PURE size_t _hamt_size(_Hamt _t)
+{
+    switch (index(_t))
+    {
+        case _HAMT_NODE:
+        {
+            const _HamtNode &_n = _t;
+            return _n.size;
+        }
+        case _HAMT_COLLISION:
+        {
+            const _HamtCollision &_c = _t;
+            return _c.size;
+        }
+        default:
+            return 0;
+    }
+}
+
+/*
+ * The slot bit for a hash, and the index of a slot among the set bits of a
+ * bitmap.
+ */
+inline uint32_t _hamt_bit(uint64_t _h, size_t _shift)
+{
+    return (uint32_t)1 << ((_h >> _shift) & _HAMT_MASK);
+}
+inline size_t _hamt_index(uint32_t _map, uint32_t _bit)
+{
+    return __builtin_popcount(_map & (_bit - 1));
+}
+
+/*
+ * Reference counting (only enabled for the LIBF_GC_RC backend).  Each node
+ * holds a reference to its sub-tries.
+ */
+extern void _hamt_free(_Hamt _t);
+
+/*
+ * Free a temporary node that was consumed without being linked in.
+ */
+inline void _hamt_drop(_Hamt _t)
+{
+#ifdef LIBF_GC_RC
+    if (index(_t) != _HAMT_NIL && gc_refs(_hamt_ptr(_t)) == 0)
+        _hamt_free(_t);
+#else
+    (void)_t;
+#endif
+}
+
+/*
+ * Node construction (hash and equality independent, see fhamt.cpp).
+ */
+extern _Hamt _hamt_singleton(Value<Word> _k, uint64_t _h);
+extern _Hamt _hamt_pair(Value<Word> _k0, uint64_t _h0, Value<Word> _k1,
+    uint64_t _h1, size_t _shift);
+extern _Hamt _hamt_node_update(const _HamtNode &_n, size_t _size,
+    uint32_t _bit, uint32_t _datamap, uint32_t _nodemap,
+    const Value<Word> *_k, const _Hamt *_t);
+extern _Hamt _hamt_collision_update(const _HamtCollision &_c, size_t _i,
+    const Value<Word> *_k);
+
+extern _Hamt _hamt_retain(_Hamt _t);
+extern void _hamt_release(_Hamt _t);
+extern PURE _Hamt _hamt_map(_Hamt _t,
+    Value<Word> (*_func)(void *, Value<Word>), void *_data);
+extern PURE bool _hamt_verify(_Hamt _t, _Hash _hash);
+extern PURE String _hamt_show(_Hamt _t, String (*_f)(Value<Word>));
+
+/*
+ * Search.
+ */
+template <typename _Eq>
+inline PURE const Value<Word> *_hamt_search_k(_Hamt _t, Value<Word> _k,
+    uint64_t _h, _Eq _equal)
+{
+    size_t _shift = 0;
+    while (true)
+    {
+        switch (index(_t))
+        {
+            case _HAMT_NIL:
+                return nullptr;
+            case _HAMT_NODE:
+            {
+                const _HamtNode &_n = _t;
+                uint32_t _bit = _hamt_bit(_h, _shift);
+                if ((_n.datamap & _bit) != 0)
+                {
+                    const Value<Word> *_e =
+                        _hamt_keys(_n) + _hamt_index(_n.datamap, _bit);
+                    return (_equal(_k, *_e)? _e: nullptr);
+                }
+                if ((_n.nodemap & _bit) == 0)
+                    return nullptr;
+                _t = _hamt_children(_n)[_hamt_index(_n.nodemap, _bit)];
+                _shift += _HAMT_BITS;
+                continue;
+            }
+            case _HAMT_COLLISION:
+            {
+                const _HamtCollision &_c = _t;
+                const Value<Word> *_ks = _hamt_collision_keys(_c);
+                for (size_t _i = 0; _i < _c.size; _i++)
+                {
+                    if (_equal(_k, _ks[_i]))
+                        return _ks + _i;
+                }
+                return nullptr;
+            }
+            default:
+                error("data-structure invariant violated");
+        }
+    }
+}
+
+/*
+ * Insert.  An entry with an equal key is replaced.
+ */
+template <typename _Hsh, typename _Eq>
+_Hamt _hamt_insert_2_k(_Hamt _t, Value<Word> _k, uint64_t _h, size_t _shift,
+    _Hsh _hash, _Eq _equal)
+{
+    switch (index(_t))
+    {
+        case _HAMT_NODE:
+        {
+            const _HamtNode &_n = _t;
+            uint32_t _bit = _hamt_bit(_h, _shift);
+            if ((_n.datamap & _bit) != 0)
+            {
+                const Value<Word> &_k0 =
+                    _hamt_keys(_n)[_hamt_index(_n.datamap, _bit)];
+                if (_equal(_k, _k0))
+                    return _hamt_node_update(_n, _n.size, _bit, _n.datamap,
+                        _n.nodemap, &_k, nullptr);
+                _Hamt _nt = _hamt_pair(_k0, _hash(_k0), _k, _h,
+                    _shift + _HAMT_BITS);
+                return _hamt_node_update(_n, _n.size + 1, _bit,
+                    _n.datamap & ~_bit, _n.nodemap | _bit, nullptr, &_nt);
+            }
+            if ((_n.nodemap & _bit) != 0)
+            {
+                _Hamt _t0 = _hamt_children(_n)[_hamt_index(_n.nodemap, _bit)];
+                _Hamt _nt = _hamt_insert_2_k(_t0, _k, _h, _shift + _HAMT_BITS,
+                    _hash, _equal);
+                size_t _size = _n.size - _hamt_size(_t0) + _hamt_size(_nt);
+                return _hamt_node_update(_n, _size, _bit, _n.datamap,
+                    _n.nodemap, nullptr, &_nt);
+            }
+            return _hamt_node_update(_n, _n.size + 1, _bit,
+                _n.datamap | _bit, _n.nodemap, &_k, nullptr);
+        }
+        case _HAMT_COLLISION:
+        {
+            const _HamtCollision &_c = _t;
+            const Value<Word> *_ks = _hamt_collision_keys(_c);
+            size_t _i = 0;
+            while (_i < _c.size && !_equal(_k, _ks[_i]))
+                _i++;
+            return _hamt_collision_update(_c, _i, &_k);
+        }
+        default:
+            error("data-structure invariant violated");
+    }
+}
+
+template <typename _Hsh, typename _Eq>
+inline PURE _Hamt _hamt_insert_k(_Hamt _t, Value<Word> _k, uint64_t _h,
+    _Hsh _hash, _Eq _equal)
+{
+    if (index(_t) == _HAMT_NIL)
+        return _hamt_singleton(_k, _h);
+    return _hamt_insert_2_k(_t, _k, _h, 0, _hash, _equal);
+}
+
+/*
+ * Delete.  The trie is returned as-is if it has no entry with the key.  A
+ * sub-trie that is reduced to a single entry is replaced by that entry.
+ */
+template <typename _Eq>
+_Hamt _hamt_delete_2_k(_Hamt _t, Value<Word> _k, uint64_t _h, size_t _shift,
+    _Eq _equal)
+{
+    switch (index(_t))
+    {
+        case _HAMT_NIL:
+            return _t;
+        case _HAMT_NODE:
+        {
+            const _HamtNode &_n = _t;
+            uint32_t _bit = _hamt_bit(_h, _shift);
+            if ((_n.datamap & _bit) != 0)
+            {
+                const Value<Word> &_k0 =
+                    _hamt_keys(_n)[_hamt_index(_n.datamap, _bit)];
+                if (!_equal(_k, _k0))
+                    return _t;
+                if (_n.size == 1)
+                    return _hamt_empty();
+                return _hamt_node_update(_n, _n.size - 1, _bit,
+                    _n.datamap & ~_bit, _n.nodemap, nullptr, nullptr);
+            }
+            if ((_n.nodemap & _bit) == 0)
+                return _t;
+            _Hamt _t0 = _hamt_children(_n)[_hamt_index(_n.nodemap, _bit)];
+            _Hamt _nt = _hamt_delete_2_k(_t0, _k, _h, _shift + _HAMT_BITS,
+                _equal);
+            if (_nt == _t0)
+                return _t;
+            if (_hamt_size(_nt) == 1)
+            {
+                Value<Word> _k1;
+                if (index(_nt) == _HAMT_NODE)
+                {
+                    const _HamtNode &_n1 = _nt;
+                    _k1 = _hamt_keys(_n1)[0];
+                }
+                else
+                {
+                    const _HamtCollision &_c1 = _nt;
+                    _k1 = _hamt_collision_keys(_c1)[0];
+                }
+                _Hamt _r = _hamt_node_update(_n, _n.size - 1, _bit,
+                    _n.datamap | _bit, _n.nodemap & ~_bit, &_k1, nullptr);
+                _hamt_drop(_nt);
+                return _r;
+            }
+            return _hamt_node_update(_n, _n.size - 1, _bit, _n.datamap,
+                _n.nodemap, nullptr, &_nt);
+        }
+        case _HAMT_COLLISION:
+        {
+            const _HamtCollision &_c = _t;
+            const Value<Word> *_ks = _hamt_collision_keys(_c);
+            for (size_t _i = 0; _i < _c.size; _i++)
+            {
+                if (_equal(_k, _ks[_i]))
+                    return _hamt_collision_update(_c, _i, nullptr);
+            }
+            return _t;
+        }
+        default:
+            error("data-structure invariant violated");
+    }
+}
+
+template <typename _Eq>
+inline PURE _Hamt _hamt_delete_k(_Hamt _t, Value<Word> _k, uint64_t _h,
+    _Eq _equal)
+{
+    return _hamt_delete_2_k(_t, _k, _h, 0, _equal);
+}
+
+/*
+ * Traversal (in trie order).
+ */
+template <typename _F>
+inline void _hamt_for_each_k(_Hamt _t, _F &_func)
+{
+    switch (index(_t))
+    {
+        case _HAMT_NIL:
+            return;
+        case _HAMT_NODE:
+        {
+            const _HamtNode &_n = _t;
+            const Value<Word> *_ks = _hamt_keys(_n);
+            size_t _nk = __builtin_popcount(_n.datamap);
+            for (size_t _i = 0; _i < _nk; _i++)
+                _func(_ks[_i]);
+            const _Hamt *_ts = _hamt_children(_n);
+            size_t _nt = __builtin_popcount(_n.nodemap);
+            for (size_t _i = 0; _i < _nt; _i++)
+                _hamt_for_each_k(_ts[_i], _func);
+            return;
+        }
+        case _HAMT_COLLISION:
+        {
+            const _HamtCollision &_c = _t;
+            const Value<Word> *_ks = _hamt_collision_keys(_c);
+            for (size_t _i = 0; _i < _c.size; _i++)
+                _func(_ks[_i]);
+            return;
+        }
+        default:
+            error("data-structure invariant violated");
+    }
+}
+
+/*
+ * Kernel selection.  Hashed containers call these with their hash and
+ * equality functions as template arguments, which inlines them into the
+ * kernels.
+ */
+template <_Hash _hash>
+struct _HamtHash
+{
+    uint64_t operator()(Value<Word> _k) const
+    {
+        return _hash(_k);
+    }
+};
+
+template <_Equal _equal>
+struct _HamtEqual
+{
+    bool operator()(Value<Word> _a, Value<Word> _b) const
+    {
+        return _equal(_a, _b);
+    }
+};
+
+template <_Hash _hash, _Equal _equal>
+inline PURE const Value<Word> *_hamt_search(_Hamt _t, Value<Word> _k)
+{
+    return _hamt_search_k(_t, _k, _hash(_k), _HamtEqual<_equal>());
+}
+
+template <_Hash _hash, _Equal _equal>
+inline PURE _Hamt _hamt_insert(_Hamt _t, Value<Word> _k)
+{
+    return _hamt_insert_k(_t, _k, _hash(_k), _HamtHash<_hash>(),
+        _HamtEqual<_equal>());
+}
+
+template <_Hash _hash, _Equal _equal>
+inline PURE _Hamt _hamt_delete(_Hamt _t, Value<Word> _k)
+{
+    return _hamt_delete_k(_t, _k, _hash(_k), _HamtEqual<_equal>());
+}
+
+}           /* namespace F */
+
+#include "fstring.h"
+
+#endif      /* _FHAMT_H */
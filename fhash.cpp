@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "fhash.h"
+#include "fvalue.h"
+
+namespace F
+{
+
+/*
+ * 64-bit finalizer (from MurmurHash3).  Every input bit affects the low
+ * bits, which select the slots of the first trie levels.
+ */
+static inline uint64_t hash_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+extern PURE uint64_t hash(const void *x)
+{
+    return hash_mix((uint64_t)(uintptr_t)x);
+}
+
+extern PURE uint64_t hash(bool x)
+{
+    return hash_mix((uint64_t)x);
+}
+
+extern PURE uint64_t hash(signed char x)
+{
+    return hash_mix((uint64_t)x);
+}
+
+extern PURE uint64_t hash(unsigned char x)
+{
+    return hash_mix((uint64_t)x);
+}
+
+extern PURE uint64_t hash(short x)
+{
+    return hash_mix((uint64_t)x);
+}
+
+extern PURE uint64_t hash(unsigned short x)
+{
+    return hash_mix((uint64_t)x);
+}
+
+extern PURE uint64_t hash(int x)
+{
+    return hash_mix((uint64_t)x);
+}
+
+extern PURE uint64_t hash(unsigned x)
+{
+    return hash_mix((uint64_t)x);
+}
+
+extern PURE uint64_t hash(long int x)
+{
+    return hash_mix((uint64_t)x);
+}
+
+extern PURE uint64_t hash(unsigned long int x)
+{
+    return hash_mix((uint64_t)x);
+}
+
+extern PURE uint64_t hash(long long int x)
+{
+    return hash_mix((uint64_t)x);
+}
+
+extern PURE uint64_t hash(unsigned long long int x)
+{
+    return hash_mix((uint64_t)x);
+}
+
+/*
+ * Floats are hashed by representation, consistent with compare() (which
+ * distinguishes -0.0 from 0.0, and equates NaNs with the same bits).
+ */
+extern PURE uint64_t hash(float x)
+{
+    return hash_mix((uint64_t)_bit_cast<uint32_t>(x));
+}
+
+extern PURE uint64_t hash(double x)
+{
+    return hash_mix(_bit_cast<uint64_t>(x));
+}
+
+}
+
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FHASH_H
+#define _FHASH_H
+
+#include <cstdint>
+
+#include "fbase.h"
+
+namespace F
+{
+
+/*
+ * Hash functions, used by HashMap and HashSet.  A type T can be used as a
+ * hashed key if it has both compare() and hash() overloads, such that
+ * compare(x, y) == 0 implies hash(x) == hash(y).
+ */
+
+/**
+ * Hash pointers.
+ */
+extern PURE uint64_t hash(const void *_x);
+
+/**
+ * Hash Booleans.
+ */
+extern PURE uint64_t hash(bool _x);
+
+/**
+ * Hash signed characters.
+ */
+extern PURE uint64_t hash(signed char _x);
+
+/**
+ * Hash unsigned characters.
+ */
+extern PURE uint64_t hash(unsigned char _x);
+
+/**
+ * Hash signed short integers.
+ */
+extern PURE uint64_t hash(short _x);
+
+/**
+ * Hash unsigned short integers.
+ */
+extern PURE uint64_t hash(unsigned short _x);
+
+/**
+ * Hash signed integers.
+ */
+extern PURE uint64_t hash(int _x);
+
+/**
+ * Hash unsigned integers.
+ */
+extern PURE uint64_t hash(unsigned _x);
+
+/**
+ * Hash signed long integers.
+ */
+extern PURE uint64_t hash(long int _x);
+
+/**
+ * Hash unsigned long integers.
+ */
+extern PURE uint64_t hash(unsigned long int _x);
+
+/**
+ * Hash signed long long integers.
+ */
+extern PURE uint64_t hash(long long int _x);
+
+/**
+ * Hash unsigned long long integers.
+ */
+extern PURE uint64_t hash(unsigned long long int _x);
+
+/**
+ * Hash floats.
+ */
+extern PURE uint64_t hash(float _x);
+
+/**
+ * Hash doubles.
+ */
+extern PURE uint64_t hash(double _x);
+
+/*
+ * Combine the hash of a component into the hash of a compound value.
+ */
+inline PURE uint64_t _hash_combine(uint64_t _h, uint64_t _g)
+{
+    return _h ^ (_g + 0x9E3779B97F4A7C15ull + (_h << 6) + (_h >> 2));
+}
+
+}               /* namespace F */
+
+#endif          /* _FHASH_H */
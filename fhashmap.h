@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FHASHMAP_H
+#define _FHASHMAP_H
+
+#include "fbase.h"
+#include "fcompare.h"
+#include "fhamt.h"
+#include "fhash.h"
+#include "fmap.h"
+
+#include "fhashmap_defs.h"
+#include "flist_defs.h"
+#include "fstring_defs.h"
+#include "ftuple_defs.h"
+
+namespace F
+{
+
+/*
+ * Entries are represented as for Map (see fmap.h).  Keys are hashed with
+ * hash() and are equal if compare() returns 0.
+ */
+template <typename _K, typename _V>
+uint64_t _hashmap_hash_wrapper(Value<Word> _k)
+{
+    Tuple<_K, _V> _a = _map_entry_ref<_K, _V>(_k);
+    return hash(first(_a));
+}
+
+template <typename _K, typename _V>
+bool _hashmap_equal_wrapper(Value<Word> _k1, Value<Word> _k2)
+{
+    Tuple<_K, _V> _a = _map_entry_ref<_K, _V>(_k1);
+    Tuple<_K, _V> _b = _map_entry_ref<_K, _V>(_k2);
+    return (compare(first(_a), first(_b)) == 0);
+}
+
+/**
+ * Construct an empty hash map.
+ * O(1).
+ */
+template <typename _K, typename _V>
+inline PURE HashMap<_K, _V> hash_map()
+{
+    HashMap<_K, _V> _m = {_hamt_empty()};
+    return _m;
+}
+
+/**
+ * Test if a hash map is empty.
+ * O(1).
+ */
+template <typename _K, typename _V>
+inline PURE bool empty(HashMap<_K, _V> _m)
+{
+    return _hamt_is_empty(_m._impl);
+}
+
+/**
+ * Insert a key-value pair into a hash map.
+ * O(log32(n)).
+ */
+template <typename _K, typename _V>
+inline PURE HashMap<_K, _V> insert(HashMap<_K, _V> _m, Tuple<_K, _V> _k)
+{
+    HashMap<_K, _V> _m1 = {_hamt_insert<_hashmap_hash_wrapper<_K, _V>,
+        _hashmap_equal_wrapper<_K, _V>>(_m._impl, _map_entry(_k))};
+    return _m1;
+}
+
+/**
+ * Construct a hash map from a list of entries.
+ * O(n * log32(n)).
+ */
+template <typename _K, typename _V>
+inline PURE HashMap<_K, _V> hash_map(List<Tuple<_K, _V>> _xs)
+{
+    HashMap<_K, _V> _m = hash_map<_K, _V>();
+    for (; !empty(_xs); _xs = tail(_xs))
+        _m = insert(_m, head(_xs));
+    return _m;
+}
+
+/**
+ * Find an entry in the hash map.
+ * O(log32(n)).
+ */
+template <typename _K, typename _V>
+inline PURE Optional<Tuple<_K, _V>> find(HashMap<_K, _V> _m, const _K &_k)
+{
+    auto _entry = _hamt_search<_hashmap_hash_wrapper<_K, _V>,
+        _hashmap_equal_wrapper<_K, _V>>(_m._impl, _map_key<_K, _V>(_k));
+    return (_entry != nullptr?
+        Optional<Tuple<_K, _V>>(_map_entry_ref<_K, _V>(*_entry)):
+        Optional<Tuple<_K, _V>>());
+}
+
+/**
+ * Remove an entry from the hash map.
+ * O(log32(n)).
+ */
+template <typename _K, typename _V>
+inline PURE HashMap<_K, _V> erase(HashMap<_K, _V> _m, const _K &_k)
+{
+    HashMap<_K, _V> _m1 = {_hamt_delete<_hashmap_hash_wrapper<_K, _V>,
+        _hashmap_equal_wrapper<_K, _V>>(_m._impl, _map_key<_K, _V>(_k))};
+    return _m1;
+}
+
+/**
+ * Hash map size.
+ * O(1).
+ */
+template <typename _K, typename _V>
+inline PURE size_t size(HashMap<_K, _V> _m)
+{
+    return _hamt_size(_m._impl);
+}
+
+/**
+ * Hash map fold left.  The order of the entries is unspecified.
+ * ([](A a, Tuple<K, V> e) -> A).
+ * O(n).
+ */
+template <typename _K, typename _V, typename _A, typename _F>
+inline PURE _A foldl(HashMap<_K, _V> _m, const _A &_arg, _F _func)
+{
+    _A _a = _arg;
+    auto _visit = [&_a, &_func](const Value<Word> &_k)
+    {
+        _a = _func(_a, _map_entry_ref<_K, _V>(_k));
+    };
+    _hamt_for_each_k(_m._impl, _visit);
+    return _a;
+}
+
+/**
+ * Hash map for each.  Calls func on each entry in an unspecified order.
+ * ([](Tuple<K, V> e)).
+ * O(n).
+ */
+template <typename _K, typename _V, typename _F>
+inline void for_each(HashMap<_K, _V> _m, _F _func)
+{
+    auto _func_1 = [&_func](const Value<Word> &_k)
+    {
+        _func(_map_entry_ref<_K, _V>(_k));
+    };
+    _hamt_for_each_k(_m._impl, _func_1);
+}
+
+/**
+ * Hash map map. ([](Tuple<K, V> e) -> W).
+ * O(n).
+ */
+template <typename _W, typename _K, typename _V, typename _F>
+inline PURE HashMap<_K, _W> map(HashMap<_K, _V> _m, _F _func)
+{
+    Value<Word> (*_func_ptr)(void *, Value<Word>) =
+        [](void *_func_0, Value<Word> _k0) -> Value<Word>
+    {
+        Tuple<_K, _V> _entry = _map_entry_copy<_K, _V>(_k0);
+        _F *_func_1 = (_F *)_func_0;
+        _W _w = (*_func_1)(_entry);
+        Tuple<_K, _W> _new_entry = tuple<_K, _W>(first(_entry), _w);
+        return _map_entry(_new_entry);
+    };
+    HashMap<_K, _W> _m1 = {_hamt_map(_m._impl, _func_ptr, (void *)&_func)};
+    return _m1;
+}
+
+/**
+ * All hash map keys, in an unspecified order.
+ * O(n).
+ */
+template <typename _K, typename _V>
+inline PURE List<_K> keys(HashMap<_K, _V> _m)
+{
+    List<_K> _xs = list<_K>();
+    auto _visit = [&_xs](const Value<Word> &_k)
+    {
+        _xs = list<_K>(first(_map_entry_ref<_K, _V>(_k)), _xs);
+    };
+    _hamt_for_each_k(_m._impl, _visit);
+    return _xs;
+}
+
+/**
+ * All hash map values, in the same order as keys().
+ * O(n).
+ */
+template <typename _K, typename _V>
+inline PURE List<_V> values(HashMap<_K, _V> _m)
+{
+    List<_V> _xs = list<_V>();
+    auto _visit = [&_xs](const Value<Word> &_k)
+    {
+        _xs = list<_V>(second(_map_entry_ref<_K, _V>(_k)), _xs);
+    };
+    _hamt_for_each_k(_m._impl, _visit);
+    return _xs;
+}
+
+/**
+ * Retain a hash map so that it outlives the values it was derived from.
+ * Only meaningful for the reference counting backend (LIBF_GC_RC).
+ * O(1).
+ */
+template <typename _K, typename _V>
+inline HashMap<_K, _V> retain(HashMap<_K, _V> _m)
+{
+    HashMap<_K, _V> _m1 = {_hamt_retain(_m._impl)};
+    return _m1;
+}
+
+/**
+ * Release a hash map.  Nodes that are no longer referenced are freed
+ * immediately by the reference counting backend (LIBF_GC_RC), otherwise
+ * this is a no-op.
+ * Only a value that was passed to retain() may be released; releasing
+ * one that was not is an error.
+ * O(k), where k is the number of nodes freed.
+ */
+template <typename _K, typename _V>
+inline void release(HashMap<_K, _V> _m)
+{
+    _hamt_release(_m._impl);
+}
+
+/**
+ * Hash map verify.
+ * O(n).
+ */
+template <typename _K, typename _V>
+inline PURE bool verify(HashMap<_K, _V> _m)
+{
+    return _hamt_verify(_m._impl, _hashmap_hash_wrapper<_K, _V>);
+}
+
+/**
+ * Hash map show.
+ * O(n).
+ */
+template <typename _K, typename _V>
+inline PURE String show(HashMap<_K, _V> _m)
+{
+    String (*_func_ptr)(Value<Word>) =
+        [] (Value<Word> _k0) -> String
+    {
+        Tuple<_K, _V> _k = _map_entry_ref<_K, _V>(_k0);
+        return append(append(show(first(_k)), "->"), show(second(_k)));
+    };
+    return _hamt_show(_m._impl, _func_ptr);
+}
+
+}           /* namespace F */
+
+#include "flist.h"
+#include "fstring.h"
+#include "ftuple.h"
+
+#endif      /* _FHASHMAP_H */
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FHASHSET_H
+#define _FHASHSET_H
+
+#include "fbase.h"
+#include "fcompare.h"
+#include "fhamt.h"
+#include "fhash.h"
+#include "fshow.h"
+#include "fvalue.h"
+
+#include "fhashset_defs.h"
+#include "flist_defs.h"
+#include "fstring_defs.h"
+
+namespace F
+{
+
+/*
+ * Elements are hashed with hash() and are equal if compare() returns 0.
+ */
+template <typename _T>
+uint64_t _hashset_hash_wrapper(Value<Word> _k)
+{
+    Value<_T> _a0 = _bit_cast<Value<_T>>(_k);
+    const _T &_a = _a0;
+    return hash(_a);
+}
+
+template <typename _T>
+bool _hashset_equal_wrapper(Value<Word> _k1, Value<Word> _k2)
+{
+    Value<_T> _a0 = _bit_cast<Value<_T>>(_k1);
+    Value<_T> _b0 = _bit_cast<Value<_T>>(_k2);
+    const _T &_a = _a0;
+    const _T &_b = _b0;
+    return (compare(_a, _b) == 0);
+}
+
+/**
+ * Construct the empty hash set.
+ * O(1).
+ */
+template <typename _T>
+inline PURE HashSet<_T> hash_set(void)
+{
+    HashSet<_T> _s = {_hamt_empty()};
+    return _s;
+}
+
+/**
+ * Test if a hash set is empty.
+ * O(1).
+ */
+template <typename _T>
+inline PURE bool empty(HashSet<_T> _s)
+{
+    return _hamt_is_empty(_s._impl);
+}
+
+/**
+ * Insert an element into a hash set.
+ * O(log32(n)).
+ */
+template <typename _T>
+inline PURE HashSet<_T> insert(HashSet<_T> _s, const _T &_k)
+{
+    Value<_T> _k1 = _k;
+    HashSet<_T> _s1 = {_hamt_insert<_hashset_hash_wrapper<_T>,
+        _hashset_equal_wrapper<_T>>(_s._impl, _bit_cast<Value<Word>>(_k1))};
+    return _s1;
+}
+
+/**
+ * Construct a hash set from a list.
+ * O(n * log32(n)).
+ */
+template <typename _T>
+inline PURE HashSet<_T> hash_set(List<_T> _xs)
+{
+    HashSet<_T> _s = hash_set<_T>();
+    for (; !empty(_xs); _xs = tail(_xs))
+        _s = insert(_s, head(_xs));
+    return _s;
+}
+
+/**
+ * Hash set find.
+ * O(log32(n)).
+ */
+template <typename _T>
+inline PURE bool find(HashSet<_T> _s, const _T &_k)
+{
+    Value<_T> _k1 = _k;
+    auto _entry = _hamt_search<_hashset_hash_wrapper<_T>,
+        _hashset_equal_wrapper<_T>>(_s._impl, _bit_cast<Value<Word>>(_k1));
+    return (_entry != nullptr);
+}
+
+/**
+ * Remove an element from a hash set.
+ * O(log32(n)).
+ */
+template <typename _T>
+inline PURE HashSet<_T> erase(HashSet<_T> _s, const _T &_k)
+{
+    Value<_T> _k1 = _k;
+    HashSet<_T> _s1 = {_hamt_delete<_hashset_hash_wrapper<_T>,
+        _hashset_equal_wrapper<_T>>(_s._impl, _bit_cast<Value<Word>>(_k1))};
+    return _s1;
+}
+
+/**
+ * Hash set size.
+ * O(1).
+ */
+template <typename _T>
+inline PURE size_t size(HashSet<_T> _s)
+{
+    return _hamt_size(_s._impl);
+}
+
+/**
+ * Hash set fold left.  The order of the elements is unspecified.
+ * ([](A a, T x) -> A).
+ * O(n).
+ */
+template <typename _T, typename _A, typename _F>
+inline PURE _A foldl(HashSet<_T> _s, const _A &_arg, _F _func)
+{
+    _A _a = _arg;
+    auto _visit = [&_a, &_func](const Value<Word> &_k0)
+    {
+        Value<_T> _k = _bit_cast<Value<_T>>(_k0);
+        _a = _func(_a, _k);
+    };
+    _hamt_for_each_k(_s._impl, _visit);
+    return _a;
+}
+
+/**
+ * Hash set for each.  Calls func on each element in an unspecified order.
+ * ([](T x)).
+ * O(n).
+ */
+template <typename _T, typename _F>
+inline void for_each(HashSet<_T> _s, _F _func)
+{
+    auto _func_1 = [&_func](const Value<Word> &_k0)
+    {
+        Value<_T> _k = _bit_cast<Value<_T>>(_k0);
+        _func(_k);
+    };
+    _hamt_for_each_k(_s._impl, _func_1);
+}
+
+/**
+ * All hash set elements, in an unspecified order.
+ * O(n).
+ */
+template <typename _T>
+inline PURE List<_T> list(HashSet<_T> _s)
+{
+    List<_T> _xs = list<_T>();
+    auto _visit = [&_xs](const Value<Word> &_k0)
+    {
+        Value<_T> _k = _bit_cast<Value<_T>>(_k0);
+        _xs = list<_T>(_k, _xs);
+    };
+    _hamt_for_each_k(_s._impl, _visit);
+    return _xs;
+}
+
+/**
+ * Retain a hash set so that it outlives the values it was derived from.
+ * Only meaningful for the reference counting backend (LIBF_GC_RC).
+ * O(1).
+ */
+template <typename _T>
+inline HashSet<_T> retain(HashSet<_T> _s)
+{
+    HashSet<_T> _s1 = {_hamt_retain(_s._impl)};
+    return _s1;
+}
+
+/**
+ * Release a hash set.  Nodes that are no longer referenced are freed
+ * immediately by the reference counting backend (LIBF_GC_RC), otherwise
+ * this is a no-op.
+ * Only a value that was passed to retain() may be released; releasing
+ * one that was not is an error.
+ * O(k), where k is the number of nodes freed.
+ */
+template <typename _T>
+inline void release(HashSet<_T> _s)
+{
+    _hamt_release(_s._impl);
+}
+
+/**
+ * Hash set verify.
+ * O(n).
+ */
+template <typename _T>
+inline PURE bool verify(HashSet<_T> _s)
+{
+    return _hamt_verify(_s._impl, _hashset_hash_wrapper<_T>);
+}
+
+/**
+ * Hash set show.
+ * O(n).
+ */
+template <typename _T>
+inline PURE String show(HashSet<_T> _s)
+{
+    String (*_func_ptr)(Value<Word>) =
+        [] (Value<Word> _k0) -> String
+    {
+        Value<_T> _k = _bit_cast<Value<_T>>(_k0);
+        const _T &_x = _k;
+        return show(_x);
+    };
+    return _hamt_show(_s._impl, _func_ptr);
+}
+
+}           /* namespace F */
+
+#include "flist.h"
+#include "fstring.h"
+
+#endif      /* _FHASHSET_H */
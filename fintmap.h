@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FINTMAP_H
+#define _FINTMAP_H
+
+#include "fbase.h"
+#include "fpatricia.h"
+#include "fshow.h"
+#include "fvalue.h"
+
+#include "fintmap_defs.h"
+#include "flist_defs.h"
+#include "fstring_defs.h"
+#include "ftuple_defs.h"
+
+namespace F
+{
+
+/*
+ * Entries of maps with word-sized values are returned as Tuples that point
+ * directly into the trie leaf (see _PatriciaLeaf), else they are copied.
+ * Not used by the reference counting backend, since such tuples would not
+ * keep the leaf alive.
+ */
+template <typename _V>
+struct _intmap_inline
+{
+#ifdef LIBF_GC_RC
+    static const bool _value = false;
+#else
+    static const bool _value = (sizeof(_V) <= sizeof(Word));
+#endif
+};
+
+template <typename _V>
+inline Tuple<uint64_t, _V> _intmap_entry(const _PatriciaLeaf &_l)
+{
+    if constexpr (_intmap_inline<_V>::_value)
+    {
+        Tuple<uint64_t, _V> _t = {(Value<Word> *)&_l};
+        return _t;
+    }
+    else
+    {
+        Value<_V> _v = _bit_cast<Value<_V>>(_l.val);
+        const _V &_x = _v;
+        return tuple<uint64_t, _V>(_l.key, _x);
+    }
+}
+
+/**
+ * Construct an empty integer map.
+ * O(1).
+ */
+template <typename _V>
+inline PURE IntMap<_V> int_map()
+{
+    IntMap<_V> _m = {_patricia_empty()};
+    return _m;
+}
+
+/**
+ * Test if an integer map is empty.
+ * O(1).
+ */
+template <typename _V>
+inline PURE bool empty(IntMap<_V> _m)
+{
+    return _patricia_is_empty(_m._impl);
+}
+
+/**
+ * Insert a key-value pair into an integer map.
+ * O(min(n, 64)).
+ */
+template <typename _V>
+inline PURE IntMap<_V> insert(IntMap<_V> _m, Tuple<uint64_t, _V> _k)
+{
+    Value<_V> _v = second(_k);
+    IntMap<_V> _m1 = {_patricia_insert(_m._impl, first(_k),
+        _bit_cast<Value<Word>>(_v))};
+    return _m1;
+}
+
+/**
+ * Construct an integer map from a list of entries.
+ * O(n * min(n, 64)).
+ */
+template <typename _V>
+inline PURE IntMap<_V> int_map(List<Tuple<uint64_t, _V>> _xs)
+{
+    IntMap<_V> _m = int_map<_V>();
+    for (; !empty(_xs); _xs = tail(_xs))
+        _m = insert(_m, head(_xs));
+    return _m;
+}
+
+/**
+ * Find an entry in the integer map.
+ * O(min(n, 64)).
+ */
+template <typename _V>
+inline PURE Optional<Tuple<uint64_t, _V>> find(IntMap<_V> _m, uint64_t _k)
+{
+    const _PatriciaLeaf *_l = _patricia_search(_m._impl, _k);
+    return (_l != nullptr?
+        Optional<Tuple<uint64_t, _V>>(_intmap_entry<_V>(*_l)):
+        Optional<Tuple<uint64_t, _V>>());
+}
+
+/**
+ * Remove an entry from the integer map.
+ * O(min(n, 64)).
+ */
+template <typename _V>
+inline PURE IntMap<_V> erase(IntMap<_V> _m, uint64_t _k)
+{
+    IntMap<_V> _m1 = {_patricia_delete(_m._impl, _k)};
+    return _m1;
+}
+
+/**
+ * Integer map size.
+ * O(1).
+ */
+template <typename _V>
+inline PURE size_t size(IntMap<_V> _m)
+{
+    return _patricia_size(_m._impl);
+}
+
+/**
+ * Integer map merge.  Entries of mb replace entries of ma with the same key.
+ * O(n + m), or O(1) if the key ranges of the maps are disjoint.
+ */
+template <typename _V>
+inline PURE IntMap<_V> merge(IntMap<_V> _ma, IntMap<_V> _mb)
+{
+    IntMap<_V> _m1 = {_patricia_union(_ma._impl, _mb._impl)};
+    return _m1;
+}
+
+/**
+ * Integer map intersect.  The entries of ma whose keys are in mb.
+ * O(n + m).
+ */
+template <typename _V>
+inline PURE IntMap<_V> intersect(IntMap<_V> _ma, IntMap<_V> _mb)
+{
+    IntMap<_V> _m1 = {_patricia_intersect(_ma._impl, _mb._impl)};
+    return _m1;
+}
+
+/**
+ * Integer map difference.  The entries of ma whose keys are not in mb.
+ * O(n + m).
+ */
+template <typename _V>
+inline PURE IntMap<_V> diff(IntMap<_V> _ma, IntMap<_V> _mb)
+{
+    IntMap<_V> _m1 = {_patricia_diff(_ma._impl, _mb._impl)};
+    return _m1;
+}
+
+/**
+ * Integer map fold left. ([](A a, Tuple<uint64_t, V> e) -> A).
+ * O(n).
+ */
+template <typename _V, typename _A, typename _F>
+inline PURE _A foldl(IntMap<_V> _m, const _A &_arg, _F _func)
+{
+    _A _a = _arg;
+    auto _visit = [&_a, &_func](const _PatriciaLeaf &_l)
+    {
+        _a = _func(_a, _intmap_entry<_V>(_l));
+    };
+    _patricia_for_each_k(_m._impl, _visit);
+    return _a;
+}
+
+/**
+ * Integer map fold right. ([](A a, Tuple<uint64_t, V> e) -> A).
+ * O(n).
+ */
+template <typename _V, typename _A, typename _F>
+inline PURE _A foldr(IntMap<_V> _m, const _A &_arg, _F _func)
+{
+    _A _a = _arg;
+    auto _visit = [&_a, &_func](const _PatriciaLeaf &_l)
+    {
+        _a = _func(_a, _intmap_entry<_V>(_l));
+    };
+    _patricia_for_each_rev_k(_m._impl, _visit);
+    return _a;
+}
+
+/**
+ * Integer map for each.  Calls func on each entry in order.
+ * ([](Tuple<uint64_t, V> e)).
+ * O(n).
+ */
+template <typename _V, typename _F>
+inline void for_each(IntMap<_V> _m, _F _func)
+{
+    auto _func_1 = [&_func](const _PatriciaLeaf &_l)
+    {
+        _func(_intmap_entry<_V>(_l));
+    };
+    _patricia_for_each_k(_m._impl, _func_1);
+}
+
+/**
+ * Integer map map. ([](Tuple<uint64_t, V> e) -> W).
+ * O(n).
+ */
+template <typename _W, typename _V, typename _F>
+inline PURE IntMap<_W> map(IntMap<_V> _m, _F _func)
+{
+    Value<Word> (*_func_ptr)(void *, uint64_t, Value<Word>) =
+        [](void *_func_0, uint64_t _k, Value<Word> _v0) -> Value<Word>
+    {
+        Value<_V> _v = _bit_cast<Value<_V>>(_v0);
+        const _V &_x = _v;
+        _F *_func_1 = (_F *)_func_0;
+        Value<_W> _w = (*_func_1)(tuple<uint64_t, _V>(_k, _x));
+        return _bit_cast<Value<Word>>(_w);
+    };
+    IntMap<_W> _m1 = {_patricia_map(_m._impl, _func_ptr, (void *)&_func)};
+    return _m1;
+}
+
+/**
+ * All integer map keys, in order.
+ * O(n).
+ */
+template <typename _V>
+inline PURE List<uint64_t> keys(IntMap<_V> _m)
+{
+    List<uint64_t> _xs = list<uint64_t>();
+    auto _visit = [&_xs](const _PatriciaLeaf &_l)
+    {
+        _xs = list<uint64_t>(_l.key, _xs);
+    };
+    _patricia_for_each_rev_k(_m._impl, _visit);
+    return _xs;
+}
+
+/**
+ * All integer map values, in key order.
+ * O(n).
+ */
+template <typename _V>
+inline PURE List<_V> values(IntMap<_V> _m)
+{
+    List<_V> _xs = list<_V>();
+    auto _visit = [&_xs](const _PatriciaLeaf &_l)
+    {
+        Value<_V> _v = _bit_cast<Value<_V>>(_l.val);
+        _xs = list<_V>(_v, _xs);
+    };
+    _patricia_for_each_rev_k(_m._impl, _visit);
+    return _xs;
+}
+
+/**
+ * Retain an integer map so that it outlives the values it was derived from.
+ * Only meaningful for the reference counting backend (LIBF_GC_RC).
+ * O(1).
+ */
+template <typename _V>
+inline IntMap<_V> retain(IntMap<_V> _m)
+{
+    IntMap<_V> _m1 = {_patricia_retain(_m._impl)};
+    return _m1;
+}
+
+/**
+ * Release an integer map.  Nodes that are no longer referenced are freed
+ * immediately by the reference counting backend (LIBF_GC_RC), otherwise
+ * this is a no-op.
+ * Only a value that was passed to retain() may be released; releasing
+ * one that was not is an error.
+ * O(k), where k is the number of nodes freed.
+ */
+template <typename _V>
+inline void release(IntMap<_V> _m)
+{
+    _patricia_release(_m._impl);
+}
+
+/**
+ * Integer map verify.
+ * O(n).
+ */
+template <typename _V>
+inline PURE bool verify(IntMap<_V> _m)
+{
+    return _patricia_verify(_m._impl);
+}
+
+/**
+ * Integer map show.
+ * O(n).
+ */
+template <typename _V>
+inline PURE String show(IntMap<_V> _m)
+{
+    String (*_func_ptr)(uint64_t, Value<Word>) =
+        [] (uint64_t _k, Value<Word> _v0) -> String
+    {
+        Value<_V> _v = _bit_cast<Value<_V>>(_v0);
+        const _V &_x = _v;
+        return append(append(show(_k), "->"), show(_x));
+    };
+    return _patricia_show(_m._impl, _func_ptr);
+}
+
+}           /* namespace F */
+
+#include "flist.h"
+#include "fstring.h"
+#include "ftuple.h"
+
+#endif      /* _FINTMAP_H */
@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FINTSET_H
+#define _FINTSET_H
+
+#include "fbase.h"
+#include "fpatricia.h"
+#include "fshow.h"
+#include "fvalue.h"
+
+#include "fintset_defs.h"
+#include "flist_defs.h"
+#include "fstring_defs.h"
+
+namespace F
+{
+
+/**
+ * Construct the empty integer set.
+ * O(1).
+ */
+inline PURE IntSet int_set(void)
+{
+    IntSet _s = {_patricia_empty()};
+    return _s;
+}
+
+/**
+ * Test if an integer set is empty.
+ * O(1).
+ */
+inline PURE bool empty(IntSet _s)
+{
+    return _patricia_is_empty(_s._impl);
+}
+
+/**
+ * Insert an element into an integer set.
+ * O(min(n, 64)).
+ */
+inline PURE IntSet insert(IntSet _s, uint64_t _k)
+{
+    if (_patricia_search(_s._impl, _k) != nullptr)
+        return _s;
+    IntSet _s1 = {_patricia_insert(_s._impl, _k, Value<Word>())};
+    return _s1;
+}
+
+/**
+ * Construct an integer set from a list.
+ * O(n * min(n, 64)).
+ */
+inline PURE IntSet int_set(List<uint64_t> _xs)
+{
+    IntSet _s = int_set();
+    for (; !empty(_xs); _xs = tail(_xs))
+        _s = insert(_s, head(_xs));
+    return _s;
+}
+
+/**
+ * Integer set find.
+ * O(min(n, 64)).
+ */
+inline PURE bool find(IntSet _s, uint64_t _k)
+{
+    return (_patricia_search(_s._impl, _k) != nullptr);
+}
+
+/**
+ * Remove an element from an integer set.
+ * O(min(n, 64)).
+ */
+inline PURE IntSet erase(IntSet _s, uint64_t _k)
+{
+    IntSet _s1 = {_patricia_delete(_s._impl, _k)};
+    return _s1;
+}
+
+/**
+ * Integer set size.
+ * O(1).
+ */
+inline PURE size_t size(IntSet _s)
+{
+    return _patricia_size(_s._impl);
+}
+
+/**
+ * Integer set union (merge).  Sub-tries shared by both sets or covering
+ * disjoint key ranges are reused as-is.
+ * O(n + m), or O(1) if the key ranges of the sets are disjoint.
+ */
+inline PURE IntSet merge(IntSet _s, IntSet _t)
+{
+    IntSet _u = {_patricia_union(_s._impl, _t._impl)};
+    return _u;
+}
+
+/**
+ * Integer set intersect.
+ * O(n + m).
+ */
+inline PURE IntSet intersect(IntSet _s, IntSet _t)
+{
+    IntSet _u = {_patricia_intersect(_s._impl, _t._impl)};
+    return _u;
+}
+
+/**
+ * Integer set difference.
+ * O(n + m).
+ */
+inline PURE IntSet diff(IntSet _s, IntSet _t)
+{
+    IntSet _u = {_patricia_diff(_s._impl, _t._impl)};
+    return _u;
+}
+
+/**
+ * Integer set fold left. ([](A a, uint64_t x) -> A).
+ * O(n).
+ */
+template <typename _A, typename _F>
+inline PURE _A foldl(IntSet _s, const _A &_arg, _F _func)
+{
+    _A _a = _arg;
+    auto _visit = [&_a, &_func](const _PatriciaLeaf &_l)
+    {
+        _a = _func(_a, _l.key);
+    };
+    _patricia_for_each_k(_s._impl, _visit);
+    return _a;
+}
+
+/**
+ * Integer set fold right. ([](A a, uint64_t x) -> A).
+ * O(n).
+ */
+template <typename _A, typename _F>
+inline PURE _A foldr(IntSet _s, const _A &_arg, _F _func)
+{
+    _A _a = _arg;
+    auto _visit = [&_a, &_func](const _PatriciaLeaf &_l)
+    {
+        _a = _func(_a, _l.key);
+    };
+    _patricia_for_each_rev_k(_s._impl, _visit);
+    return _a;
+}
+
+/**
+ * Integer set for each.  Calls func on each element in order.
+ * ([](uint64_t x)).
+ * O(n).
+ */
+template <typename _F>
+inline void for_each(IntSet _s, _F _func)
+{
+    auto _func_1 = [&_func](const _PatriciaLeaf &_l)
+    {
+        _func(_l.key);
+    };
+    _patricia_for_each_k(_s._impl, _func_1);
+}
+
+/**
+ * All integer set elements, in order.
+ * O(n).
+ */
+inline PURE List<uint64_t> list(IntSet _s)
+{
+    List<uint64_t> _xs = list<uint64_t>();
+    auto _visit = [&_xs](const _PatriciaLeaf &_l)
+    {
+        _xs = list<uint64_t>(_l.key, _xs);
+    };
+    _patricia_for_each_rev_k(_s._impl, _visit);
+    return _xs;
+}
+
+/**
+ * Retain an integer set so that it outlives the values it was derived from.
+ * Only meaningful for the reference counting backend (LIBF_GC_RC).
+ * O(1).
+ */
+inline IntSet retain(IntSet _s)
+{
+    IntSet _s1 = {_patricia_retain(_s._impl)};
+    return _s1;
+}
+
+/**
+ * Release an integer set.  Nodes that are no longer referenced are freed
+ * immediately by the reference counting backend (LIBF_GC_RC), otherwise
+ * this is a no-op.
+ * Only a value that was passed to retain() may be released; releasing
+ * one that was not is an error.
+ * O(k), where k is the number of nodes freed.
+ */
+inline void release(IntSet _s)
+{
+    _patricia_release(_s._impl);
+}
+
+/**
+ * Integer set verify.
+ * O(n).
+ */
+inline PURE bool verify(IntSet _s)
+{
+    return _patricia_verify(_s._impl);
+}
+
+/**
+ * Integer set show.
+ * O(n).
+ */
+inline PURE String show(IntSet _s)
+{
+    String (*_func_ptr)(uint64_t, Value<Word>) =
+        [] (uint64_t _k, Value<Word> _v) -> String
+    {
+        return show(_k);
+    };
+    return _patricia_show(_s._impl, _func_ptr);
+}
+
+}           /* namespace F */
+
+#include "flist.h"
+#include "fstring.h"
+
+#endif      /* _FINTSET_H */
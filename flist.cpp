@@ -132,29 +132,28 @@ extern PURE List<Word> _list_reverse(List<Word> xs)
 /*
  * Zip.
  */
-extern PURE List<Word> _list_zip(List<Word> xs, List<Word> ys)
+extern PURE List<Word> _list_zip(List<Word> xs, List<Word> ys,
+    Value<Word> (*pair)(Value<Word>, Value<Word>))
 {
     if (empty(xs) || empty(ys))
         return list<Word>();
 
     const Node<Word> &nodex = xs;
     const Node<Word> &nodey = ys;
-    Tuple<Value<Word>, Value<Word>> t = tuple(nodex.elem, nodey.elem);
-    List<Tuple<Value<Word>, Value<Word>>> zs =
-        list(t, list<Tuple<Value<Word>, Value<Word>>>());
+    List<Value<Word>> zs =
+        list(pair(nodex.elem, nodey.elem), list<Value<Word>>());
     xs = tail(xs);
     ys = tail(ys);
-    List<Tuple<Value<Word>, Value<Word>>> ws = zs;
+    List<Value<Word>> ws = zs;
 
     while (!empty(xs) && !empty(ys))
     {
         const Node<Word> &nodex = xs;
         const Node<Word> &nodey = ys;
-        Tuple<Value<Word>, Value<Word>> t = tuple(nodex.elem, nodey.elem);
-		List<Tuple<Value<Word>, Value<Word>>> vs =
-			list(t, list<Tuple<Value<Word>, Value<Word>>>());
-        const Node<Tuple<Value<Word>, Value<Word>>> &node = zs;
-		const_cast<Node<Tuple<Value<Word>, Value<Word>>> &>(node).next = vs;
+        List<Value<Word>> vs =
+            list(pair(nodex.elem, nodey.elem), list<Value<Word>>());
+        const Node<Value<Word>> &node = ws;
+        const_cast<Node<Value<Word>> &>(node).next = vs;
         ws = vs;
         xs = tail(xs);
         ys = tail(ys);
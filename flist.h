@@ -61,7 +61,8 @@ extern PURE List<Word> _list_last(List<Word> _xs);
 extern PURE size_t _list_length(List<Word> _xs);
 extern PURE List<Word> _list_append(List<Word> _xs, List<Word> _ys);
 extern PURE List<Word> _list_reverse(List<Word> _xs);
-extern PURE List<Word> _list_zip(List<Word> xs, List<Word> ys);
+extern PURE List<Word> _list_zip(List<Word> _xs, List<Word> _ys,
+    Value<Word> (*_pair)(Value<Word>, Value<Word>));
 extern PURE List<Word> _list_sort(List<Word> _xs, void *_data,
     _SortCompare _f);
 extern PURE List<Word> _list_take(List<Word> _xs, size_t _len);
@@ -128,7 +129,7 @@ inline PURE List<Tuple<_K, _V>> list(Map<_K, _V> _m)
     Value<Word> (*_func_ptr)(void *, Value<Word>) =
         [] (void *_unused, Value<Word> _k) -> Value<Word>
     {
-        return _k;
+        return _bit_cast<Value<Word>>(_map_entry_copy<_K, _V>(_k));
     };
     List<Tuple<_K, _V>> _xs = _bit_cast<List<Tuple<_K, _V>>>(
         _tree_to_list(_m._impl, _func_ptr, nullptr));
@@ -276,8 +277,17 @@ inline PURE List<_T> reverse(List<_T> _xs)
 template <typename _T, typename _U>
 inline PURE List<Tuple<_T, _U>> zip(List<_T> _xs, List<_U> _ys)
 {
+    Value<Word> (*_pair)(Value<Word>, Value<Word>) =
+        [] (Value<Word> _x, Value<Word> _y) -> Value<Word>
+    {
+        Value<_T> _x1 = _bit_cast<Value<_T>>(_x);
+        Value<_U> _y1 = _bit_cast<Value<_U>>(_y);
+        const _T &_x2 = _x1;
+        const _U &_y2 = _y1;
+        return _bit_cast<Value<Word>>(tuple<_T, _U>(_x2, _y2));
+    };
     return _bit_cast<List<Tuple<_T, _U>>>(_list_zip(_bit_cast<List<Word>>(_xs),
-        _bit_cast<List<Word>>(_ys)));
+        _bit_cast<List<Word>>(_ys), _pair));
 }
 
 /**
@@ -53,6 +53,22 @@ struct Node
     List<T> next;
 };
 
+/*
+ * Precise GC layout (LIBF_GC_TYPED): elem is only a pointer for non-atomic
+ * types.
+ */
+template <typename T>
+struct _GCLayout<Node<T>>
+{
+    static const uint64_t _mask = (_GCAtomic<T>::_value? 0x2: 0x3);
+};
+
+template <typename T>
+struct _GCStatKind<Node<T>>
+{
+    static const unsigned _kind = GC_STAT_LIST;
+};
+
 enum
 {
     NIL  = List<Word>::index<Nil>(),
@@ -33,21 +33,113 @@
 #include "fbase.h"
 #include "fcompare.h"
 #include "ftree.h"
+#include "ftree_inline.h"
 
 #include "flist_defs.h"
 #include "fmap_defs.h"
 #include "fstring_defs.h"
 #include "ftuple_defs.h"
+#include "fvector_defs.h"
 
 namespace F
 {
 
-template <typename _K>
+template <typename _T>
+inline PURE size_t size(Vector<_T> _v);
+template <typename _T>
+inline VectorItr<_T> begin(Vector<_T> _v);
+template <typename _T>
+inline VectorItr<_T> &operator ++(VectorItr<_T> &_i);
+template <typename _T>
+inline PURE _T operator *(VectorItr<_T> &_i);
+
+/*
+ * Entries of maps with small scalar keys and values (e.g. Map<int, int>) are
+ * stored inline in the tree key slots, so that comparisons do not need to
+ * dereference a Tuple.  Tuples returned for such entries point directly into
+ * the tree node.  Not used by the reference counting backend, since such
+ * tuples would not keep the node alive.
+ */
+template <typename _K, typename _V>
+struct _map_inline
+{
+#ifdef LIBF_GC_RC
+    static const bool _value = false;
+#else
+    static const bool _value = _GCAtomic<_K>::_value &&
+        _GCAtomic<_V>::_value &&
+        ((sizeof(_K) + alignof(_V) - 1) / alignof(_V)) * alignof(_V) +
+            sizeof(_V) <= sizeof(Word);
+#endif
+};
+
+template <typename _K, typename _V>
+inline Value<Word> _map_entry(Tuple<_K, _V> _t)
+{
+    if constexpr (_map_inline<_K, _V>::_value)
+    {
+        Value<Word> _k;
+        std::memcpy(&_k, _t._impl, sizeof(_k));
+        return _k;
+    }
+    else
+        return _bit_cast<Value<Word>>(_t);
+}
+
+template <typename _K, typename _V>
+inline Value<Word> _map_key(const _K &_k)
+{
+    if constexpr (_map_inline<_K, _V>::_value)
+    {
+        Value<Word> _k1;
+        std::memcpy(&_k1, &_k, sizeof(_K));
+        return _k1;
+    }
+    else
+    {
+        Tuple<_K, _V> _key = {(Value<Word> *)&_k};
+        return _bit_cast<Value<Word>>(_key);
+    }
+}
+
+template <typename _K, typename _V>
+inline Tuple<_K, _V> _map_entry_ref(const Value<Word> &_k)
+{
+    if constexpr (_map_inline<_K, _V>::_value)
+    {
+        Tuple<_K, _V> _t = {(Value<Word> *)&_k};
+        return _t;
+    }
+    else
+        return _bit_cast<Tuple<_K, _V>>(_k);
+}
+
+template <typename _K, typename _V>
+inline Tuple<_K, _V> _map_entry_copy(Value<Word> _k)
+{
+    Tuple<_K, _V> _t = _map_entry_ref<_K, _V>(_k);
+    if constexpr (_map_inline<_K, _V>::_value)
+        return tuple<_K, _V>(first(_t), second(_t));
+    else
+        return _t;
+}
+
+template <typename _K, typename _V>
 int _map_compare_wrapper(Value<Word> _k1, Value<Word> _k2)
 {
-    Tuple<_K, Value<Word>> _a = _bit_cast<Tuple<_K, Value<Word>>>(_k1);
-    Tuple<_K, Value<Word>> _b = _bit_cast<Tuple<_K, Value<Word>>>(_k2);
-    return compare(first(_a), first(_b));
+    if constexpr (_map_inline<_K, _V>::_value)
+    {
+        _K _a, _b;
+        std::memcpy(&_a, &_k1, sizeof(_K));
+        std::memcpy(&_b, &_k2, sizeof(_K));
+        return compare(_a, _b);
+    }
+    else
+    {
+        Tuple<_K, Value<Word>> _a = _bit_cast<Tuple<_K, Value<Word>>>(_k1);
+        Tuple<_K, Value<Word>> _b = _bit_cast<Tuple<_K, Value<Word>>>(_k2);
+        return compare(first(_a), first(_b));
+    }
 }
 
 /**
@@ -61,6 +153,64 @@ inline PURE Map<_K, _V> map()
     return _m;
 }
 
+/**
+ * Construct a map from a list of entries with strictly increasing keys.
+ * O(n).
+ */
+template <typename _K, typename _V>
+inline PURE Map<_K, _V> map_from_sorted(List<Tuple<_K, _V>> _xs)
+{
+    Value<Word> (*_next)(void *) = [](void *_data) -> Value<Word>
+    {
+        List<Tuple<_K, _V>> *_ys = (List<Tuple<_K, _V>> *)_data;
+        Value<Word> _k = _map_entry(head(*_ys));
+        *_ys = tail(*_ys);
+        return _k;
+    };
+    Map<_K, _V> _m = {_tree_from_sorted(size(_xs), _next, (void *)&_xs,
+        _map_compare_wrapper<_K, _V>)};
+    return _m;
+}
+
+/**
+ * Construct a map from a vector of entries with strictly increasing keys.
+ * O(n).
+ */
+template <typename _K, typename _V>
+inline PURE Map<_K, _V> map_from_sorted(Vector<Tuple<_K, _V>> _v)
+{
+    Value<Word> (*_next)(void *) = [](void *_data) -> Value<Word>
+    {
+        VectorItr<Tuple<_K, _V>> *_i = (VectorItr<Tuple<_K, _V>> *)_data;
+        Value<Word> _k = _map_entry(**_i);
+        ++*_i;
+        return _k;
+    };
+    VectorItr<Tuple<_K, _V>> _i = begin(_v);
+    Map<_K, _V> _m = {_tree_from_sorted(size(_v), _next, (void *)&_i,
+        _map_compare_wrapper<_K, _V>)};
+    return _m;
+}
+
+/**
+ * Construct a map from a C-array of entries with strictly increasing keys.
+ * O(n).
+ */
+template <typename _K, typename _V>
+inline PURE Map<_K, _V> map_from_sorted(const Tuple<_K, _V> *_a, size_t _len)
+{
+    Value<Word> (*_next)(void *) = [](void *_data) -> Value<Word>
+    {
+        const Tuple<_K, _V> **_ptr = (const Tuple<_K, _V> **)_data;
+        Value<Word> _k = _map_entry(**_ptr);
+        (*_ptr)++;
+        return _k;
+    };
+    Map<_K, _V> _m = {_tree_from_sorted(_len, _next, (void *)&_a,
+        _map_compare_wrapper<_K, _V>)};
+    return _m;
+}
+
 /**
  * Test if a map is empty.
  * O(1).
@@ -78,8 +228,8 @@ inline PURE bool empty(Map<_K, _V> _m)
 template <typename _K, typename _V>
 inline PURE Map<_K, _V> insert(Map<_K, _V> _m, Tuple<_K, _V> _k)
 {
-    Map<_K, _V> _m1 = {_tree_insert(_m._impl, _bit_cast<Value<Word>>(_k),
-        _map_compare_wrapper<_K>)};
+    Map<_K, _V> _m1 = {_tree_insert<_map_compare_wrapper<_K, _V>>(_m._impl,
+        _map_entry(_k))};
     return _m1;
 }
 
@@ -90,12 +240,10 @@ inline PURE Map<_K, _V> insert(Map<_K, _V> _m, Tuple<_K, _V> _k)
 template <typename _K, typename _V>
 inline PURE Optional<Tuple<_K, _V>> find(Map<_K, _V> _m, const _K &_k)
 {
-    Value<_K> _k1 = _k;
-    Tuple<_K, _V> _key = {_bit_cast<Value<Word> *>(&_k1)};
-    auto _entry = _tree_search(_m._impl, _bit_cast<Value<Word>>(_key),
-        _map_compare_wrapper<_K>);
-    Tuple<_K, _V> *_entry1 = (Tuple<_K, _V> *)_entry;
-    return (_entry1 != nullptr? Optional<Tuple<_K, _V>>(*_entry1):
+    auto _entry = _tree_search<_map_compare_wrapper<_K, _V>>(_m._impl,
+        _map_key<_K, _V>(_k));
+    return (_entry != nullptr?
+        Optional<Tuple<_K, _V>>(_map_entry_ref<_K, _V>(*_entry)):
         Optional<Tuple<_K, _V>>());
 }
 
@@ -106,13 +254,102 @@ inline PURE Optional<Tuple<_K, _V>> find(Map<_K, _V> _m, const _K &_k)
 template <typename _K, typename _V>
 inline PURE Map<_K, _V> erase(Map<_K, _V> _m, const _K &_k)
 {
-    Value<_K> _k1 = _k;
-    Tuple<_K, _V> _key = {_bit_cast<Value<Word> *>(&_k1)};
-    Map<_K, _V> _m1 = {_tree_delete(_m._impl, _bit_cast<Value<Word>>(_key),
-        _map_compare_wrapper<_K>)};
+    Map<_K, _V> _m1 = {_tree_delete<_map_compare_wrapper<_K, _V>>(_m._impl,
+        _map_key<_K, _V>(_k))};
     return _m1;
 }
 
+/*
+ * Single-pass update of the entry for a key.  The function is passed the old
+ * value (nullptr if none) and returns the new value, or an empty Optional to
+ * erase the entry.  The original map is returned if the new value is
+ * identical to the old value.
+ */
+template <typename _K, typename _V, typename _F>
+inline Map<_K, _V> _map_alter(Map<_K, _V> _m, const _K &_k, _F &_func)
+{
+    struct _Data
+    {
+        const _K *_key;
+        _F *_func;
+    } _data = {&_k, &_func};
+    int (*_func_ptr)(void *, const Value<Word> *, Value<Word> *) =
+        [](void *_data0, const Value<Word> *_e0, Value<Word> *_e1) -> int
+    {
+        _Data *_data1 = (_Data *)_data0;
+        Tuple<_K, _V> _entry;
+        const _V *_old = nullptr;
+        if (_e0 != nullptr)
+        {
+            _entry = _map_entry_ref<_K, _V>(*_e0);
+            _old = &second(_entry);
+        }
+        Optional<_V> _r = (*_data1->_func)(_old);
+        if (empty(_r))
+            return (_old == nullptr? _TREE_ALTER_KEEP: _TREE_ALTER_ERASE);
+        const _V &_new = _r._get();
+        if (_old != nullptr && std::memcmp(_old, &_new, sizeof(_V)) == 0)
+            return _TREE_ALTER_KEEP;
+        *_e1 = _map_entry(tuple<_K, _V>(*_data1->_key, _new));
+        return _TREE_ALTER_SET;
+    };
+    Map<_K, _V> _m1 = {_tree_alter(_m._impl, _map_key<_K, _V>(_k),
+        _map_compare_wrapper<_K, _V>, _func_ptr, (void *)&_data)};
+    return _m1;
+}
+
+/**
+ * Insert a key-value pair into a map, or if the key is present, combine the
+ * old value with the new.  ([](V old, V v) -> V).
+ * O(log(n)).
+ */
+template <typename _K, typename _V, typename _F>
+inline PURE Map<_K, _V> insert_with(Map<_K, _V> _m, const _K &_k,
+    const _V &_v, _F _func)
+{
+    auto _func_1 = [&_v, &_func](const _V *_old) -> Optional<_V>
+    {
+        if (_old == nullptr)
+            return Optional<_V>(_v);
+        return Optional<_V>(_func(*_old, _v));
+    };
+    return _map_alter(_m, _k, _func_1);
+}
+
+/**
+ * Update the value of a key, if present.  ([](V v) -> V).
+ * O(log(n)).
+ */
+template <typename _K, typename _V, typename _F>
+inline PURE Map<_K, _V> adjust(Map<_K, _V> _m, const _K &_k, _F _func)
+{
+    auto _func_1 = [&_func](const _V *_old) -> Optional<_V>
+    {
+        if (_old == nullptr)
+            return Optional<_V>();
+        return Optional<_V>(_func(*_old));
+    };
+    return _map_alter(_m, _k, _func_1);
+}
+
+/**
+ * Insert, update or erase the entry for a key.  The function is passed the
+ * old value (if any), and returns the new value (if any).
+ * ([](Optional<V> v) -> Optional<V>).
+ * O(log(n)).
+ */
+template <typename _K, typename _V, typename _F>
+inline PURE Map<_K, _V> alter(Map<_K, _V> _m, const _K &_k, _F _func)
+{
+    auto _func_1 = [&_func](const _V *_old) -> Optional<_V>
+    {
+        if (_old == nullptr)
+            return _func(Optional<_V>());
+        return _func(Optional<_V>(*_old));
+    };
+    return _map_alter(_m, _k, _func_1);
+}
+
 /**
  * Map size.
  * O(1).
@@ -130,21 +367,113 @@ inline PURE size_t size(Map<_K, _V> _m)
 template <typename _K, typename _V, typename _A, typename _F>
 inline PURE _A foldl(Map<_K, _V> _m, const _A &_arg, _F _func)
 {
-    Value<Word> (*_func_ptr)(void *, Value<Word>, Value<Word>) =
-        [](void *_func_0, Value<Word> _a0, Value<Word> _k0) -> Value<Word>
+    auto _func_1 = [&_func](const _A &_a, const Value<Word> &_k) -> _A
+    {
+        return _func(_a, _map_entry_ref<_K, _V>(_k));
+    };
+    return _tree_foldl(_m._impl, _arg, _func_1);
+}
+
+/**
+ * Map fold left over the entries with keys in [lo, hi).
+ * ([](A a, Tuple<K, V> e) -> A).
+ * O(log(n) + m), where m is the number of entries in the range.
+ */
+template <typename _K, typename _V, typename _A, typename _F>
+inline PURE _A foldl_range(Map<_K, _V> _m, const _K &_lo, const _K &_hi,
+    const _A &_arg, _F _func)
+{
+    Value<Word> (*_func_ptr)(void *, Value<Word>, const Value<Word> &) =
+        [](void *_func_0, Value<Word> _a0, const Value<Word> &_k0)
+            -> Value<Word>
     {
         Value<_A> _a = _bit_cast<Value<_A>>(_a0);
-        Tuple<_K, _V> _entry = _bit_cast<Tuple<_K, _V>>(_k0);
+        Tuple<_K, _V> _entry = _map_entry_ref<_K, _V>(_k0);
         _F *_func_1 = (_F *)_func_0;
         Value<_A> _b = (*_func_1)(_a, _entry);
         return _bit_cast<Value<Word>>(_b);
     };
     Value<_A> _arg1 = _arg;
-    Value<Word> _r = _tree_foldl(_m._impl, _bit_cast<Value<Word>>(_arg1),
-        _func_ptr, (void *)&_func);
+    Value<Word> _lo1 = _map_key<_K, _V>(_lo), _hi1 = _map_key<_K, _V>(_hi);
+    Value<Word> _r = _tree_foldl_range(_m._impl, &_lo1, &_hi1,
+        _bit_cast<Value<Word>>(_arg1), _func_ptr, (void *)&_func,
+        _map_compare_wrapper<_K, _V>);
     return _bit_cast<Value<_A>>(_r);
 }
 
+/*
+ * Type-erased monoid for aggregate().  The address of _desc identifies the
+ * summaries cached for M in the tree nodes.
+ */
+template <typename _M, typename _K, typename _V>
+struct _map_measure
+{
+    typedef decltype(_M::empty()) _A;
+
+    static Value<Word> _empty(void)
+    {
+        Value<_A> _a = _M::empty();
+        return _bit_cast<Value<Word>>(_a);
+    }
+
+    static Value<Word> _measure(const Value<Word> &_k0)
+    {
+        Tuple<_K, _V> _entry = _map_entry_ref<_K, _V>(_k0);
+        Value<_A> _a = _M::measure(first(_entry), second(_entry));
+        return _bit_cast<Value<Word>>(_a);
+    }
+
+    static Value<Word> _combine(Value<Word> _a0, Value<Word> _b0)
+    {
+        Value<_A> _a = _bit_cast<Value<_A>>(_a0);
+        Value<_A> _b = _bit_cast<Value<_A>>(_b0);
+        Value<_A> _c = _M::combine(_a, _b);
+        return _bit_cast<Value<Word>>(_c);
+    }
+
+    static const _TreeMeasure _desc;
+};
+
+template <typename _M, typename _K, typename _V>
+const _TreeMeasure _map_measure<_M, _K, _V>::_desc =
+    {_empty, _measure, _combine};
+
+/**
+ * Map aggregate of the entries with keys in [lo, hi) under the monoid M,
+ * i.e. M::combine() over M::measure(k, v) in key order, or M::empty() if the
+ * range is empty.  M::combine() must be associative with identity
+ * M::empty().
+ * O(log(n)) amortised with -DLIBF_TREE_MEASURE, where each node caches the
+ * summary of the last monoid aggregated over it, else O(log(n) + m).  Each
+ * node has a single cache slot, so the amortised bound only holds while one
+ * monoid is used per map: alternating aggregate<M1>() and aggregate<M2>()
+ * over the same map overwrites the slots, and each call is O(log(n) + m).
+ */
+template <typename _M, typename _K, typename _V>
+inline PURE auto aggregate(Map<_K, _V> _m, const _K &_lo, const _K &_hi)
+    -> decltype(_M::empty())
+{
+    typedef _map_measure<_M, _K, _V> _Measure;
+    Value<Word> _lo1 = _map_key<_K, _V>(_lo), _hi1 = _map_key<_K, _V>(_hi);
+    Value<Word> _r = _tree_aggregate(_m._impl, &_lo1, &_hi1,
+        &_Measure::_desc, _map_compare_wrapper<_K, _V>);
+    return _bit_cast<Value<typename _Measure::_A>>(_r);
+}
+
+/**
+ * Map aggregate of all entries under the monoid M (see above, including the
+ * single-monoid caveat).
+ * O(1) amortised with -DLIBF_TREE_MEASURE, else O(n).
+ */
+template <typename _M, typename _K, typename _V>
+inline PURE auto aggregate(Map<_K, _V> _m) -> decltype(_M::empty())
+{
+    typedef _map_measure<_M, _K, _V> _Measure;
+    Value<Word> _r = _tree_aggregate(_m._impl, nullptr, nullptr,
+        &_Measure::_desc, _map_compare_wrapper<_K, _V>);
+    return _bit_cast<Value<typename _Measure::_A>>(_r);
+}
+
 /**
  * Map fold right. ([](A a, Tuple<K, V> e) -> A).
  * O(n).
@@ -152,19 +481,25 @@ inline PURE _A foldl(Map<_K, _V> _m, const _A &_arg, _F _func)
 template <typename _K, typename _V, typename _A, typename _F>
 inline PURE _A foldr(Map<_K, _V> _m, const _A &_arg, _F _func)
 {
-    Value<Word> (*_func_ptr)(void *, Value<Word>, Value<Word>) =
-        [](void *_func_0, Value<Word> _a0, Value<Word> _k0) -> Value<Word>
+    auto _func_1 = [&_func](const _A &_a, const Value<Word> &_k) -> _A
     {
-        Value<_A> _a = _bit_cast<Value<_A>>(_a0);
-        Tuple<_K, _V> _entry = _bit_cast<Tuple<_K, _V>>(_k0);
-        _F *_func_1 = (_F *)_func_0;
-        Value<_A> _b = (*_func_1)(_a, _entry);
-        return _bit_cast<Value<Word>>(_b);
+        return _func(_a, _map_entry_ref<_K, _V>(_k));
     };
-    Value<_A> _arg1 = _arg;
-    Value<Word> _r = _tree_foldr(_m._impl, _bit_cast<Value<Word>>(_arg1),
-        _func_ptr, (void *)&_func);
-    return _bit_cast<Value<_A>>(_r);
+    return _tree_foldr(_m._impl, _arg, _func_1);
+}
+
+/**
+ * Map for each.  Calls func on each entry in order. ([](Tuple<K, V> e)).
+ * O(n).
+ */
+template <typename _K, typename _V, typename _F>
+inline void for_each(Map<_K, _V> _m, _F _func)
+{
+    auto _func_1 = [&_func](const Value<Word> &_k)
+    {
+        _func(_map_entry_ref<_K, _V>(_k));
+    };
+    _tree_for_each(_m._impl, _func_1);
 }
 
 /**
@@ -177,11 +512,11 @@ inline PURE Map<_K, _W> map(Map<_K, _V> _m, _F _func)
     Value<Word> (*_func_ptr)(void *, Value<Word>) =
         [](void *_func_0, Value<Word> _k0) -> Value<Word>
     {
-        Tuple<_K, _V> _entry = _bit_cast<Tuple<_K, _V>>(_k0);
+        Tuple<_K, _V> _entry = _map_entry_copy<_K, _V>(_k0);
         _F *_func_1 = (_F *)_func_0;
         _W _w = (*_func_1)(_entry);
         Tuple<_K, _W> _new_entry = tuple<_K, _W>(first(_entry), _w);
-        return _bit_cast<Value<Word>>(_new_entry);
+        return _map_entry(_new_entry);
     };
     Map<_K, _W> _m1 = {_tree_map(_m._impl, _func_ptr, (void *)&_func)};
     return _m1;
@@ -197,7 +532,7 @@ inline PURE List<_K> keys(Map<_K, _V> _m)
     Value<Word> (*_func_ptr)(void *, Value<Word>) =
         [] (void *_unused, Value<Word> _k0) -> Value<Word>
     {
-        Tuple<_K, _V> _k = _bit_cast<Tuple<_K, _V>>(_k0);
+        Tuple<_K, _V> _k = _map_entry_ref<_K, _V>(_k0);
         return _bit_cast<Value<Word>>(first(_k));
     };
     List<_K> _xs = _bit_cast<List<_K>>(
@@ -215,7 +550,7 @@ inline PURE List<_V> values(Map<_K, _V> _m)
     Value<Word> (*_func_ptr)(void *, Value<Word>) =
         [] (void *_unused, Value<Word> _k0) -> Value<Word>
     {
-        Tuple<_K, _V> _k = _bit_cast<Tuple<_K, _V>>(_k0);
+        Tuple<_K, _V> _k = _map_entry_ref<_K, _V>(_k0);
         return _bit_cast<Value<Word>>(second(_k));
     };
     List<_V> _xs = _bit_cast<List<_V>>(
@@ -230,13 +565,89 @@ inline PURE List<_V> values(Map<_K, _V> _m)
 template <typename _K, typename _V>
 inline PURE Result<Map<_K, _V>, Map<_K, _V>> split(Map<_K, _V> _m, _K _k)
 {
-    Tuple<_K, _V> _key = {_bit_cast<Value<Word> *>(&_k)};
     auto [_tl, _tr] = _tree_split(_m._impl,
-        _bit_cast<Value<Word>>(_key), _map_compare_wrapper<_K>);
+        _map_key<_K, _V>(_k), _map_compare_wrapper<_K, _V>);
     Result<Map<_K, _V>, Map<_K, _V>> _r = {{_tl}, {_tr}};
     return _r;
 }
 
+/**
+ * Map split at a position.  The first map holds the first i entries (in key
+ * order), and the second map the rest.
+ * O(log(n)).
+ */
+template <typename _K, typename _V>
+inline PURE Result<Map<_K, _V>, Map<_K, _V>> split_at(Map<_K, _V> _m,
+    size_t _i)
+{
+    auto [_tl, _tr] = _tree_split_at(_m._impl, _i,
+        _map_compare_wrapper<_K, _V>);
+    Result<Map<_K, _V>, Map<_K, _V>> _r = {{_tl}, {_tr}};
+    return _r;
+}
+
+/**
+ * Map take.  The first n entries of the map (in key order).
+ * O(log(n)).
+ */
+template <typename _K, typename _V>
+inline PURE Map<_K, _V> take(Map<_K, _V> _m, size_t _n)
+{
+    Map<_K, _V> _m1 = {_tree_split_at(_m._impl, _n,
+        _map_compare_wrapper<_K, _V>)._result_0};
+    return _m1;
+}
+
+/**
+ * Map drop.  All but the first n entries of the map (in key order).
+ * O(log(n)).
+ */
+template <typename _K, typename _V>
+inline PURE Map<_K, _V> drop(Map<_K, _V> _m, size_t _n)
+{
+    Map<_K, _V> _m1 = {_tree_split_at(_m._impl, _n,
+        _map_compare_wrapper<_K, _V>)._result_1};
+    return _m1;
+}
+
+/**
+ * Map nth.  The entry at position i (in key order), if any.
+ * O(log(n)).
+ */
+template <typename _K, typename _V>
+inline PURE Optional<Tuple<_K, _V>> nth(Map<_K, _V> _m, size_t _i)
+{
+    auto _entry = _tree_nth(_m._impl, _i);
+    return (_entry != nullptr?
+        Optional<Tuple<_K, _V>>(_map_entry_ref<_K, _V>(*_entry)):
+        Optional<Tuple<_K, _V>>());
+}
+
+/**
+ * Map rank.  The number of keys less than k.
+ * O(log(n)).
+ */
+template <typename _K, typename _V>
+inline PURE size_t rank(Map<_K, _V> _m, const _K &_k)
+{
+    return _tree_rank(_m._impl, _map_key<_K, _V>(_k),
+        _map_compare_wrapper<_K, _V>, false);
+}
+
+/**
+ * Map range count.  The number of keys in [lo, hi).
+ * O(log(n)).
+ */
+template <typename _K, typename _V>
+inline PURE size_t count_range(Map<_K, _V> _m, const _K &_lo, const _K &_hi)
+{
+    size_t _i = _tree_rank(_m._impl, _map_key<_K, _V>(_lo),
+        _map_compare_wrapper<_K, _V>, false);
+    size_t _j = _tree_rank(_m._impl, _map_key<_K, _V>(_hi),
+        _map_compare_wrapper<_K, _V>, false);
+    return (_j > _i? _j - _i: 0);
+}
+
 /**
  * Map merge.
  * O(log(n) + log(m)).
@@ -245,10 +656,191 @@ template <typename _K, typename _V>
 inline PURE Map<_K, _V> merge(Map<_K, _V> _ma, Map<_K, _V> _mb)
 {
     Map<_K, _V> _m1 = {_tree_union(_ma._impl, _mb._impl,
-        _map_compare_wrapper<_K>)};
+        _map_compare_wrapper<_K, _V>)};
+    return _m1;
+}
+
+/*
+ * Union/intersection/difference with a function that combines the values of
+ * keys in both maps.  The function is passed the key and both values, and
+ * returns the combined value, or an empty Optional to drop the key.  The
+ * entry of ma is reused if the combined value is identical to its value.
+ */
+template <typename _K, typename _V, typename _F>
+inline Map<_K, _V> _map_merge_with(Map<_K, _V> _ma, Map<_K, _V> _mb, int _op,
+    _F &_func)
+{
+    bool (*_func_ptr)(void *, const Value<Word> *, const Value<Word> *,
+            Value<Word> *) =
+        [](void *_func_0, const Value<Word> *_ea0, const Value<Word> *_eb0,
+            Value<Word> *_e1) -> bool
+    {
+        _F *_func_1 = (_F *)_func_0;
+        Tuple<_K, _V> _ea = _map_entry_ref<_K, _V>(*_ea0);
+        Tuple<_K, _V> _eb = _map_entry_ref<_K, _V>(*_eb0);
+        Optional<_V> _r = (*_func_1)(first(_ea), second(_ea), second(_eb));
+        if (empty(_r))
+            return false;
+        const _V &_new = _r._get();
+        if (std::memcmp(&second(_ea), &_new, sizeof(_V)) == 0)
+            *_e1 = *_ea0;
+        else
+            *_e1 = _map_entry(tuple<_K, _V>(first(_ea), _new));
+        return true;
+    };
+    Map<_K, _V> _m1 = {_tree_merge_with(_ma._impl, _mb._impl,
+        _map_compare_wrapper<_K, _V>, _op, _func_ptr, (void *)&_func)};
+    return _m1;
+}
+
+/**
+ * Map merge with a combining function for keys in both maps.
+ * ([](K k, V va, V vb) -> V).
+ * O(m * log(n/m + 1)), where m <= n are the map sizes.
+ */
+template <typename _K, typename _V, typename _F>
+inline PURE Map<_K, _V> merge_with(Map<_K, _V> _ma, Map<_K, _V> _mb,
+    _F _func)
+{
+    auto _func_1 = [&_func](const _K &_k, const _V &_a, const _V &_b)
+        -> Optional<_V>
+    {
+        return Optional<_V>(_func(_k, _a, _b));
+    };
+    return _map_merge_with(_ma, _mb, _TREE_UNION, _func_1);
+}
+
+/**
+ * Map intersect with a combining function.  ([](K k, V va, V vb) -> V).
+ * O(m * log(n/m + 1)), where m <= n are the map sizes.
+ */
+template <typename _K, typename _V, typename _F>
+inline PURE Map<_K, _V> intersect_with(Map<_K, _V> _ma, Map<_K, _V> _mb,
+    _F _func)
+{
+    auto _func_1 = [&_func](const _K &_k, const _V &_a, const _V &_b)
+        -> Optional<_V>
+    {
+        return Optional<_V>(_func(_k, _a, _b));
+    };
+    return _map_merge_with(_ma, _mb, _TREE_INTERSECT, _func_1);
+}
+
+/**
+ * Map difference with a combining function.  Keys of ma that are not in mb
+ * are kept, and keys in both maps are kept with the value returned by the
+ * function (if any).  ([](K k, V va, V vb) -> Optional<V>).
+ * O(m * log(n/m + 1)), where m <= n are the map sizes.
+ */
+template <typename _K, typename _V, typename _F>
+inline PURE Map<_K, _V> difference_with(Map<_K, _V> _ma, Map<_K, _V> _mb,
+    _F _func)
+{
+    return _map_merge_with(_ma, _mb, _TREE_DIFF, _func);
+}
+
+/**
+ * Construct a transient (mutable) copy of a map.  Operations on the
+ * transient update nodes that it owns in place, and copy nodes shared with
+ * other maps.  The transient must not be used after persistent().
+ * Copying a TransientMap by value aliases the same owner, so only one of
+ * the copies may be updated.  Owner tokens are eventually reused, so a
+ * transient that is never made persistent must not share nodes with later
+ * transients.
+ * O(1).
+ */
+template <typename _K, typename _V>
+inline TransientMap<_K, _V> transient(Map<_K, _V> _m)
+{
+    TransientMap<_K, _V> _t = {_m._impl, _tree_owner_new()};
+    return _t;
+}
+
+/**
+ * Insert a key-value pair into a transient map (in place).
+ * O(log(n)).
+ */
+template <typename _K, typename _V>
+inline void insert(TransientMap<_K, _V> &_t, Tuple<_K, _V> _k)
+{
+    _t._impl = _tree_insert_owned(_t._impl, _map_entry(_k),
+        _map_compare_wrapper<_K, _V>, _t._owner);
+}
+
+/**
+ * Remove an entry from a transient map.
+ * O(log(n)).
+ */
+template <typename _K, typename _V>
+inline void erase(TransientMap<_K, _V> &_t, const _K &_k)
+{
+    _t._impl = _tree_delete_owned(_t._impl, _map_key<_K, _V>(_k),
+        _map_compare_wrapper<_K, _V>, _t._owner);
+}
+
+/**
+ * Find an entry in a transient map.  The entry is copied, since owned nodes
+ * are updated in place by later operations on the transient.
+ * O(log(n)).
+ */
+template <typename _K, typename _V>
+inline Optional<Tuple<_K, _V>> find(const TransientMap<_K, _V> &_t,
+    const _K &_k)
+{
+    auto _entry = _tree_search<_map_compare_wrapper<_K, _V>>(_t._impl,
+        _map_key<_K, _V>(_k));
+    return (_entry != nullptr?
+        Optional<Tuple<_K, _V>>(_map_entry_copy<_K, _V>(*_entry)):
+        Optional<Tuple<_K, _V>>());
+}
+
+/**
+ * Transient map size.
+ * O(1).
+ */
+template <typename _K, typename _V>
+inline size_t size(const TransientMap<_K, _V> &_t)
+{
+    return _tree_size(_t._impl);
+}
+
+/**
+ * Convert a transient map back into an (immutable) map.
+ * O(k), where k is the number of nodes owned by the transient.
+ */
+template <typename _K, typename _V>
+inline Map<_K, _V> persistent(TransientMap<_K, _V> &_t)
+{
+    Map<_K, _V> _m = {_tree_freeze(_t._impl, _t._owner)};
+    _t._impl = _tree_empty();
+    return _m;
+}
+
+/**
+ * Retain a map so that it outlives the values it was derived from.  Only
+ * meaningful for the reference counting backend (LIBF_GC_RC).
+ * O(1).
+ */
+template <typename _K, typename _V>
+inline Map<_K, _V> retain(Map<_K, _V> _m)
+{
+    Map<_K, _V> _m1 = {_tree_retain(_m._impl)};
     return _m1;
 }
 
+/**
+ * Release a map.  Nodes that are no longer referenced are freed immediately
+ * by the reference counting backend (LIBF_GC_RC), otherwise this is a no-op.
+ * Only a value that was passed to retain() may be released; releasing
+ * one that was not is an error.
+ * O(k), where k is the number of nodes freed.
+ */
+template <typename _K, typename _V>
+inline void release(Map<_K, _V> _m)
+{
+    _tree_release(_m._impl);
+}
+
 /**
  * Map verify.
  * O(n).
@@ -269,13 +861,71 @@ inline PURE int compare(Map<_K, _V> _m1, Map<_K, _V> _m2)
     int (*_func_ptr)(void *, Value<Word>, Value<Word>) =
         [] (void *_unused, Value<Word> _k10, Value<Word> _k20) -> int
     {
-        Tuple<_K, _V> _k1 = _bit_cast<Tuple<_K, _V>>(_k10);
-        Tuple<_K, _V> _k2 = _bit_cast<Tuple<_K, _V>>(_k20);
+        Tuple<_K, _V> _k1 = _map_entry_ref<_K, _V>(_k10);
+        Tuple<_K, _V> _k2 = _map_entry_ref<_K, _V>(_k20);
         return compare(_k1, _k2);
     };
     return _tree_compare(_m1._impl, _m2._impl, nullptr, _func_ptr);
 }
 
+/**
+ * Map diff.  Calls added(e) for each entry of m2 whose key is not in m1,
+ * removed(e) for each entry of m1 whose key is not in m2, and
+ * changed(e1, e2) for each key whose value differs, in key order.
+ * ([](Tuple<K, V> e) -> void), ([](Tuple<K, V> e1, Tuple<K, V> e2) -> void).
+ * Subtrees shared by both maps are skipped, so diffing a map against a
+ * recent version of itself is O(d * log(n)) for d changed entries.
+ */
+template <typename _K, typename _V, typename _F, typename _G, typename _H>
+inline void diff_entries(Map<_K, _V> _m1, Map<_K, _V> _m2, _F _added,
+    _G _removed, _H _changed)
+{
+    struct _Funcs
+    {
+        _F *_added;
+        _G *_removed;
+        _H *_changed;
+    } _funcs = {&_added, &_removed, &_changed};
+    void (*_func_ptr)(void *, const Value<Word> *, const Value<Word> *) =
+        [] (void *_funcs_0, const Value<Word> *_k1, const Value<Word> *_k2)
+    {
+        _Funcs *_funcs_1 = (_Funcs *)_funcs_0;
+        if (_k1 == nullptr)
+            (*_funcs_1->_added)(_map_entry_copy<_K, _V>(*_k2));
+        else if (_k2 == nullptr)
+            (*_funcs_1->_removed)(_map_entry_copy<_K, _V>(*_k1));
+        else
+        {
+            Tuple<_K, _V> _e1 = _map_entry_copy<_K, _V>(*_k1);
+            Tuple<_K, _V> _e2 = _map_entry_copy<_K, _V>(*_k2);
+            if (compare(second(_e1), second(_e2)) != 0)
+                (*_funcs_1->_changed)(_e1, _e2);
+        }
+    };
+    _tree_diff_entries(_m1._impl, _m2._impl, _map_compare_wrapper<_K, _V>,
+        _func_ptr, (void *)&_funcs);
+}
+
+/**
+ * Map diff as a map.  Maps each key that was added or changed from m1 to m2
+ * to its new value, and each key that was removed to an empty value.
+ * O(d * log(n)) for d changed entries (see above).
+ */
+template <typename _K, typename _V>
+inline PURE Map<_K, Optional<_V>> diff_entries(Map<_K, _V> _m1,
+    Map<_K, _V> _m2)
+{
+    TransientMap<_K, Optional<_V>> _t = transient(map<_K, Optional<_V>>());
+    diff_entries(_m1, _m2,
+        [&_t] (Tuple<_K, _V> _e)
+            { insert(_t, tuple(first(_e), Optional<_V>(second(_e)))); },
+        [&_t] (Tuple<_K, _V> _e)
+            { insert(_t, tuple(first(_e), Optional<_V>())); },
+        [&_t] (Tuple<_K, _V> _e1, Tuple<_K, _V> _e2)
+            { insert(_t, tuple(first(_e2), Optional<_V>(second(_e2)))); });
+    return persistent(_t);
+}
+
 /**
  * Map show.
  * O(n).
@@ -286,7 +936,7 @@ inline PURE String show(Map<_K, _V> _m)
     String (*_func_ptr)(Value<Word>) = 
         [] (Value<Word> _k0) -> String
     {
-        Tuple<_K, _V> _k = _bit_cast<Tuple<_K, _V>>(_k0);
+        Tuple<_K, _V> _k = _map_entry_ref<_K, _V>(_k0);
         return append(append(show(first(_k)), "->"), show(second(_k)));
     };
     return _tree_show(_m._impl, _func_ptr);
@@ -316,6 +966,36 @@ inline PURE MapItr<_K, _V> end(Map<_K, _V> _m)
     return _itr;
 }
 
+/**
+ * Construct an iterator pointing to the least entry of a map with a key not
+ * less than k (or end() if there is none).
+ * O(log(n)).
+ */
+template <typename _K, typename _V>
+inline PURE MapItr<_K, _V> lower_bound(Map<_K, _V> _m, const _K &_k)
+{
+    MapItr<_K, _V> _itr;
+    _itr._tree_itr = begin(_m._impl);
+    _itr._tree_itr += _tree_rank(_m._impl, _map_key<_K, _V>(_k),
+        _map_compare_wrapper<_K, _V>, false);
+    return _itr;
+}
+
+/**
+ * Construct an iterator pointing to the least entry of a map with a key
+ * greater than k (or end() if there is none).
+ * O(log(n)).
+ */
+template <typename _K, typename _V>
+inline PURE MapItr<_K, _V> upper_bound(Map<_K, _V> _m, const _K &_k)
+{
+    MapItr<_K, _V> _itr;
+    _itr._tree_itr = begin(_m._impl);
+    _itr._tree_itr += _tree_rank(_m._impl, _map_key<_K, _V>(_k),
+        _map_compare_wrapper<_K, _V>, true);
+    return _itr;
+}
+
 /**
  * Map iterator increment.
  * O(1).
@@ -389,8 +1069,7 @@ inline MapItr<_K, _V> &operator-=(MapItr<_K, _V> &_i, ssize_t _offset)
 template <typename _K, typename _V>
 inline PURE Tuple<_K, _V> operator*(MapItr<_K, _V> &_i)
 {
-    Value<Word> _k = *_i._tree_itr;
-    return _bit_cast<Tuple<_K, _V>>(_k);
+    return _map_entry_ref<_K, _V>(*_i._tree_itr);
 }
 
 /**
@@ -400,7 +1079,7 @@ inline PURE Tuple<_K, _V> operator*(MapItr<_K, _V> &_i)
 template <typename _K, typename _V>
 inline bool operator==(const MapItr<_K, _V> &_i, const MapItr<_K, _V> &_j)
 {
-    return (_i._tree_itr != _j._tree_itr);
+    return (_i._tree_itr == _j._tree_itr);
 }
 
 /**
@@ -418,5 +1097,6 @@ inline bool operator!=(const MapItr<_K, _V> &_i, const MapItr<_K, _V> &_j)
 #include "flist.h"
 #include "fstring.h"
 #include "ftuple.h"
+#include "fvector.h"
 
 #endif      /* _MAP_H */
@@ -31,6 +31,7 @@
 #define _FMAP_DEFS_H
 
 #include "ftree.h"
+#include "ftuple_defs.h"
 
 namespace F
 {
@@ -41,12 +42,22 @@ struct Map
     _Tree _impl;
 };
 
+template <typename _K, typename _V>
+struct TransientMap
+{
+    _Tree _impl;
+    size_t _owner;
+};
+
 template <typename _K, typename _V>
 struct MapItr
 {
     _TreeItr _tree_itr;
 };
 
+template <typename _K, typename _V>
+inline Tuple<_K, _V> _map_entry_copy(Value<Word> _k);
+
 }           /* namespace F */
 
 #endif      /* _FMAP_DEFS_H */
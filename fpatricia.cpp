@@ -0,0 +1,548 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "fbase.h"
+#include "fgc.h"
+#include "fpatricia.h"
+#include "fstring.h"
+
+namespace F
+{
+
+/*
+ * Big-endian Patricia tries.
+ */
+
+#define error_bad_patricia()    error("data-structure invariant violated")
+
+/*
+ * Interface renaming.
+ */
+typedef _Patricia Patricia;
+typedef _PatriciaLeaf PatriciaLeaf;
+typedef _PatriciaBranch PatriciaBranch;
+typedef Value<Word> V;
+#define PATRICIA_EMPTY _patricia_empty()
+
+enum
+{
+    PATRICIA_NIL    = _PATRICIA_NIL,
+    PATRICIA_LEAF   = _PATRICIA_LEAF,
+    PATRICIA_BRANCH = _PATRICIA_BRANCH
+};
+
+#ifdef LIBF_GC_RC
+static void patricia_free(Patricia t);
+#endif
+
+/*
+ * Key bit manipulation.  The prefix of a key for a mask is the key with the
+ * mask bit and all lower bits cleared.
+ */
+static inline uint64_t patricia_prefix(uint64_t k, uint64_t m)
+{
+    return k & ~(m | (m - 1));
+}
+static inline bool patricia_match(uint64_t k, uint64_t p, uint64_t m)
+{
+    return (patricia_prefix(k, m) == p);
+}
+static inline uint64_t patricia_highest_bit(uint64_t x)
+{
+    return (uint64_t)1 << (63 - __builtin_clzll(x));
+}
+
+/*
+ * The key of a leaf, or the prefix of a branch.
+ */
+static inline uint64_t patricia_key(Patricia t)
+{
+    if (index(t) == PATRICIA_LEAF)
+    {
+        const PatriciaLeaf &l = t;
+        return l.key;
+    }
+    const PatriciaBranch &b = t;
+    return _patricia_prefix(b);
+}
+
+static inline const void *patricia_ptr(Patricia t)
+{
+    return (const void *)(_bit_cast<Word>(t) & ~(Word)_UNION_TAG_MASK);
+}
+
+/*
+ * Reference counting (only enabled for the LIBF_GC_RC backend).
+ */
+static inline void patricia_retain(Patricia t)
+{
+#ifdef LIBF_GC_RC
+    if (index(t) != PATRICIA_NIL)
+        gc_retain(patricia_ptr(t));
+#else
+    (void)t;
+#endif
+}
+static inline void patricia_unref(Patricia t)
+{
+#ifdef LIBF_GC_RC
+    if (index(t) != PATRICIA_NIL && gc_release(patricia_ptr(t)))
+        patricia_free(t);
+#else
+    (void)t;
+#endif
+}
+
+extern Patricia _patricia_retain(Patricia t)
+{
+    patricia_retain(t);
+    return t;
+}
+
+extern void _patricia_release(Patricia t)
+{
+#ifdef LIBF_GC_RC
+    if (index(t) == PATRICIA_NIL)
+        return;
+    if (gc_refs(patricia_ptr(t)) == 0)
+        error("release of a value that was not retained");
+    patricia_unref(t);
+#else
+    (void)t;
+#endif
+}
+
+#ifdef LIBF_GC_RC
+static void patricia_free(Patricia t)
+{
+    switch (index(t))
+    {
+        case PATRICIA_LEAF:
+            gc_free_node<PatriciaLeaf>((void *)patricia_ptr(t));
+            break;
+        case PATRICIA_BRANCH:
+        {
+            const PatriciaBranch &b = t;
+            patricia_unref(b.left);
+            patricia_unref(b.right);
+            gc_free_node<PatriciaBranch>((void *)&b);
+            break;
+        }
+        default:
+            error_bad_patricia();
+    }
+}
+#endif
+
+/*
+ * Constructors.
+ */
+static Patricia patricia_leaf(uint64_t k, V v)
+{
+    PatriciaLeaf *l = (PatriciaLeaf *)gc_malloc_node<PatriciaLeaf>();
+    l->key = k;
+    l->val = v;
+    return _bit_cast<Patricia>((Word)l | PATRICIA_LEAF);
+}
+static Patricia patricia_branch(uint64_t p, uint64_t m, Patricia t,
+    Patricia u)
+{
+    PatriciaBranch *b = (PatriciaBranch *)gc_malloc_node<PatriciaBranch>();
+    b->bits = p | m;
+    b->size = _patricia_size(t) + _patricia_size(u);
+    b->left = t;
+    b->right = u;
+    patricia_retain(t);
+    patricia_retain(u);
+    return _bit_cast<Patricia>((Word)b | PATRICIA_BRANCH);
+}
+
+/*
+ * Rebuild branch t with new sub-tries, either of which may be empty.  The
+ * branch is returned as-is if both sub-tries are unchanged.
+ */
+static Patricia patricia_rebranch(Patricia t, Patricia l, Patricia r)
+{
+    const PatriciaBranch &b = t;
+    if (index(l) == PATRICIA_NIL)
+        return r;
+    if (index(r) == PATRICIA_NIL)
+        return l;
+    if (l == b.left && r == b.right)
+        return t;
+    return patricia_branch(_patricia_prefix(b), _patricia_mask(b), l, r);
+}
+
+/*
+ * Join two non-empty tries whose keys (or prefixes) k and j disagree above
+ * both of their masks.
+ */
+static Patricia patricia_join(uint64_t k, Patricia t, uint64_t j,
+    Patricia u)
+{
+    uint64_t m = patricia_highest_bit(k ^ j);
+    uint64_t p = patricia_prefix(k, m);
+    if ((k & m) == 0)
+        return patricia_branch(p, m, t, u);
+    else
+        return patricia_branch(p, m, u, t);
+}
+
+/*
+ * Insert a leaf.  An existing entry with the same key is replaced if
+ * replace is set, otherwise the trie is returned as-is.
+ */
+static Patricia patricia_insert_2(Patricia t, Patricia l, bool replace)
+{
+    const PatriciaLeaf &nl = l;
+    uint64_t k = nl.key;
+    switch (index(t))
+    {
+        case PATRICIA_NIL:
+            return l;
+        case PATRICIA_LEAF:
+        {
+            const PatriciaLeaf &tl = t;
+            if (tl.key == k)
+                return (replace? l: t);
+            return patricia_join(k, l, tl.key, t);
+        }
+        case PATRICIA_BRANCH:
+        {
+            const PatriciaBranch &b = t;
+            uint64_t p = _patricia_prefix(b), m = _patricia_mask(b);
+            if (!patricia_match(k, p, m))
+                return patricia_join(k, l, p, t);
+            if ((k & m) == 0)
+            {
+                Patricia nt = patricia_insert_2(b.left, l, replace);
+                return patricia_rebranch(t, nt, b.right);
+            }
+            else
+            {
+                Patricia nt = patricia_insert_2(b.right, l, replace);
+                return patricia_rebranch(t, b.left, nt);
+            }
+        }
+        default:
+            error_bad_patricia();
+    }
+}
+
+extern PURE Patricia _patricia_insert(Patricia t, uint64_t k, V v)
+{
+    return patricia_insert_2(t, patricia_leaf(k, v), true);
+}
+
+/*
+ * Delete.  A branch that loses one of its sub-tries is replaced by the
+ * other.
+ */
+extern PURE Patricia _patricia_delete(Patricia t, uint64_t k)
+{
+    switch (index(t))
+    {
+        case PATRICIA_NIL:
+            return t;
+        case PATRICIA_LEAF:
+        {
+            const PatriciaLeaf &l = t;
+            return (l.key == k? PATRICIA_EMPTY: t);
+        }
+        case PATRICIA_BRANCH:
+        {
+            const PatriciaBranch &b = t;
+            uint64_t m = _patricia_mask(b);
+            if (!patricia_match(k, _patricia_prefix(b), m))
+                return t;
+            if ((k & m) == 0)
+                return patricia_rebranch(t, _patricia_delete(b.left, k),
+                    b.right);
+            else
+                return patricia_rebranch(t, b.left,
+                    _patricia_delete(b.right, k));
+        }
+        default:
+            error_bad_patricia();
+    }
+}
+
+/*
+ * The leaf for a key, else empty.
+ */
+static Patricia patricia_lookup(Patricia t, uint64_t k)
+{
+    while (index(t) == PATRICIA_BRANCH)
+    {
+        const PatriciaBranch &b = t;
+        t = ((k & _patricia_mask(b)) == 0? b.left: b.right);
+    }
+    if (index(t) == PATRICIA_LEAF)
+    {
+        const PatriciaLeaf &l = t;
+        if (l.key == k)
+            return t;
+    }
+    return PATRICIA_EMPTY;
+}
+
+/*
+ * Union.  Shared sub-tries are returned as-is, and tries with disjoint
+ * prefixes are joined by a single new branch, so the union of tries over
+ * mostly disjoint key ranges only copies the paths where they overlap.
+ */
+extern PURE Patricia _patricia_union(Patricia t, Patricia u)
+{
+    if (t == u || index(u) == PATRICIA_NIL)
+        return t;
+    switch (index(t))
+    {
+        case PATRICIA_NIL:
+            return u;
+        case PATRICIA_LEAF:
+            return patricia_insert_2(u, t, false);
+        case PATRICIA_BRANCH:
+            break;
+        default:
+            error_bad_patricia();
+    }
+    if (index(u) == PATRICIA_LEAF)
+        return patricia_insert_2(t, u, true);
+    const PatriciaBranch &bt = t;
+    const PatriciaBranch &bu = u;
+    uint64_t pt = _patricia_prefix(bt), mt = _patricia_mask(bt);
+    uint64_t pu = _patricia_prefix(bu), mu = _patricia_mask(bu);
+    if (bt.bits == bu.bits)
+        return patricia_rebranch(t, _patricia_union(bt.left, bu.left),
+            _patricia_union(bt.right, bu.right));
+    if (mt > mu && patricia_match(pu, pt, mt))
+    {
+        if ((pu & mt) == 0)
+            return patricia_rebranch(t, _patricia_union(bt.left, u),
+                bt.right);
+        else
+            return patricia_rebranch(t, bt.left,
+                _patricia_union(bt.right, u));
+    }
+    if (mt < mu && patricia_match(pt, pu, mu))
+    {
+        if ((pt & mu) == 0)
+            return patricia_rebranch(u, _patricia_union(t, bu.left),
+                bu.right);
+        else
+            return patricia_rebranch(u, bu.left,
+                _patricia_union(t, bu.right));
+    }
+    return patricia_join(pt, t, pu, u);
+}
+
+/*
+ * Intersection.
+ */
+extern PURE Patricia _patricia_intersect(Patricia t, Patricia u)
+{
+    if (t == u)
+        return t;
+    if (index(t) == PATRICIA_NIL || index(u) == PATRICIA_NIL)
+        return PATRICIA_EMPTY;
+    if (index(t) == PATRICIA_LEAF)
+    {
+        const PatriciaLeaf &l = t;
+        return (_patricia_search(u, l.key) != nullptr? t: PATRICIA_EMPTY);
+    }
+    if (index(u) == PATRICIA_LEAF)
+    {
+        const PatriciaLeaf &l = u;
+        return patricia_lookup(t, l.key);
+    }
+    const PatriciaBranch &bt = t;
+    const PatriciaBranch &bu = u;
+    uint64_t pt = _patricia_prefix(bt), mt = _patricia_mask(bt);
+    uint64_t pu = _patricia_prefix(bu), mu = _patricia_mask(bu);
+    if (bt.bits == bu.bits)
+        return patricia_rebranch(t, _patricia_intersect(bt.left, bu.left),
+            _patricia_intersect(bt.right, bu.right));
+    if (mt > mu && patricia_match(pu, pt, mt))
+        return _patricia_intersect(
+            ((pu & mt) == 0? bt.left: bt.right), u);
+    if (mt < mu && patricia_match(pt, pu, mu))
+        return _patricia_intersect(t,
+            ((pt & mu) == 0? bu.left: bu.right));
+    return PATRICIA_EMPTY;
+}
+
+/*
+ * Difference.
+ */
+extern PURE Patricia _patricia_diff(Patricia t, Patricia u)
+{
+    if (t == u)
+        return PATRICIA_EMPTY;
+    if (index(t) == PATRICIA_NIL || index(u) == PATRICIA_NIL)
+        return t;
+    if (index(t) == PATRICIA_LEAF)
+    {
+        const PatriciaLeaf &l = t;
+        return (_patricia_search(u, l.key) != nullptr? PATRICIA_EMPTY: t);
+    }
+    if (index(u) == PATRICIA_LEAF)
+    {
+        const PatriciaLeaf &l = u;
+        return _patricia_delete(t, l.key);
+    }
+    const PatriciaBranch &bt = t;
+    const PatriciaBranch &bu = u;
+    uint64_t pt = _patricia_prefix(bt), mt = _patricia_mask(bt);
+    uint64_t pu = _patricia_prefix(bu), mu = _patricia_mask(bu);
+    if (bt.bits == bu.bits)
+        return patricia_rebranch(t, _patricia_diff(bt.left, bu.left),
+            _patricia_diff(bt.right, bu.right));
+    if (mt > mu && patricia_match(pu, pt, mt))
+    {
+        if ((pu & mt) == 0)
+            return patricia_rebranch(t, _patricia_diff(bt.left, u),
+                bt.right);
+        else
+            return patricia_rebranch(t, bt.left,
+                _patricia_diff(bt.right, u));
+    }
+    if (mt < mu && patricia_match(pt, pu, mu))
+        return _patricia_diff(t,
+            ((pt & mu) == 0? bu.left: bu.right));
+    return t;
+}
+
+/*
+ * Map.  Keys are unchanged, so the trie keeps its shape.
+ */
+extern PURE Patricia _patricia_map(Patricia t, V (*f)(void *, uint64_t, V),
+    void *data)
+{
+    switch (index(t))
+    {
+        case PATRICIA_NIL:
+            return t;
+        case PATRICIA_LEAF:
+        {
+            const PatriciaLeaf &l = t;
+            return patricia_leaf(l.key, f(data, l.key, l.val));
+        }
+        case PATRICIA_BRANCH:
+        {
+            const PatriciaBranch &b = t;
+            Patricia l = _patricia_map(b.left, f, data);
+            Patricia r = _patricia_map(b.right, f, data);
+            return patricia_branch(_patricia_prefix(b), _patricia_mask(b), l,
+                r);
+        }
+        default:
+            error_bad_patricia();
+    }
+}
+
+/*
+ * Verify.  Each mask must be below the mask of the parent, sub-tries must
+ * be non-empty, and sizes must be correct.  The key bits at and above the
+ * mask m of the parent must equal p for every key in the trie.
+ */
+static bool patricia_verify_2(Patricia t, uint64_t p, uint64_t m)
+{
+    uint64_t k = patricia_key(t);
+    if (m != 0 && (k & ~(m - 1)) != p)
+        return false;
+    switch (index(t))
+    {
+        case PATRICIA_LEAF:
+            return true;
+        case PATRICIA_BRANCH:
+        {
+            const PatriciaBranch &b = t;
+            uint64_t p1 = _patricia_prefix(b), m1 = _patricia_mask(b);
+            if (m1 == 0 || (m != 0 && m1 >= m))
+                return false;
+            if (index(b.left) == PATRICIA_NIL ||
+                    index(b.right) == PATRICIA_NIL)
+                return false;
+            if (b.size != _patricia_size(b.left) + _patricia_size(b.right))
+                return false;
+            return patricia_verify_2(b.left, p1, m1) &&
+                patricia_verify_2(b.right, p1 | m1, m1);
+        }
+        default:
+            return false;
+    }
+}
+
+extern PURE bool _patricia_verify(Patricia t)
+{
+    if (index(t) == PATRICIA_NIL)
+        return true;
+    return patricia_verify_2(t, 0, 0);
+}
+
+/*
+ * Show.
+ */
+static String patricia_show_2(Patricia t, String r, bool *first,
+    String (*f)(uint64_t, V))
+{
+    switch (index(t))
+    {
+        case PATRICIA_NIL:
+            return r;
+        case PATRICIA_LEAF:
+        {
+            const PatriciaLeaf &l = t;
+            if (!*first)
+                r = append(r, ',');
+            *first = false;
+            return append(r, f(l.key, l.val));
+        }
+        case PATRICIA_BRANCH:
+        {
+            const PatriciaBranch &b = t;
+            r = patricia_show_2(b.left, r, first, f);
+            return patricia_show_2(b.right, r, first, f);
+        }
+        default:
+            error_bad_patricia();
+    }
+}
+
+extern PURE String _patricia_show(Patricia t, String (*f)(uint64_t, V))
+{
+    bool first = true;
+    String r = string('{');
+    r = patricia_show_2(t, r, &first, f);
+    r = append(r, '}');
+    return r;
+}
+
+}
+
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FPATRICIA_H
+#define _FPATRICIA_H
+
+/*
+ * Big-endian Patricia tries for IntMap and IntSet.  Keys are 64-bit
+ * unsigned integers, so lookups branch on a single key bit per level rather
+ * than calling a comparison function.  Values are type-erased as for trees
+ * (see ftree.h).  Lookup and traversal are inlined into client code, while
+ * updates and the set operations are out-of-line (see fpatricia.cpp).
+ */
+
+#include <cstdint>
+
+#include "fbase.h"
+#include "fgc.h"
+#include "fvalue.h"
+
+#include "fstring_defs.h"
+
+namespace F
+{
+
+/*
+ * Patricia trie object.
+ */
+struct _PatriciaNil
+{
+    // Empty
+};
+struct _PatriciaLeaf;
+struct _PatriciaBranch;
+typedef Union<_PatriciaNil, _PatriciaLeaf, _PatriciaBranch> _Patricia;
+
+/*
+ * Leaf node holding a single entry.  The value is stored as a Value<V>, so
+ * the leaf has the same layout as a Tuple<uint64_t, V> for word-sized V.
+ */
+struct _PatriciaLeaf
+{
+    uint64_t key;
+    Value<Word> val;
+};
+
+/*
+ * Branch node.  The mask is the highest bit at which the keys of the two
+ * sub-tries differ, and the prefix holds the key bits above the mask that
+ * are common to all keys.  Both are packed into the bits field as the
+ * prefix with the mask bit set, since all lower bits are zero.  Keys with
+ * the mask bit clear are in the left sub-trie, so traversal is in
+ * increasing key order.  Both sub-tries are non-empty, so the shape of a
+ * trie depends only on its keys.  The size field is the number of entries
+ * in the trie.
+ */
+struct _PatriciaBranch
+{
+    uint64_t bits;
+    size_t size;
+    _Patricia left;
+    _Patricia right;
+};
+
+inline uint64_t _patricia_mask(const _PatriciaBranch &_b)
+{
+    return _b.bits & -_b.bits;
+}
+inline uint64_t _patricia_prefix(const _PatriciaBranch &_b)
+{
+    return _b.bits & (_b.bits - 1);
+}
+
+/*
+ * Patricia trie node types.
+ */
+enum
+{
+    _PATRICIA_NIL    = _Patricia::index<_PatriciaNil>(),
+    _PATRICIA_LEAF   = _Patricia::index<_PatriciaLeaf>(),
+    _PATRICIA_BRANCH = _Patricia::index<_PatriciaBranch>()
+};
+
+/*
+ * Precise GC layouts (LIBF_GC_TYPED): keys, masks and sizes are never
+ * pointers.
+ */
+template <> struct _GCLayout<_PatriciaLeaf>
+    { static const uint64_t _mask = 0x2; };
+template <> struct _GCLayout<_PatriciaBranch>
+    { static const uint64_t _mask = 0xC; };
+
+/*
+ * Allocation statistics (LIBF_ALLOC_STATS).
+ */
+template <> struct _GCStatKind<_PatriciaLeaf>
+    { static const unsigned _kind = GC_STAT_TREE; };
+template <> struct _GCStatKind<_PatriciaBranch>
+    { static const unsigned _kind = GC_STAT_TREE; };
+
+inline PURE _Patricia _patricia_empty(void)
+{
+    return (_PatriciaNil){};
+}
+inline PURE bool _patricia_is_empty(_Patricia _t)
+{
+    return (index(_t) == _PATRICIA_NIL);
+}
+
+inline PURE size_t _patricia_size(_Patricia _t)
+{
+    switch (index(_t))
+    {
+        case _PATRICIA_LEAF:
+            return 1;
+        case _PATRICIA_BRANCH:
+        {
+            const _PatriciaBranch &_b = _t;
+            return _b.size;
+        }
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Search.  Only the mask bits are tested on the way down; the key itself is
+ * compared once at the leaf.
+ */
+inline PURE const _PatriciaLeaf *_patricia_search(_Patricia _t, uint64_t _k)
+{
+    while (index(_t) == _PATRICIA_BRANCH)
+    {
+        const _PatriciaBranch &_b = _t;
+        _t = ((_k & _patricia_mask(_b)) == 0? _b.left: _b.right);
+    }
+    if (index(_t) != _PATRICIA_LEAF)
+        return nullptr;
+    const _PatriciaLeaf &_l = _t;
+    return (_l.key == _k? &_l: nullptr);
+}
+
+/*
+ * Reference counting (only enabled for the LIBF_GC_RC backend).  Each
+ * branch holds a reference to its sub-tries.
+ */
+extern _Patricia _patricia_retain(_Patricia _t);
+extern void _patricia_release(_Patricia _t);
+
+/*
+ * Updates and set operations.  Results share all unchanged sub-tries with
+ * their arguments, and an argument is returned as-is if it is unchanged.
+ * Union keeps the entries of u for keys in both tries; intersection and
+ * difference keep the entries of t.
+ */
+extern PURE _Patricia _patricia_insert(_Patricia _t, uint64_t _k,
+    Value<Word> _v);
+extern PURE _Patricia _patricia_delete(_Patricia _t, uint64_t _k);
+extern PURE _Patricia _patricia_union(_Patricia _t, _Patricia _u);
+extern PURE _Patricia _patricia_intersect(_Patricia _t, _Patricia _u);
+extern PURE _Patricia _patricia_diff(_Patricia _t, _Patricia _u);
+extern PURE _Patricia _patricia_map(_Patricia _t,
+    Value<Word> (*_func)(void *, uint64_t, Value<Word>), void *_data);
+extern PURE bool _patricia_verify(_Patricia _t);
+extern PURE String _patricia_show(_Patricia _t,
+    String (*_f)(uint64_t, Value<Word>));
+
+/*
+ * Traversal in increasing (resp. decreasing) key order.
+ */
+template <typename _F>
+inline void _patricia_for_each_k(_Patricia _t, _F &_func)
+{
+    while (index(_t) == _PATRICIA_BRANCH)
+    {
+        const _PatriciaBranch &_b = _t;
+        _patricia_for_each_k(_b.left, _func);
+        _t = _b.right;
+    }
+    if (index(_t) == _PATRICIA_LEAF)
+    {
+        const _PatriciaLeaf &_l = _t;
+        _func(_l);
+    }
+}
+
+template <typename _F>
+inline void _patricia_for_each_rev_k(_Patricia _t, _F &_func)
+{
+    while (index(_t) == _PATRICIA_BRANCH)
+    {
+        const _PatriciaBranch &_b = _t;
+        _patricia_for_each_rev_k(_b.right, _func);
+        _t = _b.left;
+    }
+    if (index(_t) == _PATRICIA_LEAF)
+    {
+        const _PatriciaLeaf &_l = _t;
+        _func(_l);
+    }
+}
+
+}           /* namespace F */
+
+#include "fstring.h"
+
+#endif      /* _FPATRICIA_H */
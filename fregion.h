@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FREGION_H
+#define _FREGION_H
+
+#include "fbase.h"
+#include "fgc.h"
+#include "flist.h"
+#include "fmap.h"
+#include "fmaybe.h"
+#include "fset.h"
+#include "fstring.h"
+#include "ftuple.h"
+#include "fvector.h"
+
+namespace F
+{
+
+/**
+ * Allocation region.  While a Region object is live, all LibF objects
+ * created by the current thread are bump-allocated from the region, and are
+ * released together in one step when the Region is destroyed.  Values that
+ * must outlive the region must be copied out with promote().
+ */
+struct Region
+{
+    _GCRegion _impl;
+
+    Region()
+    {
+        _gc_region_begin(&_impl);
+    }
+
+    ~Region()
+    {
+        _gc_region_end(&_impl);
+    }
+
+    Region(const Region &) = delete;
+    Region &operator=(const Region &) = delete;
+};
+
+/*
+ * Suspend the current region (allocate from the GC heap).
+ */
+struct _RegionSuspend
+{
+    _GCRegion *_region;
+
+    _RegionSuspend() : _region(_gc_region)
+    {
+        _gc_region = nullptr;
+    }
+
+    ~_RegionSuspend()
+    {
+        _gc_region = _region;
+    }
+};
+
+/**
+ * Promote a value out of a region, i.e. (deep) copy it to the GC heap.  For
+ * values without LibF objects this is the identity.
+ * O(1).
+ */
+template <typename _T>
+inline PURE _T promote(const _T &_x)
+{
+    return _x;
+}
+
+/**
+ * Promote a list out of a region.
+ * O(n).
+ */
+template <typename _T>
+inline PURE List<_T> promote(List<_T> _xs)
+{
+    _RegionSuspend _suspend;
+    return map<_T>(_xs, [] (const _T &_x) -> _T { return promote(_x); });
+}
+
+/**
+ * Promote a maybe out of a region.
+ * O(1) + the cost of promoting the element.
+ */
+template <typename _T>
+inline PURE Maybe<_T> promote(Maybe<_T> _m)
+{
+    if (empty(_m))
+        return _m;
+    _RegionSuspend _suspend;
+    const _T &_x = _m;
+    return maybe<_T>(promote(_x));
+}
+
+/*
+ * Tuple promote helpers.
+ */
+template <size_t _i, typename... _T>
+inline void _tuple_promote(uint8_t *_dst, Tuple<_T...> _t)
+{
+    if constexpr (_i < sizeof...(_T))
+    {
+        typedef _tuple_elem<_i, 0, _T...> _E;
+        typename _E::_type _x = promote(_tuple_get<_i, _T...>(_t));
+        std::memcpy(_dst + _E::_offset, &_x, sizeof(_x));
+        _tuple_promote<_i + 1, _T...>(_dst, _t);
+    }
+}
+
+/**
+ * Promote a tuple out of a region.
+ * O(1) + the cost of promoting the elements.
+ */
+template <typename... _T>
+inline PURE Tuple<_T...> promote(Tuple<_T...> _t)
+{
+    _RegionSuspend _suspend;
+    uint8_t *_data = (uint8_t *)gc_malloc_node<_TupleData<_T...>>();
+    _tuple_promote<0, _T...>(_data, _t);
+    Tuple<_T...> _t1 = {(Value<Word> *)_data};
+    return _t1;
+}
+
+/**
+ * Promote a string out of a region.
+ * O(n).
+ */
+inline PURE String promote(String _s)
+{
+    _RegionSuspend _suspend;
+    return map(_s, [] (size_t _idx, char32_t _c) -> char32_t { return _c; });
+}
+
+/**
+ * Promote a vector out of a region.
+ * O(n).
+ */
+template <typename _T>
+inline PURE Vector<_T> promote(Vector<_T> _v)
+{
+    _RegionSuspend _suspend;
+    return map<_T>(_v, [] (size_t _idx, const _T &_x) -> _T
+        { return promote(_x); });
+}
+
+/**
+ * Promote a set out of a region.
+ * O(n).
+ */
+template <typename _T>
+inline PURE Set<_T> promote(Set<_T> _s)
+{
+    _RegionSuspend _suspend;
+    Value<Word> (*_func_ptr)(void *, Value<Word>) =
+        [] (void *_unused, Value<Word> _k0) -> Value<Word>
+    {
+        Value<_T> _k = _bit_cast<Value<_T>>(_k0);
+        const _T &_x = _k;
+        return _bit_cast<Value<Word>>(Value<_T>(promote(_x)));
+    };
+    Set<_T> _s1 = {_tree_map(_s._impl, _func_ptr, nullptr)};
+    return _s1;
+}
+
+/**
+ * Promote a map out of a region.
+ * O(n).
+ */
+template <typename _K, typename _V>
+inline PURE Map<_K, _V> promote(Map<_K, _V> _m)
+{
+    _RegionSuspend _suspend;
+    Value<Word> (*_func_ptr)(void *, Value<Word>) =
+        [] (void *_unused, Value<Word> _k0) -> Value<Word>
+    {
+        Tuple<_K, _V> _entry = _map_entry_ref<_K, _V>(_k0);
+        return _map_entry(promote(_entry));
+    };
+    Map<_K, _V> _m1 = {_tree_map(_m._impl, _func_ptr, nullptr)};
+    return _m1;
+}
+
+}           /* namespace F */
+
+#endif      /* _FREGION_H */
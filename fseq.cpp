@@ -129,6 +129,30 @@ enum
     DEEP   = Seq::index<Deep>()
 };
 
+/*
+ * Precise GC layouts (LIBF_GC_TYPED): the len field is never a pointer.
+ */
+template <> struct _GCLayout<Tree2> : _GCLayoutSized<Tree2> { };
+template <> struct _GCLayout<Tree3> : _GCLayoutSized<Tree3> { };
+template <> struct _GCLayout<Dig1> : _GCLayoutSized<Dig1> { };
+template <> struct _GCLayout<Dig2> : _GCLayoutSized<Dig2> { };
+template <> struct _GCLayout<Dig3> : _GCLayoutSized<Dig3> { };
+template <> struct _GCLayout<Dig4> : _GCLayoutSized<Dig4> { };
+template <> struct _GCLayout<Single> : _GCLayoutSized<Single> { };
+template <> struct _GCLayout<Deep> : _GCLayoutSized<Deep> { };
+
+/*
+ * Allocation statistics (LIBF_ALLOC_STATS).
+ */
+template <> struct _GCStatKind<Tree2> { static const unsigned _kind = GC_STAT_SEQ; };
+template <> struct _GCStatKind<Tree3> { static const unsigned _kind = GC_STAT_SEQ; };
+template <> struct _GCStatKind<Dig1> { static const unsigned _kind = GC_STAT_SEQ; };
+template <> struct _GCStatKind<Dig2> { static const unsigned _kind = GC_STAT_SEQ; };
+template <> struct _GCStatKind<Dig3> { static const unsigned _kind = GC_STAT_SEQ; };
+template <> struct _GCStatKind<Dig4> { static const unsigned _kind = GC_STAT_SEQ; };
+template <> struct _GCStatKind<Single> { static const unsigned _kind = GC_STAT_SEQ; };
+template <> struct _GCStatKind<Deep> { static const unsigned _kind = GC_STAT_SEQ; };
+
 static size_t dig_length(Dig s);
 static size_t tree_length(Tree s);
 static size_t seq_depth(Seq s);
@@ -173,6 +197,57 @@ static PURE Value<Word> tree_search_left(Tree s, void *data, Value<Word> state,
     Value<Word> (*next)(void *, Frag, Value<Word>),
     bool (*stop)(Value<Word>));
 
+/*
+ * Reference counting (only enabled for the LIBF_GC_RC backend).  Each node
+ * holds a reference to its children, and each leaf to its fragment.
+ */
+template <typename T>
+static inline const void *node_ptr(T x)
+{
+    return (const void *)(_bit_cast<Word>(x) & ~(Word)_UNION_TAG_MASK);
+}
+static inline void tree_retain(Tree t)
+{
+#ifdef LIBF_GC_RC
+    gc_retain(node_ptr(t));
+#else
+    (void)t;
+#endif
+}
+static inline void dig_retain(Dig d)
+{
+#ifdef LIBF_GC_RC
+    gc_retain(node_ptr(d));
+#else
+    (void)d;
+#endif
+}
+static inline void seq_retain(Seq s)
+{
+#ifdef LIBF_GC_RC
+    if (index(s) != NIL)
+        gc_retain(node_ptr(s));
+#else
+    (void)s;
+#endif
+}
+static void tree_unref(Tree t);
+static void dig_unref(Dig d);
+static void seq_unref(Seq s);
+static void seq_free(Seq s);
+
+/*
+ * Leaf constructor.
+ */
+static inline Tree leaf(Frag f)
+{
+#ifdef LIBF_GC_RC
+    const FragHeader &fh = f;
+    gc_retain(&fh);
+#endif
+    return f;
+}
+
 /*
  * Node constructors.
  */
@@ -183,6 +258,7 @@ static Seq empty(void)
 
 static Seq single(Tree t0)
 {
+    tree_retain(t0);
     size_t len = tree_length(t0);
     Single node = {len, {t0}};
     return node;
@@ -190,6 +266,7 @@ static Seq single(Tree t0)
 
 static Seq deep(Dig l, Seq m, Dig r)
 {
+    dig_retain(l); seq_retain(m); dig_retain(r);
     size_t len = dig_length(l) + _seq_length(m) + dig_length(r);
     Deep node = {len, l, m, r};
     return node;
@@ -197,6 +274,7 @@ static Seq deep(Dig l, Seq m, Dig r)
 
 static Dig dig1(Tree t0)
 {
+    tree_retain(t0);
     size_t len = tree_length(t0);
     Dig1 node = {len, {t0}};
     return node;
@@ -204,6 +282,7 @@ static Dig dig1(Tree t0)
 
 static Dig dig2(Tree t0, Tree t1)
 {
+    tree_retain(t0); tree_retain(t1);
     size_t len = tree_length(t0) + tree_length(t1);
     Dig2 node = {len, {t0, t1}};
     return node;
@@ -211,6 +290,7 @@ static Dig dig2(Tree t0, Tree t1)
 
 static Dig dig3(Tree t0, Tree t1, Tree t2)
 {
+    tree_retain(t0); tree_retain(t1); tree_retain(t2);
     size_t len = tree_length(t0) + tree_length(t1) + tree_length(t2);
     Dig3 node = {len, {t0, t1, t2}};
     return node;
@@ -218,6 +298,7 @@ static Dig dig3(Tree t0, Tree t1, Tree t2)
 
 static Dig dig4(Tree t0, Tree t1, Tree t2, Tree t3)
 {
+    tree_retain(t0); tree_retain(t1); tree_retain(t2); tree_retain(t3);
     size_t len = tree_length(t0) + tree_length(t1) + tree_length(t2) + 
         tree_length(t3);
     Dig4 node = {len, {t0, t1, t2, t3}};
@@ -226,6 +307,7 @@ static Dig dig4(Tree t0, Tree t1, Tree t2, Tree t3)
 
 static Tree tree2(Tree t0, Tree t1)
 {
+    tree_retain(t0); tree_retain(t1);
     size_t len = tree_length(t0) + tree_length(t1);
     Tree2 node = {len, {t0, t1}};
     return node;
@@ -233,6 +315,7 @@ static Tree tree2(Tree t0, Tree t1)
 
 static Tree tree3(Tree t0, Tree t1, Tree t2)
 {
+    tree_retain(t0); tree_retain(t1); tree_retain(t2);
     size_t len = tree_length(t0) + tree_length(t1) + tree_length(t2);
     Tree3 node = {len, {t0, t1, t2}};
     return node;
@@ -290,6 +373,131 @@ static Seq dig_to_seq(Dig d)
     }
 }
 
+/*
+ * Retain/release.
+ */
+extern Seq _seq_retain(Seq s)
+{
+    seq_retain(s);
+    return s;
+}
+
+extern void _seq_release(Seq s)
+{
+#ifdef LIBF_GC_RC
+    if (index(s) == NIL)
+        return;
+    if (gc_refs(node_ptr(s)) == 0)
+        error("release of a value that was not retained");
+    seq_unref(s);
+#else
+    (void)s;
+#endif
+}
+
+static void tree_unref(Tree t)
+{
+    if (!gc_release(node_ptr(t)))
+        return;
+    switch (index(t))
+    {
+        case TREE_LEAF:
+        {
+            const Frag &tl = t;
+            const FragHeader &tlh = tl;
+            if (gc_release(&tlh))
+                gc_free((void *)&tlh);
+            gc_free_node<Frag>((void *)&tl);
+            break;
+        }
+        case TREE_2:
+        {
+            const Tree2 &t2 = t;
+            tree_unref(t2.t[0]); tree_unref(t2.t[1]);
+            gc_free_node<Tree2>((void *)&t2);
+            break;
+        }
+        case TREE_3:
+        {
+            const Tree3 &t3 = t;
+            tree_unref(t3.t[0]); tree_unref(t3.t[1]); tree_unref(t3.t[2]);
+            gc_free_node<Tree3>((void *)&t3);
+            break;
+        }
+        default:
+            error_bad_tree();
+    }
+}
+
+static void dig_unref(Dig d)
+{
+    if (!gc_release(node_ptr(d)))
+        return;
+    switch (index(d))
+    {
+        case DIG_1:
+        {
+            const Dig1 &d1 = d;
+            tree_unref(d1.t[0]);
+            gc_free_node<Dig1>((void *)&d1);
+            break;
+        }
+        case DIG_2:
+        {
+            const Dig2 &d2 = d;
+            tree_unref(d2.t[0]); tree_unref(d2.t[1]);
+            gc_free_node<Dig2>((void *)&d2);
+            break;
+        }
+        case DIG_3:
+        {
+            const Dig3 &d3 = d;
+            tree_unref(d3.t[0]); tree_unref(d3.t[1]); tree_unref(d3.t[2]);
+            gc_free_node<Dig3>((void *)&d3);
+            break;
+        }
+        case DIG_4:
+        {
+            const Dig4 &d4 = d;
+            tree_unref(d4.t[0]); tree_unref(d4.t[1]); tree_unref(d4.t[2]);
+            tree_unref(d4.t[3]);
+            gc_free_node<Dig4>((void *)&d4);
+            break;
+        }
+        default:
+            error_bad_tree();
+    }
+}
+
+static void seq_unref(Seq s)
+{
+    if (index(s) != NIL && gc_release(node_ptr(s)))
+        seq_free(s);
+}
+
+static void seq_free(Seq s)
+{
+    switch (index(s))
+    {
+        case SINGLE:
+        {
+            const Single &ss = s;
+            tree_unref(ss.t[0]);
+            gc_free_node<Single>((void *)&ss);
+            break;
+        }
+        case DEEP:
+        {
+            const Deep &sd = s;
+            dig_unref(sd.l); seq_unref(sd.m); dig_unref(sd.r);
+            gc_free_node<Deep>((void *)&sd);
+            break;
+        }
+        default:
+            error_bad_tree();
+    }
+}
+
 /*
  * Is empty.
  */
@@ -653,7 +861,7 @@ static Result<Frag, size_t> tree_lookup(Tree s, size_t idx)
  */
 extern PURE Seq _seq_push_front(Seq s, Frag f)
 {
-    return seq_push_front(s, f);
+    return seq_push_front(s, leaf(f));
 }
 
 static Seq seq_push_front(Seq s, Tree t)
@@ -776,7 +984,7 @@ static Seq seq_pop_front(Seq s, Tree *t)
  */
 extern PURE Seq _seq_replace_front(Seq s, Frag f)
 {
-    Tree l = f;
+    Tree l = leaf(f);
     switch (index(s))
     {
         case NIL:
@@ -868,7 +1076,7 @@ extern PURE Frag _seq_peek_front(Seq s)
  */
 extern PURE Seq _seq_push_back(Seq s, Frag f)
 {
-    Tree t = f;
+    Tree t = leaf(f);
     return seq_push_back(s, t);
 }
 
@@ -992,7 +1200,7 @@ static Seq seq_pop_back(Seq s, Tree *t)
  */
 extern PURE Seq _seq_replace_back(Seq s, Frag f)
 {
-    Tree l = f;
+    Tree l = leaf(f);
     switch (index(s))
     {
         case NIL:
@@ -1540,6 +1748,29 @@ extern PURE Value<Word> _seq_foldl(Seq s, Value<Word> arg,
     return seq_foldl(s, arg, &idx, f, data);
 }
 
+/*
+ * For each.  A left fold for side effects only (_seq_foldl() is pure).
+ */
+struct SeqForEach
+{
+    void (*f)(void *, size_t, Frag);
+    void *data;
+};
+
+extern void _seq_for_each(Seq s, void (*f)(void *, size_t, Frag), void *data)
+{
+    SeqForEach info = {f, data};
+    Value<Word> (*g)(void *, Value<Word>, size_t, Frag) =
+        [] (void *info0, Value<Word> arg, size_t idx, Frag frag) -> Value<Word>
+    {
+        SeqForEach *info = (SeqForEach *)info0;
+        info->f(info->data, idx, frag);
+        return arg;
+    };
+    size_t idx = 0;
+    seq_foldl(s, Value<Word>((Word)0), &idx, g, (void *)&info);
+}
+
 static Value<Word> seq_foldl(Seq s, Value<Word> arg, size_t *idx,
     Value<Word> (*f)(void *, Value<Word>, size_t, Frag), void *data)
 {
@@ -1834,7 +2065,7 @@ static Tree tree_map(Tree t, size_t *idx, Frag (*f)(void *, size_t, Frag),
             Frag tl1 = f(data, *idx, tl);
             const FragHeader &tlh = tl;
             *idx += tlh._len;
-            return tl1;
+            return leaf(tl1);
         }
         case TREE_2:
         {
@@ -84,9 +84,13 @@ extern PURE Value<Word> _seq_foldl(_Seq _s, Value<Word> _arg,
     Value<Word> (*_f)(void *, Value<Word>, size_t, _Frag), void *_data);
 extern PURE Value<Word> _seq_foldr(_Seq _s, Value<Word> _arg,
     Value<Word> (*_f)(void *, Value<Word>, size_t, _Frag), void *_data);
+extern void _seq_for_each(_Seq _s, void (*_f)(void *, size_t, _Frag),
+    void *_data);
 extern PURE _Seq _seq_map(_Seq _s, _Frag (*_f)(void *, size_t, _Frag),
     void *_data);
 extern PURE bool _seq_verify(_Seq _s);
+extern _Seq _seq_retain(_Seq _s);
+extern void _seq_release(_Seq _s);
 extern _Frag _seq_frag_alloc(size_t _size);
 
 struct _SeqItrEntry
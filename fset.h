@@ -34,15 +34,26 @@
 #include "fcompare.h"
 #include "fshow.h"
 #include "ftree.h"
+#include "ftree_inline.h"
 #include "fvalue.h"
 
 #include "flist_defs.h"
 #include "fset_defs.h"
 #include "fstring_defs.h"
+#include "fvector_defs.h"
 
 namespace F
 {
 
+template <typename _T>
+inline PURE size_t size(Vector<_T> _v);
+template <typename _T>
+inline VectorItr<_T> begin(Vector<_T> _v);
+template <typename _T>
+inline VectorItr<_T> &operator ++(VectorItr<_T> &_i);
+template <typename _T>
+inline PURE _T operator *(VectorItr<_T> &_i);
+
 template <typename _T>
 int _set_compare_wrapper(Value<Word> _k1, Value<Word> _k2)
 {
@@ -66,7 +77,7 @@ inline PURE Set<_T> set(void)
 
 /**
  * Construct a set from a list.
- * O(n * log(n)).
+ * O(n) if the list is sorted, O(n * log(n)) otherwise.
  */
 template <typename _T>
 inline PURE Set<_T> set(List<_T> _xs)
@@ -76,6 +87,65 @@ inline PURE Set<_T> set(List<_T> _xs)
     return _s;
 }
 
+/**
+ * Construct a set from a strictly increasing list.
+ * O(n).
+ */
+template <typename _T>
+inline PURE Set<_T> set_from_sorted(List<_T> _xs)
+{
+    Value<Word> (*_next)(void *) = [](void *_data) -> Value<Word>
+    {
+        List<Value<Word>> *_ys = (List<Value<Word>> *)_data;
+        Value<Word> _k = head(*_ys);
+        *_ys = tail(*_ys);
+        return _k;
+    };
+    List<Value<Word>> _ys = _bit_cast<List<Value<Word>>>(_xs);
+    Set<_T> _s = {_tree_from_sorted(size(_xs), _next, (void *)&_ys,
+        _set_compare_wrapper<_T>)};
+    return _s;
+}
+
+/**
+ * Construct a set from a strictly increasing vector.
+ * O(n).
+ */
+template <typename _T>
+inline PURE Set<_T> set_from_sorted(Vector<_T> _v)
+{
+    Value<Word> (*_next)(void *) = [](void *_data) -> Value<Word>
+    {
+        VectorItr<_T> *_i = (VectorItr<_T> *)_data;
+        Value<_T> _k = **_i;
+        ++*_i;
+        return _bit_cast<Value<Word>>(_k);
+    };
+    VectorItr<_T> _i = begin(_v);
+    Set<_T> _s = {_tree_from_sorted(size(_v), _next, (void *)&_i,
+        _set_compare_wrapper<_T>)};
+    return _s;
+}
+
+/**
+ * Construct a set from a strictly increasing C-array.
+ * O(n).
+ */
+template <typename _T>
+inline PURE Set<_T> set_from_sorted(const _T *_a, size_t _len)
+{
+    Value<Word> (*_next)(void *) = [](void *_data) -> Value<Word>
+    {
+        const _T **_ptr = (const _T **)_data;
+        Value<_T> _k = **_ptr;
+        (*_ptr)++;
+        return _bit_cast<Value<Word>>(_k);
+    };
+    Set<_T> _s = {_tree_from_sorted(_len, _next, (void *)&_a,
+        _set_compare_wrapper<_T>)};
+    return _s;
+}
+
 /**
  * Test if a set is empty.
  * O(1).
@@ -94,8 +164,8 @@ template <typename _T>
 inline PURE bool find(Set<_T> _s, const _T &_k)
 {
     Value<_T> _k1 = _k;
-    auto _entry = _tree_search(_s._impl, _bit_cast<Value<Word>>(_k1),
-        _set_compare_wrapper<_T>);
+    auto _entry = _tree_search<_set_compare_wrapper<_T>>(_s._impl,
+        _bit_cast<Value<Word>>(_k1));
     return (_entry != nullptr);
 }
 
@@ -107,8 +177,8 @@ template <typename _T>
 inline PURE Set<_T> insert(Set<_T> _s, const _T &_k)
 {
     Value<_T> _k1 = _k;
-    Set<_T> _s1 = {_tree_insert(_s._impl, _bit_cast<Value<Word>>(_k1),
-            _set_compare_wrapper<_T>)};
+    Set<_T> _s1 = {_tree_insert<_set_compare_wrapper<_T>>(_s._impl,
+        _bit_cast<Value<Word>>(_k1))};
     return _s1;
 }
 
@@ -120,8 +190,8 @@ template <typename _T>
 inline PURE Set<_T> erase(Set<_T> _s, const _T &_k)
 {
     Value<_T> _k1 = _k;
-    Set<_T> _s1 = {_tree_delete(_s._impl, _bit_cast<Value<Word>>(_k1),
-        _set_compare_wrapper<_T>)};
+    Set<_T> _s1 = {_tree_delete<_set_compare_wrapper<_T>>(_s._impl,
+        _bit_cast<Value<Word>>(_k1))};
     return _s1;
 }
 
@@ -159,6 +229,84 @@ inline PURE Set<_T> diff(Set<_T> _s, Set<_T> _t)
     return _u;
 }
 
+/**
+ * Set split at a position.  The first set holds the first i elements (in
+ * order), and the second set the rest.
+ * O(log(n)).
+ */
+template <typename _T>
+inline PURE Result<Set<_T>, Set<_T>> split_at(Set<_T> _s, size_t _i)
+{
+    auto [_tl, _tr] = _tree_split_at(_s._impl, _i, _set_compare_wrapper<_T>);
+    Result<Set<_T>, Set<_T>> _r = {{_tl}, {_tr}};
+    return _r;
+}
+
+/**
+ * Set take.  The first n elements of the set (in order).
+ * O(log(n)).
+ */
+template <typename _T>
+inline PURE Set<_T> take(Set<_T> _s, size_t _n)
+{
+    Set<_T> _u = {_tree_split_at(_s._impl, _n,
+        _set_compare_wrapper<_T>)._result_0};
+    return _u;
+}
+
+/**
+ * Set drop.  All but the first n elements of the set (in order).
+ * O(log(n)).
+ */
+template <typename _T>
+inline PURE Set<_T> drop(Set<_T> _s, size_t _n)
+{
+    Set<_T> _u = {_tree_split_at(_s._impl, _n,
+        _set_compare_wrapper<_T>)._result_1};
+    return _u;
+}
+
+/**
+ * Set nth.  The element at position i (in order), if any.
+ * O(log(n)).
+ */
+template <typename _T>
+inline PURE Optional<_T> nth(Set<_T> _s, size_t _i)
+{
+    auto _entry = _tree_nth(_s._impl, _i);
+    if (_entry == nullptr)
+        return Optional<_T>();
+    Value<_T> _k = _bit_cast<Value<_T>>(*_entry);
+    return Optional<_T>(_k);
+}
+
+/**
+ * Set rank.  The number of elements less than k.
+ * O(log(n)).
+ */
+template <typename _T>
+inline PURE size_t rank(Set<_T> _s, const _T &_k)
+{
+    Value<_T> _k1 = _k;
+    return _tree_rank(_s._impl, _bit_cast<Value<Word>>(_k1),
+        _set_compare_wrapper<_T>, false);
+}
+
+/**
+ * Set range count.  The number of elements in [lo, hi).
+ * O(log(n)).
+ */
+template <typename _T>
+inline PURE size_t count_range(Set<_T> _s, const _T &_lo, const _T &_hi)
+{
+    Value<_T> _lo1 = _lo, _hi1 = _hi;
+    size_t _i = _tree_rank(_s._impl, _bit_cast<Value<Word>>(_lo1),
+        _set_compare_wrapper<_T>, false);
+    size_t _j = _tree_rank(_s._impl, _bit_cast<Value<Word>>(_hi1),
+        _set_compare_wrapper<_T>, false);
+    return (_j > _i? _j - _i: 0);
+}
+
 /**
  * Set size.
  * O(n).
@@ -176,8 +324,25 @@ inline PURE size_t size(Set<_T> _s)
 template <typename _T, typename _A, typename _F>
 inline PURE _A foldl(Set<_T> _s, const _A &_arg, _F _func)
 {
-    Value<Word> (*_func_ptr)(void *, Value<Word>, Value<Word>) =
-        [](void *_func_0, Value<Word> _a0, Value<Word> _k0) -> Value<Word>
+    auto _func_1 = [&_func](const _A &_a, const Value<Word> &_k0) -> _A
+    {
+        Value<_T> _k = _bit_cast<Value<_T>>(_k0);
+        return _func(_a, _k);
+    };
+    return _tree_foldl(_s._impl, _arg, _func_1);
+}
+
+/**
+ * Set fold left over the elements in [lo, hi). ([](A a, T x) -> A).
+ * O(log(n) + m), where m is the number of elements in the range.
+ */
+template <typename _T, typename _A, typename _F>
+inline PURE _A foldl_range(Set<_T> _s, const _T &_lo, const _T &_hi,
+    const _A &_arg, _F _func)
+{
+    Value<Word> (*_func_ptr)(void *, Value<Word>, const Value<Word> &) =
+        [](void *_func_0, Value<Word> _a0, const Value<Word> &_k0)
+            -> Value<Word>
     {
         Value<_A> _a = _bit_cast<Value<_A>>(_a0);
         Value<_T> _k = _bit_cast<Value<_T>>(_k0);
@@ -186,8 +351,12 @@ inline PURE _A foldl(Set<_T> _s, const _A &_arg, _F _func)
         return _bit_cast<Value<Word>>(_b);
     };
     Value<_A> _arg1 = _arg;
-    Value<Word> _r = _tree_foldl(_s._impl, _bit_cast<Value<Word>>(_arg1),
-        _func_ptr, (void *)&_func);
+    Value<_T> _lo0 = _lo, _hi0 = _hi;
+    Value<Word> _lo1 = _bit_cast<Value<Word>>(_lo0),
+        _hi1 = _bit_cast<Value<Word>>(_hi0);
+    Value<Word> _r = _tree_foldl_range(_s._impl, &_lo1, &_hi1,
+        _bit_cast<Value<Word>>(_arg1), _func_ptr, (void *)&_func,
+        _set_compare_wrapper<_T>);
     return _bit_cast<Value<_A>>(_r);
 }
 
@@ -198,19 +367,27 @@ inline PURE _A foldl(Set<_T> _s, const _A &_arg, _F _func)
 template <typename _T, typename _A, typename _F>
 inline PURE _A foldr(Set<_T> _s, const _A &_arg, _F _func)
 {
-    Value<Word> (*_func_ptr)(void *, Value<Word>, Value<Word>) =
-        [](void *_func_0, Value<Word> _a0, Value<Word> _k0) -> Value<Word>
+    auto _func_1 = [&_func](const _A &_a, const Value<Word> &_k0) -> _A
     {
-        Value<_A> _a = _bit_cast<Value<_A>>(_a0);
         Value<_T> _k = _bit_cast<Value<_T>>(_k0);
-        _F *_func_1 = (_F *)_func_0;
-        Value<_A> _b = (*_func_1)(_a, _k);
-        return _bit_cast<Value<Word>>(_b);
+        return _func(_a, _k);
     };
-    Value<_A> _arg1 = _arg;
-    Value<Word> _r = _tree_foldr(_s._impl, _bit_cast<Value<Word>>(_arg1),
-        _func_ptr, (void *)&_func);
-    return _bit_cast<Value<_A>>(_r);
+    return _tree_foldr(_s._impl, _arg, _func_1);
+}
+
+/**
+ * Set for each.  Calls func on each element in order. ([](T x)).
+ * O(n).
+ */
+template <typename _T, typename _F>
+inline void for_each(Set<_T> _s, _F _func)
+{
+    auto _func_1 = [&_func](const Value<Word> &_k0)
+    {
+        Value<_T> _k = _bit_cast<Value<_T>>(_k0);
+        _func(_k);
+    };
+    _tree_for_each(_s._impl, _func_1);
 }
 
 /**
@@ -232,6 +409,40 @@ inline PURE int compare(Set<_T> _s, Set<_T> _t)
     return _tree_compare(_s._impl, _t._impl, nullptr, _func_ptr);
 }
 
+/**
+ * Set diff.  Calls added(x) for each element of s2 not in s1, and
+ * removed(x) for each element of s1 not in s2, in order.
+ * ([](T x) -> void).
+ * Subtrees shared by both sets are skipped, so diffing a set against a
+ * recent version of itself is O(d * log(n)) for d changed elements.
+ */
+template <typename _T, typename _F, typename _G>
+inline void diff_entries(Set<_T> _s1, Set<_T> _s2, _F _added, _G _removed)
+{
+    struct _Funcs
+    {
+        _F *_added;
+        _G *_removed;
+    } _funcs = {&_added, &_removed};
+    void (*_func_ptr)(void *, const Value<Word> *, const Value<Word> *) =
+        [] (void *_funcs_0, const Value<Word> *_k1, const Value<Word> *_k2)
+    {
+        _Funcs *_funcs_1 = (_Funcs *)_funcs_0;
+        if (_k1 == nullptr)
+        {
+            Value<_T> _k = _bit_cast<Value<_T>>(*_k2);
+            (*_funcs_1->_added)(_k);
+        }
+        else if (_k2 == nullptr)
+        {
+            Value<_T> _k = _bit_cast<Value<_T>>(*_k1);
+            (*_funcs_1->_removed)(_k);
+        }
+    };
+    _tree_diff_entries(_s1._impl, _s2._impl, _set_compare_wrapper<_T>,
+        _func_ptr, (void *)&_funcs);
+}
+
 /**
  * Set show.
  * O(n).
@@ -273,6 +484,38 @@ inline PURE SetItr<_T> end(Set<_T> _s)
     return _itr;
 }
 
+/**
+ * Construct an iterator pointing to the least element of a set not less
+ * than k (or end() if there is none).
+ * O(log(n)).
+ */
+template <typename _T>
+inline PURE SetItr<_T> lower_bound(Set<_T> _s, const _T &_k)
+{
+    Value<_T> _k1 = _k;
+    SetItr<_T> _itr;
+    _itr._tree_itr = begin(_s._impl);
+    _itr._tree_itr += _tree_rank(_s._impl, _bit_cast<Value<Word>>(_k1),
+        _set_compare_wrapper<_T>, false);
+    return _itr;
+}
+
+/**
+ * Construct an iterator pointing to the least element of a set greater than
+ * k (or end() if there is none).
+ * O(log(n)).
+ */
+template <typename _T>
+inline PURE SetItr<_T> upper_bound(Set<_T> _s, const _T &_k)
+{
+    Value<_T> _k1 = _k;
+    SetItr<_T> _itr;
+    _itr._tree_itr = begin(_s._impl);
+    _itr._tree_itr += _tree_rank(_s._impl, _bit_cast<Value<Word>>(_k1),
+        _set_compare_wrapper<_T>, true);
+    return _itr;
+}
+
 /**
  * Set iterator increment.
  * O(1).
@@ -350,6 +593,105 @@ inline PURE const _T &operator*(SetItr<_T> &_i)
     return (Value<_T> &)_k;
 }
 
+/**
+ * Construct a transient (mutable) copy of a set.  Operations on the
+ * transient update nodes that it owns in place, and copy nodes shared with
+ * other sets.  The transient must not be used after persistent().
+ * Copying a TransientSet by value aliases the same owner, so only one of
+ * the copies may be updated.  Owner tokens are eventually reused, so a
+ * transient that is never made persistent must not share nodes with later
+ * transients.
+ * O(1).
+ */
+template <typename _T>
+inline TransientSet<_T> transient(Set<_T> _m)
+{
+    TransientSet<_T> _t = {_m._impl, _tree_owner_new()};
+    return _t;
+}
+
+/**
+ * Insert an element into a transient set (in place).
+ * O(log(n)).
+ */
+template <typename _T>
+inline void insert(TransientSet<_T> &_t, const _T &_k)
+{
+    Value<_T> _k1 = _k;
+    _t._impl = _tree_insert_owned(_t._impl, _bit_cast<Value<Word>>(_k1),
+        _set_compare_wrapper<_T>, _t._owner);
+}
+
+/**
+ * Remove an element from a transient set.
+ * O(log(n)).
+ */
+template <typename _T>
+inline void erase(TransientSet<_T> &_t, const _T &_k)
+{
+    Value<_T> _k1 = _k;
+    _t._impl = _tree_delete_owned(_t._impl, _bit_cast<Value<Word>>(_k1),
+        _set_compare_wrapper<_T>, _t._owner);
+}
+
+/**
+ * Test if an element is a member of a transient set.
+ * O(log(n)).
+ */
+template <typename _T>
+inline bool find(const TransientSet<_T> &_t, const _T &_k)
+{
+    Set<_T> _m = {_t._impl};
+    return find(_m, _k);
+}
+
+/**
+ * Transient set size.
+ * O(1).
+ */
+template <typename _T>
+inline size_t size(const TransientSet<_T> &_t)
+{
+    return _tree_size(_t._impl);
+}
+
+/**
+ * Convert a transient set back into an (immutable) set.
+ * O(k), where k is the number of nodes owned by the transient.
+ */
+template <typename _T>
+inline Set<_T> persistent(TransientSet<_T> &_t)
+{
+    Set<_T> _m = {_tree_freeze(_t._impl, _t._owner)};
+    _t._impl = _tree_empty();
+    return _m;
+}
+
+/**
+ * Retain a set so that it outlives the values it was derived from.  Only
+ * meaningful for the reference counting backend (LIBF_GC_RC).
+ * O(1).
+ */
+template <typename _T>
+inline Set<_T> retain(Set<_T> _s)
+{
+    Set<_T> _s1 = {_tree_retain(_s._impl)};
+    return _s1;
+}
+
+/**
+ * Release a set.  Nodes that are no longer referenced are freed immediately
+ * by the reference counting backend (LIBF_GC_RC), otherwise this is a no-op.
+ * Only a value that was passed to retain() may be released; releasing
+ * one that was not is an error.
+ * O(k), where k is the number of nodes freed.
+ */
+template <typename _T>
+inline void release(Set<_T> _s)
+{
+    _tree_release(_s._impl);
+}
+
 /**
  * Set verify.
  * O(n).
@@ -384,5 +726,6 @@ inline PURE bool operator!=(const SetItr<_T> &_i, const SetItr<_T> &_j)
 
 #include "flist.h"
 #include "fstring.h"
+#include "fvector.h"
 
 #endif      /* _FSET_H */
@@ -41,6 +41,13 @@ struct Set
     _Tree _impl;
 };
 
+template <typename _T>
+struct TransientSet
+{
+    _Tree _impl;
+    size_t _owner;
+};
+
 template <typename _T>
 struct SetItr
 {
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FSTATS_H
+#define _FSTATS_H
+
+#include "fbase.h"
+#include "fgc.h"
+
+namespace F
+{
+
+/**
+ * Allocation counters for one subsystem.  Frees are only counted for
+ * objects that are explicitly freed (e.g. by the reference counting
+ * backend); objects reclaimed by the collector or by a Region are not, so
+ * `live' is an upper bound.
+ */
+struct AllocStat
+{
+    size_t allocs;
+    size_t bytes;
+    size_t frees;
+    size_t live;
+};
+
+/**
+ * Allocation statistics by subsystem.
+ */
+struct AllocStats
+{
+    AllocStat tree;         // Map/Set/HashMap/HashSet/IntMap/IntSet nodes
+    AllocStat seq;          // Vector/String finger tree nodes
+    AllocStat vector;       // Vector fragments
+    AllocStat string;       // String fragments
+    AllocStat tuple;        // Tuples
+    AllocStat list;         // List cells
+    AllocStat other;        // Other boxed values
+};
+
+static inline AllocStat _alloc_stat(unsigned _kind)
+{
+    AllocStat _stat = {0, 0, 0, 0};
+#ifdef LIBF_ALLOC_STATS
+    _GCStat *_s = &_gc_stats[_kind];
+    _stat.allocs = __atomic_load_n(&_s->_allocs, __ATOMIC_RELAXED);
+    _stat.bytes  = __atomic_load_n(&_s->_bytes, __ATOMIC_RELAXED);
+    _stat.frees  = __atomic_load_n(&_s->_frees, __ATOMIC_RELAXED);
+    size_t _freed_bytes = __atomic_load_n(&_s->_freed_bytes,
+        __ATOMIC_RELAXED);
+    _stat.live = (_stat.bytes > _freed_bytes? _stat.bytes - _freed_bytes: 0);
+#else
+    (void)_kind;
+#endif
+    return _stat;
+}
+
+/**
+ * Get a snapshot of the allocation statistics.  All counters are zero
+ * unless LibF was built with -DLIBF_ALLOC_STATS.
+ * O(1).
+ */
+inline AllocStats alloc_stats(void)
+{
+    AllocStats _stats =
+    {
+        _alloc_stat(GC_STAT_TREE),
+        _alloc_stat(GC_STAT_SEQ),
+        _alloc_stat(GC_STAT_VECTOR),
+        _alloc_stat(GC_STAT_STRING),
+        _alloc_stat(GC_STAT_TUPLE),
+        _alloc_stat(GC_STAT_LIST),
+        _alloc_stat(GC_STAT_OTHER)
+    };
+    return _stats;
+}
+
+}           /* namespace F */
+
+#endif      /* _FSTATS_H */
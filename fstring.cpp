@@ -30,6 +30,7 @@
 #include <ctype.h>
 #include <stdio.h>
 
+#include "fhash.h"
 #include "flist.h"
 #include "fseq.h"
 #include "fstring.h"
@@ -64,6 +65,13 @@ static inline _Frag str_frag_from_data(StrData *str)
     return frag;
 }
 
+static inline StrData *str_malloc(size_t size)
+{
+    size_t total_size = sizeof(StrData) + size * sizeof(char);
+    gc_stat_alloc(GC_STAT_STRING, total_size);
+    return (StrData *)gc_malloc_atomic(total_size);
+}
+
 /*
  * Char32 decode.
  */
@@ -248,8 +256,7 @@ extern PURE _Frag _string_frag_map(size_t idx, _Frag frag,
         char32_encode(cs + k, c);
         k += char32_size(c);
     }
-    StrData *new_str = (StrData *)gc_malloc_atomic(sizeof(StrData) +
-        k * sizeof(char));
+    StrData *new_str = str_malloc(k);
     new_str->header._len = str->header._len;
     new_str->size = k;
     memmove(new_str->data, cs, k * sizeof(char));
@@ -278,8 +285,7 @@ extern PURE Optional<_Frag> _string_frag_filter_map(size_t idx, _Frag frag,
     }
     if (k == 0)
         return Optional<_Frag>();
-    StrData *new_str = (StrData *)gc_malloc_atomic(sizeof(StrData) +
-        k * sizeof(char));
+    StrData *new_str = str_malloc(k);
     new_str->header._len = l;
     new_str->size = k;
     memmove(new_str->data, cs, k * sizeof(char));
@@ -296,8 +302,7 @@ static PURE _Seq _string_init_2(_Seq s, const char *cstr)
     {
         size_t frag_size = (len-i > STRING_FRAG_MAX_SIZE? STRING_FRAG_MAX_SIZE:
             len-i);
-        StrData *str = (StrData *)gc_malloc_atomic(sizeof(StrData) +
-            frag_size * sizeof(char));
+        StrData *str = str_malloc(frag_size);
         size_t j = 0, frag_len = 0;
         while (true)
         {
@@ -331,8 +336,7 @@ extern PURE _Seq _string_init(const char *cstr)
 extern PURE _Seq _string_init_with_char(char32_t c)
 {
     size_t clen = char32_size(c);
-    StrData *str = (StrData *)gc_malloc_atomic(
-        sizeof(StrData) + clen * sizeof(char));
+    StrData *str = str_malloc(clen);
     str->header._len = 1;
     str->size = clen;
     char32_encode(str->data, c);
@@ -451,8 +455,7 @@ extern PURE _Seq _string_append_char(_Seq s, char32_t c)
     if (_seq_is_empty(s))
     {
 string_append_char_push_back:
-        StrData *str = (StrData *)gc_malloc_atomic(sizeof(StrData) +
-            clen * sizeof(char));
+        StrData *str = str_malloc(clen);
         str->header._len = 1;
         str->size = clen;
         char32_encode(str->data, c);
@@ -464,8 +467,7 @@ string_append_char_push_back:
     if (str->size + clen > STRING_FRAG_MAX_SIZE)
         goto string_append_char_push_back;
 
-    StrData *new_str = (StrData *)gc_malloc_atomic(sizeof(StrData) +
-        (str->size + clen) * sizeof(char));
+    StrData *new_str = str_malloc(str->size + clen);
     new_str->header._len  = str->header._len + 1;
     new_str->size = str->size + clen;
     memmove(new_str->data, str->data, str->size);
@@ -473,6 +475,47 @@ string_append_char_push_back:
     return _seq_replace_back(s, str_frag_from_data(new_str));
 }
 
+/*
+ * Transient string append char.  Characters are encoded in place into an
+ * owned tail fragment that is not yet part of the sequence.
+ */
+extern _Seq _string_append_char_owned(_Seq s, _FragHeader **tail, char32_t c)
+{
+    size_t clen = char32_size(c);
+    StrData *str = (StrData *)*tail;
+    if (str != nullptr && str->size + clen > STRING_FRAG_MAX_SIZE)
+    {
+        s = _seq_push_back(s, str_frag_from_data(str));
+        str = nullptr;
+    }
+    if (str == nullptr)
+    {
+        str = str_malloc(STRING_FRAG_MAX_SIZE);
+        str->header._len = 0;
+        str->size = 0;
+    }
+    char32_encode(str->data + str->size, c);
+    str->header._len++;
+    str->size += clen;
+    *tail = &str->header;
+    return s;
+}
+
+/*
+ * Transient string append C-String.
+ */
+extern _Seq _string_append_cstring_owned(_Seq s, _FragHeader **tail,
+    const char *cstr)
+{
+    while (*cstr != '\0')
+    {
+        char32_t c = char32_decode(cstr);
+        s = _string_append_char_owned(s, tail, c);
+        cstr += char32_size(c);
+    }
+    return s;
+}
+
 /*
  * String append C-String.
  */
@@ -485,8 +528,7 @@ extern PURE _Seq _string_append_cstring(_Seq s, const char *cstr)
         StrData *str = str_data_from_frag(frag);
         if (len + str->size <= STRING_FRAG_MAX_SIZE)
         {
-            StrData *new_str = (StrData *)gc_malloc_atomic(sizeof(StrData) +
-                (str->size + len) * sizeof(char));
+            StrData *new_str = str_malloc(str->size + len);
             memmove(new_str->data, str->data, str->size);
             memmove(new_str->data + str->size, cstr, len);
             new_str->header._len = str->header._len + cstr_len(cstr);
@@ -515,10 +557,8 @@ extern PURE Result<_Seq, _Seq> _string_split(const _Seq s, size_t i0)
     else
     {
         size_t idx = cstr_index(str->data, i);
-        StrData *left = (StrData *)gc_malloc_atomic(sizeof(StrData) +
-            idx * sizeof(char));
-        StrData *right = (StrData *)gc_malloc_atomic(sizeof(StrData) +
-            (str->size - idx) * sizeof(char));
+        StrData *left = str_malloc(idx);
+        StrData *right = str_malloc(str->size - idx);
         memmove(left->data, str->data, idx);
         memmove(right->data, str->data + idx, str->size - idx);
         left->size = idx;
@@ -546,8 +586,7 @@ extern PURE _Seq _string_left(const _Seq s, size_t i0)
     else if (i > 0)
     {
         size_t idx = cstr_index(str->data, i);
-        StrData *left = (StrData *)gc_malloc_atomic(sizeof(StrData) +
-            idx * sizeof(char));
+        StrData *left = str_malloc(idx);
         memmove(left->data, str->data, idx);
         left->size = idx;
         left->header._len = i;
@@ -571,8 +610,7 @@ extern PURE _Seq _string_right(const _Seq s, size_t i0)
     else if (i < str->header._len)
     {
         size_t idx = cstr_index(str->data, i);
-        StrData *right = (StrData *)gc_malloc_atomic(sizeof(StrData) +
-            (str->size - idx) * sizeof(char));
+        StrData *right = str_malloc(str->size - idx);
         memmove(right->data, str->data + idx, str->size - idx);
         right->size = str->size - idx;
         right->header._len = str->header._len - i;
@@ -644,6 +682,31 @@ extern PURE int _string_frag_compare(void *unused, _Frag a, size_t idx1,
     return 0;
 }
 
+/*
+ * String hash accumulate.  FNV-1a over the UTF-8 bytes, so that the hash
+ * does not depend on how the string is split into fragments.
+ */
+static Value<Word> string_hash_accumulate(void *data0, Value<Word> arg,
+    size_t idx, _Frag frag)
+{
+    uint64_t h = _bit_cast<uint64_t>(arg);
+    StrData *str = str_data_from_frag(frag);
+    for (size_t i = 0; i < str->size; i++)
+        h = (h ^ (uint8_t)str->data[i]) * 0x100000001B3ull;
+    return _bit_cast<Value<Word>>(h);
+}
+
+/*
+ * String hash.
+ */
+extern PURE uint64_t hash(String s)
+{
+    Value<Word> h = _seq_foldl(s._impl,
+        _bit_cast<Value<Word>>((uint64_t)0xCBF29CE484222325ull),
+        string_hash_accumulate, nullptr);
+    return hash(_bit_cast<uint64_t>(h));
+}
+
 /*
  * Character find.
  */
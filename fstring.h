@@ -61,6 +61,10 @@ extern PURE char32_t _string_frag_lookup(_Frag frag, size_t idx);
 extern PURE char32_t _string_search(_Seq _s, size_t _idx);
 extern PURE _Seq _string_append_char(_Seq _s, char32_t _c);
 extern PURE _Seq _string_append_cstring(_Seq _s, const char *_str);
+extern _Seq _string_append_char_owned(_Seq _s, _FragHeader **_tail,
+    char32_t _c);
+extern _Seq _string_append_cstring_owned(_Seq _s, _FragHeader **_tail,
+    const char *_str);
 extern PURE Result<_Seq, _Seq> _string_split(_Seq _s, size_t _idx);
 extern PURE _Seq _string_left(_Seq _s, size_t _idx);
 extern PURE _Seq _string_right(_Seq _s, size_t _idx);
@@ -211,6 +215,60 @@ inline String &operator+=(String &_str0, const char *_cstr)
 	return _str0;
 }
 
+/**
+ * Construct a transient (mutable) string for batch appends.  Characters are
+ * appended in place to an owned tail fragment.  The transient must not be
+ * used after persistent().
+ * O(1).
+ */
+inline TransientString transient(String _str)
+{
+    TransientString _t = {_str._impl, nullptr};
+    return _t;
+}
+
+/**
+ * Append a character to a transient string (in place).
+ * O(1).
+ */
+inline void append(TransientString &_t, char32_t _c)
+{
+    _t._impl = _string_append_char_owned(_t._impl, &_t._tail, _c);
+}
+
+/**
+ * Append a C-string to a transient string (in place).
+ * O(n).
+ */
+inline void append(TransientString &_t, const char *_cstr)
+{
+    _t._impl = _string_append_cstring_owned(_t._impl, &_t._tail, _cstr);
+}
+
+/**
+ * Transient string size.
+ * O(1).
+ */
+inline size_t size(const TransientString &_t)
+{
+    return _seq_length(_t._impl) +
+        (_t._tail != nullptr? _t._tail->_len: 0);
+}
+
+/**
+ * Convert a transient string back into an (immutable) string.
+ * O(1).
+ */
+inline String persistent(TransientString &_t)
+{
+    String _str = {_t._impl};
+    if (_t._tail != nullptr)
+        _str._impl = _seq_push_back(_t._impl, _Frag(_t._tail));
+    _t._impl = _seq_empty();
+    _t._tail = nullptr;
+    return _str;
+}
+
 /**
  * String size (a.k.a. string length).
  * O(1).
@@ -357,6 +415,12 @@ inline PURE int compare(String _s, String _t)
     return _seq_compare(_s._impl, _t._impl, nullptr, _string_frag_compare);
 }
 
+/**
+ * String hash.
+ * O(n).
+ */
+extern PURE uint64_t hash(String _str);
+
 /**
  * String fold left. ([](T, size_t idx, char32_t c) -> T).
  * O(n).
@@ -502,6 +566,30 @@ inline PURE String filter_map(String _str, _F _func)
     return _r1;
 }
 
+/**
+ * Retain a string so that it outlives the values it was derived from.  Only
+ * meaningful for the reference counting backend (LIBF_GC_RC).
+ * O(1).
+ */
+inline String retain(String _s)
+{
+    String _s1 = {_seq_retain(_s._impl)};
+    return _s1;
+}
+
+/**
+ * Release a string.  Nodes and fragments that are no longer referenced are
+ * freed immediately by the reference counting backend (LIBF_GC_RC),
+ * otherwise this is a no-op.
+ * Only a value that was passed to retain() may be released; releasing
+ * one that was not is an error.
+ * O(k), where k is the number of nodes freed.
+ */
+inline void release(String _s)
+{
+    _seq_release(_s._impl);
+}
+
 /**
  * Verify.
  * O(n).
@@ -40,6 +40,12 @@ struct String
     _Seq _impl;
 };
 
+struct TransientString
+{
+    _Seq _impl;
+    _FragHeader *_tail;
+};
+
 struct StringItr
 {
     _SeqItr _seq_itr;
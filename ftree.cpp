@@ -30,13 +30,16 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "fbase.h"
 #include "fgc.h"
 #include "flist.h"
 #include "fstring.h"
 #include "ftree.h"
+#include "ftree_inline.h"
 
+#ifndef LIBF_TREE_BTREE         /* else see fbtree.cpp */
 
 namespace F
 {
@@ -55,6 +58,9 @@ typedef _TreeNil TreeNil;
 typedef _Tree2 Tree2;
 typedef _Tree3 Tree3;
 typedef _Tree4 Tree4;
+typedef _TreeLeaf1 TreeLeaf1;
+typedef _TreeLeaf2 TreeLeaf2;
+typedef _TreeLeaf3 TreeLeaf3;
 typedef _Compare Compare;
 typedef Value<Word> K;
 typedef Value<Word> A;
@@ -62,83 +68,100 @@ typedef Value<Word> C;
 #define TREE_EMPTY _tree_empty()
 
 /*
- * Tree node definitions.
+ * Tree node definitions (see ftree_inline.h).
  */
-struct _Tree2
+#define TREE_OWNER_SHIFT    _TREE_OWNER_SHIFT
+#define TREE_SIZE_MASK      _TREE_SIZE_MASK
+#define TREE_OWNER_MAX      ((1ull << (64 - TREE_OWNER_SHIFT)) - 1)
+
+enum
 {
-    size_t size;
-    K k[1];
-    Tree t[2];
+    TREE_NIL = _TREE_NIL,
+    TREE_2   = _TREE_2,
+    TREE_3   = _TREE_3,
+    TREE_4   = _TREE_4,
+    TREE_LEAF1 = _TREE_LEAF1,
+    TREE_LEAF2 = _TREE_LEAF2,
+    TREE_LEAF3 = _TREE_LEAF3
 };
-struct _Tree3
+
+/*
+ * Reference counting (only enabled for the LIBF_GC_RC backend).  Each node
+ * holds a reference to its children.
+ */
+static inline const void *tree_ptr(Tree t)
 {
-    size_t size;
-    K k[2];
-    Tree t[3];
-};
-struct _Tree4
+    return _tree_ptr(t);
+}
+static inline void tree_retain(Tree t)
 {
-    size_t size;
-    K k[3];
-    Tree t[4];
-};
+    _tree_ref(t);
+}
+static inline void tree_unref(Tree t)
+{
+#ifdef LIBF_GC_RC
+    if (index(t) != TREE_NIL && gc_release(tree_ptr(t)))
+        _tree_free(t);
+#else
+    (void)t;
+#endif
+}
 
 /*
- * Tree node types.
+ * Free a temporary node that was consumed without being linked in.
  */
-enum
+static inline void tree_drop(Tree t)
 {
-    TREE_NIL = Tree::index<TreeNil>(),
-    TREE_2   = Tree::index<Tree2>(),
-    TREE_3   = Tree::index<Tree3>(),
-    TREE_4   = Tree::index<Tree4>()
-};
+    _tree_drop(t);
+}
 
 /*
  * Node constructors.
  */
 static inline Tree tree2(Tree t0, K k0, Tree t1)
 {
-    size_t size = 1 + _tree_size(t0) + _tree_size(t1);
-    Tree2 node = {size, {k0}, {t0, t1}};
-    return node;
+    return _tree2(t0, k0, t1);
 }
 static inline Tree tree3(Tree t0, K k0, Tree t1, K k1, Tree t2)
 {
-    size_t size = 2 + _tree_size(t0) + _tree_size(t1) + _tree_size(t2);
-    Tree3 node = {size, {k0, k1}, {t0, t1, t2}};
-    return node;
+    return _tree3(t0, k0, t1, k1, t2);
 }
 static inline Tree tree4(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
     Tree t3)
 {
-    size_t size = 3 + _tree_size(t0) + _tree_size(t1) + _tree_size(t2) +
-        _tree_size(t3);
-    Tree4 node = {size, {k0, k1, k2}, {t0, t1, t2, t3}};
-    return node;
+    return _tree4(t0, k0, t1, k1, t2, k2, t3);
+}
+
+/*
+ * Leaves.
+ */
+static inline bool tree_is_leaf(Tree t)
+{
+    return _tree_is_leaf(t);
+}
+static inline const K *tree_leaf_keys(Tree t)
+{
+    return _tree_leaf_keys(t);
+}
+static inline const Tree2 &tree2_view(Tree t, Tree2 *buf)
+{
+    return _tree2_view(t, buf);
+}
+static inline const Tree3 &tree3_view(Tree t, Tree3 *buf)
+{
+    return _tree3_view(t, buf);
+}
+static inline const Tree4 &tree4_view(Tree t, Tree4 *buf)
+{
+    return _tree4_view(t, buf);
 }
 
 /*
  * Prototypes.
  */
-static Tree tree2_insert(const Tree2 &t, K k, Compare compare);
-static Tree tree3_insert(const Tree3 &t, K k, Compare compare);
-static Tree tree_delete_2(Tree t, K k, Compare compare, bool *reduced);
-static Tree tree_delete_min_2(Tree t, K *k, bool *reduced);
+static Tree tree_insert_owned_2(Tree t, K k, Compare compare, size_t owner,
+    bool *added, bool *split, K *mk, Tree *rt);
 static Tree tree_delete_max_2(Tree t, K *k, bool *reduced);
-static Tree tree2_fix_t0(Tree t0, K k0, Tree t1, bool *reduced);
-static Tree tree2_fix_t1(Tree t0, K k0, Tree t1, bool *reduced);
-static Tree tree3_fix_t0(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced);
-static Tree tree3_fix_t1(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced);
-static Tree tree3_fix_t2(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced);
-static Tree tree4_fix_t0(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
-    Tree t3, bool *reduced);
-static Tree tree4_fix_t1(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
-    Tree t3, bool *reduced);
-static Tree tree4_fix_t2(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
-    Tree t3, bool *reduced);
-static Tree tree4_fix_t3(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
-    Tree t3, bool *reduced);
 static Tree tree2_concat_3_min(const Tree2 &t, K k, Tree u, size_t depth);
 static Tree tree3_concat_3_min(const Tree3 &t, K k, Tree u, size_t depth);
 static Tree tree2_concat_3_max(const Tree2 &t, K k, Tree u, size_t depth);
@@ -167,570 +190,421 @@ extern PURE Tree _tree_singleton(K k)
 }
 
 /*
- * Search.
+ * Retain/release.
  */
-extern const K *_tree_search(Tree t, K k, Compare compare)
+extern Tree _tree_retain(Tree t)
 {
-    while (true)
+    tree_retain(t);
+    return t;
+}
+
+extern void _tree_release(Tree t)
+{
+#ifdef LIBF_GC_RC
+    if (index(t) == TREE_NIL)
+        return;
+    if (gc_refs(tree_ptr(t)) == 0)
+        error("release of a value that was not retained");
+    tree_unref(t);
+#else
+    (void)t;
+#endif
+}
+
+extern void _tree_free(Tree t)
+{
+    switch (index(t))
     {
-        switch (index(t))
+        case TREE_2:
         {
-            case TREE_NIL:
-                return nullptr;
-            case TREE_2:
-            {
-                const Tree2 &t2 = t;
-                int cmp = compare(k, t2.k[0]);
-                if (cmp < 0)
-                {
-                    t = t2.t[0];
-                    continue;
-                }
-                else if (cmp > 0)
-                {
-                    t = t2.t[1];
-                    continue;
-                }
-                return &t2.k[0];
-            }
-            case TREE_3:
-            {
-                const Tree3 &t3 = t;
-                int cmp = compare(k, t3.k[0]);
-                if (cmp < 0)
-                {
-                    t = t3.t[0];
-                    continue;
-                }
-                else if (cmp > 0)
-                {
-                    cmp = compare(k, t3.k[1]);
-                    if (cmp < 0)
-                    {
-                        t = t3.t[1];
-                        continue;
-                    }
-                    else if (cmp > 0)
-                    {
-                        t = t3.t[2];
-                        continue;
-                    }
-                    return &t3.k[1];
-                }
-                return &t3.k[0];
-            }
-            case TREE_4:
-            {
-                const Tree4 &t4 = t;
-                int cmp = compare(k, t4.k[1]);
-                if (cmp < 0)
-                {
-                    cmp = compare(k, t4.k[0]);
-                    if (cmp < 0)
-                    {
-                        t = t4.t[0];
-                        continue;
-                    }
-                    else if (cmp > 0)
-                    {
-                        t = t4.t[1];
-                        continue;
-                    }
-                    return &t4.k[0];
-                }
-                else if (cmp > 0)
-                {
-                    cmp = compare(k, t4.k[2]);
-                    if (cmp < 0)
-                    {
-                        t = t4.t[2];
-                        continue;
-                    }
-                    else if (cmp > 0)
-                    {
-                        t = t4.t[3];
-                        continue;
-                    }
-                    return &t4.k[2];
-                }
-                return &t4.k[1];
-            }
+            const Tree2 &t2 = t;
+            tree_unref(t2.t[0]); tree_unref(t2.t[1]);
+            gc_free_node<Tree2>((void *)&t2);
+            break;
+        }
+        case TREE_3:
+        {
+            const Tree3 &t3 = t;
+            tree_unref(t3.t[0]); tree_unref(t3.t[1]); tree_unref(t3.t[2]);
+            gc_free_node<Tree3>((void *)&t3);
+            break;
+        }
+        case TREE_4:
+        {
+            const Tree4 &t4 = t;
+            tree_unref(t4.t[0]); tree_unref(t4.t[1]); tree_unref(t4.t[2]);
+            tree_unref(t4.t[3]);
+            gc_free_node<Tree4>((void *)&t4);
+            break;
         }
+        case TREE_LEAF1:
+            gc_free_node<TreeLeaf1>((void *)tree_ptr(t));
+            break;
+        case TREE_LEAF2:
+            gc_free_node<TreeLeaf2>((void *)tree_ptr(t));
+            break;
+        case TREE_LEAF3:
+            gc_free_node<TreeLeaf3>((void *)tree_ptr(t));
+            break;
+        default:
+            error_bad_tree();
     }
 }
 
+/*
+ * Search.
+ */
+extern const K *_tree_search(Tree t, K k, Compare compare)
+{
+    return _tree_search_k(t, k, compare);
+}
+
 /*
  * Insert.
  */
 extern PURE Tree _tree_insert(Tree t, K k, Compare compare)
+{
+    return _tree_insert_k(t, k, compare);
+}
+
+/*
+ * Transients.  A transient tree tags the nodes it creates with an owner
+ * token, and updates owned nodes in place rather than path copying them.
+ * Nodes without the token are shared and are copied (as owned nodes) when
+ * updated.  Freezing clears the tokens, making the tree immutable again.
+ *
+ * Tokens are only 24 bits (they share the node's size word), so they wrap
+ * after 2^24 transients.  A transient that is abandoned without being frozen
+ * keeps its tokens, and a later transient that reuses the token would update
+ * those nodes in place.  Abandoned transients must therefore not share
+ * structure with any later transient.
+ */
+static size_t tree_owner_next = 0;
+
+extern size_t _tree_owner_new(void)
+{
+    size_t owner;
+    do
+    {
+        owner = __atomic_add_fetch(&tree_owner_next, 1, __ATOMIC_RELAXED) &
+            TREE_OWNER_MAX;
+    }
+    while (owner == 0);
+    return owner;
+}
+
+static inline size_t *tree_size_ptr(Tree t)
+{
+    return (size_t *)tree_ptr(t);
+}
+
+static inline bool tree_is_owned(Tree t, size_t owner)
+{
+    return (index(t) != TREE_NIL && !tree_is_leaf(t) &&
+        (*tree_size_ptr(t) >> TREE_OWNER_SHIFT) == owner);
+}
+
+static inline Tree tree_set_owner(Tree t, size_t owner)
+{
+    if (!tree_is_leaf(t))
+        *tree_size_ptr(t) |= (owner << TREE_OWNER_SHIFT);
+    return t;
+}
+
+static size_t tree_unpack(Tree t, K *ks, Tree *ts)
 {
     switch (index(t))
     {
-        case TREE_NIL:
-            return tree2(TREE_EMPTY, k, TREE_EMPTY);
         case TREE_2:
-            return tree2_insert(t, k, compare);
+        {
+            const Tree2 &t2 = t;
+            ks[0] = t2.k[0];
+            ts[0] = t2.t[0]; ts[1] = t2.t[1];
+            return 1;
+        }
         case TREE_3:
-            return tree3_insert(t, k, compare);
+        {
+            const Tree3 &t3 = t;
+            ks[0] = t3.k[0]; ks[1] = t3.k[1];
+            ts[0] = t3.t[0]; ts[1] = t3.t[1]; ts[2] = t3.t[2];
+            return 2;
+        }
         case TREE_4:
         {
             const Tree4 &t4 = t;
-            Tree lt = tree2(t4.t[0], t4.k[0], t4.t[1]);
-            Tree rt = tree2(t4.t[2], t4.k[2], t4.t[3]);
-            Tree nt = tree2(lt, t4.k[1], rt);
-            return tree2_insert(nt, k, compare);
+            ks[0] = t4.k[0]; ks[1] = t4.k[1]; ks[2] = t4.k[2];
+            ts[0] = t4.t[0]; ts[1] = t4.t[1]; ts[2] = t4.t[2];
+            ts[3] = t4.t[3];
+            return 3;
+        }
+        case TREE_LEAF1:
+        case TREE_LEAF2:
+        case TREE_LEAF3:
+        {
+            const K *lks = tree_leaf_keys(t);
+            size_t n = _tree_node_size(t);
+            for (size_t i = 0; i < n; i++)
+            {
+                ks[i] = lks[i];
+                ts[i] = TREE_EMPTY;
+            }
+            ts[n] = TREE_EMPTY;
+            return n;
         }
         default:
             error_bad_tree();
     }
 }
 
-static Tree tree2_insert(const Tree2 &t, K k, Compare compare)
+static Tree tree_pack(size_t owner, size_t n, const K *ks, const Tree *ts)
 {
-    int cmp = compare(k, t.k[0]);
-    if (index(t.t[0]) == TREE_NIL)
+    switch (n)
     {
-        Tree nil = TREE_EMPTY;
-        if (cmp < 0)
-            return tree3(nil, k, nil, t.k[0], nil);
-        else if (cmp > 0)
-            return tree3(nil, t.k[0], nil, k, nil);
-        else
-            return tree2(nil, k, nil);
+        case 1:
+            return tree_set_owner(tree2(ts[0], ks[0], ts[1]), owner);
+        case 2:
+            return tree_set_owner(tree3(ts[0], ks[0], ts[1], ks[1], ts[2]),
+                owner);
+        case 3:
+            return tree_set_owner(tree4(ts[0], ks[0], ts[1], ks[1], ts[2],
+                ks[2], ts[3]), owner);
+        default:
+            error_bad_tree();
     }
-    if (cmp < 0)
+}
+
+/*
+ * Offsets of the keys and children of an internal node (same for all
+ * types).  Only owned nodes may be updated through these.
+ */
+static inline K *tree_keys(Tree t)
+{
+    return (K *)(tree_size_ptr(t) + 1);
+}
+static inline Tree *tree_children(Tree t, size_t n)
+{
+    return (Tree *)(tree_keys(t) + n);
+}
+
+/*
+ * Transient insert.
+ */
+extern Tree _tree_insert_owned(Tree t, K k, Compare compare, size_t owner)
+{
+    if (index(t) == TREE_NIL)
+        return tree_set_owner(tree2(t, k, t), owner);
+    bool added, split;
+    K mk;
+    Tree rt;
+    Tree nt = tree_insert_owned_2(t, k, compare, owner, &added, &split, &mk,
+        &rt);
+    if (split)
+        nt = tree_set_owner(tree2(nt, mk, rt), owner);
+    if (tree_ptr(nt) != tree_ptr(t) && tree_is_owned(t, owner))
+        tree_drop(t);
+    return nt;
+}
+
+static Tree tree_insert_owned_2(Tree t, K k, Compare compare, size_t owner,
+    bool *added, bool *split, K *mk, Tree *rt)
+{
+    K ks[4];
+    Tree ts[5];
+    size_t n = tree_unpack(t, ks, ts), i;
+    int cmp = 1;
+    for (i = 0; i < n && (cmp = compare(k, ks[i])) > 0; i++)
+        ;
+    *split = false;
+    if (i < n && cmp == 0)
     {
-        switch (index(t.t[0]))
+        *added = false;
+        if (tree_is_owned(t, owner))
         {
-            case TREE_2:
-            {
-                const Tree2 &t2 = t.t[0];
-                Tree nt = tree2_insert(t2, k, compare);
-                return tree2(nt, t.k[0], t.t[1]);
-            }
-            case TREE_3:
-            {
-                const Tree3 &t3 = t.t[0];
-                Tree nt = tree3_insert(t3, k, compare);
-                return tree2(nt, t.k[0], t.t[1]);
-            }
-            case TREE_4:
-            {
-                const Tree4 &t4 = t.t[0];
-                cmp = compare(k, t4.k[1]);
-                Tree lt = tree2(t4.t[0], t4.k[0], t4.t[1]);
-                Tree rt = tree2(t4.t[2], t4.k[2], t4.t[3]);
-                if (cmp < 0)
-                {
-                    Tree nt = tree2_insert(lt, k, compare);
-                    return tree3(nt, t4.k[1], rt, t.k[0], t.t[1]);
-                }
-                else if (cmp > 0)
-                {
-                    Tree nt = tree2_insert(rt, k, compare);
-                    return tree3(lt, t4.k[1], nt, t.k[0], t.t[1]);
-                }
-                else
-                    return tree3(lt, k, rt, t.k[0], t.t[1]);
-            }
-            default:
-                error_bad_tree();
+            tree_keys(t)[i] = k;
+            return t;
         }
+        ks[i] = k;
+        return tree_pack(owner, n, ks, ts);
     }
-    else if (cmp > 0)
+    Tree nt = ts[i], nrt = TREE_EMPTY;
+    K nk = k;
+    if (index(nt) != TREE_NIL)
     {
-        switch (index(t.t[1]))
+        bool nsplit;
+        nt = tree_insert_owned_2(nt, k, compare, owner, added, &nsplit, &nk,
+            &nrt);
+        if (!nsplit)
         {
-            case TREE_2:
+            if (!tree_is_owned(t, owner))
             {
-                const Tree2 &t2 = t.t[1];
-                Tree nt = tree2_insert(t2, k, compare);
-                return tree2(t.t[0], t.k[0], nt);
+                ts[i] = nt;
+                return tree_pack(owner, n, ks, ts);
             }
-            case TREE_3:
+            Tree *slot = tree_children(t, n) + i;
+            if (tree_ptr(*slot) != tree_ptr(nt))
             {
-                const Tree3 &t3 = t.t[1];
-                Tree nt = tree3_insert(t3, k, compare);
-                return tree2(t.t[0], t.k[0], nt);
+                tree_retain(nt);
+                tree_unref(*slot);
+                *slot = nt;
             }
-            case TREE_4:
-            {
-                const Tree4 &t4 = t.t[1];
-                cmp = compare(k, t4.k[1]);
-                Tree lt = tree2(t4.t[0], t4.k[0], t4.t[1]);
-                Tree rt = tree2(t4.t[2], t4.k[2], t4.t[3]);
-                if (cmp < 0)
-                {
-                    Tree nt = tree2_insert(lt, k, compare);
-                    return tree3(t.t[0], t.k[0], nt, t4.k[1], rt);
-                }
-                else if (cmp > 0)
-                {
-                    Tree nt = tree2_insert(rt, k, compare);
-                    return tree3(t.t[0], t.k[0], lt, t4.k[1], nt);
-                }
-                else
-                    return tree3(t.t[0], t.k[0], lt, k, rt);
-            }
-            default:
-                error_bad_tree();
+            if (*added)
+                (*tree_size_ptr(t))++;
+            return t;
         }
     }
     else
-        return tree2(t.t[0], k, t.t[1]);
+        *added = true;
+
+    // Insert (nt, nk, nrt) in place of ts[i]:
+    for (size_t j = n; j > i; j--)
+    {
+        ks[j] = ks[j-1];
+        ts[j+1] = ts[j];
+    }
+    ks[i] = nk;
+    ts[i] = nt;
+    ts[i+1] = nrt;
+    n++;
+    if (n <= 3)
+        return tree_pack(owner, n, ks, ts);
+    *split = true;
+    *mk = ks[1];
+    *rt = tree_pack(owner, 2, ks+2, ts+2);
+    return tree_pack(owner, 1, ks, ts);
 }
 
-static Tree tree3_insert(const Tree3 &t, K k, Compare compare)
+/*
+ * Transient delete.  Owned nodes on the search path are updated in place
+ * unless their child was reduced, in which case the node is rebuilt by the
+ * usual rebalancing (which always allocates) and the new node is claimed.
+ * Shared subtrees are path copied, and the fresh copy is claimed.
+ */
+static Tree tree_fix(size_t n, size_t i, const K *ks, const Tree *ts,
+    bool *reduced)
 {
-    int cmp = compare(k, t.k[0]);
-    if (index(t.t[0]) == TREE_NIL)
+    switch (n * 4 + i)
     {
-        Tree nil = TREE_EMPTY;
-        if (cmp < 0)
-            return tree4(nil, k, nil, t.k[0], nil, t.k[1], nil);
-        else if (cmp > 0)
-        {
-            cmp = compare(k, t.k[1]);
-            if (cmp < 0)
-                return tree4(nil, t.k[0], nil, k, nil, t.k[1], nil);
-            else if (cmp > 0)
-                return tree4(nil, t.k[0], nil, t.k[1], nil, k, nil);
-            else
-                return tree3(nil, t.k[0], nil, k, nil);
-        }
-        else
-            return tree3(nil, k, nil, t.k[1], nil);
+        case 1 * 4 + 0:
+            return _tree2_fix_t0(ts[0], ks[0], ts[1], reduced);
+        case 1 * 4 + 1:
+            return _tree2_fix_t1(ts[0], ks[0], ts[1], reduced);
+        case 2 * 4 + 0:
+            return _tree3_fix_t0(ts[0], ks[0], ts[1], ks[1], ts[2], reduced);
+        case 2 * 4 + 1:
+            return _tree3_fix_t1(ts[0], ks[0], ts[1], ks[1], ts[2], reduced);
+        case 2 * 4 + 2:
+            return _tree3_fix_t2(ts[0], ks[0], ts[1], ks[1], ts[2], reduced);
+        case 3 * 4 + 0:
+            return _tree4_fix_t0(ts[0], ks[0], ts[1], ks[1], ts[2], ks[2],
+                ts[3], reduced);
+        case 3 * 4 + 1:
+            return _tree4_fix_t1(ts[0], ks[0], ts[1], ks[1], ts[2], ks[2],
+                ts[3], reduced);
+        case 3 * 4 + 2:
+            return _tree4_fix_t2(ts[0], ks[0], ts[1], ks[1], ts[2], ks[2],
+                ts[3], reduced);
+        case 3 * 4 + 3:
+            return _tree4_fix_t3(ts[0], ks[0], ts[1], ks[1], ts[2], ks[2],
+                ts[3], reduced);
+        default:
+            error_bad_tree();
     }
+}
 
-    if (cmp < 0)
+static Tree tree_delete_owned_2(Tree t, K k, Compare compare, size_t owner,
+    bool *reduced)
+{
+    if (!tree_is_owned(t, owner))
     {
-        switch (index(t.t[0]))
-        {
-            case TREE_2:
-            {
-                const Tree2 &t2 = t.t[0];
-                Tree nt = tree2_insert(t2, k, compare);
-                return tree3(nt, t.k[0], t.t[1], t.k[1], t.t[2]);
-            }
-            case TREE_3:
-            {
-                const Tree3 &t3 = t.t[0];
-                Tree nt = tree3_insert(t3, k, compare);
-                return tree3(nt, t.k[0], t.t[1], t.k[1], t.t[2]);
-            }
-            case TREE_4:
-            {
-                const Tree4 &t4 = t.t[0];
-                cmp = compare(k, t4.k[1]);
-                Tree lt = tree2(t4.t[0], t4.k[0], t4.t[1]);
-                Tree rt = tree2(t4.t[2], t4.k[2], t4.t[3]);
-                if (cmp < 0)
-                {
-                    Tree nt = tree2_insert(lt, k, compare);
-                    return tree4(nt, t4.k[1], rt, t.k[0], t.t[1], t.k[1],
-                        t.t[2]);
-                }
-                else if (cmp > 0)
-                {
-                    Tree nt = tree2_insert(rt, k, compare);
-                    return tree4(lt, t4.k[1], nt, t.k[0], t.t[1], t.k[1],
-                        t.t[2]);
-                }
-                else
-                    return tree4(lt, k, rt, t.k[0], t.t[1], t.k[1], t.t[2]);
-            }
-            default:
-                error_bad_tree();
-        }
+        Tree nt = _tree_delete_2_k(t, k, compare, reduced);
+        if (tree_ptr(nt) != tree_ptr(t) && index(nt) != TREE_NIL)
+            tree_set_owner(nt, owner);
+        return nt;
     }
-    else if (cmp > 0)
+    K ks[3];
+    Tree ts[4];
+    size_t n = tree_unpack(t, ks, ts), i;
+    int cmp = 1;
+    for (i = 0; i < n && (cmp = compare(k, ks[i])) > 0; i++)
+        ;
+    Tree nt;
+    size_t j = i;
+    if (i < n && cmp == 0)
     {
-        cmp = compare(k, t.k[1]);
-        if (cmp < 0)
-        {
-            switch (index(t.t[1]))
-            {
-                case TREE_2:
-                {
-                    const Tree2 &t2 = t.t[1];
-                    Tree nt = tree2_insert(t2, k, compare);
-                    return tree3(t.t[0], t.k[0], nt, t.k[1], t.t[2]);
-                }
-                case TREE_3:
-                {
-                    const Tree3 &t3 = t.t[1];
-                    Tree nt = tree3_insert(t3, k, compare);
-                    return tree3(t.t[0], t.k[0], nt, t.k[1], t.t[2]);
-                }
-                case TREE_4:
-                {
-                    const Tree4 &t4 = t.t[1];
-                    cmp = compare(k, t4.k[1]);
-                    Tree lt = tree2(t4.t[0], t4.k[0], t4.t[1]);
-                    Tree rt = tree2(t4.t[2], t4.k[2], t4.t[3]);
-                    if (cmp < 0)
-                    {
-                        Tree nt = tree2_insert(lt, k, compare);
-                        return tree4(t.t[0], t.k[0], nt, t4.k[1], rt, t.k[1],
-                            t.t[2]);
-                    }
-                    else if (cmp > 0)
-                    {
-                        Tree nt = tree2_insert(rt, k, compare);
-                        return tree4(t.t[0], t.k[0], lt, t4.k[1], nt, t.k[1],
-                            t.t[2]);
-                    }
-                    else
-                        return tree4(t.t[0], t.k[0], lt, k, rt, t.k[1],
-                            t.t[2]);
-                }
-                default:
-                    error_bad_tree();
-            }
-        }
-        else if (cmp > 0)
+        // Replace the key with its successor (owned nodes are never leaves):
+        j = i+1;
+        nt = _tree_delete_min_2(ts[j], &ks[i], reduced);
+        if (index(nt) != TREE_NIL)
+            tree_set_owner(nt, owner);
+    }
+    else
+    {
+        size_t size = _tree_size(ts[i]);
+        nt = tree_delete_owned_2(ts[i], k, compare, owner, reduced);
+        if (_tree_size(nt) == size)
         {
-            switch (index(t.t[2]))
-            {
-                case TREE_2:
-                {
-                    const Tree2 &t2 = t.t[2];
-                    Tree nt = tree2_insert(t2, k, compare);
-                    return tree3(t.t[0], t.k[0], t.t[1], t.k[1], nt);
-                }
-                case TREE_3:
-                {
-                    const Tree3 &t3 = t.t[2];
-                    Tree nt = tree3_insert(t3, k, compare);
-                    return tree3(t.t[0], t.k[0], t.t[1], t.k[1], nt);
-                }
-                case TREE_4:
-                {
-                    const Tree4 &t4 = t.t[2];
-                    cmp = compare(k, t4.k[1]);
-                    Tree lt = tree2(t4.t[0], t4.k[0], t4.t[1]);
-                    Tree rt = tree2(t4.t[2], t4.k[2], t4.t[3]);
-                    if (cmp < 0)
-                    {
-                        Tree nt = tree2_insert(lt, k, compare);
-                        return tree4(t.t[0], t.k[0], t.t[1], t.k[1], nt,
-                            t4.k[1], rt);
-                    }
-                    else if (cmp > 0)
-                    {
-                        Tree nt = tree2_insert(rt, k, compare);
-                        return tree4(t.t[0], t.k[0], t.t[1], t.k[1], lt,
-                            t4.k[1], nt);
-                    }
-                    else
-                        return tree4(t.t[0], t.k[0], t.t[1], t.k[1], lt, k,
-                            rt);
-                }
-                default:
-                    error_bad_tree();
-            }
+            // Not found:
+            if (tree_ptr(nt) != tree_ptr(ts[i]))
+                tree_drop(nt);
+            return t;
         }
-        else
-            return tree3(t.t[0], t.k[0], t.t[1], k, t.t[2]);
     }
-    else
-        return tree3(t.t[0], k, t.t[1], t.k[1], t.t[2]);
+    if (*reduced)
+    {
+        ts[j] = nt;
+        return tree_set_owner(tree_fix(n, j, ks, ts, reduced), owner);
+    }
+    if (j != i)
+        tree_keys(t)[i] = ks[i];
+    Tree *slot = tree_children(t, n) + j;
+    if (tree_ptr(*slot) != tree_ptr(nt))
+    {
+        tree_retain(nt);
+        tree_unref(*slot);
+        *slot = nt;
+    }
+    (*tree_size_ptr(t))--;
+    return t;
+}
+
+extern Tree _tree_delete_owned(Tree t, K k, Compare compare, size_t owner)
+{
+    bool reduced = false;
+    Tree nt = tree_delete_owned_2(t, k, compare, owner, &reduced);
+    if (tree_ptr(nt) != tree_ptr(t) && tree_is_owned(t, owner))
+        tree_drop(t);
+    return nt;
 }
 
 /*
- * Delete.
+ * Freeze a transient tree.  Only owned nodes are visited, since owned nodes
+ * are only ever reachable through other owned nodes.
  */
-extern Tree _tree_delete(Tree t, K k, Compare compare)
+extern Tree _tree_freeze(Tree t, size_t owner)
 {
-    bool reduced = false;
-    t = tree_delete_2(t, k, compare, &reduced);
+    if (!tree_is_owned(t, owner))
+        return t;
+    K ks[3];
+    Tree ts[4];
+    size_t n = tree_unpack(t, ks, ts);
+    *tree_size_ptr(t) &= TREE_SIZE_MASK;
+    for (size_t i = 0; i <= n; i++)
+        _tree_freeze(ts[i], owner);
     return t;
 }
 
-static Tree tree_delete_2(Tree t, K k, Compare compare, bool *reduced)
+/*
+ * Delete.
+ */
+extern Tree _tree_delete(Tree t, K k, Compare compare)
 {
-    switch (index(t))
-    {
-        case TREE_NIL:
-            *reduced = false;
-            return t;
-        case TREE_2:
-        {
-            const Tree2 &t2 = t;
-            int cmp = compare(k, t2.k[0]);
-            if (cmp < 0)
-            {
-                Tree nt = tree_delete_2(t2.t[0], k, compare, reduced);
-                return tree2_fix_t0(nt, t2.k[0], t2.t[1], reduced);
-            }
-            else if (cmp > 0)
-            {
-                Tree nt = tree_delete_2(t2.t[1], k, compare, reduced);
-                return tree2_fix_t1(t2.t[0], t2.k[0], nt, reduced);
-            }
-            else
-            {
-                if (index(t2.t[1]) == TREE_NIL)
-                {
-                    *reduced = true;
-                    return TREE_EMPTY;
-                }
-                else
-                {
-                    K ks;
-                    Tree nt = tree_delete_min_2(t2.t[1], &ks, reduced);
-                    return tree2_fix_t1(t2.t[0], ks, nt, reduced);
-                }
-            }
-        }
-        case TREE_3:
-        {
-            const Tree3 &t3 = t;
-            int cmp = compare(k, t3.k[0]);
-            if (cmp < 0)
-            {
-                Tree nt = tree_delete_2(t3.t[0], k, compare, reduced);
-                return tree3_fix_t0(nt, t3.k[0], t3.t[1], t3.k[1], t3.t[2],
-                    reduced);
-            }
-            else if (cmp > 0)
-            {
-                cmp = compare(k, t3.k[1]);
-                if (cmp < 0)
-                {
-                    Tree nt = tree_delete_2(t3.t[1], k, compare, reduced);
-                    return tree3_fix_t1(t3.t[0], t3.k[0], nt, t3.k[1], t3.t[2],
-                        reduced);
-                }
-                else if (cmp > 0)
-                {
-                    Tree nt = tree_delete_2(t3.t[2], k, compare, reduced);
-                    return tree3_fix_t2(t3.t[0], t3.k[0], t3.t[1], t3.k[1], nt,
-                        reduced);
-                }
-                else
-                {
-                    if (index(t3.t[2]) == TREE_NIL)
-                    {
-                        Tree nil = TREE_EMPTY;
-                        return tree2(nil, t3.k[0], nil);
-                    }
-                    else
-                    {
-                        K ks;
-                        Tree nt = tree_delete_min_2(t3.t[2], &ks, reduced);
-                        return tree3_fix_t2(t3.t[0], t3.k[0], t3.t[1], ks, nt,
-                            reduced);
-                    }
-                }
-            }
-            else
-            {
-                if (index(t3.t[1]) == TREE_NIL)
-                {
-                    Tree nil = TREE_EMPTY;
-                    return tree2(nil, t3.k[1], nil);
-                }
-                else
-                {
-                    K ks;
-                    Tree nt = tree_delete_min_2(t3.t[1], &ks, reduced);
-                    return tree3_fix_t1(t3.t[0], ks, nt, t3.k[1], t3.t[2],
-                        reduced);
-                }
-            }
-        }
-        case TREE_4:
-        {
-            const Tree4 &t4 = t;
-            int cmp = compare(k, t4.k[1]);
-            if (cmp < 0)
-            {
-                cmp = compare(k, t4.k[0]);
-                if (cmp < 0)
-                {
-                    Tree nt = tree_delete_2(t4.t[0], k, compare, reduced);
-                    return tree4_fix_t0(nt, t4.k[0], t4.t[1], t4.k[1], t4.t[2],
-                        t4.k[2], t4.t[3], reduced);
-                }
-                else if (cmp > 0)
-                {
-                    Tree nt = tree_delete_2(t4.t[1], k, compare, reduced);
-                    return tree4_fix_t1(t4.t[0], t4.k[0], nt, t4.k[1], t4.t[2],
-                        t4.k[2], t4.t[3], reduced);
-                }
-                else
-                {
-                    if (index(t4.t[1]) == TREE_NIL)
-                    {
-                        Tree nil = TREE_EMPTY;
-                        return tree3(nil, t4.k[1], nil, t4.k[2], nil);
-                    }
-                    else
-                    {
-                        K ks;
-                        Tree nt = tree_delete_min_2(t4.t[1], &ks, reduced);
-                        return tree4_fix_t1(t4.t[0], ks, nt, t4.k[1], t4.t[2],
-                            t4.k[2], t4.t[3], reduced);
-                    }
-                }
-            }
-            else if (cmp > 0)
-            {
-                cmp = compare(k, t4.k[2]);
-                if (cmp < 0)
-                {
-                    Tree nt = tree_delete_2(t4.t[2], k, compare, reduced);
-                    return tree4_fix_t2(t4.t[0], t4.k[0], t4.t[1], t4.k[1], nt,
-                        t4.k[2], t4.t[3], reduced);
-                }
-                else if (cmp > 0)
-                {
-                    Tree nt = tree_delete_2(t4.t[3], k, compare, reduced);
-                    return tree4_fix_t3(t4.t[0], t4.k[0], t4.t[1], t4.k[1],
-                        t4.t[2], t4.k[2], nt, reduced);
-                }
-                else
-                {
-                    if (index(t4.t[3]) == TREE_NIL)
-                    {
-                        Tree nil = TREE_EMPTY;
-                        return tree3(nil, t4.k[0], nil, t4.k[1], nil);
-                    }
-                    else
-                    {
-                        K ks;
-                        Tree nt = tree_delete_min_2(t4.t[3], &ks, reduced);
-                        return tree4_fix_t3(t4.t[0], t4.k[0], t4.t[1], t4.k[1],
-                            t4.t[2], ks, nt, reduced);
-                    }
-                }
-            }
-            else
-            {
-                if (index(t4.t[2]) == TREE_NIL)
-                {
-                    Tree nil = TREE_EMPTY;
-                    return tree3(nil, t4.k[0], nil, t4.k[2], nil);
-                }
-                else
-                {
-                    K ks;
-                    Tree nt = tree_delete_min_2(t4.t[2], &ks, reduced);
-                    return tree4_fix_t2(t4.t[0], t4.k[0], t4.t[1], ks, nt,
-                        t4.k[2], t4.t[3], reduced);
-                }
-            }
-        }
-        default:
-            error_bad_tree();
-    }
+    return _tree_delete_k(t, k, compare);
 }
 
 /*
  * Delete min.
  */
-static Tree tree_delete_min_2(Tree t, K *k, bool *reduced)
+extern Tree _tree_delete_min_2(Tree t, K *k, bool *reduced)
 {
     switch (index(t))
     {
@@ -738,8 +612,10 @@ static Tree tree_delete_min_2(Tree t, K *k, bool *reduced)
             *reduced = false;
             return t;
         case TREE_2:
+        case TREE_LEAF1:
         {
-            const Tree2 &t2 = t;
+            Tree2 t2_buf;
+            const Tree2 &t2 = tree2_view(t, &t2_buf);
             if (index(t2.t[0]) == TREE_NIL)
             {
                 *reduced = true;
@@ -749,13 +625,15 @@ static Tree tree_delete_min_2(Tree t, K *k, bool *reduced)
             }
             else
             {
-                Tree nt = tree_delete_min_2(t2.t[0], k, reduced);
-                return tree2_fix_t0(nt, t2.k[0], t2.t[1], reduced);
+                Tree nt = _tree_delete_min_2(t2.t[0], k, reduced);
+                return _tree2_fix_t0(nt, t2.k[0], t2.t[1], reduced);
             }
         }
         case TREE_3:
+        case TREE_LEAF2:
         {
-            const Tree3 &t3 = t;
+            Tree3 t3_buf;
+            const Tree3 &t3 = tree3_view(t, &t3_buf);
             if (index(t3.t[0]) == TREE_NIL)
             {
                 if (k != nullptr)
@@ -765,14 +643,16 @@ static Tree tree_delete_min_2(Tree t, K *k, bool *reduced)
             }
             else
             {
-                Tree nt = tree_delete_min_2(t3.t[0], k, reduced);
-                return tree3_fix_t0(nt, t3.k[0], t3.t[1], t3.k[1], t3.t[2],
+                Tree nt = _tree_delete_min_2(t3.t[0], k, reduced);
+                return _tree3_fix_t0(nt, t3.k[0], t3.t[1], t3.k[1], t3.t[2],
                     reduced);
             }
         }
         case TREE_4:
+        case TREE_LEAF3:
         {
-            const Tree4 &t4 = t;
+            Tree4 t4_buf;
+            const Tree4 &t4 = tree4_view(t, &t4_buf);
             if (index(t4.t[0]) == TREE_NIL)
             {
                 if (k != nullptr)
@@ -782,8 +662,8 @@ static Tree tree_delete_min_2(Tree t, K *k, bool *reduced)
             }
             else
             {
-                Tree nt = tree_delete_min_2(t4.t[0], k, reduced);
-                return tree4_fix_t0(nt, t4.k[0], t4.t[1], t4.k[1], t4.t[2],
+                Tree nt = _tree_delete_min_2(t4.t[0], k, reduced);
+                return _tree4_fix_t0(nt, t4.k[0], t4.t[1], t4.k[1], t4.t[2],
                     t4.k[2], t4.t[3], reduced);
             }
         }
@@ -803,8 +683,10 @@ static Tree tree_delete_max_2(Tree t, K *k, bool *reduced)
             *reduced = false;
             return t;
         case TREE_2:
+        case TREE_LEAF1:
         {
-            const Tree2 &t2 = t;
+            Tree2 t2_buf;
+            const Tree2 &t2 = tree2_view(t, &t2_buf);
             if (index(t2.t[1]) == TREE_NIL)
             {
                 *reduced = true;
@@ -815,12 +697,14 @@ static Tree tree_delete_max_2(Tree t, K *k, bool *reduced)
             else
             {
                 Tree nt = tree_delete_max_2(t2.t[1], k, reduced);
-                return tree2_fix_t1(t2.t[0], t2.k[0], nt, reduced);
+                return _tree2_fix_t1(t2.t[0], t2.k[0], nt, reduced);
             }
         }
         case TREE_3:
+        case TREE_LEAF2:
         {
-            const Tree3 &t3 = t;
+            Tree3 t3_buf;
+            const Tree3 &t3 = tree3_view(t, &t3_buf);
             if (index(t3.t[2]) == TREE_NIL)
             {
                 if (k != nullptr)
@@ -831,13 +715,15 @@ static Tree tree_delete_max_2(Tree t, K *k, bool *reduced)
             else
             {
                 Tree nt = tree_delete_max_2(t3.t[2], k, reduced);
-                return tree3_fix_t2(t3.t[0], t3.k[0], t3.t[1], t3.k[1], nt,
+                return _tree3_fix_t2(t3.t[0], t3.k[0], t3.t[1], t3.k[1], nt,
                     reduced);
             }
         }
         case TREE_4:
+        case TREE_LEAF3:
         {
-            const Tree4 &t4 = t;
+            Tree4 t4_buf;
+            const Tree4 &t4 = tree4_view(t, &t4_buf);
             if (index(t4.t[3]) == TREE_NIL)
             {
                 if (k != nullptr)
@@ -848,7 +734,7 @@ static Tree tree_delete_max_2(Tree t, K *k, bool *reduced)
             else
             {
                 Tree nt = tree_delete_max_2(t4.t[3], k, reduced);
-                return tree4_fix_t3(t4.t[0], t4.k[0], t4.t[1], t4.k[1],
+                return _tree4_fix_t3(t4.t[0], t4.k[0], t4.t[1], t4.k[1],
                     t4.t[2], t4.k[2], nt, reduced);
             }
         }
@@ -857,29 +743,35 @@ static Tree tree_delete_max_2(Tree t, K *k, bool *reduced)
     }
 }
 
-static Tree tree2_fix_t0(Tree t0, K k0, Tree t1, bool *reduced)
+extern Tree _tree2_fix_t0(Tree t0, K k0, Tree t1, bool *reduced)
 {
     if (*reduced)
     {
         switch (index(t1))
         {
             case TREE_2:
+            case TREE_LEAF1:
             {
-                const Tree2 &t12 = t1;
+                Tree2 t12_buf;
+                const Tree2 &t12 = tree2_view(t1, &t12_buf);
                 return tree3(t0, k0, t12.t[0], t12.k[0], t12.t[1]);
             }
             case TREE_3:
+            case TREE_LEAF2:
             {
                 *reduced = false;
-                const Tree3 &t13 = t1;
+                Tree3 t13_buf;
+                const Tree3 &t13 = tree3_view(t1, &t13_buf);
                 Tree nt1 = tree2(t13.t[1], t13.k[1], t13.t[2]);
                 Tree nt0 = tree2(t0, k0, t13.t[0]);
                 return tree2(nt0, t13.k[0], nt1);
             }
             case TREE_4:
+            case TREE_LEAF3:
             {
                 *reduced = false;
-                const Tree4 &t14 = t1;
+                Tree4 t14_buf;
+                const Tree4 &t14 = tree4_view(t1, &t14_buf);
                 Tree nt1 = tree3(t14.t[1], t14.k[1], t14.t[2],
                     t14.k[2], t14.t[3]);
                 Tree nt0 = tree2(t0, k0, t14.t[0]);
@@ -893,29 +785,35 @@ static Tree tree2_fix_t0(Tree t0, K k0, Tree t1, bool *reduced)
         return tree2(t0, k0, t1);
 }
 
-static Tree tree2_fix_t1(Tree t0, K k0, Tree t1, bool *reduced)
+extern Tree _tree2_fix_t1(Tree t0, K k0, Tree t1, bool *reduced)
 {
     if (*reduced)
     {
         switch (index(t0))
         {
             case TREE_2:
+            case TREE_LEAF1:
             {
-                const Tree2 &t02 = t0;
+                Tree2 t02_buf;
+                const Tree2 &t02 = tree2_view(t0, &t02_buf);
                 return tree3(t02.t[0], t02.k[0], t02.t[1], k0, t1);
             }
             case TREE_3:
+            case TREE_LEAF2:
             {
                 *reduced = false;
-                const Tree3 &t03 = t0;
+                Tree3 t03_buf;
+                const Tree3 &t03 = tree3_view(t0, &t03_buf);
                 Tree nt0 = tree2(t03.t[0], t03.k[0], t03.t[1]);
                 Tree nt1 = tree2(t03.t[2], k0, t1);
                 return tree2(nt0, t03.k[1], nt1);
             }
             case TREE_4:
+            case TREE_LEAF3:
             {
                 *reduced = false;
-                const Tree4 &t04 = t0;
+                Tree4 t04_buf;
+                const Tree4 &t04 = tree4_view(t0, &t04_buf);
                 Tree nt0 = tree3(t04.t[0], t04.k[0], t04.t[1], t04.k[1],
                     t04.t[2]);
                 Tree nt1 = tree2(t04.t[3], k0, t1);
@@ -929,7 +827,7 @@ static Tree tree2_fix_t1(Tree t0, K k0, Tree t1, bool *reduced)
         return tree2(t0, k0, t1);
 }
 
-static Tree tree3_fix_t0(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced)
+extern Tree _tree3_fix_t0(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced)
 {
     if (*reduced)
     {
@@ -937,21 +835,27 @@ static Tree tree3_fix_t0(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced)
         switch (index(t1))
         {
             case TREE_2:
+            case TREE_LEAF1:
             {
-                const Tree2 &t12 = t1;
+                Tree2 t12_buf;
+                const Tree2 &t12 = tree2_view(t1, &t12_buf);
                 Tree nt1 = tree3(t0, k0, t12.t[0], t12.k[0], t12.t[1]);
                 return tree2(nt1, k1, t2);
             }
             case TREE_3:
+            case TREE_LEAF2:
             {
-                const Tree3 &t13 = t1;
+                Tree3 t13_buf;
+                const Tree3 &t13 = tree3_view(t1, &t13_buf);
                 Tree nt1 = tree2(t13.t[1], t13.k[1], t13.t[2]);
                 Tree nt0 = tree2(t0, k0, t13.t[0]);
                 return tree3(nt0, t13.k[0], nt1, k1, t2);
             }
             case TREE_4:
+            case TREE_LEAF3:
             {
-                const Tree4 &t14 = t1;
+                Tree4 t14_buf;
+                const Tree4 &t14 = tree4_view(t1, &t14_buf);
                 Tree nt1 = tree3(t14.t[1], t14.k[1], t14.t[2],
                     t14.k[2], t14.t[3]);
                 Tree nt0 = tree2(t0, k0, t14.t[0]);
@@ -965,7 +869,7 @@ static Tree tree3_fix_t0(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced)
         return tree3(t0, k0, t1, k1, t2);
 }
 
-static Tree tree3_fix_t1(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced)
+extern Tree _tree3_fix_t1(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced)
 {
     if (*reduced)
     {
@@ -973,21 +877,27 @@ static Tree tree3_fix_t1(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced)
         switch (index(t0))
         {
             case TREE_2:
+            case TREE_LEAF1:
             {
-                const Tree2 &t02 = t0;
+                Tree2 t02_buf;
+                const Tree2 &t02 = tree2_view(t0, &t02_buf);
                 Tree nt0 = tree3(t02.t[0], t02.k[0], t02.t[1], k0, t1);
                 return tree2(nt0, k1, t2);
             }
             case TREE_3:
+            case TREE_LEAF2:
             {
-                const Tree3 &t03 = t0;
+                Tree3 t03_buf;
+                const Tree3 &t03 = tree3_view(t0, &t03_buf);
                 Tree nt0 = tree2(t03.t[0], t03.k[0], t03.t[1]);
                 Tree nt1 = tree2(t03.t[2], k0, t1);
                 return tree3(nt0, t03.k[1], nt1, k1, t2);
             }
             case TREE_4:
+            case TREE_LEAF3:
             {
-                const Tree4 &t04 = t0;
+                Tree4 t04_buf;
+                const Tree4 &t04 = tree4_view(t0, &t04_buf);
                 Tree nt0 = tree3(t04.t[0], t04.k[0], t04.t[1],
                     t04.k[1], t04.t[2]);
                 Tree nt1 = tree2(t04.t[3], k0, t1);
@@ -1001,7 +911,7 @@ static Tree tree3_fix_t1(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced)
         return tree3(t0, k0, t1, k1, t2);
 }
 
-static Tree tree3_fix_t2(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced)
+extern Tree _tree3_fix_t2(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced)
 {
     if (*reduced)
     {
@@ -1009,21 +919,27 @@ static Tree tree3_fix_t2(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced)
         switch (index(t1))
         {
             case TREE_2:
+            case TREE_LEAF1:
             {
-                const Tree2 &t12 = t1;
+                Tree2 t12_buf;
+                const Tree2 &t12 = tree2_view(t1, &t12_buf);
                 Tree nt1 = tree3(t12.t[0], t12.k[0], t12.t[1], k1, t2);
                 return tree2(t0, k0, nt1);
             }
             case TREE_3:
+            case TREE_LEAF2:
             {
-                const Tree3 &t13 = t1;
+                Tree3 t13_buf;
+                const Tree3 &t13 = tree3_view(t1, &t13_buf);
                 Tree nt1 = tree2(t13.t[0], t13.k[0], t13.t[1]);
                 Tree nt2 = tree2(t13.t[2], k1, t2);
                 return tree3(t0, k0, nt1, t13.k[1], nt2);
             }
             case TREE_4:
+            case TREE_LEAF3:
             {
-                const Tree4 &t14 = t1;
+                Tree4 t14_buf;
+                const Tree4 &t14 = tree4_view(t1, &t14_buf);
                 Tree nt1 = tree3(t14.t[0], t14.k[0], t14.t[1],
                     t14.k[1], t14.t[2]);
                 Tree nt2 = tree2(t14.t[3], k1, t2);
@@ -1037,7 +953,7 @@ static Tree tree3_fix_t2(Tree t0, K k0, Tree t1, K k1, Tree t2, bool *reduced)
         return tree3(t0, k0, t1, k1, t2);
 }
 
-static Tree tree4_fix_t0(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
+extern Tree _tree4_fix_t0(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
     Tree t3, bool *reduced)
 {
     if (*reduced)
@@ -1046,21 +962,27 @@ static Tree tree4_fix_t0(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
         switch (index(t1))
         {
             case TREE_2:
+            case TREE_LEAF1:
             {
-                const Tree2 &t12 = t1;
+                Tree2 t12_buf;
+                const Tree2 &t12 = tree2_view(t1, &t12_buf);
                 Tree nt1 = tree3(t0, k0, t12.t[0], t12.k[0], t12.t[1]);
                 return tree3(nt1, k1, t2, k2, t3);
             }
             case TREE_3:
+            case TREE_LEAF2:
             {
-                const Tree3 &t13 = t1;
+                Tree3 t13_buf;
+                const Tree3 &t13 = tree3_view(t1, &t13_buf);
                 Tree nt1 = tree2(t13.t[1], t13.k[1], t13.t[2]);
                 Tree nt0 = tree2(t0, k0, t13.t[0]);
                 return tree4(nt0, t13.k[0], nt1, k1, t2, k2, t3);
             }
             case TREE_4:
+            case TREE_LEAF3:
             {
-                const Tree4 &t14 = t1;
+                Tree4 t14_buf;
+                const Tree4 &t14 = tree4_view(t1, &t14_buf);
                 Tree nt1 = tree3(t14.t[1], t14.k[1], t14.t[2], t14.k[2],
                     t14.t[3]);
                 Tree nt0 = tree2(t0, k0, t14.t[0]);
@@ -1074,7 +996,7 @@ static Tree tree4_fix_t0(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
         return tree4(t0, k0, t1, k1, t2, k2, t3);
 }
 
-static Tree tree4_fix_t1(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
+extern Tree _tree4_fix_t1(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
     Tree t3, bool *reduced)
 {
     if (*reduced)
@@ -1083,21 +1005,27 @@ static Tree tree4_fix_t1(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
         switch (index(t2))
         {
             case TREE_2:
+            case TREE_LEAF1:
             {
-                const Tree2 &t22 = t2;
+                Tree2 t22_buf;
+                const Tree2 &t22 = tree2_view(t2, &t22_buf);
                 Tree nt2 = tree3(t1, k1, t22.t[0], t22.k[0], t22.t[1]);
                 return tree3(t0, k0, nt2, k2, t3);
             }
             case TREE_3:
+            case TREE_LEAF2:
             {
-                const Tree3 &t23 = t2;
+                Tree3 t23_buf;
+                const Tree3 &t23 = tree3_view(t2, &t23_buf);
                 Tree nt2 = tree2(t23.t[1], t23.k[1], t23.t[2]);
                 Tree nt1 = tree2(t1, k1, t23.t[0]);
                 return tree4(t0, k0, nt1, t23.k[0], nt2, k2, t3);
             }
             case TREE_4:
+            case TREE_LEAF3:
             {
-                const Tree4 &t24 = t2;
+                Tree4 t24_buf;
+                const Tree4 &t24 = tree4_view(t2, &t24_buf);
                 Tree nt2 = tree3(t24.t[1], t24.k[1], t24.t[2],
                     t24.k[2], t24.t[3]);
                 Tree nt1 = tree2(t1, k1, t24.t[0]);
@@ -1111,7 +1039,7 @@ static Tree tree4_fix_t1(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
         return tree4(t0, k0, t1, k1, t2, k2, t3);
 }
 
-static Tree tree4_fix_t2(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
+extern Tree _tree4_fix_t2(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
     Tree t3, bool *reduced)
 {
     if (*reduced)
@@ -1120,21 +1048,27 @@ static Tree tree4_fix_t2(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
         switch (index(t3))
         {
             case TREE_2:
+            case TREE_LEAF1:
             {
-                const Tree2 &t32 = t3;
+                Tree2 t32_buf;
+                const Tree2 &t32 = tree2_view(t3, &t32_buf);
                 Tree nt3 = tree3(t2, k2, t32.t[0], t32.k[0], t32.t[1]);
                 return tree3(t0, k0, t1, k1, nt3);
             }
             case TREE_3:
+            case TREE_LEAF2:
             {
-                const Tree3 &t33 = t3;
+                Tree3 t33_buf;
+                const Tree3 &t33 = tree3_view(t3, &t33_buf);
                 Tree nt3 = tree2(t33.t[1], t33.k[1], t33.t[2]);
                 Tree nt2 = tree2(t2, k2, t33.t[0]);
                 return tree4(t0, k0, t1, k1, nt2, t33.k[0], nt3);
             }
             case TREE_4:
+            case TREE_LEAF3:
             {
-                const Tree4 &t34 = t3;
+                Tree4 t34_buf;
+                const Tree4 &t34 = tree4_view(t3, &t34_buf);
                 Tree nt3 = tree3(t34.t[1], t34.k[1], t34.t[2],
                     t34.k[2], t34.t[3]);
                 Tree nt2 = tree2(t2, k2, t34.t[0]);
@@ -1148,7 +1082,7 @@ static Tree tree4_fix_t2(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
         return tree4(t0, k0, t1, k1, t2, k2, t3);
 }
 
-static Tree tree4_fix_t3(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
+extern Tree _tree4_fix_t3(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
     Tree t3, bool *reduced)
 {
     if (*reduced)
@@ -1157,21 +1091,27 @@ static Tree tree4_fix_t3(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
         switch (index(t2))
         {
             case TREE_2:
+            case TREE_LEAF1:
             {
-                const Tree2 &t22 = t2;
+                Tree2 t22_buf;
+                const Tree2 &t22 = tree2_view(t2, &t22_buf);
                 Tree nt2 = tree3(t22.t[0], t22.k[0], t22.t[1], k2, t3);
                 return tree3(t0, k0, t1, k1, nt2);
             }
             case TREE_3:
+            case TREE_LEAF2:
             {
-                const Tree3 &t23 = t2;
+                Tree3 t23_buf;
+                const Tree3 &t23 = tree3_view(t2, &t23_buf);
                 Tree nt2 = tree2(t23.t[0], t23.k[0], t23.t[1]);
                 Tree nt3 = tree2(t23.t[2], k2, t3);
                 return tree4(t0, k0, t1, k1, nt2, t23.k[1], nt3);
             }
             case TREE_4:
+            case TREE_LEAF3:
             {
-                const Tree4 &t24 = t2;
+                Tree4 t24_buf;
+                const Tree4 &t24 = tree4_view(t2, &t24_buf);
                 Tree nt2 = tree3(t24.t[0], t24.k[0], t24.t[1],
                     t24.k[1], t24.t[2]);
                 Tree nt3 = tree2(t24.t[3], k2, t3);
@@ -1185,6 +1125,151 @@ static Tree tree4_fix_t3(Tree t0, K k0, Tree t1, K k1, Tree t2, K k2,
         return tree4(t0, k0, t1, k1, t2, k2, t3);
 }
 
+/*
+ * Alter.  A single pass that calls f on the entry matching k (nullptr if
+ * there is none), and then keeps, sets or erases the entry as directed.
+ * Inserts split on the way back up, and erases are rebalanced on the way
+ * back up as for delete.  If the entry is kept, the original tree is
+ * returned.
+ */
+typedef int (*TreeAlter)(void *, const K *, K *);
+
+static Tree tree_fix(size_t n, const K *ks, const Tree *ts, size_t i,
+    bool *reduced)
+{
+    switch (n)
+    {
+        case 1:
+            return (i == 0? _tree2_fix_t0(ts[0], ks[0], ts[1], reduced):
+                            _tree2_fix_t1(ts[0], ks[0], ts[1], reduced));
+        case 2:
+            switch (i)
+            {
+                case 0:
+                    return _tree3_fix_t0(ts[0], ks[0], ts[1], ks[1], ts[2],
+                        reduced);
+                case 1:
+                    return _tree3_fix_t1(ts[0], ks[0], ts[1], ks[1], ts[2],
+                        reduced);
+                default:
+                    return _tree3_fix_t2(ts[0], ks[0], ts[1], ks[1], ts[2],
+                        reduced);
+            }
+        case 3:
+            switch (i)
+            {
+                case 0:
+                    return _tree4_fix_t0(ts[0], ks[0], ts[1], ks[1], ts[2],
+                        ks[2], ts[3], reduced);
+                case 1:
+                    return _tree4_fix_t1(ts[0], ks[0], ts[1], ks[1], ts[2],
+                        ks[2], ts[3], reduced);
+                case 2:
+                    return _tree4_fix_t2(ts[0], ks[0], ts[1], ks[1], ts[2],
+                        ks[2], ts[3], reduced);
+                default:
+                    return _tree4_fix_t3(ts[0], ks[0], ts[1], ks[1], ts[2],
+                        ks[2], ts[3], reduced);
+            }
+        default:
+            error_bad_tree();
+    }
+}
+
+static Tree tree_alter_2(Tree t, K k, Compare compare, TreeAlter f,
+    void *data, bool *split, K *mk, Tree *rt, bool *reduced)
+{
+    K ks[4];
+    Tree ts[5];
+    size_t n = tree_unpack(t, ks, ts), i;
+    int cmp = 1;
+    for (i = 0; i < n && (cmp = compare(k, ks[i])) > 0; i++)
+        ;
+    *split = false;
+    *reduced = false;
+    bool leaf = (index(ts[0]) == TREE_NIL);
+    K nk;
+    if (i < n && cmp == 0)
+    {
+        switch (f(data, ks + i, &nk))
+        {
+            case _TREE_ALTER_SET:
+                ks[i] = nk;
+                return tree_pack(0, n, ks, ts);
+            case _TREE_ALTER_ERASE:
+                if (leaf)
+                {
+                    for (size_t j = i+1; j < n; j++)
+                        ks[j-1] = ks[j];
+                    *reduced = (n == 1);
+                    return (n == 1? TREE_EMPTY: tree_pack(0, n-1, ks, ts));
+                }
+                // Replace the key with its successor:
+                ts[i+1] = _tree_delete_min_2(ts[i+1], ks + i, reduced);
+                return tree_fix(n, ks, ts, i+1, reduced);
+            default:
+                return t;
+        }
+    }
+
+    Tree nt = TREE_EMPTY, nrt = TREE_EMPTY;
+    if (leaf)
+    {
+        if (f(data, nullptr, &nk) != _TREE_ALTER_SET)
+            return t;
+    }
+    else
+    {
+        bool nsplit;
+        nt = tree_alter_2(ts[i], k, compare, f, data, &nsplit, &nk, &nrt,
+            reduced);
+        if (tree_ptr(nt) == tree_ptr(ts[i]))
+            return t;
+        if (!nsplit)
+        {
+            ts[i] = nt;
+            return tree_fix(n, ks, ts, i, reduced);
+        }
+    }
+
+    // Insert (nt, nk, nrt) in place of ts[i]:
+    for (size_t j = n; j > i; j--)
+    {
+        ks[j] = ks[j-1];
+        ts[j+1] = ts[j];
+    }
+    ks[i] = nk;
+    ts[i] = nt;
+    ts[i+1] = nrt;
+    n++;
+    if (n <= 3)
+        return tree_pack(0, n, ks, ts);
+    *split = true;
+    *mk = ks[1];
+    *rt = tree_pack(0, 2, ks+2, ts+2);
+    return tree_pack(0, 1, ks, ts);
+}
+
+extern PURE Tree _tree_alter(Tree t, K k, Compare compare, TreeAlter f,
+    void *data)
+{
+    if (index(t) == TREE_NIL)
+    {
+        K nk;
+        if (f(data, nullptr, &nk) != _TREE_ALTER_SET)
+            return t;
+        return tree2(t, nk, t);
+    }
+    bool split, reduced;
+    K mk;
+    Tree rt;
+    Tree nt = tree_alter_2(t, k, compare, f, data, &split, &mk, &rt,
+        &reduced);
+    if (split)
+        nt = tree2(nt, mk, rt);
+    return nt;
+}
+
 /*
  * Size.
  */
@@ -1197,18 +1282,24 @@ extern size_t _tree_size(Tree t)
         case TREE_2:
         {
             const Tree2 &t2 = t;
-            return t2.size;
+            return t2.size & TREE_SIZE_MASK;
         }
         case TREE_3:
         {
             const Tree3 &t3 = t;
-            return t3.size;
+            return t3.size & TREE_SIZE_MASK;
         }
         case TREE_4:
         {
             const Tree4 &t4 = t;
-            return t4.size;
+            return t4.size & TREE_SIZE_MASK;
         }
+        case TREE_LEAF1:
+            return 1;
+        case TREE_LEAF2:
+            return 2;
+        case TREE_LEAF3:
+            return 3;
         default:
             error_bad_tree();
     }
@@ -1247,6 +1338,10 @@ extern size_t tree_depth(Tree t)
                 t = t4.t[0];
                 continue;
             }
+            case TREE_LEAF1:
+            case TREE_LEAF2:
+            case TREE_LEAF3:
+                return depth + 1;
         }
     }
 }
@@ -1261,23 +1356,32 @@ static Tree tree2_concat_3_min(const Tree2 &t, K k, Tree u, size_t depth)
     switch (index(t.t[0]))
     {
         case TREE_2:
+        case TREE_LEAF1:
         {
-            const Tree2 &t2 = t.t[0];
+            Tree2 t2_buf;
+            const Tree2 &t2 = tree2_view(t.t[0], &t2_buf);
             Tree nt = tree2_concat_3_min(t2, k, u, depth-1);
             return tree2(nt, t.k[0], t.t[1]);
         }
         case TREE_3:
+        case TREE_LEAF2:
         {
-            const Tree3 &t3 = t.t[0];
+            Tree3 t3_buf;
+            const Tree3 &t3 = tree3_view(t.t[0], &t3_buf);
             Tree nt = tree3_concat_3_min(t3, k, u, depth-1);
             return tree2(nt, t.k[0], t.t[1]);
         }
         case TREE_4:
+        case TREE_LEAF3:
         {
-            const Tree4 &t4 = t.t[0];
+            Tree4 t4_buf;
+            const Tree4 &t4 = tree4_view(t.t[0], &t4_buf);
             Tree lt = tree2(t4.t[0], t4.k[0], t4.t[1]);
             Tree rt = tree2(t4.t[2], t4.k[2], t4.t[3]);
-            Tree nt = tree2_concat_3_min(lt, k, u, depth-1);
+            Tree2 lt_buf;
+            Tree nt = tree2_concat_3_min(tree2_view(lt, &lt_buf), k, u,
+                depth-1);
+            tree_drop(lt);
             return tree3(nt, t4.k[1], rt, t.k[0], t.t[1]);
         }
         default:
@@ -1292,23 +1396,32 @@ static Tree tree3_concat_3_min(const Tree3 &t, K k, Tree u, size_t depth)
     switch (index(t.t[0]))
     {
         case TREE_2:
+        case TREE_LEAF1:
         {
-            const Tree2 &t2 = t.t[0];
+            Tree2 t2_buf;
+            const Tree2 &t2 = tree2_view(t.t[0], &t2_buf);
             Tree nt = tree2_concat_3_min(t2, k, u, depth-1);
             return tree3(nt, t.k[0], t.t[1], t.k[1], t.t[2]);
         }
         case TREE_3:
+        case TREE_LEAF2:
         {
-            const Tree3 &t3 = t.t[0];
+            Tree3 t3_buf;
+            const Tree3 &t3 = tree3_view(t.t[0], &t3_buf);
             Tree nt = tree3_concat_3_min(t3, k, u, depth-1);
             return tree3(nt, t.k[0], t.t[1], t.k[1],  t.t[2]);
         }
         case TREE_4:
+        case TREE_LEAF3:
         {
-            const Tree4 &t4 = t.t[0];
+            Tree4 t4_buf;
+            const Tree4 &t4 = tree4_view(t.t[0], &t4_buf);
             Tree lt = tree2(t4.t[0], t4.k[0], t4.t[1]);
             Tree rt = tree2(t4.t[2], t4.k[2], t4.t[3]);
-            Tree nt = tree2_concat_3_min(lt, k, u, depth-1);
+            Tree2 lt_buf;
+            Tree nt = tree2_concat_3_min(tree2_view(lt, &lt_buf), k, u,
+                depth-1);
+            tree_drop(lt);
             return tree4(nt, t4.k[1], rt, t.k[0], t.t[1], t.k[1], t.t[2]);
         }
         default:
@@ -1323,23 +1436,32 @@ static Tree tree2_concat_3_max(const Tree2 &t, K k, Tree u, size_t depth)
     switch (index(t.t[1]))
     {
         case TREE_2:
+        case TREE_LEAF1:
         {
-            const Tree2 &t2 = t.t[1];
+            Tree2 t2_buf;
+            const Tree2 &t2 = tree2_view(t.t[1], &t2_buf);
             Tree nt = tree2_concat_3_max(t2, k, u, depth-1);
             return tree2(t.t[0], t.k[0], nt);
         }
         case TREE_3:
+        case TREE_LEAF2:
         {
-            const Tree3 &t3 = t.t[1];
+            Tree3 t3_buf;
+            const Tree3 &t3 = tree3_view(t.t[1], &t3_buf);
             Tree nt = tree3_concat_3_max(t3, k, u, depth-1);
             return tree2(t.t[0], t.k[0], nt);
         }
         case TREE_4:
+        case TREE_LEAF3:
         {
-            const Tree4 &t4 = t.t[1];
+            Tree4 t4_buf;
+            const Tree4 &t4 = tree4_view(t.t[1], &t4_buf);
             Tree lt = tree2(t4.t[0], t4.k[0], t4.t[1]);
             Tree rt = tree2(t4.t[2], t4.k[2], t4.t[3]);
-            Tree nt = tree2_concat_3_max(rt, k, u, depth-1);
+            Tree2 rt_buf;
+            Tree nt = tree2_concat_3_max(tree2_view(rt, &rt_buf), k, u,
+                depth-1);
+            tree_drop(rt);
             return tree3(t.t[0], t.k[0], lt, t4.k[1], nt);
         }
         default:
@@ -1354,23 +1476,32 @@ static Tree tree3_concat_3_max(const Tree3 &t, K k, Tree u, size_t depth)
     switch (index(t.t[2]))
     {
         case TREE_2:
+        case TREE_LEAF1:
         {
-            const Tree2 &t2 = t.t[2];
+            Tree2 t2_buf;
+            const Tree2 &t2 = tree2_view(t.t[2], &t2_buf);
             Tree nt = tree2_concat_3_max(t2, k, u, depth-1);
             return tree3(t.t[0], t.k[0], t.t[1], t.k[1], nt);
         }
         case TREE_3:
+        case TREE_LEAF2:
         {
-            const Tree3 &t3 = t.t[2];
+            Tree3 t3_buf;
+            const Tree3 &t3 = tree3_view(t.t[2], &t3_buf);
             Tree nt = tree3_concat_3_max(t3, k, u, depth-1);
             return tree3(t.t[0], t.k[0], t.t[1], t.k[1],  nt);
         }
         case TREE_4:
+        case TREE_LEAF3:
         {
-            const Tree4 &t4 = t.t[2];
+            Tree4 t4_buf;
+            const Tree4 &t4 = tree4_view(t.t[2], &t4_buf);
             Tree lt = tree2(t4.t[0], t4.k[0], t4.t[1]);
             Tree rt = tree2(t4.t[2], t4.k[2], t4.t[3]);
-            Tree nt = tree2_concat_3_max(rt, k, u, depth-1);
+            Tree2 rt_buf;
+            Tree nt = tree2_concat_3_max(tree2_view(rt, &rt_buf), k, u,
+                depth-1);
+            tree_drop(rt);
             return tree4(t.t[0], t.k[0], t.t[1], t.k[1], lt, t4.k[1], nt);
         }
         default:
@@ -1392,17 +1523,31 @@ static Tree tree_concat_3(Tree t, K k, Tree u, size_t t_depth, size_t u_depth,
         switch (index(u))
         {
             case TREE_2:
-                return tree2_concat_3_min(u, k, t, u_depth - t_depth);
+            case TREE_LEAF1:
+            {
+                Tree2 u2_buf;
+                return tree2_concat_3_min(tree2_view(u, &u2_buf), k, t,
+                    u_depth - t_depth);
+            }
             case TREE_3:
-                return tree3_concat_3_min(u, k, t, u_depth - t_depth);
+            case TREE_LEAF2:
+            {
+                Tree3 u3_buf;
+                return tree3_concat_3_min(tree3_view(u, &u3_buf), k, t,
+                    u_depth - t_depth);
+            }
             case TREE_4:
+            case TREE_LEAF3:
             {
                 *depth = u_depth + 1;
-                const Tree4 &u4 = u;
+                Tree4 u4_buf;
+                const Tree4 &u4 = tree4_view(u, &u4_buf);
                 Tree lu = tree2(u4.t[0], u4.k[0], u4.t[1]);
                 Tree ru = tree2(u4.t[2], u4.k[2], u4.t[3]);
                 Tree nu = tree2(lu, u4.k[1], ru);
-                return tree2_concat_3_min(nu, k, t, u_depth - t_depth + 1);
+                Tree r = tree2_concat_3_min(nu, k, t, u_depth - t_depth + 1);
+                tree_drop(nu);
+                return r;
             }
             default:
                 error_bad_tree();
@@ -1414,17 +1559,31 @@ static Tree tree_concat_3(Tree t, K k, Tree u, size_t t_depth, size_t u_depth,
         switch (index(t))
         {
             case TREE_2:
-                return tree2_concat_3_max(t, k, u, t_depth - u_depth);
+            case TREE_LEAF1:
+            {
+                Tree2 t2_buf;
+                return tree2_concat_3_max(tree2_view(t, &t2_buf), k, u,
+                    t_depth - u_depth);
+            }
             case TREE_3:
-                return tree3_concat_3_max(t, k, u, t_depth - u_depth);
+            case TREE_LEAF2:
+            {
+                Tree3 t3_buf;
+                return tree3_concat_3_max(tree3_view(t, &t3_buf), k, u,
+                    t_depth - u_depth);
+            }
             case TREE_4:
+            case TREE_LEAF3:
             {
                 *depth = t_depth + 1;
-                const Tree4 &t4 = t;
+                Tree4 t4_buf;
+                const Tree4 &t4 = tree4_view(t, &t4_buf);
                 Tree lt = tree2(t4.t[0], t4.k[0], t4.t[1]);
                 Tree rt = tree2(t4.t[2], t4.k[2], t4.t[3]);
                 Tree nt = tree2(lt, t4.k[1], rt);
-                return tree2_concat_3_max(nt, k, u, t_depth - u_depth + 1);
+                Tree r = tree2_concat_3_max(nt, k, u, t_depth - u_depth + 1);
+                tree_drop(nt);
+                return r;
             }
             default:
                 error_bad_tree();
@@ -1435,7 +1594,7 @@ static Tree tree_concat_3(Tree t, K k, Tree u, size_t t_depth, size_t u_depth,
 static Tree tree_concat(Tree t, Tree u, size_t t_depth, size_t u_depth,
     size_t *depth)
 {
-    bool reduced;
+    bool reduced = false;
     K k;
     if (t_depth == 0)
     {
@@ -1455,7 +1614,7 @@ static Tree tree_concat(Tree t, Tree u, size_t t_depth, size_t u_depth,
     }
     else
     {
-        u = tree_delete_min_2(u, &k, &reduced);
+        u = _tree_delete_min_2(u, &k, &reduced);
         return tree_concat_3(t, k, u, t_depth, (reduced? u_depth-1: u_depth),
             depth);
     }
@@ -1487,8 +1646,10 @@ static bool tree_split_2(Tree t, K k, size_t depth, Tree *lt, Tree *rt,
     switch (index(t))
     {
         case TREE_2:
+        case TREE_LEAF1:
         {
-            const Tree2 &t2 = t;
+            Tree2 t2_buf;
+            const Tree2 &t2 = tree2_view(t, &t2_buf);
             int cmp = compare(k, t2.k[0]);
             bool r = true;
             if (cmp < 0)
@@ -1515,8 +1676,10 @@ static bool tree_split_2(Tree t, K k, size_t depth, Tree *lt, Tree *rt,
             return r;
         }
         case TREE_3:
+        case TREE_LEAF2:
         {
-            const Tree3 &t3 = t;
+            Tree3 t3_buf;
+            const Tree3 &t3 = tree3_view(t, &t3_buf);
             int cmp = compare(k, t3.k[0]);
             bool r = true;
             if (cmp < 0)
@@ -1565,8 +1728,10 @@ static bool tree_split_2(Tree t, K k, size_t depth, Tree *lt, Tree *rt,
             return r;
         }
         case TREE_4:
+        case TREE_LEAF3:
         {
-            const Tree4 &t4 = t;
+            Tree4 t4_buf;
+            const Tree4 &t4 = tree4_view(t, &t4_buf);
             int cmp = compare(k, t4.k[1]);
             bool r = true;
             if (cmp < 0)
@@ -1646,7 +1811,108 @@ static bool tree_split_2(Tree t, K k, size_t depth, Tree *lt, Tree *rt,
 }
 
 /*
- * Union.
+ * Positional access.  The subtree sizes give the position of every key
+ * without visiting the keys before it.
+ */
+static inline size_t tree_count(Tree t)
+{
+    switch (index(t))
+    {
+        case TREE_NIL:
+            return 0;
+        case TREE_2:
+            return 1;
+        case TREE_3:
+            return 2;
+        case TREE_4:
+            return 3;
+        default:
+            return _tree_node_size(t);
+    }
+}
+
+extern PURE const K *_tree_nth(Tree t, size_t i)
+{
+    while (index(t) != TREE_NIL)
+    {
+        size_t n = tree_count(t);
+        if (tree_is_leaf(t))
+            return (i < n? tree_leaf_keys(t) + i: nullptr);
+        const K *ks = tree_keys(t);
+        const Tree *ts = tree_children(t, n);
+        size_t j;
+        for (j = 0; j < n; j++)
+        {
+            size_t size = _tree_size(ts[j]);
+            if (i < size)
+                break;
+            if (i == size)
+                return ks + j;
+            i -= size + 1;
+        }
+        t = ts[j];
+    }
+    return nullptr;
+}
+
+extern PURE size_t _tree_rank(Tree t, K k, Compare compare, bool upper)
+{
+    size_t r = 0;
+    while (index(t) != TREE_NIL)
+    {
+        size_t n = tree_count(t);
+        if (tree_is_leaf(t))
+        {
+            const K *ks = tree_leaf_keys(t);
+            for (size_t j = 0; j < n; j++)
+            {
+                int cmp = compare(k, ks[j]);
+                if (cmp < 0 || (cmp == 0 && !upper))
+                    break;
+                r++;
+            }
+            return r;
+        }
+        const K *ks = tree_keys(t);
+        const Tree *ts = tree_children(t, n);
+        size_t j;
+        for (j = 0; j < n; j++)
+        {
+            int cmp = compare(k, ks[j]);
+            if (cmp < 0)
+                break;
+            r += _tree_size(ts[j]);
+            if (cmp == 0)
+                return (upper? r+1: r);
+            r++;
+        }
+        t = ts[j];
+    }
+    return r;
+}
+
+/*
+ * Split at a position.  Splits on the key at position i, which then heads
+ * the right tree.
+ */
+extern PURE Result<Tree, Tree> _tree_split_at(Tree t, size_t i,
+    Compare compare)
+{
+    const K *kp = _tree_nth(t, i);
+    if (kp == nullptr)
+        return {t, TREE_EMPTY};
+    K k = *kp;
+    size_t depth = tree_depth(t), l_depth, r_depth;
+    Tree lt = TREE_EMPTY, rt = TREE_EMPTY;
+    tree_split_2(t, k, depth, &lt, &rt, &l_depth, &r_depth, compare);
+    Tree nrt = tree_concat_3(TREE_EMPTY, k, rt, 0, r_depth, &r_depth);
+    tree_drop(rt);
+    return {lt, nrt};
+}
+
+/*
+ * Union.  Subtrees shared by both trees are returned as is, at every level
+ * of the recursion.
  */
 extern PURE Tree _tree_union(Tree t, Tree u, Compare compare)
 {
@@ -1658,14 +1924,21 @@ extern PURE Tree _tree_union(Tree t, Tree u, Compare compare)
 static Tree tree_union_2(Tree t, Tree u, size_t t_depth, size_t u_depth,
     size_t *depth, Compare compare)
 {
+    if (t == u)
+    {
+        *depth = t_depth;
+        return t;
+    }
     switch (index(u))
     {
         case TREE_NIL:
             *depth = t_depth;
             return t;
         case TREE_2:
+        case TREE_LEAF1:
         {
-            const Tree2 &u2 = u;
+            Tree2 u2_buf;
+            const Tree2 &u2 = tree2_view(u, &u2_buf);
             Tree lt = TREE_EMPTY, rt = TREE_EMPTY;
             size_t l_depth, r_depth;
             tree_split_2(t, u2.k[0], t_depth, &lt, &rt, &l_depth, &r_depth,
@@ -1678,8 +1951,10 @@ static Tree tree_union_2(Tree t, Tree u, size_t t_depth, size_t u_depth,
             return t;
         }
         case TREE_3:
+        case TREE_LEAF2:
         {
-            const Tree3 &u3 = u;
+            Tree3 u3_buf;
+            const Tree3 &u3 = tree3_view(u, &u3_buf);
             Tree lt = TREE_EMPTY, mt = TREE_EMPTY, rt = TREE_EMPTY;
             size_t l_depth, m_depth, r_depth;
             tree_split_2(t, u3.k[0], t_depth, &lt, &rt, &l_depth, &r_depth,
@@ -1697,8 +1972,10 @@ static Tree tree_union_2(Tree t, Tree u, size_t t_depth, size_t u_depth,
             return t;
         }
         case TREE_4:
+        case TREE_LEAF3:
         {
-            const Tree4 &u4 = u;
+            Tree4 u4_buf;
+            const Tree4 &u4 = tree4_view(u, &u4_buf);
             Tree lt = TREE_EMPTY, mt = TREE_EMPTY, nt = TREE_EMPTY,
                 rt = TREE_EMPTY;
             size_t l_depth, m_depth, n_depth, r_depth;
@@ -1739,14 +2016,21 @@ extern PURE Tree _tree_intersect(Tree t, Tree u, Compare compare)
 static Tree tree_intersect_2(Tree t, Tree u, size_t t_depth, size_t u_depth,
     size_t *depth, Compare compare)
 {
+    if (t == u)
+    {
+        *depth = t_depth;
+        return t;
+    }
     switch (index(u))
     {
         case TREE_NIL:
             *depth = 0;
             return TREE_EMPTY;
         case TREE_2:
+        case TREE_LEAF1:
         {
-            const Tree2 &u2 = u;
+            Tree2 u2_buf;
+            const Tree2 &u2 = tree2_view(u, &u2_buf);
             Tree lt = TREE_EMPTY, rt = TREE_EMPTY;
             size_t l_depth, r_depth;
             bool in0 = tree_split_2(t, u2.k[0], t_depth, &lt, &rt, &l_depth,
@@ -1762,8 +2046,10 @@ static Tree tree_intersect_2(Tree t, Tree u, size_t t_depth, size_t u_depth,
             return t;
         }
         case TREE_3:
+        case TREE_LEAF2:
         {
-            const Tree3 &u3 = u;
+            Tree3 u3_buf;
+            const Tree3 &u3 = tree3_view(u, &u3_buf);
             Tree lt = TREE_EMPTY, mt = TREE_EMPTY, rt = TREE_EMPTY;
             size_t l_depth, m_depth, r_depth;
             bool in0 = tree_split_2(t, u3.k[0], t_depth, &lt, &rt, &l_depth,
@@ -1788,8 +2074,10 @@ static Tree tree_intersect_2(Tree t, Tree u, size_t t_depth, size_t u_depth,
             return t;
         }
         case TREE_4:
+        case TREE_LEAF3:
         {
-            const Tree4 &u4 = u;
+            Tree4 u4_buf;
+            const Tree4 &u4 = tree4_view(u, &u4_buf);
             Tree lt = TREE_EMPTY, mt = TREE_EMPTY, nt = TREE_EMPTY,
                 rt = TREE_EMPTY;
             size_t l_depth, m_depth, n_depth, r_depth;
@@ -1841,14 +2129,21 @@ extern PURE Tree _tree_diff(Tree t, Tree u, Compare compare)
 static Tree tree_diff_2(Tree t, Tree u, size_t t_depth, size_t u_depth,
     size_t *depth, Compare compare)
 {
+    if (t == u)
+    {
+        *depth = 0;
+        return TREE_EMPTY;
+    }
     switch (index(u))
     {
         case TREE_NIL:
             *depth = t_depth;
             return t;
         case TREE_2:
+        case TREE_LEAF1:
         {
-            const Tree2 &u2 = u;
+            Tree2 u2_buf;
+            const Tree2 &u2 = tree2_view(u, &u2_buf);
             Tree lt = TREE_EMPTY, rt = TREE_EMPTY;
             size_t l_depth, r_depth;
             tree_split_2(t, u2.k[0], t_depth, &lt, &rt, &l_depth, &r_depth,
@@ -1861,8 +2156,10 @@ static Tree tree_diff_2(Tree t, Tree u, size_t t_depth, size_t u_depth,
             return t;
         }
         case TREE_3:
+        case TREE_LEAF2:
         {
-            const Tree3 &u3 = u;
+            Tree3 u3_buf;
+            const Tree3 &u3 = tree3_view(u, &u3_buf);
             Tree lt = TREE_EMPTY, mt = TREE_EMPTY, rt = TREE_EMPTY;
             size_t l_depth, m_depth, r_depth;
             tree_split_2(t, u3.k[0], t_depth, &lt, &rt, &l_depth, &r_depth,
@@ -1880,8 +2177,10 @@ static Tree tree_diff_2(Tree t, Tree u, size_t t_depth, size_t u_depth,
             return t;
         }
         case TREE_4:
+        case TREE_LEAF3:
         {
-            const Tree4 &u4 = u;
+            Tree4 u4_buf;
+            const Tree4 &u4 = tree4_view(u, &u4_buf);
             Tree lt = TREE_EMPTY, mt = TREE_EMPTY, nt = TREE_EMPTY,
                 rt = TREE_EMPTY;
             size_t l_depth, m_depth, n_depth, r_depth;
@@ -1909,10 +2208,85 @@ static Tree tree_diff_2(Tree t, Tree u, size_t t_depth, size_t u_depth,
     }
 }
 
+enum
+{
+    TREE_UNION     = _TREE_UNION,
+    TREE_INTERSECT = _TREE_INTERSECT,
+    TREE_DIFF      = _TREE_DIFF
+};
+
+/*
+ * Union/intersection/difference with a combining function.  The tree t is
+ * split by each key of the root of u, the pieces are combined with the
+ * corresponding children of u, and the results are joined back together.
+ * For each key of u that is also in t, f is passed both entries and writes
+ * the combined entry, or returns false to drop the key.
+ * O(m * log(n/m + 1)).
+ */
+typedef bool (*TreeCombine)(void *, const K *, const K *, K *);
+
+static Tree tree_merge_with_2(Tree t, Tree u, size_t t_depth, size_t u_depth,
+    size_t *depth, Compare compare, int op, TreeCombine f, void *data)
+{
+    if (u_depth == 0)
+    {
+        *depth = (op == TREE_INTERSECT? 0: t_depth);
+        return (op == TREE_INTERSECT? TREE_EMPTY: t);
+    }
+    if (t_depth == 0)
+    {
+        *depth = (op == TREE_UNION? u_depth: 0);
+        return (op == TREE_UNION? u: TREE_EMPTY);
+    }
+
+    K ks[3];
+    Tree us[4];
+    size_t n = tree_unpack(u, ks, us);
+    Tree ps[4];
+    size_t hs[4];
+    bool in[3];
+    for (size_t i = 0; i < n; i++)
+    {
+        const K *k = _tree_search(t, ks[i], compare);
+        K nk;
+        in[i] = (k == nullptr? op == TREE_UNION: f(data, k, ks + i, &nk));
+        if (k != nullptr && in[i])
+            ks[i] = nk;
+        tree_split_2(t, ks[i], t_depth, ps + i, &t, hs + i, &t_depth,
+            compare);
+    }
+    ps[n] = t;
+    hs[n] = t_depth;
+    for (size_t i = 0; i <= n; i++)
+        ps[i] = tree_merge_with_2(ps[i], us[i], hs[i], u_depth-1, hs + i,
+            compare, op, f, data);
+
+    t = ps[0];
+    t_depth = hs[0];
+    for (size_t i = 0; i < n; i++)
+    {
+        if (in[i])
+            t = tree_concat_3(t, ks[i], ps[i+1], t_depth, hs[i+1], &t_depth);
+        else
+            t = tree_concat(t, ps[i+1], t_depth, hs[i+1], &t_depth);
+    }
+    *depth = t_depth;
+    return t;
+}
+
+extern PURE Tree _tree_merge_with(Tree t, Tree u, Compare compare, int op,
+    TreeCombine f, void *data)
+{
+    size_t depth;
+    return tree_merge_with_2(t, u, tree_depth(t), tree_depth(u), &depth,
+        compare, op, f, data);
+}
+
 /*
  * Fold left.
  */
-extern PURE C _tree_foldl(Tree t, C arg, C (*f)(void *, C, K), void *data)
+extern PURE C _tree_foldl(Tree t, C arg, C (*f)(void *, C, const K &),
+    void *data)
 {
     switch (index(t))
     {
@@ -1948,15 +2322,170 @@ extern PURE C _tree_foldl(Tree t, C arg, C (*f)(void *, C, K), void *data)
             arg = _tree_foldl(t4.t[3], arg, f, data);
             return arg;
         }
+        case TREE_LEAF1:
+        case TREE_LEAF2:
+        case TREE_LEAF3:
+        {
+            const K *ks = tree_leaf_keys(t);
+            size_t n = _tree_node_size(t);
+            for (size_t i = 0; i < n; i++)
+                arg = f(data, arg, ks[i]);
+            return arg;
+        }
+        default:
+            error_bad_tree();
+    }
+}
+
+/*
+ * Fold left over the keys in [*lo, *hi) (a null bound is open).  Only the
+ * children that overlap the range are visited, and children that lie
+ * entirely inside it are folded without further comparisons.
+ */
+extern PURE C _tree_foldl_range(Tree t, const K *lo, const K *hi, C arg,
+    C (*f)(void *, C, const K &), void *data, Compare compare)
+{
+    if (index(t) == TREE_NIL)
+        return arg;
+    if (lo == nullptr && hi == nullptr)
+        return _tree_foldl(t, arg, f, data);
+    size_t n = tree_count(t);
+    bool leaf = tree_is_leaf(t);
+    const K *ks = (leaf? tree_leaf_keys(t): tree_keys(t));
+    size_t i = 0, j = n;
+    if (lo != nullptr)
+        while (i < n && compare(ks[i], *lo) < 0)
+            i++;
+    if (hi != nullptr)
+    {
+        j = i;
+        while (j < n && compare(ks[j], *hi) < 0)
+            j++;
+    }
+    if (leaf)
+    {
+        for (; i < j; i++)
+            arg = f(data, arg, ks[i]);
+        return arg;
+    }
+    const Tree *ts = tree_children(t, n);
+    for (size_t m = i; m <= j; m++)
+    {
+        arg = _tree_foldl_range(ts[m], (m == i? lo: nullptr),
+            (m == j? hi: nullptr), arg, f, data, compare);
+        if (m < j)
+            arg = f(data, arg, ks[m]);
+    }
+    return arg;
+}
+
+/*
+ * Summary cache slot of an internal node.
+ */
+#ifdef LIBF_TREE_MEASURE
+static inline _TreeCache *tree_cache(Tree t)
+{
+    switch (index(t))
+    {
+        case TREE_2:
+            return &((Tree2 *)tree_ptr(t))->c;
+        case TREE_3:
+            return &((Tree3 *)tree_ptr(t))->c;
+        case TREE_4:
+            return &((Tree4 *)tree_ptr(t))->c;
         default:
             error_bad_tree();
     }
 }
+#endif
+
+/*
+ * Measure of a whole (sub)tree.  Internal nodes memoise the result in their
+ * cache slot, tagged with the measure, unless owned by a transient (whose
+ * nodes may still be updated in place).
+ */
+static A tree_measure(Tree t, const _TreeMeasure *m)
+{
+    if (index(t) == TREE_NIL)
+        return m->_empty();
+    size_t n = tree_count(t);
+    if (tree_is_leaf(t))
+    {
+        const K *ks = tree_leaf_keys(t);
+        A r = m->_empty();
+        for (size_t i = 0; i < n; i++)
+            r = m->_combine(r, m->_measure(ks[i]));
+        return r;
+    }
+#ifdef LIBF_TREE_MEASURE
+    _TreeCache *c = tree_cache(t);
+    A cached;
+    if (_tree_cache_lookup(c, (const void *)m, &cached))
+        return cached;
+#endif
+    const K *ks = tree_keys(t);
+    const Tree *ts = tree_children(t, n);
+    A r = tree_measure(ts[0], m);
+    for (size_t i = 0; i < n; i++)
+    {
+        r = m->_combine(r, m->_measure(ks[i]));
+        r = m->_combine(r, tree_measure(ts[i+1], m));
+    }
+#ifdef LIBF_TREE_MEASURE
+    if ((*tree_size_ptr(t) >> TREE_OWNER_SHIFT) == 0)
+        _tree_cache_publish(c, (const void *)m, r);
+#endif
+    return r;
+}
+
+/*
+ * Aggregate of the keys in [*lo, *hi) (a null bound is open).  Children that
+ * lie wholly inside the range contribute their (cached) measure, so only the
+ * two boundary paths are visited.
+ */
+extern PURE A _tree_aggregate(Tree t, const K *lo, const K *hi,
+    const _TreeMeasure *m, Compare compare)
+{
+    if (index(t) == TREE_NIL)
+        return m->_empty();
+    if (lo == nullptr && hi == nullptr)
+        return tree_measure(t, m);
+    size_t n = tree_count(t);
+    bool leaf = tree_is_leaf(t);
+    const K *ks = (leaf? tree_leaf_keys(t): tree_keys(t));
+    size_t i = 0, j = n;
+    if (lo != nullptr)
+        while (i < n && compare(ks[i], *lo) < 0)
+            i++;
+    if (hi != nullptr)
+    {
+        j = i;
+        while (j < n && compare(ks[j], *hi) < 0)
+            j++;
+    }
+    A r = m->_empty();
+    if (leaf)
+    {
+        for (; i < j; i++)
+            r = m->_combine(r, m->_measure(ks[i]));
+        return r;
+    }
+    const Tree *ts = tree_children(t, n);
+    for (size_t k = i; k <= j; k++)
+    {
+        r = m->_combine(r, _tree_aggregate(ts[k], (k == i? lo: nullptr),
+            (k == j? hi: nullptr), m, compare));
+        if (k < j)
+            r = m->_combine(r, m->_measure(ks[k]));
+    }
+    return r;
+}
 
 /*
  * Fold right.
  */
-extern PURE C _tree_foldr(Tree t, C arg, C (*f)(void *, C, K), void *data)
+extern PURE C _tree_foldr(Tree t, C arg, C (*f)(void *, C, const K &),
+    void *data)
 {
     switch (index(t))
     {
@@ -1992,6 +2521,15 @@ extern PURE C _tree_foldr(Tree t, C arg, C (*f)(void *, C, K), void *data)
             arg = _tree_foldr(t4.t[0], arg, f, data);
             return arg;
         }
+        case TREE_LEAF1:
+        case TREE_LEAF2:
+        case TREE_LEAF3:
+        {
+            const K *ks = tree_leaf_keys(t);
+            for (size_t i = _tree_node_size(t); i > 0; i--)
+                arg = f(data, arg, ks[i-1]);
+            return arg;
+        }
         default:
             error_bad_tree();
     }
@@ -2007,16 +2545,20 @@ extern PURE Tree _tree_map(Tree t, K (*f)(void *, K), void *data)
         case TREE_NIL:
             return TREE_EMPTY;
         case TREE_2:
+        case TREE_LEAF1:
         {
-            const Tree2 &t2 = t;
+            Tree2 t2_buf;
+            const Tree2 &t2 = tree2_view(t, &t2_buf);
             Tree t0 = _tree_map(t2.t[0], f, data);
             K k0 = f(data, t2.k[0]);
             Tree t1 = _tree_map(t2.t[1], f, data);
             return tree2(t0, k0, t1);
         }
         case TREE_3:
+        case TREE_LEAF2:
         {
-            const Tree3 &t3 = t;
+            Tree3 t3_buf;
+            const Tree3 &t3 = tree3_view(t, &t3_buf);
             Tree t0 = _tree_map(t3.t[0], f, data);
             K k0 = f(data, t3.k[0]);
             Tree t1 = _tree_map(t3.t[1], f, data);
@@ -2025,8 +2567,10 @@ extern PURE Tree _tree_map(Tree t, K (*f)(void *, K), void *data)
             return tree3(t0, k0, t1, k1, t2);
         }
         case TREE_4:
+        case TREE_LEAF3:
         {
-            const Tree4 &t4 = t;
+            Tree4 t4_buf;
+            const Tree4 &t4 = tree4_view(t, &t4_buf);
             Tree t0 = _tree_map(t4.t[0], f, data);
             K k0 = f(data, t4.k[0]);
             Tree t1 = _tree_map(t4.t[1], f, data);
@@ -2044,16 +2588,130 @@ extern PURE Tree _tree_map(Tree t, K (*f)(void *, K), void *data)
 /*
  * From list.
  */
-extern PURE Tree _tree_from_list(const List<Word> xs, Compare compare)
+static K tree_list_next(void *data)
 {
+    List<K> *ys = (List<K> *)data;
+    K k = head(*ys);
+    *ys = tail(*ys);
+    return k;
+}
+
+extern PURE Tree _tree_from_list(const List<K> xs, Compare compare)
+{
+    // Sorted input (e.g. a reloaded dump) is built bottom-up in O(n):
+    size_t n = 0;
+    bool sorted = true;
+    List<K> ys = xs;
+    K prev;
+    while (!empty(ys))
+    {
+        K k = head(ys);
+        if (n > 0 && compare(prev, k) >= 0)
+        {
+            sorted = false;
+            break;
+        }
+        prev = k;
+        n++;
+        ys = tail(ys);
+    }
+    if (sorted)
+    {
+        ys = xs;
+        return _tree_from_sorted(n, tree_list_next, (void *)&ys, compare);
+    }
+
+    size_t owner = _tree_owner_new();
     Tree t = TREE_EMPTY;
-    List<Word> ys = xs;
+    ys = xs;
     while (!empty(ys))
     {
-        t = _tree_insert(t, head(ys), compare);
+        t = _tree_insert_owned(t, head(ys), compare, owner);
         ys = tail(ys);
     }
-    return t;
+    return _tree_freeze(t, owner);
+}
+
+/*
+ * From sorted.  The n keys are produced in order by next(), and are placed
+ * into a tree of minimal height where every subtree of height h holds
+ * between 2^h-1 and 4^h-1 keys.  Each node is allocated exactly once.
+ */
+struct TreeSource
+{
+    K (*next)(void *);
+    void *data;
+    Compare compare;
+    size_t count;
+    K prev;
+};
+
+static inline size_t tree_min_keys(size_t h)
+{
+    return ((size_t)1 << h) - 1;
+}
+
+static inline size_t tree_max_keys(size_t h)
+{
+    return (2 * h >= 8 * sizeof(size_t)? SIZE_MAX:
+        ((size_t)1 << (2 * h)) - 1);
+}
+
+static K tree_source_next(TreeSource *src)
+{
+    K k = src->next(src->data);
+    if (src->count > 0 && src->compare(src->prev, k) >= 0)
+        error("sorted input is not strictly increasing");
+    src->prev = k;
+    src->count++;
+    return k;
+}
+
+static Tree tree_from_sorted_2(TreeSource *src, size_t n, size_t h)
+{
+    if (h == 0)
+        return TREE_EMPTY;
+
+    // Prefer 3-nodes (denser), then 2-nodes, then 4-nodes:
+    static const size_t degrees[] = {3, 2, 4};
+    size_t lo = tree_min_keys(h-1), hi = tree_max_keys(h-1);
+    size_t c = 0, m = 0;
+    for (size_t i = 0; i < sizeof(degrees) / sizeof(degrees[0]); i++)
+    {
+        c = degrees[i];
+        if (n < c-1)
+            continue;
+        m = n - (c-1);
+        if (m / c >= lo && (m + c - 1) / c <= hi)
+            break;
+        c = 0;
+    }
+    if (c == 0)
+        error_bad_tree();
+
+    size_t q = m / c, r = m % c;
+    Tree t0 = tree_from_sorted_2(src, q + (r > 0), h-1);
+    K k0 = tree_source_next(src);
+    Tree t1 = tree_from_sorted_2(src, q + (r > 1), h-1);
+    if (c == 2)
+        return tree2(t0, k0, t1);
+    K k1 = tree_source_next(src);
+    Tree t2 = tree_from_sorted_2(src, q + (r > 2), h-1);
+    if (c == 3)
+        return tree3(t0, k0, t1, k1, t2);
+    K k2 = tree_source_next(src);
+    Tree t3 = tree_from_sorted_2(src, q, h-1);
+    return tree4(t0, k0, t1, k1, t2, k2, t3);
+}
+
+extern Tree _tree_from_sorted(size_t n, K (*next)(void *), void *data,
+    Compare compare)
+{
+    size_t h = 0;
+    while (tree_min_keys(h+1) <= n)
+        h++;
+    TreeSource src = {next, data, compare, 0, K()};
+    return tree_from_sorted_2(&src, n, h);
 }
 
 /*
@@ -2072,16 +2730,20 @@ static List<C> tree_to_list_2(Tree t, C (*f)(void *, K), void *data,
         case TREE_NIL:
             return xs;
         case TREE_2:
+        case TREE_LEAF1:
         {
-            const Tree2 &t2 = t;
+            Tree2 t2_buf;
+            const Tree2 &t2 = tree2_view(t, &t2_buf);
             xs = tree_to_list_2(t2.t[1], f, data, xs);
             xs = list<C>(f(data, t2.k[0]), xs);
             xs = tree_to_list_2(t2.t[0], f, data, xs);
             return xs;
         }
         case TREE_3:
+        case TREE_LEAF2:
         {
-            const Tree3 &t3 = t;
+            Tree3 t3_buf;
+            const Tree3 &t3 = tree3_view(t, &t3_buf);
             xs = tree_to_list_2(t3.t[2], f, data, xs);
             xs = list<C>(f(data, t3.k[1]), xs);
             xs = tree_to_list_2(t3.t[1], f, data, xs);
@@ -2090,8 +2752,10 @@ static List<C> tree_to_list_2(Tree t, C (*f)(void *, K), void *data,
             return xs;
         }
         case TREE_4:
+        case TREE_LEAF3:
         {
-            const Tree4 &t4 = t;
+            Tree4 t4_buf;
+            const Tree4 &t4 = tree4_view(t, &t4_buf);
             xs = tree_to_list_2(t4.t[3], f, data, xs);
             xs = list<C>(f(data, t4.k[2]), xs);
             xs = tree_to_list_2(t4.t[2], f, data, xs);
@@ -2125,7 +2789,8 @@ static bool tree_verify_2(Tree t, size_t depth)
         {
             const Tree2 &t2 = t;
             size_t size = 1 + _tree_size(t2.t[0]) + _tree_size(t2.t[1]);
-            return (t2.size == size) &&
+            return (depth > 1) &&
+                   ((t2.size & TREE_SIZE_MASK) == size) &&
                    tree_verify_2(t2.t[0], depth-1) &&
                    tree_verify_2(t2.t[1], depth-1);
         }
@@ -2134,7 +2799,8 @@ static bool tree_verify_2(Tree t, size_t depth)
             const Tree3 &t3 = t;
             size_t size = 2 + _tree_size(t3.t[0]) + _tree_size(t3.t[1]) +
                 _tree_size(t3.t[2]);
-            return (t3.size == size) &&
+            return (depth > 1) &&
+                   ((t3.size & TREE_SIZE_MASK) == size) &&
                    tree_verify_2(t3.t[0], depth-1) &&
                    tree_verify_2(t3.t[1], depth-1) &&
                    tree_verify_2(t3.t[2], depth-1);
@@ -2144,19 +2810,97 @@ static bool tree_verify_2(Tree t, size_t depth)
             const Tree4 &t4 = t;
             size_t size = 3 + _tree_size(t4.t[0]) + _tree_size(t4.t[1]) +
                 _tree_size(t4.t[2]) + _tree_size(t4.t[3]);
-            return (t4.size == size) &&
+            return (depth > 1) &&
+                   ((t4.size & TREE_SIZE_MASK) == size) &&
                    tree_verify_2(t4.t[0], depth-1) &&
                    tree_verify_2(t4.t[1], depth-1) &&
                    tree_verify_2(t4.t[2], depth-1) &&
                    tree_verify_2(t4.t[3], depth-1);
         }
+        case TREE_LEAF1:
+        case TREE_LEAF2:
+        case TREE_LEAF3:
+            return (depth == 1);
         default:
             return false;
     }
 }
 
 /*
- * Compare.
+ * Paired walks.  Each tree is walked in order as a stack of pending subtrees
+ * and keys (a key entry has an empty subtree).  The larger of the two
+ * pending subtrees is expanded first, so subtrees shared by both trees meet
+ * at the top of both stacks and can be skipped unvisited.
+ */
+struct TreeWalk
+{
+    Tree t;
+    K k;
+};
+
+static TreeWalk *tree_walk_init(Tree t, size_t *ptr)
+{
+    TreeWalk *stack = (TreeWalk *)gc_malloc(
+        (tree_depth(t) + 1) * 7 * sizeof(TreeWalk));
+    *ptr = 0;
+    if (index(t) != TREE_NIL)
+    {
+        stack[0].t = t;
+        *ptr = 1;
+    }
+    return stack;
+}
+
+static void tree_walk_expand(TreeWalk *stack, size_t *ptr)
+{
+    (*ptr)--;
+    K ks[3];
+    Tree ts[4];
+    size_t n = tree_unpack(stack[*ptr].t, ks, ts);
+    for (size_t i = n+1; i-- > 0; )
+    {
+        if (index(ts[i]) != TREE_NIL)
+        {
+            stack[*ptr].t = ts[i];
+            (*ptr)++;
+        }
+        if (i > 0)
+        {
+            stack[*ptr].t = TREE_EMPTY;
+            stack[*ptr].k = ks[i-1];
+            (*ptr)++;
+        }
+    }
+}
+
+/*
+ * Advance both walks until neither top is a subtree, skipping the subtrees
+ * that are on top of both.
+ */
+static void tree_walk_align(TreeWalk *ts, size_t *t_ptr, TreeWalk *us,
+    size_t *u_ptr)
+{
+    while (true)
+    {
+        Tree a = (*t_ptr > 0? ts[*t_ptr - 1].t: TREE_EMPTY);
+        Tree b = (*u_ptr > 0? us[*u_ptr - 1].t: TREE_EMPTY);
+        bool a_node = (index(a) != TREE_NIL), b_node = (index(b) != TREE_NIL);
+        if (a_node && b_node && a == b)
+        {
+            (*t_ptr)--;
+            (*u_ptr)--;
+        }
+        else if (a_node && (!b_node || _tree_size(a) >= _tree_size(b)))
+            tree_walk_expand(ts, t_ptr);
+        else if (b_node)
+            tree_walk_expand(us, u_ptr);
+        else
+            return;
+    }
+}
+
+/*
+ * Compare.  Shared subtrees compare equal without being visited.
  */
 extern PURE int _tree_compare(Tree t, Tree u, void *data,
     int (*val_compare)(void *, Value<Word>, Value<Word>))
@@ -2164,28 +2908,71 @@ extern PURE int _tree_compare(Tree t, Tree u, void *data,
     if (t == u)
         return 0;
 
-    _TreeItr itr_t = begin(t), itr_u = begin(u);
-    _TreeItr itr_te = end(t),  itr_ue = end(u);
-
+    size_t t_ptr, u_ptr;
+    TreeWalk *ts = tree_walk_init(t, &t_ptr);
+    TreeWalk *us = tree_walk_init(u, &u_ptr);
+    int cmp = 0;
     while (true)
     {
-        if (itr_t == itr_te)
+        tree_walk_align(ts, &t_ptr, us, &u_ptr);
+        if (t_ptr == 0 || u_ptr == 0)
         {
-            if (itr_u == itr_ue)
-                return 0;
-            else
-                return -1;
+            cmp = (t_ptr == 0? (u_ptr == 0? 0: -1): 1);
+            break;
         }
-        if (itr_u == itr_ue)
-            return 1;
-        Value<Word> kt = *itr_t;
-        Value<Word> ku = *itr_u;
-        int cmp = val_compare(data, kt, ku);
+        cmp = val_compare(data, ts[t_ptr - 1].k, us[u_ptr - 1].k);
         if (cmp != 0)
-            return cmp;
-        ++itr_t;
-        ++itr_u;
+            break;
+        t_ptr--;
+        u_ptr--;
+    }
+    gc_free(ts);
+    gc_free(us);
+    return cmp;
+}
+
+/*
+ * Structural diff.  f is called with (k, nullptr) for removed keys,
+ * (nullptr, k) for added keys, and (k, k') for keys in both trees with
+ * different entries.
+ */
+extern void _tree_diff_entries(Tree t, Tree u, Compare compare,
+    void (*f)(void *, const K *, const K *), void *data)
+{
+    if (t == u)
+        return;
+
+    size_t t_ptr, u_ptr;
+    TreeWalk *ts = tree_walk_init(t, &t_ptr);
+    TreeWalk *us = tree_walk_init(u, &u_ptr);
+    while (true)
+    {
+        tree_walk_align(ts, &t_ptr, us, &u_ptr);
+        if (t_ptr == 0 && u_ptr == 0)
+            break;
+        const K *a = (t_ptr > 0? &ts[t_ptr - 1].k: nullptr);
+        const K *b = (u_ptr > 0? &us[u_ptr - 1].k: nullptr);
+        int cmp = (a == nullptr? 1: b == nullptr? -1: compare(*a, *b));
+        if (cmp < 0)
+        {
+            f(data, a, nullptr);
+            t_ptr--;
+        }
+        else if (cmp > 0)
+        {
+            f(data, nullptr, b);
+            u_ptr--;
+        }
+        else
+        {
+            if (memcmp(a, b, sizeof(K)) != 0)
+                f(data, a, b);
+            t_ptr--;
+            u_ptr--;
+        }
     }
+    gc_free(ts);
+    gc_free(us);
 }
 
 /*
@@ -2207,8 +2994,10 @@ static String tree_show_2(Tree t, String r, bool last, String (*f)(A))
         case TREE_NIL:
             return r;
         case TREE_2:
+        case TREE_LEAF1:
         {
-            const Tree2 &t2 = t;
+            Tree2 t2_buf;
+            const Tree2 &t2 = tree2_view(t, &t2_buf);
             r = tree_show_2(t2.t[0], r, false, f);
             r = append(r, f(t2.k[0]));
             if (!last || index(t2.t[1]) != TREE_NIL)
@@ -2217,8 +3006,10 @@ static String tree_show_2(Tree t, String r, bool last, String (*f)(A))
             return r;
         }
         case TREE_3:
+        case TREE_LEAF2:
         {
-            const Tree3 &t3 = t;
+            Tree3 t3_buf;
+            const Tree3 &t3 = tree3_view(t, &t3_buf);
             r = tree_show_2(t3.t[0], r, false, f);
             r = append(r, f(t3.k[0]));
             r = append(r, ',');
@@ -2230,8 +3021,10 @@ static String tree_show_2(Tree t, String r, bool last, String (*f)(A))
             return r;
         }
         case TREE_4:
+        case TREE_LEAF3:
         {
-            const Tree4 &t4 = t;
+            Tree4 t4_buf;
+            const Tree4 &t4 = tree4_view(t, &t4_buf);
             r = tree_show_2(t4.t[0], r, false, f);
             r = append(r, f(t4.k[0]));
             r = append(r, ',');
@@ -2314,166 +3107,197 @@ static String tree_show_2(Tree t, String r, bool last, String (*f)(A))
 }
 #endif
 
-static _TreeItrEntry tree_itr_entry(_Tree t, size_t offset)
+/*
+ * Iterators.  Below the top of the stack, _slot[] is the child that was
+ * descended into; at the top it is the index of the current key.
+ */
+static inline void tree_itr_push(_TreeItr *itr, Tree t, size_t slot)
 {
-    _TreeItrEntry entry = {offset, t};
-    return entry;
+    if (itr->_ptr >= _TREE_ITR_DEPTH)
+        error_bad_tree();
+    itr->_stack[itr->_ptr] = _bit_cast<Word>(t);
+    itr->_slot[itr->_ptr] = (uint8_t)slot;
+    itr->_ptr++;
 }
 
-static void tree_itr_move(_TreeItr *itr, size_t idx)
+static inline Tree tree_itr_node(const _TreeItr *itr, size_t i)
 {
-    if (itr->_ptr == 0)
-    {
-        _Tree t = _bit_cast<_Tree>(itr->_state);
-        size_t depth = tree_depth(t);
-        if (depth > UINT8_MAX)
-            error_bad_tree();
-        _TreeItrEntry *stack = (_TreeItrEntry *)gc_malloc(
-            sizeof(_TreeItrEntry) * depth);
-        stack[0] = tree_itr_entry(t, 0);
-        itr->_state = _bit_cast<Value<Word>>(stack);
-        itr->_ptr = 1;
-        return;
-    }
+    return _bit_cast<Tree>(itr->_stack[i]);
+}
+
+static inline Tree tree_itr_child(Tree t, size_t i)
+{
+    if (tree_is_leaf(t))
+        return TREE_EMPTY;
+    return tree_children(t, tree_count(t))[i];
+}
 
-    _TreeItrEntry *stack = _bit_cast<_TreeItrEntry *>(itr->_state);
+/*
+ * Rebuild the path to the key at index _idx from the root.
+ */
+static void tree_itr_seek(_TreeItr *itr)
+{
+    size_t idx = itr->_idx;
+    Tree t = itr->_root;
+    itr->_ptr = 0;
     while (true)
     {
-        if (itr->_ptr == 1)
+        if (index(t) == TREE_NIL)
+            error_bad_tree();
+        size_t n = tree_count(t);
+        if (tree_is_leaf(t))
+        {
+            if (idx >= n)
+                error_bad_tree();
+            tree_itr_push(itr, t, idx);
             break;
-        _TreeItrEntry *entry = stack + itr->_ptr - 1;
-        size_t lo = entry->_offset;
-        if (idx < lo)
+        }
+        const Tree *ts = tree_children(t, n);
+        size_t i = 0;
+        while (i < n && idx > _tree_node_size(ts[i]))
         {
-            itr->_ptr--;
-            continue;
+            idx -= _tree_node_size(ts[i]) + 1;
+            i++;
         }
-        size_t hi = lo + _tree_size(entry->_value);
-        if (idx < hi)
+        tree_itr_push(itr, t, i);
+        size_t m = _tree_node_size(ts[i]);
+        if (idx == m && i < n)
             break;
-        itr->_ptr--;
+        if (idx >= m)
+            error_bad_tree();
+        t = ts[i];
     }
+    itr->_pos = itr->_idx;
 }
 
-static const Value<Word> &tree_itr_get(_TreeItr *itr)
+/*
+ * Step the path to the next key.  Returns false if there is none.
+ */
+static bool tree_itr_next(_TreeItr *itr)
 {
-    size_t idx = itr->_idx;
-    _TreeItrEntry *stack = _bit_cast<_TreeItrEntry *>(itr->_state);
-    while (true)
+    size_t top = itr->_ptr - 1;
+    Tree t = tree_itr_node(itr, top);
+    size_t j = itr->_slot[top] + 1;
+    size_t n = tree_count(t);
+    if (!tree_is_leaf(t))
     {
-        _TreeItrEntry *entry = stack + itr->_ptr - 1;
-        size_t lo = entry->_offset;
-        switch (index(entry->_value))
+        Tree u = tree_children(t, n)[j];
+        if (index(u) != TREE_NIL)
         {
-            case TREE_2:
+            itr->_slot[top] = (uint8_t)j;
+            while (true)
             {
-                const Tree2 &t2 = entry->_value;
-                size_t hi = lo + _tree_size(t2.t[0]);
-                if (idx < hi)
-                {
-                    stack[itr->_ptr++] = tree_itr_entry(t2.t[0], lo);
-                    continue;
-                }
-                if (idx == hi)
-                    return t2.k[0];
-                lo = hi + 1;
-                stack[itr->_ptr++] = tree_itr_entry(t2.t[1], lo);
-                continue;
-            }
-            case TREE_3:
-            {
-                const Tree3 &t3 = entry->_value;
-                size_t hi = lo + _tree_size(t3.t[0]);
-                if (idx < hi)
-                {
-                    stack[itr->_ptr++] = tree_itr_entry(t3.t[0], lo);
-                    continue;
-                }
-                if (idx == hi)
-                    return t3.k[0];
-                lo = hi + 1;
-                hi = lo + _tree_size(t3.t[1]);
-                if (idx < hi)
-                {
-                    stack[itr->_ptr++] = tree_itr_entry(t3.t[1], lo);
-                    continue;
-                }
-                if (idx == hi)
-                    return t3.k[1];
-                lo = hi + 1;
-                stack[itr->_ptr++] = tree_itr_entry(t3.t[2], lo);
-                continue;
+                tree_itr_push(itr, u, 0);
+                if (tree_is_leaf(u))
+                    return true;
+                Tree v = tree_children(u, tree_count(u))[0];
+                if (index(v) == TREE_NIL)
+                    return true;
+                u = v;
             }
-            case TREE_4:
+        }
+    }
+    if (j < n)
+    {
+        itr->_slot[top] = (uint8_t)j;
+        return true;
+    }
+    while (--itr->_ptr > 0)
+    {
+        top = itr->_ptr - 1;
+        if (itr->_slot[top] < tree_count(tree_itr_node(itr, top)))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Step the path to the previous key.  Returns false if there is none.
+ */
+static bool tree_itr_prev(_TreeItr *itr)
+{
+    size_t top = itr->_ptr - 1;
+    Tree t = tree_itr_node(itr, top);
+    size_t j = itr->_slot[top];
+    Tree u = tree_itr_child(t, j);
+    if (index(u) != TREE_NIL)
+    {
+        while (true)
+        {
+            size_t n = tree_count(u);
+            Tree v = tree_itr_child(u, n);
+            if (index(v) == TREE_NIL)
             {
-                const Tree4 &t4 = entry->_value;
-                size_t hi = lo + _tree_size(t4.t[0]);
-                if (idx < hi)
-                {
-                    stack[itr->_ptr++] = tree_itr_entry(t4.t[0], lo);
-                    continue;
-                }
-                if (idx == hi)
-                    return t4.k[0];
-                lo = hi + 1;
-                hi = lo + _tree_size(t4.t[1]);
-                if (idx < hi)
-                {
-                    stack[itr->_ptr++] = tree_itr_entry(t4.t[1], lo);
-                    continue;
-                }
-                if (idx == hi)
-                    return t4.k[1];
-                lo = hi + 1;
-                hi = lo + _tree_size(t4.t[2]);
-                if (idx < hi)
-                {
-                    stack[itr->_ptr++] = tree_itr_entry(t4.t[2], lo);
-                    continue;
-                }
-                if (idx == hi)
-                    return t4.k[2];
-                lo = hi + 1;
-                stack[itr->_ptr++] = tree_itr_entry(t4.t[3], lo);
-                continue;
+                tree_itr_push(itr, u, n - 1);
+                return true;
             }
-            default:
-                error_bad_tree();
+            tree_itr_push(itr, u, n);
+            u = v;
+        }
+    }
+    if (j > 0)
+    {
+        itr->_slot[top] = (uint8_t)(j - 1);
+        return true;
+    }
+    while (--itr->_ptr > 0)
+    {
+        top = itr->_ptr - 1;
+        if (itr->_slot[top] > 0)
+        {
+            itr->_slot[top]--;
+            return true;
         }
     }
+    return false;
 }
 
 extern void _tree_itr_begin(_TreeItr *itr, _Tree t)
 {
     itr->_idx = 0;
+    itr->_pos = 0;
     itr->_ptr = 0;
-    itr->_state = _bit_cast<Value<Word>>(t);
+    itr->_root = t;
+    itr->_cur = nullptr;
+    itr->_lim = nullptr;
 }
 
 extern void _tree_itr_end(_TreeItr *itr, _Tree t)
 {
     itr->_idx = _tree_size(t);
+    itr->_pos = 0;
     itr->_ptr = 0;
-    itr->_state = _bit_cast<Value<Word>>(t);
+    itr->_root = t;
+    itr->_cur = nullptr;
+    itr->_lim = nullptr;
 }
 
 extern const Value<Word> &_tree_itr_get(_TreeItr *itr)
 {
-    tree_itr_move(itr, itr->_idx);
-    return tree_itr_get(itr);
-}
-
-extern void _tree_itr_copy(_TreeItr *dst, const _TreeItr *src)
-{
-    dst->_idx = src->_idx;
-    if (src->_ptr == 0)
-        dst->_state = src->_state;
-    else
+    if (itr->_ptr != 0 && itr->_idx != itr->_pos)
     {
-        _TreeItrEntry *stack = _bit_cast<_TreeItrEntry *>(src->_state);
-        dst->_state = _bit_cast<Value<Word>>(stack[0]._value);
+        bool ok = false;
+        if (itr->_idx == itr->_pos + 1)
+            ok = tree_itr_next(itr);
+        else if (itr->_idx + 1 == itr->_pos)
+            ok = tree_itr_prev(itr);
+        if (ok)
+            itr->_pos = itr->_idx;
+        else
+            itr->_ptr = 0;
     }
-    dst->_ptr = 0;
+    if (itr->_ptr == 0)
+        tree_itr_seek(itr);
+    size_t top = itr->_ptr - 1;
+    Tree t = tree_itr_node(itr, top);
+    bool leaf = (tree_is_leaf(t));
+    const K *ks = (leaf? tree_leaf_keys(t): tree_keys(t));
+    itr->_cur = ks + itr->_slot[top];
+    itr->_lim = (leaf? ks + tree_count(t): itr->_cur + 1);
+    return *itr->_cur;
 }
 
 }
+
+#endif      /* LIBF_TREE_BTREE */
+
@@ -46,13 +46,54 @@ struct _TreeNil
 {
     // Empty  
 };
+#ifndef LIBF_TREE_BTREE
 struct _Tree2;
 struct _Tree3;
 struct _Tree4;
-typedef Union<_TreeNil, _Tree2, _Tree3, _Tree4> _Tree;
+struct _TreeLeaf1;
+struct _TreeLeaf2;
+struct _TreeLeaf3;
+typedef Union<_TreeNil, _Tree2, _Tree3, _Tree4, _TreeLeaf1, _TreeLeaf2,
+    _TreeLeaf3> _Tree;
+#else
+struct _BTreeLeaf;
+struct _BTreeNode;
+typedef Union<_TreeNil, _BTreeLeaf, _BTreeNode> _Tree;
+#endif
 
 typedef int (*_Compare)(Value<Word> _a, Value<Word> _b);
 
+/*
+ * Actions for _tree_alter().
+ */
+enum
+{
+    _TREE_ALTER_KEEP,
+    _TREE_ALTER_SET,
+    _TREE_ALTER_ERASE
+};
+
+/*
+ * A monoid over tree entries for _tree_aggregate().  Its address identifies
+ * the summaries it has cached in tree nodes.
+ */
+struct _TreeMeasure
+{
+    Value<Word> (*_empty)(void);
+    Value<Word> (*_measure)(const Value<Word> &);
+    Value<Word> (*_combine)(Value<Word>, Value<Word>);
+};
+
+/*
+ * Operations for _tree_merge_with().
+ */
+enum
+{
+    _TREE_UNION,
+    _TREE_INTERSECT,
+    _TREE_DIFF
+};
+
 inline PURE _Tree _tree_empty(void)
 {
     return (_TreeNil){};
@@ -67,24 +108,55 @@ extern PURE const Value<Word> *_tree_search(_Tree _t, Value<Word> _k,
     _Compare _compare);
 extern PURE _Tree _tree_insert(_Tree _t, Value<Word> _k, _Compare _compare);
 extern PURE _Tree _tree_delete(_Tree _t, Value<Word> _k, _Compare _compare);
+extern PURE _Tree _tree_alter(_Tree _t, Value<Word> _k, _Compare _compare,
+    int (*_func)(void *, const Value<Word> *, Value<Word> *), void *_data);
+extern size_t _tree_owner_new(void);
+extern _Tree _tree_insert_owned(_Tree _t, Value<Word> _k, _Compare _compare,
+    size_t _owner);
+extern _Tree _tree_delete_owned(_Tree _t, Value<Word> _k, _Compare _compare,
+    size_t _owner);
+extern _Tree _tree_freeze(_Tree _t, size_t _owner);
 extern PURE size_t _tree_size(_Tree _t);
 extern PURE Value<Word> _tree_foldl(_Tree _t, Value<Word> _arg,
-    Value<Word> (*_func)(void *, Value<Word>, Value<Word>), void *_data);
+    Value<Word> (*_func)(void *, Value<Word>, const Value<Word> &),
+    void *_data);
+extern PURE Value<Word> _tree_foldl_range(_Tree _t, const Value<Word> *_lo,
+    const Value<Word> *_hi, Value<Word> _arg,
+    Value<Word> (*_func)(void *, Value<Word>, const Value<Word> &),
+    void *_data, _Compare _compare);
+extern PURE Value<Word> _tree_aggregate(_Tree _t, const Value<Word> *_lo,
+    const Value<Word> *_hi, const _TreeMeasure *_m, _Compare _compare);
 extern PURE Value<Word> _tree_foldr(_Tree _t, Value<Word> _arg,
-    Value<Word> (*_func)(void *, Value<Word>, Value<Word>), void *_data);
+    Value<Word> (*_func)(void *, Value<Word>, const Value<Word> &),
+    void *_data);
 extern PURE _Tree _tree_map(_Tree _t,
     Value<Word> (*_func)(void *, Value<Word>), void *_data);
 extern PURE List<Value<Word>> _tree_to_list(_Tree _t,
     Value<Word> (*_func)(void *, Value<Word>), void *_data);
 extern PURE _Tree _tree_from_list(List<Value<Word>> _xs, _Compare _compare);
+extern _Tree _tree_from_sorted(size_t _n, Value<Word> (*_next)(void *),
+    void *_data, _Compare _compare);
 extern PURE Result<_Tree, _Tree> _tree_split(_Tree _t, Value<Word> _k,
     _Compare _compare);
+extern PURE Result<_Tree, _Tree> _tree_split_at(_Tree _t, size_t _i,
+    _Compare _compare);
+extern PURE const Value<Word> *_tree_nth(_Tree _t, size_t _i);
+extern PURE size_t _tree_rank(_Tree _t, Value<Word> _k, _Compare _compare,
+    bool _upper);
 extern PURE _Tree _tree_union(_Tree _t, _Tree _u, _Compare _compare);
 extern PURE _Tree _tree_intersect(_Tree _t, _Tree _u, _Compare _compare);
 extern PURE _Tree _tree_diff(_Tree _t, _Tree _u, _Compare _compare);
+extern PURE _Tree _tree_merge_with(_Tree _t, _Tree _u, _Compare _compare,
+    int _op, bool (*_func)(void *, const Value<Word> *, const Value<Word> *,
+        Value<Word> *), void *_data);
+extern _Tree _tree_retain(_Tree _t);
+extern void _tree_release(_Tree _t);
 extern PURE bool _tree_verify(_Tree _t);
 extern PURE int _tree_compare(_Tree _t, _Tree u, void *_data,
     int (*_val_compare)(void *, Value<Word>, Value<Word>));
+extern void _tree_diff_entries(_Tree _t, _Tree _u, _Compare _compare,
+    void (*_func)(void *, const Value<Word> *, const Value<Word> *),
+    void *_data);
 extern PURE String _tree_show(_Tree _t, String (*_f)(Value<Word>));
 
 struct _TreeItr;
@@ -92,39 +164,53 @@ struct _TreeItr;
 extern void _tree_itr_begin(_TreeItr *_itr, _Tree _t);
 extern void _tree_itr_end(_TreeItr *_itr, _Tree _t);
 extern const Value<Word> &_tree_itr_get(_TreeItr *_itr);
-extern void _tree_itr_copy(_TreeItr *_dstitr, const _TreeItr *_srcitr);
 
-struct _TreeItrEntry
-{
-    uint64_t _offset;
-    _Tree _value;
-};
+/*
+ * Maximum tree depth supported by iterators.  A tree of depth d holds at least
+ * 2^(d-1) keys, so this bound is never reached in practice.
+ */
+#define _TREE_ITR_DEPTH     64
 
+/*
+ * Tree iterator.  The position is the index _idx, so arithmetic and
+ * comparisons are O(1).  The iterator also caches the path from the root to
+ * the key at index _pos in an inline stack (_stack[0.._ptr-1], with _ptr == 0
+ * if there is no path yet).  Dereferencing after a move by one steps the path
+ * to the successor or predecessor key, which is O(1) amortised, and
+ * otherwise descends from the root.  [_cur, _lim) are the keys from _pos to
+ * the end of its leaf, so that most steps are inline.
+ */
 struct _TreeItr
 {
-    uint64_t _ptr:8;
-    uint64_t _idx:56;
-    Value<Word> _state;
-
-    _TreeItr()
+    size_t _idx;
+    size_t _pos;
+    size_t _ptr;
+    _Tree _root;
+    const Value<Word> *_cur;
+    const Value<Word> *_lim;
+    uint8_t _slot[_TREE_ITR_DEPTH];
+    Word _stack[_TREE_ITR_DEPTH];
+
+    _TreeItr() : _idx(0), _pos(0), _ptr(0), _cur(nullptr), _lim(nullptr)
     {
-        _tree_itr_begin(this, _tree_empty());
+
     }
 
     _TreeItr(const _TreeItr &_itr)
     {
-        _tree_itr_copy(this, &_itr);
-    }
-
-    _TreeItr(_TreeItr &&_itr) : _ptr(_itr._ptr), _idx(_itr._idx),
-        _state(_itr._state)
-    {
-
+        *this = _itr;
     }
 
     _TreeItr& operator=(const _TreeItr &_itr)
     {
-        _tree_itr_copy(this, &_itr);
+        _idx = _itr._idx;
+        _pos = _itr._pos;
+        _ptr = _itr._ptr;
+        _root = _itr._root;
+        _cur = _itr._cur;
+        _lim = _itr._lim;
+        std::memcpy(_slot, _itr._slot, _ptr * sizeof(_slot[0]));
+        std::memcpy(_stack, _itr._stack, _ptr * sizeof(_stack[0]));
         return *this;
     }
 };
@@ -181,6 +267,12 @@ inline _TreeItr &operator-= (_TreeItr &_i, ssize_t _offset)
 
 inline PURE const Value<Word> &operator* (_TreeItr &_i)
 {
+    if (_i._idx == _i._pos + 1 && _i._lim - _i._cur > 1)
+    {
+        _i._pos++;
+        _i._slot[_i._ptr - 1]++;
+        return *++_i._cur;
+    }
     return _tree_itr_get(&_i);
 }
 
@@ -0,0 +1,1474 @@
+/*
+ * Copyright (c) 2017 The National University of Singapore.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FTREE_INLINE_H
+#define _FTREE_INLINE_H
+
+/*
+ * Header-instantiated 234 tree kernels.  The search/insert/delete kernels
+ * are templates over the comparison, so that sets and maps can have the key
+ * comparison inlined.  ftree.cpp instantiates the same kernels with a
+ * function pointer for the type-erased interface (see ftree.h).  With
+ * -DLIBF_TREE_BTREE the B-tree nodes and search kernel are defined instead
+ * (see fbtree.cpp).
+ */
+
+#include "fbase.h"
+#include "fgc.h"
+#include "fvalue.h"
+#include "ftree.h"
+
+namespace F
+{
+
+/*
+ * Tree node definitions.  The upper bits of the size field hold the owner
+ * token of a transient tree (see ftree.cpp), and are zero for immutable
+ * nodes.
+ */
+#define _TREE_OWNER_SHIFT   40
+#define _TREE_SIZE_MASK     ((1ull << _TREE_OWNER_SHIFT) - 1)
+
+/*
+ * Cached subtree summary of an internal node (-DLIBF_TREE_MEASURE), valid if
+ * the tag is the _TreeMeasure that computed it (see _tree_aggregate()).
+ * There is one slot per node, so aggregating under another measure evicts it.
+ * Nodes are shared between threads, so the tag doubles as a seqlock: a
+ * writer claims the cache by swapping the tag for _TREE_CACHE_BUSY, and a
+ * reader re-checks the tag after reading the value.
+ */
+struct _TreeCache
+{
+    const void *tag;
+    Value<Word> val;
+};
+
+#define _TREE_CACHE_BUSY    ((const void *)1)
+
+/*
+ * Trailing initializer for the cache slot of an internal node (empty).
+ */
+#ifdef LIBF_TREE_MEASURE
+#define _TREE_CACHE_INIT    , {nullptr, Value<Word>()}
+#else
+#define _TREE_CACHE_INIT
+#endif
+
+inline bool _tree_cache_lookup(const _TreeCache *_c, const void *_tag,
+    Value<Word> *_val)
+{
+    if (__atomic_load_n(&_c->tag, __ATOMIC_ACQUIRE) != _tag)
+        return false;
+    __atomic_load(&_c->val, _val, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (__atomic_load_n(&_c->tag, __ATOMIC_RELAXED) == _tag);
+}
+
+/*
+ * Publish a summary.  Skipped if another thread is publishing to the same
+ * node, since either summary is then as good as the other.
+ */
+inline void _tree_cache_publish(_TreeCache *_c, const void *_tag,
+    Value<Word> _val)
+{
+    const void *_old = __atomic_load_n(&_c->tag, __ATOMIC_RELAXED);
+    if (_old == _TREE_CACHE_BUSY ||
+            !__atomic_compare_exchange_n(&_c->tag, &_old, _TREE_CACHE_BUSY,
+                false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store(&_c->val, &_val, __ATOMIC_RELAXED);
+    __atomic_store_n(&_c->tag, _tag, __ATOMIC_RELEASE);
+}
+
+#ifndef LIBF_TREE_BTREE
+
+struct _Tree2
+{
+    size_t size;
+    Value<Word> k[1];
+    _Tree t[2];
+#ifdef LIBF_TREE_MEASURE
+    _TreeCache c;
+#endif
+};
+struct _Tree3
+{
+    size_t size;
+    Value<Word> k[2];
+    _Tree t[3];
+#ifdef LIBF_TREE_MEASURE
+    _TreeCache c;
+#endif
+};
+struct _Tree4
+{
+    size_t size;
+    Value<Word> k[3];
+    _Tree t[4];
+#ifdef LIBF_TREE_MEASURE
+    _TreeCache c;
+#endif
+};
+
+/*
+ * Leaf nodes omit the size field and the (all NIL) child array, and so are
+ * half the size of the corresponding internal node.  Leaves are never owned
+ * by a transient (see ftree.cpp).
+ */
+struct _TreeLeaf1
+{
+    Value<Word> k[1];
+};
+struct _TreeLeaf2
+{
+    Value<Word> k[2];
+};
+struct _TreeLeaf3
+{
+    Value<Word> k[3];
+};
+
+/*
+ * Precise GC layouts (LIBF_GC_TYPED): the size field is never a pointer.
+ */
+template <> struct _GCLayout<_Tree2> : _GCLayoutSized<_Tree2> { };
+template <> struct _GCLayout<_Tree3> : _GCLayoutSized<_Tree3> { };
+template <> struct _GCLayout<_Tree4> : _GCLayoutSized<_Tree4> { };
+
+/*
+ * Allocation statistics (LIBF_ALLOC_STATS).
+ */
+template <> struct _GCStatKind<_Tree2>
+    { static const unsigned _kind = GC_STAT_TREE; };
+template <> struct _GCStatKind<_Tree3>
+    { static const unsigned _kind = GC_STAT_TREE; };
+template <> struct _GCStatKind<_Tree4>
+    { static const unsigned _kind = GC_STAT_TREE; };
+template <> struct _GCStatKind<_TreeLeaf1>
+    { static const unsigned _kind = GC_STAT_TREE; };
+template <> struct _GCStatKind<_TreeLeaf2>
+    { static const unsigned _kind = GC_STAT_TREE; };
+template <> struct _GCStatKind<_TreeLeaf3>
+    { static const unsigned _kind = GC_STAT_TREE; };
+
+/*
+ * Tree node types.
+ */
+enum
+{
+    _TREE_NIL = _Tree::index<_TreeNil>(),
+    _TREE_2   = _Tree::index<_Tree2>(),
+    _TREE_3   = _Tree::index<_Tree3>(),
+    _TREE_4   = _Tree::index<_Tree4>(),
+    _TREE_LEAF1 = _Tree::index<_TreeLeaf1>(),
+    _TREE_LEAF2 = _Tree::index<_TreeLeaf2>(),
+    _TREE_LEAF3 = _Tree::index<_TreeLeaf3>()
+};
+
+/*
+ * Node size and reference counting (only enabled for the LIBF_GC_RC
+ * backend).  Each node holds a reference to its children.
+ */
+extern void _tree_free(_Tree _t);
+
+inline const void *_tree_ptr(_Tree _t)
+{
+    return (const void *)(_bit_cast<Word>(_t) & ~(Word)_UNION_TAG_MASK);
+}
+
+inline bool _tree_is_leaf(_Tree _t)
+{
+    return (index(_t) >= _TREE_LEAF1);
+}
+
+/*
+ * The keys of a leaf (all leaf types start with the key array).
+ */
+inline const Value<Word> *_tree_leaf_keys(_Tree _t)
+{
+    return (const Value<Word> *)_tree_ptr(_t);
+}
+
+inline size_t _tree_node_size(_Tree _t)
+{
+    if (index(_t) == _TREE_NIL)
+        return 0;
+    if (_tree_is_leaf(_t))
+        return index(_t) - _TREE_LEAF1 + 1;
+    return *(const size_t *)_tree_ptr(_t) & _TREE_SIZE_MASK;
+}
+
+inline void _tree_ref(_Tree _t)
+{
+#ifdef LIBF_GC_RC
+    if (index(_t) != _TREE_NIL)
+        gc_retain(_tree_ptr(_t));
+#else
+    (void)_t;
+#endif
+}
+
+/*
+ * Free a temporary node that was consumed without being linked in.
+ */
+inline void _tree_drop(_Tree _t)
+{
+#ifdef LIBF_GC_RC
+    if (index(_t) != _TREE_NIL && gc_refs(_tree_ptr(_t)) == 0)
+        _tree_free(_t);
+#else
+    (void)_t;
+#endif
+}
+
+/*
+ * Node constructors.  Nodes with NIL children are built as leaves.
+ */
+inline _Tree _tree2(_Tree _t0, Value<Word> _k0, _Tree _t1)
+{
+    if (index(_t0) == _TREE_NIL)
+    {
+        _TreeLeaf1 _leaf = {{_k0}};
+        return _leaf;
+    }
+    _tree_ref(_t0); _tree_ref(_t1);
+    size_t _size = 1 + _tree_node_size(_t0) + _tree_node_size(_t1);
+    _Tree2 _node = {_size, {_k0}, {_t0, _t1} _TREE_CACHE_INIT};
+    return _node;
+}
+inline _Tree _tree3(_Tree _t0, Value<Word> _k0, _Tree _t1, Value<Word> _k1,
+    _Tree _t2)
+{
+    if (index(_t0) == _TREE_NIL)
+    {
+        _TreeLeaf2 _leaf = {{_k0, _k1}};
+        return _leaf;
+    }
+    _tree_ref(_t0); _tree_ref(_t1); _tree_ref(_t2);
+    size_t _size = 2 + _tree_node_size(_t0) + _tree_node_size(_t1) +
+        _tree_node_size(_t2);
+    _Tree3 _node = {_size, {_k0, _k1}, {_t0, _t1, _t2} _TREE_CACHE_INIT};
+    return _node;
+}
+inline _Tree _tree4(_Tree _t0, Value<Word> _k0, _Tree _t1, Value<Word> _k1,
+    _Tree _t2, Value<Word> _k2, _Tree _t3)
+{
+    if (index(_t0) == _TREE_NIL)
+    {
+        _TreeLeaf3 _leaf = {{_k0, _k1, _k2}};
+        return _leaf;
+    }
+    _tree_ref(_t0); _tree_ref(_t1); _tree_ref(_t2); _tree_ref(_t3);
+    size_t _size = 3 + _tree_node_size(_t0) + _tree_node_size(_t1) +
+        _tree_node_size(_t2) + _tree_node_size(_t3);
+    _Tree4 _node = {_size, {_k0, _k1, _k2}, {_t0, _t1, _t2, _t3}
+        _TREE_CACHE_INIT};
+    return _node;
+}
+
+/*
+ * Leaf views.  Code that handles leaves and internal nodes alike reads a
+ * leaf as the corresponding internal node with NIL children, which is built
+ * in the caller's buffer.  Internal nodes are returned as-is.
+ */
+inline const _Tree2 &_tree2_view(_Tree _t, _Tree2 *_buf)
+{
+    if (index(_t) != _TREE_LEAF1)
+        return _t;
+    const _TreeLeaf1 &_l = _t;
+    _Tree _nil = _tree_empty();
+    *_buf = {1, {_l.k[0]}, {_nil, _nil} _TREE_CACHE_INIT};
+    return *_buf;
+}
+inline const _Tree3 &_tree3_view(_Tree _t, _Tree3 *_buf)
+{
+    if (index(_t) != _TREE_LEAF2)
+        return _t;
+    const _TreeLeaf2 &_l = _t;
+    _Tree _nil = _tree_empty();
+    *_buf = {2, {_l.k[0], _l.k[1]}, {_nil, _nil, _nil} _TREE_CACHE_INIT};
+    return *_buf;
+}
+inline const _Tree4 &_tree4_view(_Tree _t, _Tree4 *_buf)
+{
+    if (index(_t) != _TREE_LEAF3)
+        return _t;
+    const _TreeLeaf3 &_l = _t;
+    _Tree _nil = _tree_empty();
+    *_buf = {3, {_l.k[0], _l.k[1], _l.k[2]}, {_nil, _nil, _nil, _nil}
+        _TREE_CACHE_INIT};
+    return *_buf;
+}
+
+/*
+ * Rebalancing after a delete (comparison independent, see ftree.cpp).
+ */
+extern _Tree _tree_delete_min_2(_Tree _t, Value<Word> *_k, bool *_reduced);
+extern _Tree _tree2_fix_t0(_Tree _t0, Value<Word> _k0, _Tree _t1,
+    bool *_reduced);
+extern _Tree _tree2_fix_t1(_Tree _t0, Value<Word> _k0, _Tree _t1,
+    bool *_reduced);
+extern _Tree _tree3_fix_t0(_Tree _t0, Value<Word> _k0, _Tree _t1,
+    Value<Word> _k1, _Tree _t2, bool *_reduced);
+extern _Tree _tree3_fix_t1(_Tree _t0, Value<Word> _k0, _Tree _t1,
+    Value<Word> _k1, _Tree _t2, bool *_reduced);
+extern _Tree _tree3_fix_t2(_Tree _t0, Value<Word> _k0, _Tree _t1,
+    Value<Word> _k1, _Tree _t2, bool *_reduced);
+extern _Tree _tree4_fix_t0(_Tree _t0, Value<Word> _k0, _Tree _t1,
+    Value<Word> _k1, _Tree _t2, Value<Word> _k2, _Tree _t3, bool *_reduced);
+extern _Tree _tree4_fix_t1(_Tree _t0, Value<Word> _k0, _Tree _t1,
+    Value<Word> _k1, _Tree _t2, Value<Word> _k2, _Tree _t3, bool *_reduced);
+extern _Tree _tree4_fix_t2(_Tree _t0, Value<Word> _k0, _Tree _t1,
+    Value<Word> _k1, _Tree _t2, Value<Word> _k2, _Tree _t3, bool *_reduced);
+extern _Tree _tree4_fix_t3(_Tree _t0, Value<Word> _k0, _Tree _t1,
+    Value<Word> _k1, _Tree _t2, Value<Word> _k2, _Tree _t3, bool *_reduced);
+
+/*
+ * Search.
+ */
+template <typename _Cmp>
+inline PURE const Value<Word> *_tree_search_k(_Tree _t, Value<Word> _k,
+    _Cmp _compare)
+{
+    while (true)
+    {
+        switch (index(_t))
+        {
+            case _TREE_NIL:
+                return nullptr;
+            case _TREE_2:
+            {
+                const _Tree2 &_t2 = _t;
+                int _cmp = _compare(_k, _t2.k[0]);
+                if (_cmp < 0)
+                {
+                    _t = _t2.t[0];
+                    continue;
+                }
+                else if (_cmp > 0)
+                {
+                    _t = _t2.t[1];
+                    continue;
+                }
+                return &_t2.k[0];
+            }
+            case _TREE_3:
+            {
+                const _Tree3 &_t3 = _t;
+                int _cmp = _compare(_k, _t3.k[0]);
+                if (_cmp < 0)
+                {
+                    _t = _t3.t[0];
+                    continue;
+                }
+                else if (_cmp > 0)
+                {
+                    _cmp = _compare(_k, _t3.k[1]);
+                    if (_cmp < 0)
+                    {
+                        _t = _t3.t[1];
+                        continue;
+                    }
+                    else if (_cmp > 0)
+                    {
+                        _t = _t3.t[2];
+                        continue;
+                    }
+                    return &_t3.k[1];
+                }
+                return &_t3.k[0];
+            }
+            case _TREE_4:
+            {
+                const _Tree4 &_t4 = _t;
+                int _cmp = _compare(_k, _t4.k[1]);
+                if (_cmp < 0)
+                {
+                    _cmp = _compare(_k, _t4.k[0]);
+                    if (_cmp < 0)
+                    {
+                        _t = _t4.t[0];
+                        continue;
+                    }
+                    else if (_cmp > 0)
+                    {
+                        _t = _t4.t[1];
+                        continue;
+                    }
+                    return &_t4.k[0];
+                }
+                else if (_cmp > 0)
+                {
+                    _cmp = _compare(_k, _t4.k[2]);
+                    if (_cmp < 0)
+                    {
+                        _t = _t4.t[2];
+                        continue;
+                    }
+                    else if (_cmp > 0)
+                    {
+                        _t = _t4.t[3];
+                        continue;
+                    }
+                    return &_t4.k[2];
+                }
+                return &_t4.k[1];
+            }
+            default:
+            {
+                const Value<Word> *_ks = _tree_leaf_keys(_t);
+                size_t _n = _tree_node_size(_t);
+                for (size_t _i = 0; _i < _n; _i++)
+                {
+                    int _cmp = _compare(_k, _ks[_i]);
+                    if (_cmp < 0)
+                        return nullptr;
+                    else if (_cmp == 0)
+                        return &_ks[_i];
+                }
+                return nullptr;
+            }
+        }
+    }
+}
+
+/*
+ * Insert.
+ */
+template <typename _Cmp>
+_Tree _tree2_insert_k(const _Tree2 &_t, Value<Word> _k, _Cmp _compare);
+template <typename _Cmp>
+_Tree _tree3_insert_k(const _Tree3 &_t, Value<Word> _k, _Cmp _compare);
+
+template <typename _Cmp>
+inline _Tree _tree2_insert_view_k(_Tree _t, Value<Word> _k, _Cmp _compare)
+{
+    _Tree2 _t2_buf;
+    return _tree2_insert_k(_tree2_view(_t, &_t2_buf), _k, _compare);
+}
+
+template <typename _Cmp>
+inline PURE _Tree _tree_insert_k(_Tree _t, Value<Word> _k, _Cmp _compare)
+{
+    switch (index(_t))
+    {
+        case _TREE_NIL:
+            return _tree2(_tree_empty(), _k, _tree_empty());
+        case _TREE_2:
+        case _TREE_LEAF1:
+            return _tree2_insert_view_k(_t, _k, _compare);
+        case _TREE_3:
+        case _TREE_LEAF2:
+        {
+            _Tree3 _t3_buf;
+            return _tree3_insert_k(_tree3_view(_t, &_t3_buf), _k, _compare);
+        }
+        case _TREE_4:
+        case _TREE_LEAF3:
+        {
+            _Tree4 _t4_buf;
+            const _Tree4 &_t4 = _tree4_view(_t, &_t4_buf);
+            _Tree _lt = _tree2(_t4.t[0], _t4.k[0], _t4.t[1]);
+            _Tree _rt = _tree2(_t4.t[2], _t4.k[2], _t4.t[3]);
+            _Tree _nt = _tree2(_lt, _t4.k[1], _rt);
+            _Tree _r = _tree2_insert_k(_nt, _k, _compare);
+            _tree_drop(_nt);
+            return _r;
+        }
+        default:
+            error("data-structure invariant violated");
+    }
+}
+
+template <typename _Cmp>
+_Tree _tree2_insert_k(const _Tree2 &_t, Value<Word> _k, _Cmp _compare)
+{
+    int _cmp = _compare(_k, _t.k[0]);
+    if (index(_t.t[0]) == _TREE_NIL)
+    {
+        _Tree _nil = _tree_empty();
+        if (_cmp < 0)
+            return _tree3(_nil, _k, _nil, _t.k[0], _nil);
+        else if (_cmp > 0)
+            return _tree3(_nil, _t.k[0], _nil, _k, _nil);
+        else
+            return _tree2(_nil, _k, _nil);
+    }
+    if (_cmp < 0)
+    {
+        switch (index(_t.t[0]))
+        {
+            case _TREE_2:
+            case _TREE_LEAF1:
+            {
+                _Tree2 _t2_buf;
+                const _Tree2 &_t2 = _tree2_view(_t.t[0], &_t2_buf);
+                _Tree _nt = _tree2_insert_k(_t2, _k, _compare);
+                return _tree2(_nt, _t.k[0], _t.t[1]);
+            }
+            case _TREE_3:
+            case _TREE_LEAF2:
+            {
+                _Tree3 _t3_buf;
+                const _Tree3 &_t3 = _tree3_view(_t.t[0], &_t3_buf);
+                _Tree _nt = _tree3_insert_k(_t3, _k, _compare);
+                return _tree2(_nt, _t.k[0], _t.t[1]);
+            }
+            case _TREE_4:
+            case _TREE_LEAF3:
+            {
+                _Tree4 _t4_buf;
+                const _Tree4 &_t4 = _tree4_view(_t.t[0], &_t4_buf);
+                _cmp = _compare(_k, _t4.k[1]);
+                _Tree _lt = _tree2(_t4.t[0], _t4.k[0], _t4.t[1]);
+                _Tree _rt = _tree2(_t4.t[2], _t4.k[2], _t4.t[3]);
+                if (_cmp < 0)
+                {
+                    _Tree _nt = _tree2_insert_view_k(_lt, _k, _compare);
+                    _tree_drop(_lt);
+                    return _tree3(_nt, _t4.k[1], _rt, _t.k[0], _t.t[1]);
+                }
+                else if (_cmp > 0)
+                {
+                    _Tree _nt = _tree2_insert_view_k(_rt, _k, _compare);
+                    _tree_drop(_rt);
+                    return _tree3(_lt, _t4.k[1], _nt, _t.k[0], _t.t[1]);
+                }
+                else
+                    return _tree3(_lt, _k, _rt, _t.k[0], _t.t[1]);
+            }
+            default:
+                error("data-structure invariant violated");
+        }
+    }
+    else if (_cmp > 0)
+    {
+        switch (index(_t.t[1]))
+        {
+            case _TREE_2:
+            case _TREE_LEAF1:
+            {
+                _Tree2 _t2_buf;
+                const _Tree2 &_t2 = _tree2_view(_t.t[1], &_t2_buf);
+                _Tree _nt = _tree2_insert_k(_t2, _k, _compare);
+                return _tree2(_t.t[0], _t.k[0], _nt);
+            }
+            case _TREE_3:
+            case _TREE_LEAF2:
+            {
+                _Tree3 _t3_buf;
+                const _Tree3 &_t3 = _tree3_view(_t.t[1], &_t3_buf);
+                _Tree _nt = _tree3_insert_k(_t3, _k, _compare);
+                return _tree2(_t.t[0], _t.k[0], _nt);
+            }
+            case _TREE_4:
+            case _TREE_LEAF3:
+            {
+                _Tree4 _t4_buf;
+                const _Tree4 &_t4 = _tree4_view(_t.t[1], &_t4_buf);
+                _cmp = _compare(_k, _t4.k[1]);
+                _Tree _lt = _tree2(_t4.t[0], _t4.k[0], _t4.t[1]);
+                _Tree _rt = _tree2(_t4.t[2], _t4.k[2], _t4.t[3]);
+                if (_cmp < 0)
+                {
+                    _Tree _nt = _tree2_insert_view_k(_lt, _k, _compare);
+                    _tree_drop(_lt);
+                    return _tree3(_t.t[0], _t.k[0], _nt, _t4.k[1], _rt);
+                }
+                else if (_cmp > 0)
+                {
+                    _Tree _nt = _tree2_insert_view_k(_rt, _k, _compare);
+                    _tree_drop(_rt);
+                    return _tree3(_t.t[0], _t.k[0], _lt, _t4.k[1], _nt);
+                }
+                else
+                    return _tree3(_t.t[0], _t.k[0], _lt, _k, _rt);
+            }
+            default:
+                error("data-structure invariant violated");
+        }
+    }
+    else
+        return _tree2(_t.t[0], _k, _t.t[1]);
+}
+
+template <typename _Cmp>
+_Tree _tree3_insert_k(const _Tree3 &_t, Value<Word> _k, _Cmp _compare)
+{
+    int _cmp = _compare(_k, _t.k[0]);
+    if (index(_t.t[0]) == _TREE_NIL)
+    {
+        _Tree _nil = _tree_empty();
+        if (_cmp < 0)
+            return _tree4(_nil, _k, _nil, _t.k[0], _nil, _t.k[1], _nil);
+        else if (_cmp > 0)
+        {
+            _cmp = _compare(_k, _t.k[1]);
+            if (_cmp < 0)
+                return _tree4(_nil, _t.k[0], _nil, _k, _nil, _t.k[1], _nil);
+            else if (_cmp > 0)
+                return _tree4(_nil, _t.k[0], _nil, _t.k[1], _nil, _k, _nil);
+            else
+                return _tree3(_nil, _t.k[0], _nil, _k, _nil);
+        }
+        else
+            return _tree3(_nil, _k, _nil, _t.k[1], _nil);
+    }
+
+    if (_cmp < 0)
+    {
+        switch (index(_t.t[0]))
+        {
+            case _TREE_2:
+            case _TREE_LEAF1:
+            {
+                _Tree2 _t2_buf;
+                const _Tree2 &_t2 = _tree2_view(_t.t[0], &_t2_buf);
+                _Tree _nt = _tree2_insert_k(_t2, _k, _compare);
+                return _tree3(_nt, _t.k[0], _t.t[1], _t.k[1], _t.t[2]);
+            }
+            case _TREE_3:
+            case _TREE_LEAF2:
+            {
+                _Tree3 _t3_buf;
+                const _Tree3 &_t3 = _tree3_view(_t.t[0], &_t3_buf);
+                _Tree _nt = _tree3_insert_k(_t3, _k, _compare);
+                return _tree3(_nt, _t.k[0], _t.t[1], _t.k[1], _t.t[2]);
+            }
+            case _TREE_4:
+            case _TREE_LEAF3:
+            {
+                _Tree4 _t4_buf;
+                const _Tree4 &_t4 = _tree4_view(_t.t[0], &_t4_buf);
+                _cmp = _compare(_k, _t4.k[1]);
+                _Tree _lt = _tree2(_t4.t[0], _t4.k[0], _t4.t[1]);
+                _Tree _rt = _tree2(_t4.t[2], _t4.k[2], _t4.t[3]);
+                if (_cmp < 0)
+                {
+                    _Tree _nt = _tree2_insert_view_k(_lt, _k, _compare);
+                    _tree_drop(_lt);
+                    return _tree4(_nt, _t4.k[1], _rt, _t.k[0], _t.t[1], _t.k[1],
+                        _t.t[2]);
+                }
+                else if (_cmp > 0)
+                {
+                    _Tree _nt = _tree2_insert_view_k(_rt, _k, _compare);
+                    _tree_drop(_rt);
+                    return _tree4(_lt, _t4.k[1], _nt, _t.k[0], _t.t[1], _t.k[1],
+                        _t.t[2]);
+                }
+                else
+                    return _tree4(_lt, _k, _rt, _t.k[0], _t.t[1], _t.k[1],
+                        _t.t[2]);
+            }
+            default:
+                error("data-structure invariant violated");
+        }
+    }
+    else if (_cmp > 0)
+    {
+        _cmp = _compare(_k, _t.k[1]);
+        if (_cmp < 0)
+        {
+            switch (index(_t.t[1]))
+            {
+                case _TREE_2:
+                case _TREE_LEAF1:
+                {
+                    _Tree2 _t2_buf;
+                    const _Tree2 &_t2 = _tree2_view(_t.t[1], &_t2_buf);
+                    _Tree _nt = _tree2_insert_k(_t2, _k, _compare);
+                    return _tree3(_t.t[0], _t.k[0], _nt, _t.k[1], _t.t[2]);
+                }
+                case _TREE_3:
+                case _TREE_LEAF2:
+                {
+                    _Tree3 _t3_buf;
+                    const _Tree3 &_t3 = _tree3_view(_t.t[1], &_t3_buf);
+                    _Tree _nt = _tree3_insert_k(_t3, _k, _compare);
+                    return _tree3(_t.t[0], _t.k[0], _nt, _t.k[1], _t.t[2]);
+                }
+                case _TREE_4:
+                case _TREE_LEAF3:
+                {
+                    _Tree4 _t4_buf;
+                    const _Tree4 &_t4 = _tree4_view(_t.t[1], &_t4_buf);
+                    _cmp = _compare(_k, _t4.k[1]);
+                    _Tree _lt = _tree2(_t4.t[0], _t4.k[0], _t4.t[1]);
+                    _Tree _rt = _tree2(_t4.t[2], _t4.k[2], _t4.t[3]);
+                    if (_cmp < 0)
+                    {
+                        _Tree _nt = _tree2_insert_view_k(_lt, _k, _compare);
+                        _tree_drop(_lt);
+                        return _tree4(_t.t[0], _t.k[0], _nt, _t4.k[1], _rt,
+                            _t.k[1], _t.t[2]);
+                    }
+                    else if (_cmp > 0)
+                    {
+                        _Tree _nt = _tree2_insert_view_k(_rt, _k, _compare);
+                        _tree_drop(_rt);
+                        return _tree4(_t.t[0], _t.k[0], _lt, _t4.k[1], _nt,
+                            _t.k[1], _t.t[2]);
+                    }
+                    else
+                        return _tree4(_t.t[0], _t.k[0], _lt, _k, _rt, _t.k[1],
+                            _t.t[2]);
+                }
+                default:
+                    error("data-structure invariant violated");
+            }
+        }
+        else if (_cmp > 0)
+        {
+            switch (index(_t.t[2]))
+            {
+                case _TREE_2:
+                case _TREE_LEAF1:
+                {
+                    _Tree2 _t2_buf;
+                    const _Tree2 &_t2 = _tree2_view(_t.t[2], &_t2_buf);
+                    _Tree _nt = _tree2_insert_k(_t2, _k, _compare);
+                    return _tree3(_t.t[0], _t.k[0], _t.t[1], _t.k[1], _nt);
+                }
+                case _TREE_3:
+                case _TREE_LEAF2:
+                {
+                    _Tree3 _t3_buf;
+                    const _Tree3 &_t3 = _tree3_view(_t.t[2], &_t3_buf);
+                    _Tree _nt = _tree3_insert_k(_t3, _k, _compare);
+                    return _tree3(_t.t[0], _t.k[0], _t.t[1], _t.k[1], _nt);
+                }
+                case _TREE_4:
+                case _TREE_LEAF3:
+                {
+                    _Tree4 _t4_buf;
+                    const _Tree4 &_t4 = _tree4_view(_t.t[2], &_t4_buf);
+                    _cmp = _compare(_k, _t4.k[1]);
+                    _Tree _lt = _tree2(_t4.t[0], _t4.k[0], _t4.t[1]);
+                    _Tree _rt = _tree2(_t4.t[2], _t4.k[2], _t4.t[3]);
+                    if (_cmp < 0)
+                    {
+                        _Tree _nt = _tree2_insert_view_k(_lt, _k, _compare);
+                        _tree_drop(_lt);
+                        return _tree4(_t.t[0], _t.k[0], _t.t[1], _t.k[1], _nt,
+                            _t4.k[1], _rt);
+                    }
+                    else if (_cmp > 0)
+                    {
+                        _Tree _nt = _tree2_insert_view_k(_rt, _k, _compare);
+                        _tree_drop(_rt);
+                        return _tree4(_t.t[0], _t.k[0], _t.t[1], _t.k[1], _lt,
+                            _t4.k[1], _nt);
+                    }
+                    else
+                        return _tree4(_t.t[0], _t.k[0], _t.t[1], _t.k[1], _lt,
+                            _k, _rt);
+                }
+                default:
+                    error("data-structure invariant violated");
+            }
+        }
+        else
+            return _tree3(_t.t[0], _t.k[0], _t.t[1], _k, _t.t[2]);
+    }
+    else
+        return _tree3(_t.t[0], _k, _t.t[1], _t.k[1], _t.t[2]);
+}
+
+/*
+ * Delete.
+ */
+template <typename _Cmp>
+_Tree _tree_delete_2_k(_Tree _t, Value<Word> _k, _Cmp _compare,
+    bool *_reduced)
+{
+    switch (index(_t))
+    {
+        case _TREE_NIL:
+            *_reduced = false;
+            return _t;
+        case _TREE_2:
+        case _TREE_LEAF1:
+        {
+            _Tree2 _t2_buf;
+            const _Tree2 &_t2 = _tree2_view(_t, &_t2_buf);
+            int _cmp = _compare(_k, _t2.k[0]);
+            if (_cmp < 0)
+            {
+                _Tree _nt = _tree_delete_2_k(_t2.t[0], _k, _compare, _reduced);
+                return _tree2_fix_t0(_nt, _t2.k[0], _t2.t[1], _reduced);
+            }
+            else if (_cmp > 0)
+            {
+                _Tree _nt = _tree_delete_2_k(_t2.t[1], _k, _compare, _reduced);
+                return _tree2_fix_t1(_t2.t[0], _t2.k[0], _nt, _reduced);
+            }
+            else
+            {
+                if (index(_t2.t[1]) == _TREE_NIL)
+                {
+                    *_reduced = true;
+                    return _tree_empty();
+                }
+                else
+                {
+                    Value<Word> _ks;
+                    _Tree _nt = _tree_delete_min_2(_t2.t[1], &_ks, _reduced);
+                    return _tree2_fix_t1(_t2.t[0], _ks, _nt, _reduced);
+                }
+            }
+        }
+        case _TREE_3:
+        case _TREE_LEAF2:
+        {
+            _Tree3 _t3_buf;
+            const _Tree3 &_t3 = _tree3_view(_t, &_t3_buf);
+            int _cmp = _compare(_k, _t3.k[0]);
+            if (_cmp < 0)
+            {
+                _Tree _nt = _tree_delete_2_k(_t3.t[0], _k, _compare, _reduced);
+                return _tree3_fix_t0(_nt, _t3.k[0], _t3.t[1], _t3.k[1],
+                    _t3.t[2], _reduced);
+            }
+            else if (_cmp > 0)
+            {
+                _cmp = _compare(_k, _t3.k[1]);
+                if (_cmp < 0)
+                {
+                    _Tree _nt = _tree_delete_2_k(_t3.t[1], _k, _compare,
+                        _reduced);
+                    return _tree3_fix_t1(_t3.t[0], _t3.k[0], _nt, _t3.k[1],
+                        _t3.t[2], _reduced);
+                }
+                else if (_cmp > 0)
+                {
+                    _Tree _nt = _tree_delete_2_k(_t3.t[2], _k, _compare,
+                        _reduced);
+                    return _tree3_fix_t2(_t3.t[0], _t3.k[0], _t3.t[1], _t3.k[1],
+                        _nt, _reduced);
+                }
+                else
+                {
+                    if (index(_t3.t[2]) == _TREE_NIL)
+                    {
+                        _Tree _nil = _tree_empty();
+                        return _tree2(_nil, _t3.k[0], _nil);
+                    }
+                    else
+                    {
+                        Value<Word> _ks;
+                        _Tree _nt = _tree_delete_min_2(_t3.t[2], &_ks,
+                            _reduced);
+                        return _tree3_fix_t2(_t3.t[0], _t3.k[0], _t3.t[1], _ks,
+                            _nt, _reduced);
+                    }
+                }
+            }
+            else
+            {
+                if (index(_t3.t[1]) == _TREE_NIL)
+                {
+                    _Tree _nil = _tree_empty();
+                    return _tree2(_nil, _t3.k[1], _nil);
+                }
+                else
+                {
+                    Value<Word> _ks;
+                    _Tree _nt = _tree_delete_min_2(_t3.t[1], &_ks, _reduced);
+                    return _tree3_fix_t1(_t3.t[0], _ks, _nt, _t3.k[1], _t3.t[2],
+                        _reduced);
+                }
+            }
+        }
+        case _TREE_4:
+        case _TREE_LEAF3:
+        {
+            _Tree4 _t4_buf;
+            const _Tree4 &_t4 = _tree4_view(_t, &_t4_buf);
+            int _cmp = _compare(_k, _t4.k[1]);
+            if (_cmp < 0)
+            {
+                _cmp = _compare(_k, _t4.k[0]);
+                if (_cmp < 0)
+                {
+                    _Tree _nt = _tree_delete_2_k(_t4.t[0], _k, _compare,
+                        _reduced);
+                    return _tree4_fix_t0(_nt, _t4.k[0], _t4.t[1], _t4.k[1],
+                        _t4.t[2], _t4.k[2], _t4.t[3], _reduced);
+                }
+                else if (_cmp > 0)
+                {
+                    _Tree _nt = _tree_delete_2_k(_t4.t[1], _k, _compare,
+                        _reduced);
+                    return _tree4_fix_t1(_t4.t[0], _t4.k[0], _nt, _t4.k[1],
+                        _t4.t[2], _t4.k[2], _t4.t[3], _reduced);
+                }
+                else
+                {
+                    if (index(_t4.t[1]) == _TREE_NIL)
+                    {
+                        _Tree _nil = _tree_empty();
+                        return _tree3(_nil, _t4.k[1], _nil, _t4.k[2], _nil);
+                    }
+                    else
+                    {
+                        Value<Word> _ks;
+                        _Tree _nt = _tree_delete_min_2(_t4.t[1], &_ks,
+                            _reduced);
+                        return _tree4_fix_t1(_t4.t[0], _ks, _nt, _t4.k[1],
+                            _t4.t[2], _t4.k[2], _t4.t[3], _reduced);
+                    }
+                }
+            }
+            else if (_cmp > 0)
+            {
+                _cmp = _compare(_k, _t4.k[2]);
+                if (_cmp < 0)
+                {
+                    _Tree _nt = _tree_delete_2_k(_t4.t[2], _k, _compare,
+                        _reduced);
+                    return _tree4_fix_t2(_t4.t[0], _t4.k[0], _t4.t[1], _t4.k[1],
+                        _nt, _t4.k[2], _t4.t[3], _reduced);
+                }
+                else if (_cmp > 0)
+                {
+                    _Tree _nt = _tree_delete_2_k(_t4.t[3], _k, _compare,
+                        _reduced);
+                    return _tree4_fix_t3(_t4.t[0], _t4.k[0], _t4.t[1], _t4.k[1],
+                        _t4.t[2], _t4.k[2], _nt, _reduced);
+                }
+                else
+                {
+                    if (index(_t4.t[3]) == _TREE_NIL)
+                    {
+                        _Tree _nil = _tree_empty();
+                        return _tree3(_nil, _t4.k[0], _nil, _t4.k[1], _nil);
+                    }
+                    else
+                    {
+                        Value<Word> _ks;
+                        _Tree _nt = _tree_delete_min_2(_t4.t[3], &_ks,
+                            _reduced);
+                        return _tree4_fix_t3(_t4.t[0], _t4.k[0], _t4.t[1],
+                            _t4.k[1], _t4.t[2], _ks, _nt, _reduced);
+                    }
+                }
+            }
+            else
+            {
+                if (index(_t4.t[2]) == _TREE_NIL)
+                {
+                    _Tree _nil = _tree_empty();
+                    return _tree3(_nil, _t4.k[0], _nil, _t4.k[2], _nil);
+                }
+                else
+                {
+                    Value<Word> _ks;
+                    _Tree _nt = _tree_delete_min_2(_t4.t[2], &_ks, _reduced);
+                    return _tree4_fix_t2(_t4.t[0], _t4.k[0], _t4.t[1], _ks, _nt,
+                        _t4.k[2], _t4.t[3], _reduced);
+                }
+            }
+        }
+        default:
+            error("data-structure invariant violated");
+    }
+}
+
+template <typename _Cmp>
+inline PURE _Tree _tree_delete_k(_Tree _t, Value<Word> _k, _Cmp _compare)
+{
+    bool _reduced = false;
+    return _tree_delete_2_k(_t, _k, _compare, &_reduced);
+}
+
+/*
+ * Traversal.  Calls func on each key in order (or in reverse order), with
+ * func inlined rather than called through a pointer.
+ */
+template <typename _F>
+inline void _tree_for_each_k(_Tree _t, _F &_func)
+{
+    switch (index(_t))
+    {
+        case _TREE_NIL:
+            return;
+        case _TREE_2:
+        {
+            const _Tree2 &_t2 = _t;
+            _tree_for_each_k(_t2.t[0], _func);
+            _func(_t2.k[0]);
+            _tree_for_each_k(_t2.t[1], _func);
+            return;
+        }
+        case _TREE_3:
+        {
+            const _Tree3 &_t3 = _t;
+            _tree_for_each_k(_t3.t[0], _func);
+            _func(_t3.k[0]);
+            _tree_for_each_k(_t3.t[1], _func);
+            _func(_t3.k[1]);
+            _tree_for_each_k(_t3.t[2], _func);
+            return;
+        }
+        case _TREE_4:
+        {
+            const _Tree4 &_t4 = _t;
+            _tree_for_each_k(_t4.t[0], _func);
+            _func(_t4.k[0]);
+            _tree_for_each_k(_t4.t[1], _func);
+            _func(_t4.k[1]);
+            _tree_for_each_k(_t4.t[2], _func);
+            _func(_t4.k[2]);
+            _tree_for_each_k(_t4.t[3], _func);
+            return;
+        }
+        case _TREE_LEAF1:
+        case _TREE_LEAF2:
+        case _TREE_LEAF3:
+        {
+            const Value<Word> *_ks = _tree_leaf_keys(_t);
+            size_t _n = _tree_node_size(_t);
+            for (size_t _i = 0; _i < _n; _i++)
+                _func(_ks[_i]);
+            return;
+        }
+        default:
+            error("data-structure invariant violated");
+    }
+}
+
+template <typename _F>
+inline void _tree_for_each_rev_k(_Tree _t, _F &_func)
+{
+    switch (index(_t))
+    {
+        case _TREE_NIL:
+            return;
+        case _TREE_2:
+        {
+            const _Tree2 &_t2 = _t;
+            _tree_for_each_rev_k(_t2.t[1], _func);
+            _func(_t2.k[0]);
+            _tree_for_each_rev_k(_t2.t[0], _func);
+            return;
+        }
+        case _TREE_3:
+        {
+            const _Tree3 &_t3 = _t;
+            _tree_for_each_rev_k(_t3.t[2], _func);
+            _func(_t3.k[1]);
+            _tree_for_each_rev_k(_t3.t[1], _func);
+            _func(_t3.k[0]);
+            _tree_for_each_rev_k(_t3.t[0], _func);
+            return;
+        }
+        case _TREE_4:
+        {
+            const _Tree4 &_t4 = _t;
+            _tree_for_each_rev_k(_t4.t[3], _func);
+            _func(_t4.k[2]);
+            _tree_for_each_rev_k(_t4.t[2], _func);
+            _func(_t4.k[1]);
+            _tree_for_each_rev_k(_t4.t[1], _func);
+            _func(_t4.k[0]);
+            _tree_for_each_rev_k(_t4.t[0], _func);
+            return;
+        }
+        case _TREE_LEAF1:
+        case _TREE_LEAF2:
+        case _TREE_LEAF3:
+        {
+            const Value<Word> *_ks = _tree_leaf_keys(_t);
+            size_t _n = _tree_node_size(_t);
+            for (size_t _i = _n; _i > 0; _i--)
+                _func(_ks[_i-1]);
+            return;
+        }
+        default:
+            error("data-structure invariant violated");
+    }
+}
+
+#else       /* LIBF_TREE_BTREE */
+
+/*
+ * B-tree node definitions (-DLIBF_TREE_BTREE).  Every node except the root
+ * holds between LIBF_BTREE_DEGREE-1 and 2*LIBF_BTREE_DEGREE-1 keys, and all
+ * leaves are at the same depth.  Keys are stored contiguously so that the
+ * in-node search scans one or two cache lines, and leaves omit the child
+ * array.  The key count of a leaf is its own size.
+ */
+#ifndef LIBF_BTREE_DEGREE
+#define LIBF_BTREE_DEGREE   8
+#endif
+
+static_assert(LIBF_BTREE_DEGREE >= 2 && LIBF_BTREE_DEGREE <= 15,
+    "LIBF_BTREE_DEGREE must be in the range 2..15");
+
+#define _BTREE_MIN_KEYS     (LIBF_BTREE_DEGREE - 1)
+#define _BTREE_MAX_KEYS     (2 * LIBF_BTREE_DEGREE - 1)
+
+struct _BTreeLeaf
+{
+    size_t size;
+    Value<Word> k[_BTREE_MAX_KEYS];
+};
+struct _BTreeNode
+{
+    size_t size;
+    size_t n;
+    Value<Word> k[_BTREE_MAX_KEYS];
+    _Tree t[_BTREE_MAX_KEYS + 1];
+#ifdef LIBF_TREE_MEASURE
+    _TreeCache c;
+#endif
+};
+
+/*
+ * Precise GC layouts (LIBF_GC_TYPED): the size and count fields are never
+ * pointers.
+ */
+template <> struct _GCLayout<_BTreeLeaf> : _GCLayoutSized<_BTreeLeaf> { };
+template <>
+struct _GCLayout<_BTreeNode>
+{
+    static const uint64_t _mask =
+        (((uint64_t)1 << GC_LAYOUT_WORDS(_BTreeNode)) - 1) & ~(uint64_t)3;
+};
+
+/*
+ * Allocation statistics (LIBF_ALLOC_STATS).
+ */
+template <> struct _GCStatKind<_BTreeLeaf>
+    { static const unsigned _kind = GC_STAT_TREE; };
+template <> struct _GCStatKind<_BTreeNode>
+    { static const unsigned _kind = GC_STAT_TREE; };
+
+/*
+ * Tree node types.
+ */
+enum
+{
+    _TREE_NIL  = _Tree::index<_TreeNil>(),
+    _TREE_LEAF = _Tree::index<_BTreeLeaf>(),
+    _TREE_NODE = _Tree::index<_BTreeNode>()
+};
+
+/*
+ * Node size and reference counting (only enabled for the LIBF_GC_RC
+ * backend).  Each node holds a reference to its children.
+ */
+extern void _tree_free(_Tree _t);
+
+inline const void *_tree_ptr(_Tree _t)
+{
+    return (const void *)(_bit_cast<Word>(_t) & ~(Word)_UNION_TAG_MASK);
+}
+
+inline size_t _tree_node_size(_Tree _t)
+{
+    if (index(_t) == _TREE_NIL)
+        return 0;
+    return *(const size_t *)_tree_ptr(_t) & _TREE_SIZE_MASK;
+}
+
+inline void _tree_ref(_Tree _t)
+{
+#ifdef LIBF_GC_RC
+    if (index(_t) != _TREE_NIL)
+        gc_retain(_tree_ptr(_t));
+#else
+    (void)_t;
+#endif
+}
+
+/*
+ * Free a temporary node that was consumed without being linked in.
+ */
+inline void _tree_drop(_Tree _t)
+{
+#ifdef LIBF_GC_RC
+    if (index(_t) != _TREE_NIL && gc_refs(_tree_ptr(_t)) == 0)
+        _tree_free(_t);
+#else
+    (void)_t;
+#endif
+}
+
+/*
+ * In-node search.  Returns the index of the first of the n keys that is not
+ * less than k, and sets *found if that key equals k.  The window is halved
+ * with a conditional select rather than a branch on the comparison.
+ */
+template <typename _Cmp>
+inline size_t _btree_find(const Value<Word> *_ks, size_t _n, Value<Word> _k,
+    _Cmp _compare, bool *_found)
+{
+    *_found = false;
+    if (_n == 0)
+        return 0;
+    const Value<Word> *_base = _ks;
+    size_t _len = _n;
+    while (_len > 1)
+    {
+        size_t _half = _len / 2;
+        _base = (_compare(_k, _base[_half]) > 0? _base + _half: _base);
+        _len -= _half;
+    }
+    size_t _i = (size_t)(_base - _ks) + (_compare(_k, *_base) > 0);
+    *_found = (_i < _n && _compare(_k, _ks[_i]) == 0);
+    return _i;
+}
+
+/*
+ * Search.
+ */
+template <typename _Cmp>
+inline PURE const Value<Word> *_tree_search_k(_Tree _t, Value<Word> _k,
+    _Cmp _compare)
+{
+    while (true)
+    {
+        bool _found;
+        switch (index(_t))
+        {
+            case _TREE_NIL:
+                return nullptr;
+            case _TREE_LEAF:
+            {
+                const _BTreeLeaf &_l = _t;
+                size_t _i = _btree_find(_l.k, _l.size & _TREE_SIZE_MASK, _k,
+                    _compare, &_found);
+                return (_found? &_l.k[_i]: nullptr);
+            }
+            case _TREE_NODE:
+            {
+                const _BTreeNode &_b = _t;
+                size_t _i = _btree_find(_b.k, _b.n, _k, _compare, &_found);
+                if (_found)
+                    return &_b.k[_i];
+                _t = _b.t[_i];
+                continue;
+            }
+            default:
+                error("data-structure invariant violated");
+        }
+    }
+}
+
+/*
+ * Traversal.  Calls func on each key in order (or in reverse order), with
+ * func inlined rather than called through a pointer.
+ */
+template <typename _F>
+inline void _tree_for_each_k(_Tree _t, _F &_func)
+{
+    switch (index(_t))
+    {
+        case _TREE_NIL:
+            return;
+        case _TREE_LEAF:
+        {
+            const _BTreeLeaf &_l = _t;
+            size_t _n = _l.size & _TREE_SIZE_MASK;
+            for (size_t _i = 0; _i < _n; _i++)
+                _func(_l.k[_i]);
+            return;
+        }
+        case _TREE_NODE:
+        {
+            const _BTreeNode &_b = _t;
+            for (size_t _i = 0; _i < _b.n; _i++)
+            {
+                _tree_for_each_k(_b.t[_i], _func);
+                _func(_b.k[_i]);
+            }
+            _tree_for_each_k(_b.t[_b.n], _func);
+            return;
+        }
+        default:
+            error("data-structure invariant violated");
+    }
+}
+
+template <typename _F>
+inline void _tree_for_each_rev_k(_Tree _t, _F &_func)
+{
+    switch (index(_t))
+    {
+        case _TREE_NIL:
+            return;
+        case _TREE_LEAF:
+        {
+            const _BTreeLeaf &_l = _t;
+            size_t _n = _l.size & _TREE_SIZE_MASK;
+            for (size_t _i = _n; _i > 0; _i--)
+                _func(_l.k[_i-1]);
+            return;
+        }
+        case _TREE_NODE:
+        {
+            const _BTreeNode &_b = _t;
+            _tree_for_each_rev_k(_b.t[_b.n], _func);
+            for (size_t _i = _b.n; _i > 0; _i--)
+            {
+                _func(_b.k[_i-1]);
+                _tree_for_each_rev_k(_b.t[_i-1], _func);
+            }
+            return;
+        }
+        default:
+            error("data-structure invariant violated");
+    }
+}
+
+#endif      /* LIBF_TREE_BTREE */
+
+/*
+ * Kernel selection.  Sets and maps call these with their comparison as a
+ * template argument, which inlines it into the kernels.  Define
+ * LIBF_TREE_COMPACT to use the type-erased (out-of-line) kernels instead,
+ * for smaller binaries.  The B-tree backend only inlines the search and the
+ * traversals.
+ */
+template <_Compare _compare>
+struct _TreeCompare
+{
+    int operator()(Value<Word> _a, Value<Word> _b) const
+    {
+        return _compare(_a, _b);
+    }
+};
+
+template <_Compare _compare>
+inline PURE const Value<Word> *_tree_search(_Tree _t, Value<Word> _k)
+{
+#ifdef LIBF_TREE_COMPACT
+    return _tree_search(_t, _k, _compare);
+#else
+    return _tree_search_k(_t, _k, _TreeCompare<_compare>());
+#endif
+}
+
+template <_Compare _compare>
+inline PURE _Tree _tree_insert(_Tree _t, Value<Word> _k)
+{
+#if defined(LIBF_TREE_COMPACT) || defined(LIBF_TREE_BTREE)
+    return _tree_insert(_t, _k, _compare);
+#else
+    return _tree_insert_k(_t, _k, _TreeCompare<_compare>());
+#endif
+}
+
+template <_Compare _compare>
+inline PURE _Tree _tree_delete(_Tree _t, Value<Word> _k)
+{
+#if defined(LIBF_TREE_COMPACT) || defined(LIBF_TREE_BTREE)
+    return _tree_delete(_t, _k, _compare);
+#else
+    return _tree_delete_k(_t, _k, _TreeCompare<_compare>());
+#endif
+}
+
+/*
+ * Traversal selection.  The folds thread the accumulator through the
+ * type-erased fold in compact builds, and _tree_for_each() (which may have
+ * side effects) uses the iterator, since _tree_foldl() is pure.
+ */
+template <typename _F>
+inline void _tree_for_each(_Tree _t, _F &_func)
+{
+#ifdef LIBF_TREE_COMPACT
+    _TreeItr _e = end(_t);
+    for (_TreeItr _i = begin(_t); _i != _e; ++_i)
+        _func(*_i);
+#else
+    _tree_for_each_k(_t, _func);
+#endif
+}
+
+template <typename _A, typename _F>
+inline PURE _A _tree_foldl(_Tree _t, const _A &_arg, _F &_func)
+{
+#ifdef LIBF_TREE_COMPACT
+    Value<Word> (*_func_ptr)(void *, Value<Word>, const Value<Word> &) =
+        [](void *_func_0, Value<Word> _a0, const Value<Word> &_k)
+            -> Value<Word>
+    {
+        Value<_A> _a = _bit_cast<Value<_A>>(_a0);
+        Value<_A> _b = (*(_F *)_func_0)(_a, _k);
+        return _bit_cast<Value<Word>>(_b);
+    };
+    Value<_A> _arg1 = _arg;
+    Value<Word> _r = _tree_foldl(_t, _bit_cast<Value<Word>>(_arg1),
+        _func_ptr, (void *)&_func);
+    return _bit_cast<Value<_A>>(_r);
+#else
+    _A _a = _arg;
+    auto _visit = [&_a, &_func](const Value<Word> &_k)
+    {
+        _a = _func(_a, _k);
+    };
+    _tree_for_each_k(_t, _visit);
+    return _a;
+#endif
+}
+
+template <typename _A, typename _F>
+inline PURE _A _tree_foldr(_Tree _t, const _A &_arg, _F &_func)
+{
+#ifdef LIBF_TREE_COMPACT
+    Value<Word> (*_func_ptr)(void *, Value<Word>, const Value<Word> &) =
+        [](void *_func_0, Value<Word> _a0, const Value<Word> &_k)
+            -> Value<Word>
+    {
+        Value<_A> _a = _bit_cast<Value<_A>>(_a0);
+        Value<_A> _b = (*(_F *)_func_0)(_a, _k);
+        return _bit_cast<Value<Word>>(_b);
+    };
+    Value<_A> _arg1 = _arg;
+    Value<Word> _r = _tree_foldr(_t, _bit_cast<Value<Word>>(_arg1),
+        _func_ptr, (void *)&_func);
+    return _bit_cast<Value<_A>>(_r);
+#else
+    _A _a = _arg;
+    auto _visit = [&_a, &_func](const Value<Word> &_k)
+    {
+        _a = _func(_a, _k);
+    };
+    _tree_for_each_rev_k(_t, _visit);
+    return _a;
+#endif
+}
+
+}           /* namespace F */
+
+#endif      /* _FTREE_INLINE_H */
@@ -31,6 +31,7 @@
 #define _FTUPLE_H
 
 #include "fbase.h"
+#include "fhash.h"
 #include "fvalue.h"
 #include "fshow.h"
 
@@ -40,24 +41,108 @@
 namespace F
 {
 
-inline void _tuple_init(Value<Word> *_end_ptr)
+/*
+ * Flat tuple layout.  Fields are stored inline (unboxed) at their natural
+ * size and alignment, at offsets computed at compile time.
+ */
+constexpr size_t _tuple_align(size_t _off, size_t _align)
+{
+    return (_off + _align - 1) & ~(_align - 1);
+}
+
+constexpr uint64_t _tuple_word_mask(size_t _off, size_t _size)
+{
+    return ((_off + _size - 1) / sizeof(Word) >= 64? GC_LAYOUT_CONSERVATIVE:
+        ((((uint64_t)1 << ((_off + _size - 1) / sizeof(Word))) << 1) -
+         ((uint64_t)1 << (_off / sizeof(Word)))));
+}
+
+template <size_t _off, typename... _T>
+struct _tuple_layout
+{
+    static const size_t _size = _off;
+    static const size_t _align = sizeof(Word);
+    static const uint64_t _mask = 0;
+};
+
+template <size_t _off, typename _U, typename... _T>
+struct _tuple_layout<_off, _U, _T...>
+{
+    static const size_t _offset = _tuple_align(_off, alignof(_U));
+    typedef _tuple_layout<_offset + sizeof(_U), _T...> _next;
+    static const size_t _size = _next::_size;
+    static const size_t _align =
+        (alignof(_U) > _next::_align? alignof(_U): _next::_align);
+    static const uint64_t _mask = _next::_mask |
+        (_GCAtomic<_U>::_value? 0: _tuple_word_mask(_offset, sizeof(_U)));
+};
+
+/*
+ * The type and offset of the i-th field.
+ */
+template <size_t _i, size_t _off, typename... _T>
+struct _tuple_elem;
+
+template <size_t _off, typename _U, typename... _T>
+struct _tuple_elem<0, _off, _U, _T...>
+{
+    typedef _U _type;
+    static const size_t _offset = _tuple_align(_off, alignof(_U));
+};
+
+template <size_t _i, size_t _off, typename _U, typename... _T>
+struct _tuple_elem<_i, _off, _U, _T...> :
+    _tuple_elem<_i - 1, _tuple_align(_off, alignof(_U)) + sizeof(_U), _T...>
+{
+    // Empty
+};
+
+template <size_t _off>
+inline void _tuple_init(uint8_t *_data)
 {
     ;
 }
 
-template <typename _T>
-inline void _tuple_init(Value<Word> *_end_ptr, _T _arg)
+template <size_t _off, typename _U, typename... _T>
+inline void _tuple_init(uint8_t *_data, const _U &_arg, const _T &..._args)
 {
-    *_end_ptr = _bit_cast<Value<Word>>(Value<_T>(_arg));
+    const size_t _offset = _tuple_align(_off, alignof(_U));
+    std::memcpy(_data + _offset, &_arg, sizeof(_U));
+    _tuple_init<_offset + sizeof(_U), _T...>(_data, _args...);
 }
 
-template <typename _U, typename... _T>
-inline void _tuple_init(Value<Word> *_start_ptr, _U _arg, _T... _args)
+template <size_t _i, typename... _T>
+inline PURE const typename _tuple_elem<_i, 0, _T...>::_type &_tuple_get(
+    Tuple<_T...> _t)
 {
-    *_start_ptr = _bit_cast<Value<Word>>(Value<_U>(_arg));
-    _tuple_init<_T...>(_start_ptr + 1, _args...);
+    typedef _tuple_elem<_i, 0, _T...> _E;
+    return *(const typename _E::_type *)((const uint8_t *)_t._impl +
+        _E::_offset);
 }
 
+/*
+ * Tuple field storage, with a precise GC layout (LIBF_GC_TYPED).
+ */
+template <typename... _T>
+struct _TupleData
+{
+    alignas(_tuple_layout<0, _T...>::_align) uint8_t _data[
+        _tuple_layout<0, _T...>::_size == 0? sizeof(Word):
+        _tuple_align(_tuple_layout<0, _T...>::_size, sizeof(Word))];
+};
+
+template <typename... _T>
+struct _GCLayout<_TupleData<_T...>>
+{
+    static const uint64_t _mask = _tuple_layout<0, _T...>::_mask;
+};
+
+template <typename... _T>
+struct _GCStatKind<_TupleData<_T...>>
+{
+    static const unsigned _kind = GC_STAT_TUPLE;
+};
+
 /**
  * Construct a tuple.
  * O(1).
@@ -65,10 +150,9 @@ inline void _tuple_init(Value<Word> *_start_ptr, _U _arg, _T... _args)
 template <typename... _T>
 inline PURE Tuple<_T...> tuple(_T... _args)
 {
-    Value<Word> *_impl = (Value<Word> *)gc_malloc(
-        sizeof...(_args) * sizeof(Value<Word>));
-    _tuple_init(_impl, _args...);
-    Tuple<_T...> _t = {_impl};
+    uint8_t *_data = (uint8_t *)gc_malloc_node<_TupleData<_T...>>();
+    _tuple_init<0, _T...>(_data, _args...);
+    Tuple<_T...> _t = {(Value<Word> *)_data};
     return _t;
 }
 
@@ -79,7 +163,7 @@ inline PURE Tuple<_T...> tuple(_T... _args)
 template <typename _U, typename... _T>
 inline PURE const _U &first(Tuple<_U, _T...> _t)
 {
-    return (Value<_U> &)_t._impl[0];
+    return _tuple_get<0>(_t);
 }
 
 /**
@@ -89,7 +173,7 @@ inline PURE const _U &first(Tuple<_U, _T...> _t)
 template <typename _A, typename _U, typename... _T>
 inline PURE const _U &second(Tuple<_A, _U, _T...> _t)
 {
-    return (Value<_U> &)_t._impl[1];
+    return _tuple_get<1>(_t);
 }
 
 /**
@@ -99,7 +183,7 @@ inline PURE const _U &second(Tuple<_A, _U, _T...> _t)
 template <typename _A, typename _B, typename _U, typename... _T>
 inline PURE const _U &third(Tuple<_A, _B, _U, _T...> _t)
 {
-    return (Value<_U> &)_t._impl[2];
+    return _tuple_get<2>(_t);
 }
 
 /**
@@ -109,7 +193,7 @@ inline PURE const _U &third(Tuple<_A, _B, _U, _T...> _t)
 template <typename _A, typename _B, typename _C, typename _U, typename... _T>
 inline PURE const _U &fourth(Tuple<_A, _B, _C, _U, _T...> _t)
 {
-    return (Value<_U> &)_t._impl[3];
+    return _tuple_get<3>(_t);
 }
 
 /**
@@ -119,7 +203,7 @@ inline PURE const _U &fourth(Tuple<_A, _B, _C, _U, _T...> _t)
 template <typename _A, typename _B, typename _C, typename _D, typename _U, typename... _T>
 inline PURE const _U &fifth(Tuple<_A, _B, _C, _D, _U, _T...> _t)
 {
-    return (Value<_U> &)_t._impl[4];
+    return _tuple_get<4>(_t);
 }
 
 /**
@@ -129,7 +213,7 @@ inline PURE const _U &fifth(Tuple<_A, _B, _C, _D, _U, _T...> _t)
 template <typename _A, typename _B, typename _C, typename _D, typename _E, typename _U, typename... _T>
 inline PURE const _U &sixth(Tuple<_A, _B, _C, _D, _E, _U, _T...> _t)
 {
-    return (Value<_U> &)_t._impl[5];
+    return _tuple_get<5>(_t);
 }
 
 /**
@@ -139,7 +223,7 @@ inline PURE const _U &sixth(Tuple<_A, _B, _C, _D, _E, _U, _T...> _t)
 template <typename _A, typename _B, typename _C, typename _D, typename _E, typename _U, typename _F, typename... _T>
 inline PURE const _U &seventh(Tuple<_A, _B, _C, _D, _E, _F, _U, _T...> _t)
 {
-    return (Value<_U> &)_t._impl[6];
+    return _tuple_get<6>(_t);
 }
 
 /**
@@ -149,7 +233,7 @@ inline PURE const _U &seventh(Tuple<_A, _B, _C, _D, _E, _F, _U, _T...> _t)
 template <typename _A, typename _B, typename _C, typename _D, typename _E, typename _U, typename _F, typename _G, typename... _T>
 inline PURE const _U &eighth(Tuple<_A, _B, _C, _D, _E, _F, _G, _U, _T...> _t)
 {
-    return (Value<_U> &)_t._impl[7];
+    return _tuple_get<7>(_t);
 }
 
 /**
@@ -162,32 +246,51 @@ constexpr size_t size(Tuple<_T...> _t)
     return sizeof...(_T);
 }
 
-template <typename _T>
-inline PURE int _tuple_compare(Tuple<_T> _t, Tuple<_T> _u)
+template <size_t _i, typename... _T>
+inline PURE int _tuple_compare(Tuple<_T...> _t, Tuple<_T...> _u)
 {
-    return compare(first(_t), first(_u));
+    if constexpr (_i == sizeof...(_T))
+        return 0;
+    else
+    {
+        int _cmp = compare(_tuple_get<_i, _T...>(_t),
+            _tuple_get<_i, _T...>(_u));
+        if (_cmp != 0)
+            return _cmp;
+        return _tuple_compare<_i + 1, _T...>(_t, _u);
+    }
 }
 
-template <typename _U, typename _V, typename ..._T>
-inline PURE int _tuple_compare(Tuple<_U, _V, _T...> _t,
-    Tuple<_U, _V, _T...> _u)
+/**
+ * Tuple compare.
+ * O(n).
+ */
+template <typename... _T>
+inline PURE int compare(Tuple<_T...> _t, Tuple<_T...> _u)
+{
+    return _tuple_compare<0, _T...>(_t, _u);
+}
+
+template <size_t _i, typename... _T>
+inline PURE uint64_t _tuple_hash(Tuple<_T...> _t, uint64_t _h)
 {
-    int _cmp = compare(first(_t), first(_u));
-    if (_cmp != 0)
-        return _cmp;
-    Tuple<_V, _T...> _x = {_t._impl + 1};
-    Tuple<_V, _T...> _y = {_u._impl + 1};
-    return _tuple_compare<_V, _T...>(_x, _y);
+    if constexpr (_i == sizeof...(_T))
+        return _h;
+    else
+    {
+        _h = _hash_combine(_h, hash(_tuple_get<_i, _T...>(_t)));
+        return _tuple_hash<_i + 1, _T...>(_t, _h);
+    }
 }
 
 /**
- * Tuple compare.
+ * Tuple hash.
  * O(n).
  */
 template <typename... _T>
-inline PURE int compare(Tuple<_T...> _t, Tuple<_T...> _u)
+inline PURE uint64_t hash(Tuple<_T...> _t)
 {
-    return _tuple_compare<_T...>(_t, _u);
+    return _tuple_hash<0, _T...>(_t, 0);
 }
 
 // Forward decls:
@@ -195,22 +298,19 @@ PURE String append(String _str0, String _str1);
 PURE String append(String _str0, char32_t _c);
 PURE String string(char32_t _c);
 
-template <typename _T>
-inline PURE String _tuple_show(Tuple<_T> _t, String _str0)
-{
-    String _str = show(first(_t));
-    _str = append(_str0, _str);
-    return _str;
-}
-
-template <typename _U, typename _V, typename ..._T>
-inline PURE String _tuple_show(Tuple<_U, _V, _T...> _t, String _str0)
+template <size_t _i, typename... _T>
+inline PURE String _tuple_show(Tuple<_T...> _t, String _str0)
 {
-    String _str = show(first(_t));
-    _str = append(_str0, _str);
-    _str = append(_str, ',');
-    Tuple<_V, _T...> _u = {_t._impl + 1};
-    return _tuple_show<_V, _T...>(_u, _str);
+    if constexpr (_i == sizeof...(_T))
+        return _str0;
+    else
+    {
+        String _str = show(_tuple_get<_i, _T...>(_t));
+        if (_i > 0)
+            _str0 = append(_str0, ',');
+        _str = append(_str0, _str);
+        return _tuple_show<_i + 1, _T...>(_t, _str);
+    }
 }
 
 /**
@@ -221,7 +321,7 @@ template <typename... _T>
 inline PURE String show(Tuple<_T...> _t)
 {
     String _str = string('(');
-    _str = _tuple_show<_T...>(_t, _str);
+    _str = _tuple_show<0, _T...>(_t, _str);
     _str = append(_str, ')');
     return _str;
 }
@@ -38,7 +38,7 @@ namespace F
 template <typename... _Ts>
 struct Tuple
 {
-    Value<Word> *_impl;
+    Value<Word> *_impl;         // Flat field storage (see _TupleData).
 };
 
 }           /* namespace F */
@@ -77,7 +77,7 @@ public:
 
     _Boxed(const _T &_x)
     {
-        _ptr = (_T *)gc_malloc(sizeof(_T));
+        _ptr = (_T *)gc_malloc_node<_T>();
         *_ptr = _x;
     }
 
@@ -116,7 +116,7 @@ public:
         }
         else
         {
-            _T *_ptr = (_T *)gc_malloc(sizeof(_T));
+            _T *_ptr = (_T *)gc_malloc_node<_T>();
             *_ptr = _x;
             *(_T **)_val = _ptr;
         }
@@ -252,6 +252,63 @@ struct _is_boxed_helper<_Boxed<_T> *>
     static const bool _value = true;
 };
 
+/*
+ * Word-sized scalars (integers, doubles and pointers) that are too large to
+ * be stored alongside the tag.  Maybe<T> of such a scalar uses a second word
+ * for the payload rather than boxing it.  Other unions are always one word.
+ */
+template <typename _T>
+struct _is_scalar_helper
+{
+    static const bool _value = false;
+};
+
+template <typename _T>
+struct _is_scalar_helper<_T *>
+{
+    static const bool _value = !_is_boxed_helper<_T *>::_value;
+};
+
+#define _UNION_SCALAR(_T)                                               \
+    template <>                                                         \
+    struct _is_scalar_helper<_T>                                        \
+    {                                                                   \
+        static const bool _value = true;                                \
+    }
+_UNION_SCALAR(long);
+_UNION_SCALAR(unsigned long);
+_UNION_SCALAR(long long);
+_UNION_SCALAR(unsigned long long);
+_UNION_SCALAR(double);
+#undef _UNION_SCALAR
+
+template <typename _T, bool _scalar = _is_scalar_helper<_T>::_value>
+struct _is_wide_helper
+{
+    static const bool _value = false;
+};
+
+template <typename _T>
+struct _is_wide_helper<_T, true>
+{
+    static const bool _value =
+        sizeof(_T) > _UNION_DIRECT_SIZE && sizeof(_T) <= sizeof(Word);
+};
+
+struct Nothing;
+
+template <typename... _Ts>
+struct _union_wide_helper
+{
+    static const bool _value = false;
+};
+
+template <typename _T>
+struct _union_wide_helper<Nothing, _T>
+{
+    static const bool _value = _is_wide_helper<_T>::_value;
+};
+
 /*
  * Union<T1, ..., Tn> object.
  */
@@ -259,12 +316,20 @@ template <typename... _Ts>
 struct Union
 {
 private:
-    uint8_t _val[sizeof(Word)];
+    static const bool _wide = _union_wide_helper<_Ts...>::_value;
+
+    template <typename _U>
+    struct _is_wide
+    {
+        static const bool _value = _wide && _is_wide_helper<_U>::_value;
+    };
+
+    uint8_t _val[_wide? 2 * sizeof(Word): sizeof(Word)];
 
 public:
     Union()
     {
-        *(Word *)_val = (Word)0;
+        std::memset(_val, 0, sizeof(_val));
     }
 
     template <typename _U>
@@ -272,7 +337,11 @@ public:
     {
         _tag_helper<0, _U, _Ts...> _helper;
         unsigned _tag = _helper._get_tag();
-        if (sizeof(_U) <= _UNION_DIRECT_SIZE)
+        if (_wide)
+            std::memset(_val, 0, sizeof(_val));
+        if (_is_wide<_U>::_value)
+            std::memcpy(_val + sizeof(Word), &_x, sizeof(_U));
+        else if (sizeof(_U) <= _UNION_DIRECT_SIZE)
         {
             *(Word *)_val = (Word)0;
             *(_U *)(_val + _UNION_DIRECT_SIZE) = _x;
@@ -281,7 +350,7 @@ public:
             std::memcpy(_val, &_x, sizeof(_val));
         else
         {
-            _U *_ptr = (_U *)gc_malloc(sizeof(_U));
+            _U *_ptr = (_U *)gc_malloc_node<_U>();
             *_ptr = _x;
             *(_U **)_val = _ptr;
         }
@@ -293,7 +362,14 @@ public:
     {
         _tag_helper<0, _U, _Ts...> _helper;
         unsigned _tag = _helper._get_tag();
-        if (sizeof(_U) <= _UNION_DIRECT_SIZE)
+        if (_wide)
+            std::memset(_val, 0, sizeof(_val));
+        if (_is_wide<_U>::_value)
+        {
+            _U _y = _x;
+            std::memcpy(_val + sizeof(Word), &_y, sizeof(_U));
+        }
+        else if (sizeof(_U) <= _UNION_DIRECT_SIZE)
         {
             *(Word *)_val = (Word)0;
             *(_U *)(_val + _UNION_DIRECT_SIZE) = _U(_x);
@@ -302,7 +378,7 @@ public:
             std::memcpy(_val, &_x, sizeof(_val));
         else if (sizeof(_U) <= sizeof(_val))
         {
-            _U *_ptr = (_U *)gc_malloc(sizeof(_U));
+            _U *_ptr = (_U *)gc_malloc_node<_U>();
             *_ptr = _U(_x);
             *(_U **)_val = _ptr;
         }
@@ -321,7 +397,9 @@ public:
             _U *_null = nullptr;
             return *_null;
         }
-        if (sizeof(_U) <= _UNION_DIRECT_SIZE)
+        if (_is_wide<_U>::_value)
+            return *(_U *)(_val + sizeof(Word));
+        else if (sizeof(_U) <= _UNION_DIRECT_SIZE)
             return *(_U *)(_val + _UNION_DIRECT_SIZE);
         else
         {
@@ -341,12 +419,16 @@ public:
             _U *_null = nullptr;
             return *_null;
         }
-        if (sizeof(_U) <= sizeof(_val))
+        if (_is_wide<_U>::_value)
+            return Value<_U>(*(_U *)(_val + sizeof(Word)));
+        else if (sizeof(_U) <= _UNION_DIRECT_SIZE)
             return Value<_U>(*(_U *)(_val + _UNION_DIRECT_SIZE));
         else
         {
             Word _ptr = *(Word *)_val;
             _ptr -= (Word)_tag;
+            if (sizeof(_U) <= sizeof(Word))
+                return Value<_U>(*(_U *)_ptr);
             return _bit_cast<Value<_U>>(_ptr);
         }
     }
@@ -359,7 +441,7 @@ public:
 
     bool operator== (Union<_Ts...> _y) const
     {
-        return *(Word *)_val == *(Word *)_y._val;
+        return std::memcmp(_val, _y._val, sizeof(_val)) == 0;
     }
 
     unsigned _get_index()
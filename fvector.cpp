@@ -37,8 +37,6 @@ namespace F
 // The maximum size of a fragment.  Note that this is a soft limit.
 #define VECTOR_FRAG_MAX_SIZE        16
 
-typedef Value<Word> C;
-
 struct VecData
 {
     _FragHeader header;
@@ -73,6 +71,7 @@ static inline PURE size_t vec_get_best_frag_len(size_t size, size_t len)
 static inline VecData *vec_malloc(size_t size, size_t len)
 {
     size_t total_size = vec_get_frag_size(size, len);
+    gc_stat_alloc(GC_STAT_VECTOR, total_size);
     if (size >= sizeof(void *))
         return (VecData *)gc_malloc(total_size);
     else
@@ -214,6 +213,33 @@ vector_push_back_vec:
     return _seq_replace_back(s, vec_frag_from_data(new_vec));
 }
 
+/*
+ * Transient push back.  Elements are appended in place to an owned tail
+ * fragment that is not yet part of the sequence.  Full tails are pushed onto
+ * the sequence.
+ */
+extern _Seq _vector_push_back_owned(_Seq s, _FragHeader **tail, size_t size,
+    Value<Word> elem)
+{
+    size_t cap = vec_get_best_frag_len(size, VECTOR_FRAG_MAX_SIZE);
+    cap = (cap == 0? 1: cap);
+    VecData *vec = (VecData *)*tail;
+    if (vec == nullptr)
+    {
+        vec = vec_malloc(size, cap);
+        vec->header._len = 0;
+    }
+    vec_set_value(vec, size, vec->header._len, elem);
+    vec->header._len++;
+    if (vec->header._len < cap)
+    {
+        *tail = &vec->header;
+        return s;
+    }
+    *tail = nullptr;
+    return _seq_push_back(s, vec_frag_from_data(vec));
+}
+
 /*
  * Pop back.
  */
@@ -404,36 +430,6 @@ extern PURE _Seq _vector_delete(_Seq s, size_t size, size_t i, size_t j)
     return r;
 }
 
-/*
- * Fold left.
- */
-extern PURE C _vector_frag_foldl(_Frag frag, size_t size, C arg,
-    size_t idx, C (*f)(void *, C, size_t, Value<Word>), void *data)
-{
-    VecData *vec = vec_data_from_frag(frag);
-    for (size_t i = 0; i < vec->header._len; i++)
-    {
-        Value<Word> elem = vec_get_value(vec, size, i);
-        arg = f(data, arg, idx + i, elem);
-    }
-    return arg;
-}
-
-/*
- * Fold right.
- */
-extern PURE C _vector_frag_foldr(_Frag frag, size_t size, C arg,
-    size_t idx, C (*f)(void *, C, size_t, Value<Word>), void *data)
-{
-    VecData *vec = vec_data_from_frag(frag);
-    for (ssize_t i = vec->header._len - 1; i >= 0; i--)
-    {
-        Value<Word> elem = vec_get_value(vec, size, i);
-        arg = f(data, arg, idx + i, elem);
-    }
-    return arg;
-}
-
 /*
  * Map.
  */
@@ -44,6 +44,8 @@ extern PURE _Seq _vector_init(const void *_a, size_t _size, size_t _len);
 extern PURE void *_vector_data(_Seq _s, size_t _size,
 	void (*_copy)(void *, Value<Word>));
 extern PURE _Seq _vector_push_back(_Seq _s, size_t _size, Value<Word> _elem);
+extern _Seq _vector_push_back_owned(_Seq _s, _FragHeader **_tail,
+    size_t _size, Value<Word> _elem);
 extern PURE _Seq _vector_pop_back(_Seq _s, size_t _size);
 extern PURE _Seq _vector_push_front(_Seq _s, size_t _size, Value<Word> _elem);
 extern PURE _Seq _vector_pop_front(_Seq _s, size_t _size);
@@ -59,12 +61,6 @@ extern PURE _Seq _vector_delete(_Seq _s, size_t _size, size_t _lidx,
     size_t _ridx);
 extern PURE Value<Word> _vector_frag_lookup(_Frag _frag, size_t _size,
     size_t _idx);
-extern PURE Value<Word> _vector_frag_foldl(_Frag _frag, size_t _size,
-    Value<Word> _arg, size_t _idx,
-    Value<Word> (*_f)(void *, Value<Word>, size_t, Value<Word>), void *_data);
-extern PURE Value<Word> _vector_frag_foldr(_Frag _frag, size_t _size,
-    Value<Word> _arg, size_t _idx,
-    Value<Word> (*_f)(void *, Value<Word>, size_t, Value<Word>), void *_data);
 extern PURE _Frag _vector_frag_map(_Frag _frag, size_t _size_0,
     size_t _size_1, size_t _idx, Value<Word> (*_f)(void *, size_t, Value<Word>),
     void *_data);
@@ -74,6 +70,38 @@ extern PURE Optional<_Frag> _vector_frag_filter_map(_Frag frag, size_t _size_0,
 extern PURE int _vector_frag_compare(void *_data, _Frag _frag1, size_t _idx1,
     _Frag _frag2, size_t _idx2);
 
+/*
+ * Elements are stored in slots of at most a word.  Elements wider than a
+ * word (e.g. Maybe<int64_t>) are boxed, and the slot holds their Value<T>.
+ */
+template <typename _T>
+constexpr size_t _vector_elem_size(void)
+{
+    return (sizeof(_T) <= sizeof(Word)? sizeof(_T): sizeof(Word));
+}
+
+template <typename _T>
+inline const _T &_vector_elem_ref(const void *_ptr)
+{
+    if constexpr (sizeof(_T) <= sizeof(Word))
+        return *(const _T *)_ptr;
+    else
+        return **(const _T * const *)_ptr;
+}
+
+/*
+ * Element i of a fragment.  The elements follow the header as a packed
+ * array (see VecData in fvector.cpp).
+ */
+template <typename _T>
+inline PURE Value<_T> _vector_frag_get(const _FragHeader *_frag, size_t _i)
+{
+    Value<Word> _w;
+    const size_t _size = _vector_elem_size<_T>();
+    std::memcpy(&_w, (const uint8_t *)(_frag + 1) + _i * _size, _size);
+    return _bit_cast<Value<_T>>(_w);
+}
+
 inline PURE String string(char32_t);
 inline PURE size_t size(String);
 inline PURE String append(String, String);
@@ -97,8 +125,15 @@ inline PURE Vector<_T> vector()
 template <typename _T>
 inline PURE Vector<_T> vector(const _T *_a, size_t _len)
 {
-    Vector<_T> _v = {_vector_init(_bit_cast<const void *>(_a), sizeof(_T),
-        _len)};
+    if constexpr (sizeof(_T) > sizeof(Word))
+    {
+        TransientVector<_T> _t = transient(vector<_T>());
+        for (size_t _i = 0; _i < _len; _i++)
+            push_back(_t, _a[_i]);
+        return persistent(_t);
+    }
+    Vector<_T> _v = {_vector_init(_bit_cast<const void *>(_a),
+        _vector_elem_size<_T>(), _len)};
     return _v;
 }
 
@@ -119,8 +154,8 @@ inline PURE Vector<_T> vector(List<_T> _xs)
     Vector<_T> (*_func_ptr)(Vector<_T>, _T) =
         [](Vector<_T> _v0, _T _x) -> Vector<_T>
     {
-        Vector<_T> _v = {_vector_push_back(_v0._impl, sizeof(_T),
-            _bit_cast<Value<Word>>(_x))};
+        Vector<_T> _v = {_vector_push_back(_v0._impl, _vector_elem_size<_T>(),
+            _bit_cast<Value<Word>>(Value<_T>(_x)))};
         return _v;
     };
     return foldl(_xs, _v, _func_ptr);
@@ -140,7 +175,14 @@ inline PURE const _T *data(Vector<_T> _v)
         const _T &_elem = _elem1;
         *(_T *)_ptr = _elem;
     };
-    return (const _T *)_vector_data(_v._impl, sizeof(_T), _copy);
+    if constexpr (sizeof(_T) > sizeof(Word))
+    {
+        _T *_a = (_T *)gc_malloc(size(_v) * sizeof(_T));
+        for_each(_v, [_a] (size_t _idx, const _T &_elem)
+            { _a[_idx] = _elem; });
+        return _a;
+    }
+    return (const _T *)_vector_data(_v._impl, _vector_elem_size<_T>(), _copy);
 }
 
 /**
@@ -170,8 +212,58 @@ inline PURE size_t size(Vector<_T> _v)
 template <typename _T>
 inline PURE Vector<_T> push_back(Vector<_T> _v0, _T _elem)
 {
-    Vector<_T> _v = {_vector_push_back(_v0._impl, sizeof(_T),
-        _bit_cast<Value<Word>>(_elem))};
+    Vector<_T> _v = {_vector_push_back(_v0._impl, _vector_elem_size<_T>(),
+        _bit_cast<Value<Word>>(Value<_T>(_elem)))};
+    return _v;
+}
+
+/**
+ * Construct a transient (mutable) vector for batch appends.  Elements are
+ * appended in place to an owned tail fragment.  The transient must not be
+ * used after persistent().
+ * O(1).
+ */
+template <typename _T>
+inline TransientVector<_T> transient(Vector<_T> _v)
+{
+    TransientVector<_T> _t = {_v._impl, nullptr};
+    return _t;
+}
+
+/**
+ * Push an element to the back of a transient vector (in place).
+ * O(1).
+ */
+template <typename _T>
+inline void push_back(TransientVector<_T> &_t, _T _elem)
+{
+    _t._impl = _vector_push_back_owned(_t._impl, &_t._tail,
+        _vector_elem_size<_T>(), _bit_cast<Value<Word>>(Value<_T>(_elem)));
+}
+
+/**
+ * Transient vector size.
+ * O(1).
+ */
+template <typename _T>
+inline size_t size(const TransientVector<_T> &_t)
+{
+    return _seq_length(_t._impl) +
+        (_t._tail != nullptr? _t._tail->_len: 0);
+}
+
+/**
+ * Convert a transient vector back into an (immutable) vector.
+ * O(1).
+ */
+template <typename _T>
+inline Vector<_T> persistent(TransientVector<_T> &_t)
+{
+    Vector<_T> _v = {_t._impl};
+    if (_t._tail != nullptr)
+        _v._impl = _seq_push_back(_t._impl, _Frag(_t._tail));
+    _t._impl = _seq_empty();
+    _t._tail = nullptr;
     return _v;
 }
 
@@ -182,7 +274,7 @@ inline PURE Vector<_T> push_back(Vector<_T> _v0, _T _elem)
 template <typename _T>
 inline PURE Vector<_T> pop_back(Vector<_T> _v0)
 {
-    Vector<_T> _v = {_vector_pop_back(_v0._impl, sizeof(_T))};
+    Vector<_T> _v = {_vector_pop_back(_v0._impl, _vector_elem_size<_T>())};
     return _v;
 }
 
@@ -193,8 +285,8 @@ inline PURE Vector<_T> pop_back(Vector<_T> _v0)
 template <typename _T>
 inline PURE Vector<_T> push_front(Vector<_T> _v0, _T _elem)
 {
-    Vector<_T> _v = {_vector_push_front(_v0._impl, sizeof(_T),
-        _bit_cast<Value<Word>>(_elem))};
+    Vector<_T> _v = {_vector_push_front(_v0._impl, _vector_elem_size<_T>(),
+        _bit_cast<Value<Word>>(Value<_T>(_elem)))};
     return _v;
 }
 
@@ -205,7 +297,7 @@ inline PURE Vector<_T> push_front(Vector<_T> _v0, _T _elem)
 template <typename _T>
 inline PURE Vector<_T> pop_front(Vector<_T> _v0)
 {
-    Vector<_T> _v = {_vector_pop_front(_v0._impl, sizeof(_T))};
+    Vector<_T> _v = {_vector_pop_front(_v0._impl, _vector_elem_size<_T>())};
     return _v;
 }
 
@@ -227,8 +319,8 @@ inline PURE Vector<_T> append(Vector<_T> _v0, Vector<_T> _v1)
 template <typename _T>
 inline PURE const _T &back(Vector<_T> _v)
 {
-    void *_ptr = _vector_lookup(_v._impl, sizeof(_T), size(_v)-1);
-    return *(const _T *)_ptr;
+    void *_ptr = _vector_lookup(_v._impl, _vector_elem_size<_T>(), size(_v)-1);
+    return _vector_elem_ref<_T>(_ptr);
 }
 
 /**
@@ -238,8 +330,8 @@ inline PURE const _T &back(Vector<_T> _v)
 template <typename _T>
 inline PURE const _T &front(Vector<_T> _v)
 {
-    void *_ptr = _vector_lookup(_v._impl, sizeof(_T), 0);
-    return *(const _T *)_ptr;
+    void *_ptr = _vector_lookup(_v._impl, _vector_elem_size<_T>(), 0);
+    return _vector_elem_ref<_T>(_ptr);
 }
 
 /**
@@ -249,8 +341,8 @@ inline PURE const _T &front(Vector<_T> _v)
 template <typename _T>
 inline PURE const _T &at(Vector<_T> _v, size_t _idx)
 {
-    void *_ptr = _vector_lookup(_v._impl, sizeof(_T), _idx);
-    return *(const _T *)_ptr;
+    void *_ptr = _vector_lookup(_v._impl, _vector_elem_size<_T>(), _idx);
+    return _vector_elem_ref<_T>(_ptr);
 }
 
 /**
@@ -260,7 +352,7 @@ inline PURE const _T &at(Vector<_T> _v, size_t _idx)
 template <typename _T>
 inline PURE Result<Vector<_T>, Vector<_T>> split(Vector<_T> _v, size_t _idx)
 {
-    auto [_sl, _sr] = _vector_split(_v._impl, sizeof(_T), _idx);
+    auto [_sl, _sr] = _vector_split(_v._impl, _vector_elem_size<_T>(), _idx);
     Vector<_T> _vl = {_sl};
     Vector<_T> _vr = {_sr};
     return {_vl, _vr};
@@ -273,7 +365,7 @@ inline PURE Result<Vector<_T>, Vector<_T>> split(Vector<_T> _v, size_t _idx)
 template <typename _T>
 inline PURE Vector<_T> left(Vector<_T> _v, size_t _idx)
 {
-    Vector<_T> _vl = {_vector_left(_v._impl, sizeof(_T), _idx)};
+    Vector<_T> _vl = {_vector_left(_v._impl, _vector_elem_size<_T>(), _idx)};
     return _vl;
 }
 
@@ -284,7 +376,7 @@ inline PURE Vector<_T> left(Vector<_T> _v, size_t _idx)
 template <typename _T>
 inline PURE Vector<_T> right(Vector<_T> _v, size_t _idx)
 {
-    Vector<_T> _vr = {_vector_right(_v._impl, sizeof(_T), _idx)};
+    Vector<_T> _vr = {_vector_right(_v._impl, _vector_elem_size<_T>(), _idx)};
     return _vr;
 }
 
@@ -295,7 +387,7 @@ inline PURE Vector<_T> right(Vector<_T> _v, size_t _idx)
 template <typename _T>
 inline PURE Vector<_T> between(Vector<_T> _v, size_t _idx, size_t _count)
 {
-    Vector<_T> _vr = {_vector_between(_v._impl, sizeof(_T), _idx,
+    Vector<_T> _vr = {_vector_between(_v._impl, _vector_elem_size<_T>(), _idx,
         _idx + _count)};
     return _vr;
 }
@@ -307,7 +399,8 @@ inline PURE Vector<_T> between(Vector<_T> _v, size_t _idx, size_t _count)
 template <typename _T>
 inline PURE Vector<_T> insert(Vector<_T> _v, size_t _idx, Vector<_T> _u)
 {
-    Vector<_T> _vr = {_vector_insert(_v._impl, sizeof(_T), _idx, _u._impl)};
+    Vector<_T> _vr = {_vector_insert(_v._impl, _vector_elem_size<_T>(), _idx,
+        _u._impl)};
     return _vr;
 }
 
@@ -318,7 +411,7 @@ inline PURE Vector<_T> insert(Vector<_T> _v, size_t _idx, Vector<_T> _u)
 template <typename _T>
 inline PURE Vector<_T> erase(Vector<_T> _v, size_t _idx, size_t _count = 1)
 {
-    Vector<_T> _vr = {_vector_delete(_v._impl, sizeof(_T), _idx,
+    Vector<_T> _vr = {_vector_delete(_v._impl, _vector_elem_size<_T>(), _idx,
         _idx + _count)};
     return _vr;
 }
@@ -334,18 +427,13 @@ inline PURE _A foldl(Vector<_T> _v, const _A &_arg, _F _func)
         [](void *_func_0, Value<Word> _a0, size_t _idx, _Frag _k0) ->
             Value<Word>
     {
-        Value<Word> (*_func_ptr_1)(void *, Value<Word>, size_t, Value<Word>) =
-            [](void *_func_0, Value<Word> _a0, size_t _idx, Value<Word> _c0) ->
-                Value<Word>
-        {
-            _F *_func_1 = (_F *)_func_0;
-            Value<_A> _a = _bit_cast<Value<_A>>(_a0);
-            Value<_T> _c = _bit_cast<Value<_T>>(_c0);
-            Value<_A> _b = (*_func_1)(_a, _idx, _c);
-            return _bit_cast<Value<Word>>(_b);
-        };
-        return _vector_frag_foldl(_k0, sizeof(_T), _a0, _idx, _func_ptr_1,
-            _func_0);
+        _F *_func_1 = (_F *)_func_0;
+        const _FragHeader &_frag = _k0;
+        _A _a = _bit_cast<Value<_A>>(_a0);
+        for (size_t _i = 0; _i < _frag._len; _i++)
+            _a = (*_func_1)(_a, _idx + _i, _vector_frag_get<_T>(&_frag, _i));
+        Value<_A> _b = _a;
+        return _bit_cast<Value<Word>>(_b);
     };
     Value<_A> _arg1 = _arg;
     Value<Word> _r = _seq_foldl(_v._impl, _bit_cast<Value<Word>>(_arg1),
@@ -364,18 +452,14 @@ inline PURE _A foldr(Vector<_T> _v, const _A &_arg, _F _func)
         [](void *_func_0, Value<Word> _a0, size_t _idx, _Frag _k0) ->
             Value<Word>
     {
-        Value<Word> (*_func_ptr_1)(void *, Value<Word>, size_t, Value<Word>) =
-            [](void *_func_0, Value<Word> _a0, size_t _idx, Value<Word> _c0) ->
-                Value<Word>
-        {
-            _F *_func_1 = (_F *)_func_0;
-            Value<_A> _a = _bit_cast<Value<_A>>(_a0);
-            Value<_T> _c = _bit_cast<Value<_T>>(_c0);
-            Value<_A> _b = (*_func_1)(_a, _idx, _c);
-            return _bit_cast<Value<Word>>(_b);
-        };
-        return _vector_frag_foldr(_k0, sizeof(_T), _a0, _idx, _func_ptr_1,
-            _func_0);
+        _F *_func_1 = (_F *)_func_0;
+        const _FragHeader &_frag = _k0;
+        _A _a = _bit_cast<Value<_A>>(_a0);
+        for (size_t _i = _frag._len; _i > 0; _i--)
+            _a = (*_func_1)(_a, _idx + _i - 1,
+                _vector_frag_get<_T>(&_frag, _i - 1));
+        Value<_A> _b = _a;
+        return _bit_cast<Value<Word>>(_b);
     };
     Value<_A> _arg1 = _arg;
     Value<Word> _r = _seq_foldr(_v._impl, _bit_cast<Value<Word>>(_arg1),
@@ -383,6 +467,25 @@ inline PURE _A foldr(Vector<_T> _v, const _A &_arg, _F _func)
     return _bit_cast<Value<_A>>(_r);
 }
 
+/**
+ * Vector for each.  Calls func on each element in order.
+ * ([](size_t idx, T elem)).
+ * O(n).
+ */
+template <typename _T, typename _F>
+inline void for_each(Vector<_T> _v, _F _func)
+{
+    void (*_func_ptr)(void *, size_t, _Frag) =
+        [](void *_func_0, size_t _idx, _Frag _k0)
+    {
+        _F *_func_1 = (_F *)_func_0;
+        const _FragHeader &_frag = _k0;
+        for (size_t _i = 0; _i < _frag._len; _i++)
+            (*_func_1)(_idx + _i, _vector_frag_get<_T>(&_frag, _i));
+    };
+    _seq_for_each(_v._impl, _func_ptr, (void *)&_func);
+}
+
 /**
  * Vector map. ([](size_t idx, T elem) -> U).
  * O(n).
@@ -401,8 +504,8 @@ inline PURE Vector<_U> map(Vector<_T> _v, _F _func)
             Value<_U> _b = (*_func_1)(_idx, _a);
             return _bit_cast<Value<Word>>(_b);
         };
-        return _vector_frag_map(_k0, sizeof(_T), sizeof(_U), _idx, _func_ptr_1,
-            _func_0);
+        return _vector_frag_map(_k0, _vector_elem_size<_T>(),
+            _vector_elem_size<_U>(), _idx, _func_ptr_1, _func_0);
     };
     Vector<_U> _r = {_seq_map(_v._impl, _func_ptr, (void *)&_func)};
     return _r;
@@ -427,8 +530,9 @@ inline PURE Vector<_T> filter(Vector<_T> _v, _F _func)
             return ((*_func_1)(_idx, _a1)?
                 Optional<Word>(_a0): Optional<Word>());
         };
-        Optional<_Frag> _k = _vector_frag_filter_map(_k0, sizeof(_T),
-            sizeof(_T), _idx, _func_ptr_1, _func_0);
+        Optional<_Frag> _k = _vector_frag_filter_map(_k0,
+            _vector_elem_size<_T>(), _vector_elem_size<_T>(), _idx,
+            _func_ptr_1, _func_0);
         if (empty(_k))
             return _a0;
         _Seq _a = _bit_cast<_Seq>(_a0);
@@ -477,11 +581,37 @@ inline PURE int compare(Vector<_T> _v, Vector<_T> _u)
         return compare(_a, _b);
     };
     Result<int (*)(Value<Word>, Value<Word>), size_t> _info =
-        {_func_ptr, sizeof(_T)};
+        {_func_ptr, _vector_elem_size<_T>()};
     return _seq_compare(_v._impl, _u._impl, (void *)&_info,
         _vector_frag_compare);
 }
 
+/**
+ * Retain a vector so that it outlives the values it was derived from.  Only
+ * meaningful for the reference counting backend (LIBF_GC_RC).
+ * O(1).
+ */
+template <typename _T>
+inline Vector<_T> retain(Vector<_T> _v)
+{
+    Vector<_T> _v1 = {_seq_retain(_v._impl)};
+    return _v1;
+}
+
+/**
+ * Release a vector.  Nodes and fragments that are no longer referenced are
+ * freed immediately by the reference counting backend (LIBF_GC_RC),
+ * otherwise this is a no-op.
+ * Only a value that was passed to retain() may be released; releasing
+ * one that was not is an error.
+ * O(k), where k is the number of nodes freed.
+ */
+template <typename _T>
+inline void release(Vector<_T> _v)
+{
+    _seq_release(_v._impl);
+}
+
 /**
  * Vector verify.
  * O(n).
@@ -591,7 +721,7 @@ inline PURE _T operator *(VectorItr<_T> &_i)
 {
     size_t _idx;
     _Frag _frag = _seq_itr_get(&_i._seq_itr, &_idx);
-    Value<Word> _a = _vector_frag_lookup(_frag, sizeof(_T), _idx);
+    Value<Word> _a = _vector_frag_lookup(_frag, _vector_elem_size<_T>(), _idx);
     return _bit_cast<Value<_T>>(_a);
 }
 
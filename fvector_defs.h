@@ -41,6 +41,13 @@ struct Vector
     _Seq _impl;
 };
 
+template <typename _T>
+struct TransientVector
+{
+    _Seq _impl;
+    _FragHeader *_tail;
+};
+
 template <typename _T>
 struct VectorItr
 {